@@ -9,11 +9,28 @@
 #import "OOMesh.h"
 
 
+typedef enum
+{
+	kOOMeshPListBinaryBlobs,		// Format 2: each array as a single little-endian data blob.
+	kOOMeshPListNumberArrays		// Format 1: an array of NSNumbers per array; slow, but readable as XML.
+} OOMeshPListMode;
+
+
 @interface OOMesh (PropertyList)
 
-- (id) propertyListRepresentation;
+- (id) propertyListRepresentation;		// Binary blobs.
+- (id) propertyListRepresentationWithMode:(OOMeshPListMode)mode;
 
 @end
 
 
 id PropertyListFromOOMeshData(OOMeshData *data);
+id PropertyListFromOOMeshDataWithMode(OOMeshData *data, OOMeshPListMode mode);
+
+/*	Read either format into outData. The arrays in outData point into the
+	buffers returned in outBuffers, which must be kept alive for as long as
+	outData is used, and outData must not be freed with the OOMeshData
+	functions. Format 2 blobs are adopted without copying where the host is
+	little-endian and the data is suitably aligned.
+*/
+BOOL OOMeshDataFromPropertyList(id plist, OOMeshData *outData, id *outBuffers);
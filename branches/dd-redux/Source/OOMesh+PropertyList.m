@@ -13,7 +13,6 @@
 #define kModelDataKeyFormatTag			@"format tag"
 #define kModelDataKeyFormatTagValue		@"org.oolite.drydock.oomesh-plist"
 #define kModelDataKeyFormatVersion		@"format version"
-#define kModelDataKeyFormatVersionValue	1
 #define kModelDataKeyIndices			@"index deltas"
 #define kModelDataKeyVertices			@"vertices"
 #define kModelDataKeyNormals			@"normals"
@@ -23,12 +22,43 @@
 #define kModelDataKeyMaterialCounts		@"material counts"
 #define kModelDataKeyMaterialKeys		@"material keys"
 
+#define kFormatVersionNumberArrays		1
+#define kFormatVersionBinaryBlobs		2
 
+// Format 2 stores raw indices rather than deltas, since it isn't compressed anyway.
+#define kModelDataKeyRawIndices			@"indices"
+
+// Each format 2 array is a dictionary of element type, element count and little-endian data.
+#define kBlobKeyType					@"type"
+#define kBlobKeyCount					@"count"
+#define kBlobKeyData					@"data"
+#define kBlobTypeFloat32				@"float32"
+#define kBlobTypeUInt8					@"uint8"
+#define kBlobTypeUInt16					@"uint16"
+#define kBlobTypeUInt32					@"uint32"
+
+
+static id PropertyListWithNumberArrays(OOMeshData *data);
+static id PropertyListWithBinaryBlobs(OOMeshData *data);
 static NSArray *PListFromIndexArray(OOMeshData *data);
 static NSArray *PListFromVectorArray(GLuint count, Vector *array);
 static NSArray *PListFromFloatArray(GLuint count, GLfloat *array);
 static NSArray *PListFromIntegerArray(GLuint count, GLuint *array);
 
+static NSDictionary *BlobFromArray(const void *array, NSString *type, GLuint count);
+static NSData *ArrayFromBlob(id blob, NSString *type, GLuint count);
+static NSString *BlobTypeForIndexType(GLenum indexType);
+static GLenum IndexTypeForBlobType(NSString *type);
+static size_t BlobTypeSize(NSString *type);
+
+static BOOL ReadBinaryBlobs(NSDictionary *plist, OOMeshData *outData, NSMutableArray *buffers);
+static BOOL ReadNumberArrays(NSDictionary *plist, OOMeshData *outData, NSMutableArray *buffers);
+static NSData *IndexArrayFromDeltas(NSArray *deltas, GLenum *outIndexType);
+static NSData *VectorArrayFromPList(NSArray *array, GLuint count);
+static NSData *FloatArrayFromPList(NSArray *array, GLuint count);
+static NSData *IntegerArrayFromPList(NSArray *array, GLuint count);
+static BOOL MeshDataRangesAreValid(OOMeshData *data);
+
 
 @implementation OOMesh (PropertyList)
 
@@ -37,14 +67,96 @@ static NSArray *PListFromIntegerArray(GLuint count, GLuint *array);
 	return PropertyListFromOOMeshData(&_meshData);
 }
 
+
+- (id) propertyListRepresentationWithMode:(OOMeshPListMode)mode
+{
+	return PropertyListFromOOMeshDataWithMode(&_meshData, mode);
+}
+
 @end
 
 
 id PropertyListFromOOMeshData(OOMeshData *data)
+{
+	return PropertyListFromOOMeshDataWithMode(data, kOOMeshPListBinaryBlobs);
+}
+
+
+id PropertyListFromOOMeshDataWithMode(OOMeshData *data, OOMeshPListMode mode)
 {
 	if (data == NULL)  return nil;
 	
-	NSNumber *formatVersion = [NSNumber numberWithUnsignedInt:kModelDataKeyFormatVersionValue];
+	if (mode == kOOMeshPListNumberArrays)  return PropertyListWithNumberArrays(data);
+	else  return PropertyListWithBinaryBlobs(data);
+}
+
+
+BOOL OOMeshDataFromPropertyList(id plist, OOMeshData *outData, id *outBuffers)
+{
+	if (outData == NULL || outBuffers == NULL)  return NO;
+	*outBuffers = nil;
+	bzero(outData, sizeof *outData);
+	
+	if (![plist isKindOfClass:[NSDictionary class]])  return NO;
+	if (![[plist objectForKey:kModelDataKeyFormatTag] isEqual:kModelDataKeyFormatTagValue])  return NO;
+	
+	NSMutableArray *buffers = [NSMutableArray arrayWithCapacity:8];
+	BOOL OK;
+	switch ([[plist objectForKey:kModelDataKeyFormatVersion] intValue])
+	{
+		case kFormatVersionNumberArrays:
+			OK = ReadNumberArrays(plist, outData, buffers);
+			break;
+		
+		case kFormatVersionBinaryBlobs:
+			OK = ReadBinaryBlobs(plist, outData, buffers);
+			break;
+		
+		default:
+			OK = NO;
+	}
+	
+	if (OK)
+	{
+		// The key array is only referenced from the struct otherwise, which the collector doesn't see.
+		[buffers addObject:outData->materialKeys];
+		*outBuffers = buffers;
+	}
+	else  bzero(outData, sizeof *outData);
+	
+	return OK;
+}
+
+
+/*	The readers only check that each array has the size its count implies;
+	this checks that the indices and material ranges stay within the arrays
+	they refer to, so that a damaged file can't send drawing off the end.
+*/
+static BOOL MeshDataRangesAreValid(OOMeshData *data)
+{
+	GLuint i, element;
+	
+	for (i = 0; i < data->indexCount; i++)
+	{
+		if (!OOMeshDataGetElementIndex(data, i, &element))  return NO;
+		if (element >= data->elementCount)  return NO;
+	}
+	
+	for (i = 0; i < data->materialCount; i++)
+	{
+		if (data->materialIndexOffsets[i] > data->indexCount)  return NO;
+		if (data->materialIndexCounts[i] > data->indexCount - data->materialIndexOffsets[i])  return NO;
+	}
+	
+	return YES;
+}
+
+
+#pragma mark Format 1
+
+static id PropertyListWithNumberArrays(OOMeshData *data)
+{
+	NSNumber *formatVersion = [NSNumber numberWithUnsignedInt:kFormatVersionNumberArrays];
 	NSArray *indexArray = PListFromIndexArray(data);
 	NSArray *vertexArray = PListFromVectorArray(data->elementCount, data->vertexArray);
 	NSArray *normalArray = PListFromVectorArray(data->elementCount, data->normalArray);
@@ -154,3 +266,339 @@ static NSArray *PListFromIntegerArray(GLuint count, GLuint *array)
 	
 	return [[result copy] autorelease];
 }
+
+
+static BOOL ReadNumberArrays(NSDictionary *plist, OOMeshData *outData, NSMutableArray *buffers)
+{
+	NSArray *vertices = [plist objectForKey:kModelDataKeyVertices];
+	NSArray *materialKeys = [plist objectForKey:kModelDataKeyMaterialKeys];
+	if (![vertices isKindOfClass:[NSArray class]] || ![materialKeys isKindOfClass:[NSArray class]])  return NO;
+	
+	GLuint elementCount = vertices.count;
+	GLuint materialCount = materialKeys.count;
+	GLenum indexType;
+	
+	NSData *indexArray = IndexArrayFromDeltas([plist objectForKey:kModelDataKeyIndices], &indexType);
+	NSData *vertexArray = VectorArrayFromPList(vertices, elementCount);
+	NSData *normalArray = VectorArrayFromPList([plist objectForKey:kModelDataKeyNormals], elementCount);
+	NSData *tangentArray = VectorArrayFromPList([plist objectForKey:kModelDataKeyTangents], elementCount);
+	NSData *textureUVArray = FloatArrayFromPList([plist objectForKey:kModelDataKeyTextureCoordinates], elementCount * 2);
+	NSData *materialIndexOffsets = IntegerArrayFromPList([plist objectForKey:kModelDataKeyMaterialOffsets], materialCount);
+	NSData *materialIndexCounts = IntegerArrayFromPList([plist objectForKey:kModelDataKeyMaterialCounts], materialCount);
+	
+	if (indexArray == nil ||
+		vertexArray == nil ||
+		normalArray == nil ||
+		tangentArray == nil ||
+		textureUVArray == nil ||
+		materialIndexOffsets == nil ||
+		materialIndexCounts == nil)
+	{
+		return NO;
+	}
+	
+	[buffers addObjectsFromArray:$array(indexArray, vertexArray, normalArray, tangentArray, textureUVArray, materialIndexOffsets, materialIndexCounts)];
+	
+	outData->elementCount = elementCount;
+	outData->indexCount = indexArray.length / OOMeshDataIndexSize(indexType);
+	outData->indexType = indexType;
+	outData->indexArray = (void *)indexArray.bytes;
+	outData->vertexArray = (Vector *)vertexArray.bytes;
+	outData->normalArray = (Vector *)normalArray.bytes;
+	outData->tangentArray = (Vector *)tangentArray.bytes;
+	outData->textureUVArray = (GLfloat *)textureUVArray.bytes;
+	outData->materialCount = materialCount;
+	outData->materialIndexOffsets = (GLuint *)materialIndexOffsets.bytes;
+	outData->materialIndexCounts = (GLuint *)materialIndexCounts.bytes;
+	outData->materialKeys = materialKeys;
+	
+	return MeshDataRangesAreValid(outData);
+}
+
+
+// Format 1 indices are deltas, and are stored in the smallest type that holds the largest index.
+static NSData *IndexArrayFromDeltas(NSArray *deltas, GLenum *outIndexType)
+{
+	if (![deltas isKindOfClass:[NSArray class]])  return nil;
+	
+	GLuint i, count = deltas.count;
+	NSMutableData *indices = [NSMutableData dataWithLength:sizeof (GLuint) * count];
+	GLuint *elements = indices.mutableBytes;
+	GLuint max = 0;
+	NSInteger element = 0;
+	
+	for (i = 0; i != count; ++i)
+	{
+		id delta = [deltas objectAtIndex:i];
+		if (![delta respondsToSelector:@selector(integerValue)])  return nil;
+		element += [delta integerValue];
+		if (element < 0 || element > UINT32_MAX)  return nil;
+		elements[i] = element;
+		if (max < elements[i])  max = elements[i];
+	}
+	
+	if (max <= UINT8_MAX)
+	{
+		uint8_t *narrow = indices.mutableBytes;
+		for (i = 0; i != count; ++i)  narrow[i] = elements[i];
+		indices.length = count;
+		*outIndexType = GL_UNSIGNED_BYTE;
+	}
+	else if (max <= UINT16_MAX)
+	{
+		uint16_t *narrow = indices.mutableBytes;
+		for (i = 0; i != count; ++i)  narrow[i] = elements[i];
+		indices.length = count * sizeof (uint16_t);
+		*outIndexType = GL_UNSIGNED_SHORT;
+	}
+	else  *outIndexType = GL_UNSIGNED_INT;
+	
+	return indices;
+}
+
+
+static NSData *VectorArrayFromPList(NSArray *array, GLuint count)
+{
+	if (![array isKindOfClass:[NSArray class]] || array.count != count)  return nil;
+	
+	NSMutableData *result = [NSMutableData dataWithLength:sizeof (Vector) * count];
+	Vector *vectors = result.mutableBytes;
+	GLuint i = 0;
+	
+	for (id value in array)
+	{
+		vectors[i++] = OOVectorFromObject(value, kZeroVector);
+	}
+	
+	return result;
+}
+
+
+static NSData *FloatArrayFromPList(NSArray *array, GLuint count)
+{
+	if (![array isKindOfClass:[NSArray class]] || array.count != count)  return nil;
+	
+	NSMutableData *result = [NSMutableData dataWithLength:sizeof (GLfloat) * count];
+	GLfloat *floats = result.mutableBytes;
+	GLuint i = 0;
+	
+	for (id value in array)
+	{
+		if (![value respondsToSelector:@selector(floatValue)])  return nil;
+		floats[i++] = [value floatValue];
+	}
+	
+	return result;
+}
+
+
+static NSData *IntegerArrayFromPList(NSArray *array, GLuint count)
+{
+	if (![array isKindOfClass:[NSArray class]] || array.count != count)  return nil;
+	
+	NSMutableData *result = [NSMutableData dataWithLength:sizeof (GLuint) * count];
+	GLuint *integers = result.mutableBytes;
+	GLuint i = 0;
+	
+	for (id value in array)
+	{
+		if (![value respondsToSelector:@selector(unsignedIntValue)])  return nil;
+		integers[i++] = [value unsignedIntValue];
+	}
+	
+	return result;
+}
+
+
+#pragma mark Format 2
+
+static id PropertyListWithBinaryBlobs(OOMeshData *data)
+{
+	NSString *indexType = BlobTypeForIndexType(data->indexType);
+	if (indexType == nil)  return nil;
+	
+	NSNumber *formatVersion = [NSNumber numberWithUnsignedInt:kFormatVersionBinaryBlobs];
+	NSDictionary *indexArray = BlobFromArray(data->indexArray, indexType, data->indexCount);
+	NSDictionary *vertexArray = BlobFromArray(data->vertexArray, kBlobTypeFloat32, data->elementCount * 3);
+	NSDictionary *normalArray = BlobFromArray(data->normalArray, kBlobTypeFloat32, data->elementCount * 3);
+	NSDictionary *tangentArray = BlobFromArray(data->tangentArray, kBlobTypeFloat32, data->elementCount * 3);
+	NSDictionary *textureUVArray = BlobFromArray(data->textureUVArray, kBlobTypeFloat32, data->elementCount * 2);
+	NSDictionary *materialIndexOffsets = BlobFromArray(data->materialIndexOffsets, kBlobTypeUInt32, data->materialCount);
+	NSDictionary *materialIndexCounts = BlobFromArray(data->materialIndexCounts, kBlobTypeUInt32, data->materialCount);
+	
+	if (formatVersion == nil ||
+		indexArray == nil ||
+		vertexArray == nil ||
+		normalArray == nil ||
+		tangentArray == nil ||
+		textureUVArray == nil ||
+		materialIndexOffsets == nil ||
+		materialIndexCounts == nil ||
+		data->materialKeys == nil)
+	{
+		return nil;
+	}
+	
+	return $dict(kModelDataKeyFormatTag, kModelDataKeyFormatTagValue,
+				 kModelDataKeyFormatVersion, formatVersion,
+				 kModelDataKeyRawIndices, indexArray,
+				 kModelDataKeyVertices, vertexArray,
+				 kModelDataKeyNormals, normalArray,
+				 kModelDataKeyTangents, tangentArray,
+				 kModelDataKeyTextureCoordinates, textureUVArray,
+				 kModelDataKeyMaterialOffsets, materialIndexOffsets,
+				 kModelDataKeyMaterialCounts, materialIndexCounts,
+				 kModelDataKeyMaterialKeys, data->materialKeys);
+}
+
+
+static BOOL ReadBinaryBlobs(NSDictionary *plist, OOMeshData *outData, NSMutableArray *buffers)
+{
+	NSDictionary *vertices = [plist objectForKey:kModelDataKeyVertices];
+	NSDictionary *indices = [plist objectForKey:kModelDataKeyRawIndices];
+	NSArray *materialKeys = [plist objectForKey:kModelDataKeyMaterialKeys];
+	if (![vertices isKindOfClass:[NSDictionary class]] || ![indices isKindOfClass:[NSDictionary class]] || ![materialKeys isKindOfClass:[NSArray class]])  return NO;
+	
+	// Everything else is sized by the vertex and index counts.
+	GLuint vertexComponents = [[vertices objectForKey:kBlobKeyCount] unsignedIntValue];
+	if (vertexComponents % 3 != 0)  return NO;
+	GLuint elementCount = vertexComponents / 3;
+	GLuint indexCount = [[indices objectForKey:kBlobKeyCount] unsignedIntValue];
+	NSString *indexBlobType = [indices objectForKey:kBlobKeyType];
+	GLenum indexType = IndexTypeForBlobType(indexBlobType);
+	GLuint materialCount = materialKeys.count;
+	if (indexType == 0)  return NO;
+	
+	NSData *indexArray = ArrayFromBlob(indices, indexBlobType, indexCount);
+	NSData *vertexArray = ArrayFromBlob(vertices, kBlobTypeFloat32, elementCount * 3);
+	NSData *normalArray = ArrayFromBlob([plist objectForKey:kModelDataKeyNormals], kBlobTypeFloat32, elementCount * 3);
+	NSData *tangentArray = ArrayFromBlob([plist objectForKey:kModelDataKeyTangents], kBlobTypeFloat32, elementCount * 3);
+	NSData *textureUVArray = ArrayFromBlob([plist objectForKey:kModelDataKeyTextureCoordinates], kBlobTypeFloat32, elementCount * 2);
+	NSData *materialIndexOffsets = ArrayFromBlob([plist objectForKey:kModelDataKeyMaterialOffsets], kBlobTypeUInt32, materialCount);
+	NSData *materialIndexCounts = ArrayFromBlob([plist objectForKey:kModelDataKeyMaterialCounts], kBlobTypeUInt32, materialCount);
+	
+	if (indexArray == nil ||
+		vertexArray == nil ||
+		normalArray == nil ||
+		tangentArray == nil ||
+		textureUVArray == nil ||
+		materialIndexOffsets == nil ||
+		materialIndexCounts == nil)
+	{
+		return NO;
+	}
+	
+	[buffers addObjectsFromArray:$array(indexArray, vertexArray, normalArray, tangentArray, textureUVArray, materialIndexOffsets, materialIndexCounts)];
+	
+	outData->elementCount = elementCount;
+	outData->indexCount = indexCount;
+	outData->indexType = indexType;
+	outData->indexArray = (void *)indexArray.bytes;
+	outData->vertexArray = (Vector *)vertexArray.bytes;
+	outData->normalArray = (Vector *)normalArray.bytes;
+	outData->tangentArray = (Vector *)tangentArray.bytes;
+	outData->textureUVArray = (GLfloat *)textureUVArray.bytes;
+	outData->materialCount = materialCount;
+	outData->materialIndexOffsets = (GLuint *)materialIndexOffsets.bytes;
+	outData->materialIndexCounts = (GLuint *)materialIndexCounts.bytes;
+	outData->materialKeys = materialKeys;
+	
+	return MeshDataRangesAreValid(outData);
+}
+
+
+static NSDictionary *BlobFromArray(const void *array, NSString *type, GLuint count)
+{
+	size_t size = BlobTypeSize(type);
+	if (size == 0 || (array == NULL && count != 0))  return nil;
+	
+#if __BIG_ENDIAN__
+	NSMutableData *data = [NSMutableData dataWithLength:size * count];
+	GLuint i;
+	switch (size)
+	{
+		case 1:
+			memcpy(data.mutableBytes, array, count);
+			break;
+		
+		case 2:
+			for (i = 0; i != count; ++i)  ((uint16_t *)data.mutableBytes)[i] = CFSwapInt16HostToLittle(((const uint16_t *)array)[i]);
+			break;
+		
+		case 4:
+			for (i = 0; i != count; ++i)  ((uint32_t *)data.mutableBytes)[i] = CFSwapInt32HostToLittle(((const uint32_t *)array)[i]);
+			break;
+	}
+#else
+	NSData *data = [NSData dataWithBytes:array length:size * count];
+#endif
+	if (data == nil)  return nil;
+	
+	return $dict(kBlobKeyType, type,
+				 kBlobKeyCount, [NSNumber numberWithUnsignedInt:count],
+				 kBlobKeyData, data);
+}
+
+
+/*	Returns the blob's own data where it can be used in place, so that a
+	mesh read from a property list uses the buffers the parser created.
+*/
+static NSData *ArrayFromBlob(id blob, NSString *type, GLuint count)
+{
+	if (![blob isKindOfClass:[NSDictionary class]])  return nil;
+	if (![[blob objectForKey:kBlobKeyType] isEqual:type])  return nil;
+	if ([[blob objectForKey:kBlobKeyCount] unsignedIntValue] != count)  return nil;
+	
+	NSData *data = [blob objectForKey:kBlobKeyData];
+	size_t size = BlobTypeSize(type);
+	if (![data isKindOfClass:[NSData class]] || size == 0 || data.length != size * count)  return nil;
+	
+#if __BIG_ENDIAN__
+	NSMutableData *swapped = [NSMutableData dataWithData:data];
+	GLuint i;
+	switch (size)
+	{
+		case 2:
+			for (i = 0; i != count; ++i)  ((uint16_t *)swapped.mutableBytes)[i] = CFSwapInt16LittleToHost(((uint16_t *)swapped.mutableBytes)[i]);
+			break;
+		
+		case 4:
+			for (i = 0; i != count; ++i)  ((uint32_t *)swapped.mutableBytes)[i] = CFSwapInt32LittleToHost(((uint32_t *)swapped.mutableBytes)[i]);
+			break;
+	}
+	return swapped;
+#else
+	if (((uintptr_t)data.bytes % size) != 0)  return [NSData dataWithData:data];
+	return data;
+#endif
+}
+
+
+static size_t BlobTypeSize(NSString *type)
+{
+	if ([type isEqualToString:kBlobTypeFloat32] || [type isEqualToString:kBlobTypeUInt32])  return 4;
+	if ([type isEqualToString:kBlobTypeUInt16])  return 2;
+	if ([type isEqualToString:kBlobTypeUInt8])  return 1;
+	return 0;
+}
+
+
+static NSString *BlobTypeForIndexType(GLenum indexType)
+{
+	switch (indexType)
+	{
+		case GL_UNSIGNED_BYTE:  return kBlobTypeUInt8;
+		case GL_UNSIGNED_SHORT:  return kBlobTypeUInt16;
+		case GL_UNSIGNED_INT:  return kBlobTypeUInt32;
+	}
+	return nil;
+}
+
+
+static GLenum IndexTypeForBlobType(NSString *type)
+{
+	if ([type isEqual:kBlobTypeUInt8])  return GL_UNSIGNED_BYTE;
+	if ([type isEqual:kBlobTypeUInt16])  return GL_UNSIGNED_SHORT;
+	if ([type isEqual:kBlobTypeUInt32])  return GL_UNSIGNED_INT;
+	return 0;
+}
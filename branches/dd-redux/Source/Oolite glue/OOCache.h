@@ -9,14 +9,47 @@
 #import <Cocoa/Cocoa.h>
 
 
-// Mock OOCache which doesn't allow itself to be instantiated.
+#define kOOCacheDefaultPruneThreshold	200U
+
+
+/*	In-memory cache with least-recently-used pruning. Each lookup or store
+	moves the entry to the front; when autoPrune is set and the cache grows
+	past pruneThreshold, the least recently used entries are dropped until it
+	is back down to 80% of the threshold, so a cache at the limit isn't
+	pruned on every store.
+	
+	Objects should be property lists if the cache is to be saved by
+	OOCacheManager.
+*/
 @interface OOCache: NSObject
+{
+@private
+	NSString				*_name;
+	NSMutableDictionary		*_entries;
+	id						_mostRecent;
+	id						_leastRecent;
+	NSUInteger				_pruneThreshold;
+	BOOL					_autoPrune;
+	BOOL					_dirty;
+}
 
 @property (copy) NSString *name;
 @property BOOL autoPrune;
 @property NSUInteger pruneThreshold;
+@property (readonly) NSUInteger count;
+@property BOOL dirty;				// Set when contents change; cleared by whoever saves the cache.
 
 - (id) objectForKey:(NSString *)key;
 - (void) setObject:(id)object forKey:(NSString *)key;
+- (void) removeObjectForKey:(NSString *)key;
+- (void) removeAllObjects;
+
+- (void) prune;						// Prune down to the threshold now, regardless of autoPrune.
+
+/*	Saved form: a dictionary of settings and an array of key/object pairs,
+	most recently used first, so a loaded cache keeps its ordering.
+*/
+- (id) initWithPropertyListRepresentation:(NSDictionary *)plist;
+- (NSDictionary *) propertyListRepresentation;
 
 @end
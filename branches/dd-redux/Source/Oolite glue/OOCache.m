@@ -9,28 +9,258 @@
 #import "OOCache.h"
 
 
+#define kPListKeyName				@"name"
+#define kPListKeyAutoPrune			@"auto prune"
+#define kPListKeyPruneThreshold		@"prune threshold"
+#define kPListKeyEntries			@"entries"
+#define kPListKeyEntryKey			@"key"
+#define kPListKeyEntryObject		@"object"
+
+// Pruning goes below the threshold so that a full cache isn't pruned on every store.
+#define kPruneReductionFactor		0.8
+
+
+// Node in the age list, which runs from most to least recently used.
+@interface OOCacheEntry: NSObject
+{
+@public
+	NSString				*key;
+	id						object;
+	OOCacheEntry			*moreRecent;
+	OOCacheEntry			*lessRecent;
+}
+
+@end
+
+
+@interface OOCache ()
+
+- (void) unlinkEntry:(OOCacheEntry *)entry;
+- (void) insertEntryAtFront:(OOCacheEntry *)entry;
+- (void) insertEntryAtBack:(OOCacheEntry *)entry;
+- (void) pruneToCount:(NSUInteger)count;
+
+@end
+
+
 @implementation OOCache
 
+@synthesize name = _name, autoPrune = _autoPrune, pruneThreshold = _pruneThreshold, dirty = _dirty;
+
+
 - (id) init
 {
-	[self release];
-	return nil;
+	if ((self = [super init]))
+	{
+		_entries = [NSMutableDictionary dictionary];
+		_autoPrune = YES;
+		_pruneThreshold = kOOCacheDefaultPruneThreshold;
+	}
+	return self;
+}
+
+
+- (id) initWithPropertyListRepresentation:(NSDictionary *)plist
+{
+	if (![plist isKindOfClass:[NSDictionary class]])  return nil;
+	
+	if ((self = [self init]))
+	{
+		id value = [plist objectForKey:kPListKeyName];
+		if ([value isKindOfClass:[NSString class]])  self.name = value;
+		value = [plist objectForKey:kPListKeyAutoPrune];
+		if ([value respondsToSelector:@selector(boolValue)])  _autoPrune = [value boolValue];
+		value = [plist objectForKey:kPListKeyPruneThreshold];
+		if ([value respondsToSelector:@selector(unsignedIntegerValue)])  _pruneThreshold = [value unsignedIntegerValue];
+		
+		NSArray *entries = [plist objectForKey:kPListKeyEntries];
+		if (![entries isKindOfClass:[NSArray class]])  entries = nil;
+		
+		for (NSDictionary *entryPList in entries)
+		{
+			if (![entryPList isKindOfClass:[NSDictionary class]])  continue;
+			
+			NSString *key = [entryPList objectForKey:kPListKeyEntryKey];
+			id object = [entryPList objectForKey:kPListKeyEntryObject];
+			if (![key isKindOfClass:[NSString class]] || object == nil || [_entries objectForKey:key] != nil)  continue;
+			
+			OOCacheEntry *entry = [[OOCacheEntry alloc] init];
+			entry->key = key;
+			entry->object = object;
+			[_entries setObject:entry forKey:key];
+			[self insertEntryAtBack:entry];
+		}
+		
+		if (_autoPrune)  [self prune];
+		_dirty = NO;
+	}
+	
+	return self;
+}
+
+
+- (NSDictionary *) propertyListRepresentation
+{
+	NSMutableArray *entries = [NSMutableArray arrayWithCapacity:_entries.count];
+	
+	for (OOCacheEntry *entry = _mostRecent; entry != nil; entry = entry->lessRecent)
+	{
+		[entries addObject:$dict(kPListKeyEntryKey, entry->key, kPListKeyEntryObject, entry->object)];
+	}
+	
+	NSMutableDictionary *result = [NSMutableDictionary dictionaryWithObjectsAndKeys:
+								   [NSNumber numberWithBool:_autoPrune], kPListKeyAutoPrune,
+								   [NSNumber numberWithUnsignedInteger:_pruneThreshold], kPListKeyPruneThreshold,
+								   entries, kPListKeyEntries,
+								   nil];
+	if (_name != nil)  [result setObject:_name forKey:kPListKeyName];
+	
+	return result;
 }
 
 
-// Don't need to be implemented since they can never be called
-@dynamic name, autoPrune, pruneThreshold;
+- (NSUInteger) count
+{
+	return _entries.count;
+}
 
 
 - (id) objectForKey:(NSString *)key
 {
-	return nil;
+	OOCacheEntry *entry = [_entries objectForKey:key];
+	if (entry == nil)  return nil;
+	
+	if (entry != _mostRecent)
+	{
+		[self unlinkEntry:entry];
+		[self insertEntryAtFront:entry];
+	}
+	
+	return entry->object;
 }
 
 
 - (void) setObject:(id)object forKey:(NSString *)key
 {
+	if (key == nil)  return;
+	if (object == nil)
+	{
+		[self removeObjectForKey:key];
+		return;
+	}
+	
+	OOCacheEntry *entry = [_entries objectForKey:key];
+	if (entry != nil)
+	{
+		[self unlinkEntry:entry];
+	}
+	else
+	{
+		entry = [[OOCacheEntry alloc] init];
+		entry->key = [key copy];
+		[_entries setObject:entry forKey:entry->key];
+	}
+	
+	entry->object = object;
+	[self insertEntryAtFront:entry];
+	_dirty = YES;
+	
+	if (_autoPrune && _pruneThreshold < _entries.count)  [self prune];
+}
+
+
+- (void) removeObjectForKey:(NSString *)key
+{
+	OOCacheEntry *entry = [_entries objectForKey:key];
+	if (entry == nil)  return;
 	
+	[self unlinkEntry:entry];
+	[_entries removeObjectForKey:key];
+	_dirty = YES;
 }
 
+
+- (void) removeAllObjects
+{
+	if (_entries.count == 0)  return;
+	
+	[_entries removeAllObjects];
+	_mostRecent = nil;
+	_leastRecent = nil;
+	_dirty = YES;
+}
+
+
+- (void) setPruneThreshold:(NSUInteger)threshold
+{
+	_pruneThreshold = threshold;
+	if (_autoPrune && _pruneThreshold < _entries.count)  [self prune];
+}
+
+
+- (void) prune
+{
+	if (_entries.count <= _pruneThreshold)  return;
+	[self pruneToCount:_pruneThreshold * kPruneReductionFactor];
+}
+
+
+- (void) pruneToCount:(NSUInteger)count
+{
+	while (count < _entries.count && _leastRecent != nil)
+	{
+		OOCacheEntry *entry = _leastRecent;
+		[self unlinkEntry:entry];
+		[_entries removeObjectForKey:entry->key];
+		_dirty = YES;
+	}
+}
+
+
+- (void) unlinkEntry:(OOCacheEntry *)entry
+{
+	if (entry->moreRecent != nil)  entry->moreRecent->lessRecent = entry->lessRecent;
+	else  _mostRecent = entry->lessRecent;
+	
+	if (entry->lessRecent != nil)  entry->lessRecent->moreRecent = entry->moreRecent;
+	else  _leastRecent = entry->moreRecent;
+	
+	entry->moreRecent = nil;
+	entry->lessRecent = nil;
+}
+
+
+- (void) insertEntryAtFront:(OOCacheEntry *)entry
+{
+	OOCacheEntry *front = _mostRecent;
+	
+	entry->moreRecent = nil;
+	entry->lessRecent = front;
+	if (front != nil)  front->moreRecent = entry;
+	else  _leastRecent = entry;
+	_mostRecent = entry;
+}
+
+
+- (void) insertEntryAtBack:(OOCacheEntry *)entry
+{
+	OOCacheEntry *back = _leastRecent;
+	
+	entry->lessRecent = nil;
+	entry->moreRecent = back;
+	if (back != nil)  back->lessRecent = entry;
+	else  _mostRecent = entry;
+	_leastRecent = entry;
+}
+
+
+- (NSString *) description
+{
+	return [NSString stringWithFormat:@"<%@ %p>{\"%@\", %lu entries, threshold %lu%@}", self.class, self, _name, (unsigned long)_entries.count, (unsigned long)_pruneThreshold, _autoPrune ? @"" : @", manual pruning"];
+}
+
+@end
+
+
+@implementation OOCacheEntry
 @end
@@ -8,12 +8,35 @@
 
 #import "DDMockSingleton.h"
 
+
+/*	Stand-in for Oolite's cache manager. Unlike the other mock singletons, the
+	caches themselves are shared by every document, and saved to the user's
+	Caches folder so that reopening a ship doesn't load its model from
+	scratch. Saving happens on a background thread a few seconds after the
+	last change, and when quitting.
+	
+	Keys of the form "file" or "file:options", as used by OOMesh, where file
+	can be resolved by the owning document, are stored by the file's full
+	path and checked against its modification date; an entry for a file
+	which has changed since it was cached is discarded.
+*/
 @interface DDMockCacheManager: DDMockSingleton
 
 + (id) sharedCache;
 
 - (id) objectForKey:(NSString *)key inCache:(NSString *)cache;
 - (void) setObject:(id)object forKey:(NSString *)key inCache:(NSString *)cache;
+- (void) removeObjectForKey:(NSString *)key inCache:(NSString *)cache;
+- (void) clearCache:(NSString *)cache;
+- (void) clearAllCaches;
+
+- (void) setPruneThreshold:(NSUInteger)threshold forCache:(NSString *)cache;
+- (NSUInteger) pruneThresholdForCache:(NSString *)cache;
+- (void) setAutoPrune:(BOOL)flag forCache:(NSString *)cache;
+- (BOOL) autoPruneForCache:(NSString *)cache;
+
+// Write any changes to disk now, on the calling thread.
+- (void) flush;
 
 @end
 
@@ -7,6 +7,47 @@
 //
 
 #import "OOCacheManager.h"
+#import "OOCache.h"
+#import "DDDocument.h"
+#import "NSThreadOOExtensions.h"
+
+
+#define kCacheFileName				@"Oolite Caches.plist"
+#define kCacheFormatVersion			1
+#define kPListKeyFormatVersion		@"format version"
+#define kPListKeyCaches				@"caches"
+
+#define kEntryKeyObject				@"object"
+#define kEntryKeyModificationDate	@"modification date"
+
+// Changes are saved this long after the last one, so loading a batch of ships saves once.
+#define kWriteDelay					5.0
+
+
+/*	Shared by all documents' cache managers. Only touched on the main thread,
+	except that the writer thread serializes snapshots taken from it.
+*/
+static NSMutableDictionary	*sCaches = nil;
+static NSLock				*sWriteLock = nil;
+static NSUInteger			sSnapshotGeneration = 0;
+static NSUInteger			sWrittenGeneration = 0;
+
+
+@interface DDMockCacheManager ()
+
++ (void) loadCaches;
++ (NSString *) cachePath;
++ (OOCache *) cacheNamed:(NSString *)name create:(BOOL)create;
++ (void) scheduleWrite;
++ (void) writeCachesInBackground;
++ (void) writeSnapshot:(NSDictionary *)snapshot;
++ (NSDictionary *) snapshotIfDirty;
++ (void) flushCaches;
++ (void) applicationWillTerminate:(NSNotification *)notification;
+
+- (NSString *) resolvedKeyForKey:(NSString *)key modificationDate:(NSDate **)outDate;
+
+@end
 
 
 @implementation DDMockCacheManager
@@ -19,13 +60,285 @@
 
 - (id) objectForKey:(NSString *)key inCache:(NSString *)cache
 {
-	return nil;
+	NSDate *date = nil;
+	NSString *resolvedKey = [self resolvedKeyForKey:key modificationDate:&date];
+	OOCache *cacheObject = [DDMockCacheManager cacheNamed:cache create:NO];
+	
+	NSDictionary *entry = [cacheObject objectForKey:resolvedKey];
+	if (![entry isKindOfClass:[NSDictionary class]])  return nil;
+	
+	NSDate *cachedDate = [entry objectForKey:kEntryKeyModificationDate];
+	if ((date != nil || cachedDate != nil) && ![date isEqualToDate:cachedDate])
+	{
+		// The file has changed since it was cached.
+		[cacheObject removeObjectForKey:resolvedKey];
+		[DDMockCacheManager scheduleWrite];
+		return nil;
+	}
+	
+	return [entry objectForKey:kEntryKeyObject];
 }
 
 
 - (void) setObject:(id)object forKey:(NSString *)key inCache:(NSString *)cache
 {
+	if (object == nil)
+	{
+		[self removeObjectForKey:key inCache:cache];
+		return;
+	}
+	
+	NSDate *date = nil;
+	NSString *resolvedKey = [self resolvedKeyForKey:key modificationDate:&date];
+	NSDictionary *entry = (date != nil) ? $dict(kEntryKeyObject, object, kEntryKeyModificationDate, date) : $dict(kEntryKeyObject, object);
+	
+	[[DDMockCacheManager cacheNamed:cache create:YES] setObject:entry forKey:resolvedKey];
+	[DDMockCacheManager scheduleWrite];
+}
+
+
+- (void) removeObjectForKey:(NSString *)key inCache:(NSString *)cache
+{
+	[[DDMockCacheManager cacheNamed:cache create:NO] removeObjectForKey:[self resolvedKeyForKey:key modificationDate:NULL]];
+	[DDMockCacheManager scheduleWrite];
+}
+
+
+- (void) clearCache:(NSString *)cache
+{
+	[[DDMockCacheManager cacheNamed:cache create:NO] removeAllObjects];
+	[DDMockCacheManager scheduleWrite];
+}
+
+
+- (void) clearAllCaches
+{
+	[DDMockCacheManager loadCaches];
+	for (OOCache *cache in [sCaches allValues])
+	{
+		[cache removeAllObjects];
+	}
+	[DDMockCacheManager scheduleWrite];
+}
+
+
+- (void) setPruneThreshold:(NSUInteger)threshold forCache:(NSString *)cache
+{
+	[DDMockCacheManager cacheNamed:cache create:YES].pruneThreshold = threshold;
+	[DDMockCacheManager scheduleWrite];
+}
+
+
+- (NSUInteger) pruneThresholdForCache:(NSString *)cache
+{
+	OOCache *cacheObject = [DDMockCacheManager cacheNamed:cache create:NO];
+	return (cacheObject != nil) ? cacheObject.pruneThreshold : kOOCacheDefaultPruneThreshold;
+}
+
+
+- (void) setAutoPrune:(BOOL)flag forCache:(NSString *)cache
+{
+	[DDMockCacheManager cacheNamed:cache create:YES].autoPrune = flag;
+	[DDMockCacheManager scheduleWrite];
+}
+
+
+- (BOOL) autoPruneForCache:(NSString *)cache
+{
+	OOCache *cacheObject = [DDMockCacheManager cacheNamed:cache create:NO];
+	return (cacheObject != nil) ? cacheObject.autoPrune : YES;
+}
+
+
+- (void) flush
+{
+	[DDMockCacheManager flushCaches];
+}
+
+
+- (NSString *) resolvedKeyForKey:(NSString *)key modificationDate:(NSDate **)outDate
+{
+	if (outDate != NULL)  *outDate = nil;
+	if (key == nil)  return nil;
+	
+	NSRange colon = [key rangeOfString:@":"];
+	NSString *fileName = (colon.location != NSNotFound) ? [key substringToIndex:colon.location] : key;
+	
+	NSString *path = [self.mockSingletonContext.owner resolveResourcePathForFile:fileName nominalFolder:@"Models"];
+	if (path == nil)  return key;
 	
+	if (outDate != NULL)
+	{
+		*outDate = [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL] fileModificationDate];
+	}
+	
+	if (colon.location != NSNotFound)  path = [path stringByAppendingString:[key substringFromIndex:colon.location]];
+	return path;
+}
+
+
++ (OOCache *) cacheNamed:(NSString *)name create:(BOOL)create
+{
+	if (name == nil)  return nil;
+	
+	[self loadCaches];
+	
+	OOCache *cache = [sCaches objectForKey:name];
+	if (cache == nil && create)
+	{
+		cache = [[OOCache alloc] init];
+		cache.name = name;
+		[sCaches setObject:cache forKey:name];
+	}
+	
+	return cache;
+}
+
+
++ (NSString *) cachePath
+{
+	NSArray *searchPaths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+	if (searchPaths.count == 0)  return nil;
+	
+	NSString *bundleID = [[NSBundle mainBundle] bundleIdentifier];
+	if (bundleID == nil)  bundleID = @"Dry Dock Redux";
+	
+	return [[[searchPaths objectAtIndex:0] stringByAppendingPathComponent:bundleID] stringByAppendingPathComponent:kCacheFileName];
+}
+
+
++ (void) loadCaches
+{
+	if (sCaches != nil)  return;
+	
+	sCaches = [NSMutableDictionary dictionary];
+	sWriteLock = [[NSLock alloc] init];
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(applicationWillTerminate:)
+												 name:NSApplicationWillTerminateNotification
+											   object:nil];
+	
+	NSString *path = [self cachePath];
+	NSData *data = (path != nil) ? [NSData dataWithContentsOfMappedFile:path] : nil;
+	if (data == nil)  return;
+	
+	NSString *error = nil;
+	NSDictionary *plist = [NSPropertyListSerialization propertyListFromData:data
+														   mutabilityOption:NSPropertyListImmutable
+																	 format:NULL
+														   errorDescription:&error];
+	if (![plist isKindOfClass:[NSDictionary class]])
+	{
+		LogWithFormat(@"Ignoring unreadable cache file: %@", error);
+		return;
+	}
+	if ([[plist objectForKey:kPListKeyFormatVersion] intValue] != kCacheFormatVersion)  return;
+	
+	NSArray *caches = [plist objectForKey:kPListKeyCaches];
+	if (![caches isKindOfClass:[NSArray class]])  return;
+	
+	for (NSDictionary *cachePList in caches)
+	{
+		OOCache *cache = [[OOCache alloc] initWithPropertyListRepresentation:cachePList];
+		if (cache.name != nil)  [sCaches setObject:cache forKey:cache.name];
+	}
+}
+
+
++ (void) scheduleWrite
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(writeCachesInBackground) object:nil];
+	[self performSelector:@selector(writeCachesInBackground) withObject:nil afterDelay:kWriteDelay];
+}
+
+
++ (NSDictionary *) snapshotIfDirty
+{
+	BOOL dirty = NO;
+	for (OOCache *cache in [sCaches allValues])
+	{
+		if (cache.dirty)  dirty = YES;
+	}
+	if (!dirty)  return nil;
+	
+	/*	The snapshot shares the cached objects, which are property lists and
+		not modified once cached, so only the containers need copying here.
+	*/
+	NSMutableArray *caches = [NSMutableArray arrayWithCapacity:sCaches.count];
+	for (OOCache *cache in [sCaches allValues])
+	{
+		[caches addObject:[cache propertyListRepresentation]];
+		cache.dirty = NO;
+	}
+	
+	NSDictionary *plist = $dict(kPListKeyFormatVersion, [NSNumber numberWithInt:kCacheFormatVersion],
+								kPListKeyCaches, caches);
+	return $dict(@"plist", plist, @"generation", [NSNumber numberWithUnsignedInteger:++sSnapshotGeneration]);
+}
+
+
++ (void) writeCachesInBackground
+{
+	NSDictionary *snapshot = [self snapshotIfDirty];
+	if (snapshot == nil)  return;
+	
+	[NSThread detachNewThreadSelector:@selector(writeSnapshot:) toTarget:self withObject:snapshot];
+}
+
+
++ (void) writeSnapshot:(NSDictionary *)snapshot
+{
+	if (![NSThread isMainThread])  [NSThread ooSetCurrentThreadName:@"cache writer"];
+	
+	[sWriteLock lock];
+	
+	// Writers can be scheduled out of order; never replace a newer snapshot with an older one.
+	NSUInteger generation = [[snapshot objectForKey:@"generation"] unsignedIntegerValue];
+	if (sWrittenGeneration < generation)
+	{
+		NSString *error = nil;
+		NSData *data = [NSPropertyListSerialization dataFromPropertyList:[snapshot objectForKey:@"plist"]
+																  format:NSPropertyListBinaryFormat_v1_0
+														errorDescription:&error];
+		NSString *path = [self cachePath];
+		
+		if (data != nil && path != nil)
+		{
+			[[NSFileManager defaultManager] createDirectoryAtPath:path.stringByDeletingLastPathComponent
+									  withIntermediateDirectories:YES
+													   attributes:nil
+															error:NULL];
+			if ([data writeToFile:path atomically:YES])  sWrittenGeneration = generation;
+			else  LogWithFormat(@"Failed to write cache file %@.", path);
+		}
+		else
+		{
+			LogWithFormat(@"Failed to serialize caches: %@", error);
+		}
+	}
+	
+	[sWriteLock unlock];
+}
+
+
++ (void) flushCaches
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(writeCachesInBackground) object:nil];
+	
+	NSDictionary *snapshot = [self snapshotIfDirty];
+	if (snapshot != nil)  [self writeSnapshot:snapshot];
+	else
+	{
+		// Wait for a background write that's still in progress.
+		[sWriteLock lock];
+		[sWriteLock unlock];
+	}
+}
+
+
++ (void) applicationWillTerminate:(NSNotification *)notification
+{
+	[self flushCaches];
 }
 
 @end
@@ -0,0 +1,75 @@
+/*
+	DDCollisionOctree.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Collision octree for a mesh, in the form Oolite builds at load time. See
+	DDOctreeBuilder.h for the node layout.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import <Foundation/Foundation.h>
+#import "DDPropertyListRepresentation.h"
+#import "phystypes.h"
+
+@class DDMesh;
+
+
+@interface DDCollisionOctree: NSObject <DDPropertyListRepresentation>
+{
+	int32_t					*_nodes;
+	uint32_t				_nodeCount;
+	Scalar					_radius;
+	unsigned				_depth;
+	NSTimeInterval			_buildTime;
+}
+
+// Depth used when none is specified; user default "collision octree depth".
++ (unsigned)defaultDepth;
+
+- (id)initWithMesh:(DDMesh *)inMesh depth:(unsigned)inDepth;
+
+@property (readonly) Scalar radius;
+@property (readonly) unsigned depth;
+@property (readonly) uint32_t nodeCount;
+@property (readonly) size_t memoryUsage;			// Bytes used by the node array
+@property (readonly) NSTimeInterval buildTime;		// Seconds; 0 if loaded from a document
+
+- (const int32_t *)nodes;
+
+- (void)getSolidLeafCount:(NSUInteger *)outSolid mixedLeafCount:(NSUInteger *)outMixed emptyLeafCount:(NSUInteger *)outEmpty;
+
+/*	Write octree for use with a DAT. The file is an XML property list with
+	keys "radius", "depth" and "octree" (data, big-endian int32_t). As in
+	Oolite, mixed leaves are written as solid.
+*/
+- (BOOL)writeToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+
+// Name of the file written alongside a DAT, e.g. foo.dat -> foo-octree.plist
++ (NSURL *)octreeURLForDATURL:(NSURL *)inDATURL;
+
+@end
+
+
+@interface DDMesh (DDCollisionOctree)
+
+// For building an octree with a DDMeshOperation, which can only message the mesh.
+- (DDCollisionOctree *)collisionOctreeWithDepth:(unsigned)inDepth;
+
+@end
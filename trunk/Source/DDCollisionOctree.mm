@@ -0,0 +1,317 @@
+/*
+	DDCollisionOctree.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDCollisionOctree.h"
+#import "DDOctreeBuilder.h"
+#import "DDMesh.h"
+#import "DDProblemReportManager.h"
+#import "DDUtilities.h"
+#import "Logging.h"
+
+
+enum
+{
+	kDefaultOctreeDepth		= 6
+};
+
+
+@implementation DDCollisionOctree
+
++ (unsigned)defaultDepth
+{
+	NSInteger				depth;
+	
+	depth = [[NSUserDefaults standardUserDefaults] integerForKey:@"collision octree depth"];
+	if (depth <= 0)  depth = kDefaultOctreeDepth;
+	if (kDDOctreeMaxDepth < depth)  depth = kDDOctreeMaxDepth;
+	
+	return depth;
+}
+
+
+- (id)initWithMesh:(DDMesh *)inMesh depth:(unsigned)inDepth
+{
+	TraceEnter();
+	
+	Vector					*soup = NULL;
+	uint32_t				triangleCount;
+	CFAbsoluteTime			start;
+	
+	self = [super init];
+	if (nil != self)
+	{
+		start = CFAbsoluteTimeGetCurrent();
+		
+		_radius = [inMesh boundingRadius];
+		_depth = inDepth;
+		
+		soup = [inMesh copyTriangleSoup:&triangleCount faceTags:NULL];
+		if (soup != NULL)  _nodes = DDBuildCollisionOctree(soup, triangleCount, _radius, _depth, &_nodeCount);
+		Free(soup);
+		
+		_buildTime = CFAbsoluteTimeGetCurrent() - start;
+		
+		if (_nodes == NULL)
+		{
+			[self release];
+			self = nil;
+		}
+		else
+		{
+			LogMessage(@"Built collision octree of depth %u for %@: %u nodes, %lu bytes, %g seconds.", _depth, [inMesh name], _nodeCount, (unsigned long)[self memoryUsage], _buildTime);
+		}
+	}
+	
+	return self;
+	TraceExit();
+}
+
+
+- (id)initWithPropertyListRepresentation:(id)inPList issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	NSDictionary			*dict = nil;
+	NSData					*data = nil;
+	const uint32_t			*bytes;
+	uint32_t				i;
+	
+	self = [super init];
+	if (nil == self)  return nil;
+	
+	if (![inPList isKindOfClass:[NSDictionary class]])  OK = NO;
+	
+	if (OK)
+	{
+		dict = inPList;
+		data = [dict objectForKey:@"octree"];
+		if (![data isKindOfClass:[NSData class]] || [data length] == 0 || [data length] % sizeof (int32_t) != 0)  OK = NO;
+		_radius = [[dict objectForKey:@"radius"] floatValue];
+		_depth = [[dict objectForKey:@"depth"] unsignedIntValue];
+		if (_radius <= 0 || _depth == 0 || kDDOctreeMaxDepth < _depth)  OK = NO;
+	}
+	
+	if (OK)
+	{
+		_nodeCount = [data length] / sizeof (int32_t);
+		_nodes = (int32_t *)malloc(sizeof *_nodes * _nodeCount);
+		if (_nodes == NULL)  OK = NO;
+	}
+	
+	if (OK)
+	{
+		bytes = (const uint32_t *)[data bytes];
+		for (i = 0; i != _nodeCount; ++i)
+		{
+			_nodes[i] = (int32_t)CFSwapInt32LittleToHost(bytes[i]);
+			// Child offsets must stay in bounds, or traversal could run off the end.
+			if (0 < _nodes[i] && _nodeCount < i + _nodes[i] + 8)
+			{
+				OK = NO;
+				break;
+			}
+		}
+	}
+	
+	if (!OK)
+	{
+		// This is only a cache, so failure to load it isn't worth bothering the user with.
+		LogMessage(@"Ignoring invalid cached collision octree.");
+		[self release];
+		self = nil;
+	}
+	
+	return self;
+	TraceExit();
+}
+
+
+- (void)dealloc
+{
+	Free(_nodes);
+	
+	[super dealloc];
+}
+
+
+- (void)finalize
+{
+	Free(_nodes);
+	
+	[super finalize];
+}
+
+
+- (void)gatherIssuesWithGeneratingPropertyListRepresentation:(DDProblemReportManager *)ioManager
+{
+	
+}
+
+
+- (id)propertyListRepresentationWithIssues:(DDProblemReportManager *)ioIssues
+{
+	NSMutableData			*data;
+	uint32_t				*bytes;
+	uint32_t				i;
+	
+	data = [NSMutableData dataWithLength:sizeof *_nodes * _nodeCount];
+	if (nil == data)  return nil;
+	
+	bytes = (uint32_t *)[data mutableBytes];
+	for (i = 0; i != _nodeCount; ++i)
+	{
+		bytes[i] = CFSwapInt32HostToLittle((uint32_t)_nodes[i]);
+	}
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+							[NSNumber numberWithFloat:_radius], @"radius",
+							[NSNumber numberWithUnsignedInt:_depth], @"depth",
+							data, @"octree",
+							nil];
+}
+
+
+- (BOOL)writeToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	NSMutableData			*octree;
+	uint32_t				*bytes;
+	uint32_t				i;
+	int32_t					value;
+	NSDictionary			*plist;
+	NSData					*data = nil;
+	NSString				*errorDesc = nil;
+	NSError					*error = nil;
+	
+	octree = [NSMutableData dataWithLength:sizeof *_nodes * _nodeCount];
+	if (nil == octree)
+	{
+		OK = NO;
+		[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage."];
+	}
+	
+	if (OK)
+	{
+		bytes = (uint32_t *)[octree mutableBytes];
+		for (i = 0; i != _nodeCount; ++i)
+		{
+			value = _nodes[i];
+			if (value == kDDOctreeMixed)  value = kDDOctreeSolid;
+			bytes[i] = CFSwapInt32HostToBig((uint32_t)value);
+		}
+		
+		plist = [NSDictionary dictionaryWithObjectsAndKeys:
+							[NSNumber numberWithFloat:_radius], @"radius",
+							[NSNumber numberWithUnsignedInt:_depth], @"depth",
+							octree, @"octree",
+							nil];
+		data = [NSPropertyListSerialization dataFromPropertyList:plist format:NSPropertyListXMLFormat_v1_0 errorDescription:&errorDesc];
+		if (nil == data)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"noConvertToPList" localizedFormat:@"The collision octree could not be converted to a property list (%@).", errorDesc];
+		}
+	}
+	
+	if (OK)
+	{
+		OK = [data writeToURL:inFile options:NSAtomicWrite error:&error];
+		if (!OK)
+		{
+			[ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The collision octree could not be saved. %@", error ? [error localizedFailureReason] : @""];
+		}
+	}
+	
+	return OK;
+	TraceExit();
+}
+
+
++ (NSURL *)octreeURLForDATURL:(NSURL *)inDATURL
+{
+	NSString				*path;
+	
+	path = [[inDATURL path] stringByDeletingPathExtension];
+	path = [path stringByAppendingString:@"-octree.plist"];
+	return [NSURL fileURLWithPath:path];
+}
+
+
+@synthesize radius = _radius;
+@synthesize depth = _depth;
+@synthesize nodeCount = _nodeCount;
+@synthesize buildTime = _buildTime;
+
+
+- (size_t)memoryUsage
+{
+	return sizeof *_nodes * _nodeCount;
+}
+
+
+- (const int32_t *)nodes
+{
+	return _nodes;
+}
+
+
+- (void)getSolidLeafCount:(NSUInteger *)outSolid mixedLeafCount:(NSUInteger *)outMixed emptyLeafCount:(NSUInteger *)outEmpty
+{
+	NSUInteger				solid = 0, mixed = 0, empty = 0;
+	uint32_t				i;
+	
+	for (i = 0; i != _nodeCount; ++i)
+	{
+		switch (_nodes[i])
+		{
+			case kDDOctreeSolid:  ++solid; break;
+			case kDDOctreeMixed:  ++mixed; break;
+			case kDDOctreeEmpty:  ++empty; break;
+		}
+	}
+	
+	if (outSolid != NULL)  *outSolid = solid;
+	if (outMixed != NULL)  *outMixed = mixed;
+	if (outEmpty != NULL)  *outEmpty = empty;
+}
+
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %p>{depth=%u, radius=%g, nodes=%u}", [self className], self, _depth, _radius, _nodeCount];
+}
+
+@end
+
+
+@implementation DDMesh (DDCollisionOctree)
+
+- (DDCollisionOctree *)collisionOctreeWithDepth:(unsigned)inDepth
+{
+	return [[[DDCollisionOctree alloc] initWithMesh:self depth:inDepth] autorelease];
+}
+
+@end
@@ -23,9 +23,9 @@
 
 #import <Cocoa/Cocoa.h>
 #import "phystypes.h"
+#import "DDMesh.h"
 
 @class DDComparatorGLView;
-@class DDMesh;
 @class DDDimensionFormatter;
 
 
@@ -37,10 +37,15 @@
 	IBOutlet NSTextField			*widthField;
 	IBOutlet NSTextField			*heightField;
 	IBOutlet DDDimensionFormatter	*formatter;
+	IBOutlet NSTextField			*deviationField;
 	BOOL							_haveSetSelfUp;
 }
 
 - (void)setMesh:(DDMesh *)inMesh radius:(float)inRadius;
+- (void)setMesh:(DDMesh *)inMesh radius:(float)inRadius vertexDeviations:(NSData *)inDeviations range:(float)inRange;
+
+// Show a summary line for the deviation of this view's mesh from the other.
+- (void)setDeviation:(DDMeshDeviation)inDeviation;
 
 - (DDComparatorGLView *)glView;
 
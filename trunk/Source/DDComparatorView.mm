@@ -63,6 +63,12 @@
 
 
 - (void)setMesh:(DDMesh *)inMesh radius:(float)inRadius
+{
+	[self setMesh:inMesh radius:inRadius vertexDeviations:nil range:0];
+}
+
+
+- (void)setMesh:(DDMesh *)inMesh radius:(float)inRadius vertexDeviations:(NSData *)inDeviations range:(float)inRange
 {
 	SceneNode				*sceneRoot;
 	
@@ -72,13 +78,22 @@
 	[heightField setFloatValue:[inMesh height]];
 	
 	// Build a scene graph
-	sceneRoot = [inMesh sceneGraphForMesh];
+	sceneRoot = [inMesh sceneGraphForMeshWithVertexDeviations:inDeviations range:inRange];
 	
 	[glView setSceneRoot:sceneRoot];
 	[glView setObjectSize:inRadius];
 }
 
 
+- (void)setDeviation:(DDMeshDeviation)inDeviation
+{
+	[deviationField setStringValue:[NSString stringWithFormat:NSLocalizedString(@"Deviation: max %@, mean %@, RMS %@", NULL),
+									[formatter stringForObjectValue:[NSNumber numberWithFloat:inDeviation.maximum]],
+									[formatter stringForObjectValue:[NSNumber numberWithFloat:inDeviation.mean]],
+									[formatter stringForObjectValue:[NSNumber numberWithFloat:inDeviation.rms]]]];
+}
+
+
 - (DDComparatorGLView *)glView
 {
 	return [[glView retain] autorelease];
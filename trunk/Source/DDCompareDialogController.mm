@@ -154,7 +154,9 @@
 
 -(void)problemReport:(DDProblemReportManager*)inManager doneWithResult:(BOOL)inResult
 {
-	float				maxR1, maxR2;
+	float				maxR1, maxR2, range;
+	DDMeshDeviation		leftDeviation, rightDeviation;
+	NSData				*leftDeviations = nil, *rightDeviations = nil;
 	
 	if (inResult)
 	{
@@ -164,8 +166,25 @@
 		
 		if (maxR1 < maxR2) maxR1 = maxR2;
 		
-		[leftView setMesh:_leftMesh radius:maxR1];
-		[rightView setMesh:_rightMesh radius:maxR1];
+		/*	Measure how far each mesh strays from the other, and colour both
+			on the same scale so they can be compared directly.
+		*/
+		if ([_leftMesh getDeviationFromMesh:_rightMesh sampleCount:0 result:&leftDeviation vertexDeviations:&leftDeviations] &&
+			[_rightMesh getDeviationFromMesh:_leftMesh sampleCount:0 result:&rightDeviation vertexDeviations:&rightDeviations])
+		{
+			range = leftDeviation.maximum;
+			if (range < rightDeviation.maximum)  range = rightDeviation.maximum;
+			
+			[leftView setMesh:_leftMesh radius:maxR1 vertexDeviations:leftDeviations range:range];
+			[rightView setMesh:_rightMesh radius:maxR1 vertexDeviations:rightDeviations range:range];
+			[leftView setDeviation:leftDeviation];
+			[rightView setDeviation:rightDeviation];
+		}
+		else
+		{
+			[leftView setMesh:_leftMesh radius:maxR1];
+			[rightView setMesh:_rightMesh radius:maxR1];
+		}
 		
 		[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(leftViewDidChange:) name:kNotificationDDSceneViewCameraOrLightChanged object:[leftView glView]];
 		[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(rightViewDidChange:) name:kNotificationDDSceneViewCameraOrLightChanged object:[rightView glView]];
@@ -55,4 +55,7 @@
 - (BOOL)readReal:(float *)outReal;
 - (BOOL)readString:(NSString **)outString;
 
+// Skip inCount tokens without examining them. Returns NO at end of file.
+- (BOOL)skipTokens:(unsigned)inCount;
+
 @end
@@ -237,6 +237,17 @@
 }
 
 
+- (BOOL)skipTokens:(unsigned)inCount
+{
+	while (inCount--)
+	{
+		if (![self advance])  return NO;
+	}
+	
+	return YES;
+}
+
+
 static inline BOOL IsSeparatorChar(char c)
 {
 	return c == ' ' || c == ',' || c == '\t' || c == '\r' || c == '\n';
@@ -23,7 +23,7 @@
 
 #import <Cocoa/Cocoa.h>
 
-@class DDDocumentWindowController, DDModelDocument, DDMesh;
+@class DDDocumentWindowController, DDModelDocument, DDMesh, DDMeshOperation, DDDocumentLoader;
 
 
 @interface DDDocument: NSDocument
@@ -31,10 +31,25 @@
 	DDModelDocument					*_document;
 	DDDocumentWindowController		*_windowController;
 	NSURL							*_actualSaveDestination;
+	
+	// Worker loading the document; nil once its textures are in.
+	DDDocumentLoader				*_loader;
+	
+	// Background mesh operation and its progress sheet
+	DDMeshOperation					*_meshOperation;
+	NSPanel							*_progressSheet;
+	NSProgressIndicator				*_progressIndicator;
+	NSTimer							*_progressTimer;
 }
 
 - (DDMesh *)mesh;
 
+/*	Documents are read on a worker thread. The window opens straight away, the
+	model appears once its geometry has been read and textures follow. Mesh
+	commands and saving are disabled until loading finishes.
+*/
+@property (readonly, getter=isLoading) BOOL loading;
+
 - (IBAction)doCompareDialog:sender;
 - (IBAction)doScaleDialog:sender;
 - (IBAction)doRecenterDialog:sender;
@@ -45,6 +60,16 @@
 
 - (void)completeAsynchronousMeshReplacingActionWithName:(NSString *)inName mesh:(DDMesh *)inMesh;
 
+/*	Run an operation on a copy of the root mesh on a worker thread. If it
+	takes more than a moment, a sheet shows its progress and allows it to be
+	cancelled. When it completes, its mesh replaces the root mesh through
+	-completeAsynchronousMeshReplacingActionWithName:mesh:. Only one operation
+	runs per document; mesh commands are disabled meanwhile.
+*/
+- (void)runMeshOperation:(DDMeshOperation *)inOperation;
+- (IBAction)cancelMeshOperation:sender;
+@property (readonly, getter=isProcessingMesh) BOOL processingMesh;
+
 - (void)scaleX:(float)inX y:(float)inY z:(float)inZ;
 
 @end
@@ -34,6 +34,8 @@
 #import "DDUtilities.h"
 #import "DDModelDocument.h"
 #import "DDRecenterDialogController.h"
+#import "DDMeshOperation.h"
+#import "DDDocumentLoader.h"
 
 
 @interface DDDocument(Private)
@@ -42,6 +44,14 @@
 - (void)undoAction:(NSString *)inName replacingMesh:(DDMesh *)inMesh;
 - (void)setUpMeshReplacingUndoActionNamed:(NSString *)inName;
 
+- (void)runMeshOperationWithName:(NSString *)inName invocation:(NSInvocation *)inInvocation;
+- (void)showProgressSheet;
+- (void)hideProgressSheet;
+- (void)updateProgress:(NSTimer *)inTimer;
+- (BOOL)isMeshAction:(SEL)inAction;
+
+- (void)cancelLoading;
+
 @end
 
 
@@ -60,12 +70,29 @@
 
 - (void)dealloc
 {
+	[_meshOperation setDelegate:nil];
+	[_meshOperation cancel];
+	[_meshOperation release];
+	[self cancelLoading];
 	[_document autorelease];
 	
 	[super dealloc];
 }
 
 
+- (void)close
+{
+	// The operation won't report back once its delegate is cleared, so tidy up after it here.
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(showProgressSheet) object:nil];
+	[self hideProgressSheet];
+	[_meshOperation setDelegate:nil];
+	[_meshOperation cancel];
+	Release(_meshOperation);
+	[self cancelLoading];
+	[super close];
+}
+
+
 - (void)makeWindowControllers
 {
 	_windowController = [[DDDocumentWindowController alloc] initWithWindowNibName:@"DDDocument"];
@@ -75,83 +102,105 @@
 }
 
 
+- (void)showWindows
+{
+	[super showWindows];
+	if (_loader != nil)  [_windowController setLoading:YES];
+}
+
+
 - (BOOL)readFromURL:(NSURL *)absoluteURL ofType:(NSString *)typeName error:(NSError **)outError
 {
 	TraceEnterMsg(@"Called with absoluteURL=%@, typeName=\"%@\"", absoluteURL, typeName);
 	
-	BOOL					success;
-	DDProblemReportManager	*problemManager;
-	DDModelDocument			*document = nil;
+	DDDocumentLoader		*loader;
 	
 	if (NULL != outError) *outError = nil;
 	
-	problemManager = [[DDProblemReportManager alloc] init];
-	[problemManager setContext:kContextOpen];
-	
-	@try
-	{
-		if ([typeName isEqualToString:@"org.aegidian.oolite.mesh"] || [typeName isEqualToString:@"Oolite Model"])
-		{
-			document = [[DDModelDocument alloc] initWithOoliteDAT:absoluteURL issues:problemManager];
-			success = (nil != document);
-		}
-		else if ([typeName isEqualToString:@"com.newtek.lightwave.obj"] || [typeName isEqualToString:@"WaveFront OBJ Model"])
-		{
-			document = [[DDModelDocument alloc] initWithWaveFrontOBJ:absoluteURL issues:problemManager];
-			success = (nil != document);
-		}
-		else if ([typeName isEqualToString:@"de.berlios.drydock.document"] || [typeName isEqualToString:@"Dry Dock Document"])
-		{
-			document = [[DDModelDocument alloc] initWithDryDockDocument:absoluteURL issues:problemManager];
-			success = (nil != document);
-		}
-		else
-		{
-			[problemManager addStopIssueWithKey:@"unknownFormat" localizedFormat:@"The document could not be opened, because the file type could not be recognised."];
-		}
-		if (nil != document)
-		{
-			[_document autorelease];
-			_document = document;
-			success = YES;
-		}
-		else success = NO;
-	}
-	@catch (id localException)
+	loader = [[DDDocumentLoader alloc] initWithURL:absoluteURL type:typeName];
+	if (nil == loader)
 	{
-		LogMessage(@"Caught %@", localException);
-		
-		NSString			*desc;
-		
-		if ([localException isKindOfClass:[NSException class]])
-		{
-			desc = [NSString stringWithFormat:@"%@: %@", [localException name], [localException reason]];
-		}
-		else
-		{
-			desc = [localException description];
-		}
-		
-		success = NO;
-		[problemManager addStopIssueWithKey:@"exception" localizedFormat:@"An uncaught exception occurred. This is almost certainly a programming error; please report it.\n%@", desc];
+		if (NULL != outError) *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadUnknownError userInfo:nil];
+		return NO;
 	}
 	
-	success = [problemManager showReportApplicationModal];
-	if (!success && NULL != outError) *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+	/*	Loading continues in -documentLoaderDidLoadGeometry: and
+		-documentLoaderDidFinish:. Problems are reported when parsing
+		completes; if they stop the document from opening, it is closed then.
+	*/
+	[self cancelLoading];
+	_loader = loader;
+	[_loader setDelegate:self];
+	[[DDMeshOperation sharedQueue] addOperation:_loader];
 	
-	[problemManager release];
+	return YES;
+	TraceExit();
+}
+
+
+- (void)documentLoaderDidLoadGeometry:(DDDocumentLoader *)inLoader
+{
+	TraceEnter();
 	
-	if (success)
+	DDProblemReportManager	*issues;
+	
+	if (inLoader != _loader)  return;
+	
+	issues = [inLoader issues];
+	if (nil == [inLoader modelDocument])
 	{
-		TraceMessage(@"Document successfully loaded.");
-		[_windowController setModelDocument:document];
+		[issues showReportApplicationModal];
+		[self close];
+		return;
 	}
 	
-    return success;
+	TraceMessage(@"Document geometry loaded.");
+	[_document autorelease];
+	_document = [[inLoader modelDocument] retain];
+	[_windowController setModelDocument:_document];
+	
+	[issues runReportModalForWindow:[self windowForSheet] modalDelegate:self isDoneSelector:@selector(problemReport:doneWithResult:)];
+	
 	TraceExit();
 }
 
 
+- (void)problemReport:(DDProblemReportManager *)inManager doneWithResult:(BOOL)inResult
+{
+	if (!inResult)  [self close];
+}
+
+
+- (void)documentLoaderDidFinish:(DDDocumentLoader *)inLoader
+{
+	if (inLoader != _loader)  return;
+	
+	[_windowController setLoading:NO];
+	[_loader setDelegate:nil];
+	Release(_loader);
+	
+	// Only missing or damaged textures are reported here, so the user has no choice to make.
+	[[inLoader textureIssues] runReportModalForWindow:[self windowForSheet] modalDelegate:nil isDoneSelector:NULL];
+}
+
+
+- (void)cancelLoading
+{
+	if (_loader == nil)  return;
+	
+	[_windowController setLoading:NO];
+	[_loader setDelegate:nil];
+	[_loader cancel];
+	Release(_loader);
+}
+
+
+- (BOOL)isLoading
+{
+	return _loader != nil;
+}
+
+
 - (BOOL)writeSafelyToURL:(NSURL *)absoluteURL ofType:(NSString *)typeName forSaveOperation:(NSSaveOperationType)saveOperation error:(NSError **)outError
 {
 	TraceEnterMsg(@"Called with absoluteURL=%@",
@@ -206,12 +255,12 @@
 		}
 		else if ([typeName isEqualToString:@"de.berlios.drydock.document"] || [typeName isEqualToString:@"Oolite Model"])
 		{
-			[[_document rootMesh] gatherIssues:problemManager withWritingOoliteDATToURL:absoluteURL];
+			[_document gatherIssues:problemManager withWritingOoliteDATToURL:absoluteURL];
 			OK = [problemManager showReportApplicationModal];
 			if (OK)
 			{
 				[problemManager clear];
-				OK = [[_document rootMesh] writeOoliteDATToURL:absoluteURL issues:problemManager];
+				OK = [_document writeOoliteDATToURL:absoluteURL issues:problemManager];
 				[problemManager showReportApplicationModal];
 			}
 			if (!OK)
@@ -219,6 +268,15 @@
 				if (NULL != outError) *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
 			}
 		}
+		else if ([typeName isEqualToString:@"de.berlios.drydock.binary-mesh"] || [typeName isEqualToString:@"Dry Dock Binary Mesh"])
+		{
+			OK = [_document writeBinaryMeshToURL:absoluteURL issues:problemManager];
+			[problemManager showReportApplicationModal];
+			if (!OK)
+			{
+				if (NULL != outError) *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSUserCancelledError userInfo:nil];
+			}
+		}
 		else if ([typeName isEqualToString:@"com.newtek.lightwave.obj"] || [typeName isEqualToString:@"WaveFront OBJ Model"])
 		{
 			[[_document rootMesh] gatherIssues:problemManager withWritingWaveFrontOBJToURL:absoluteURL];
@@ -278,6 +336,10 @@
 	{
 		type = 'DryD';
 	}
+	else if ([typeName isEqual:@"Dry Dock Binary Mesh"])
+	{
+		type = 'DryM';
+	}
 	else if ([typeName isEqual:@"Oolite Model"])
 	{
 		type = 'OoDa';
@@ -397,15 +459,15 @@
 
 - (void)sendMeshMessage:(SEL)inMessage undoableWithName:(NSString *)inName
 {
-	DDMesh					*newMesh;
+	DDMesh					*mesh;
+	NSInvocation			*invocation;
 	
-	newMesh = [[_document rootMesh] copy];
-	if (newMesh)
-	{
-		[self setUpMeshReplacingUndoActionNamed:inName];
-		[_document setRootMesh:newMesh];
-		[newMesh performSelector:inMessage];
-	}
+	mesh = [_document rootMesh];
+	if (mesh == nil)  return;
+	
+	invocation = [NSInvocation invocationWithMethodSignature:[mesh methodSignatureForSelector:inMessage]];
+	[invocation setSelector:inMessage];
+	[self runMeshOperationWithName:inName invocation:invocation];
 }
 
 
@@ -455,29 +517,26 @@
 
 - (void)scaleX:(float)inX y:(float)inY z:(float)inZ
 {
-	DDMesh					*newMesh;
-	
-	newMesh = [[_document rootMesh] copy];
-	if (nil != newMesh)
-	{
-		[self setUpMeshReplacingUndoActionNamed:@"Scale"];
-		[newMesh scaleX:inX y:inY z:inZ];
-		[_document setRootMesh:newMesh];
-	}
+	DDMesh					*mesh;
+	NSInvocation			*invocation;
+	SEL						selector = @selector(scaleX:y:z:);
+	Scalar					x = inX, y = inY, z = inZ;
+	
+	mesh = [_document rootMesh];
+	if (mesh == nil)  return;
+	
+	invocation = [NSInvocation invocationWithMethodSignature:[mesh methodSignatureForSelector:selector]];
+	[invocation setSelector:selector];
+	[invocation setArgument:&x atIndex:2];
+	[invocation setArgument:&y atIndex:3];
+	[invocation setArgument:&z atIndex:4];
+	[self runMeshOperationWithName:@"Scale" invocation:invocation];
 }
 
 
 - (IBAction)coalesceVertices:sender
 {
-	DDMesh					*newMesh;
-	
-	newMesh = [[_document rootMesh] copy];
-	if (nil != newMesh)
-	{
-		[self setUpMeshReplacingUndoActionNamed:@"Coalesce Vertices"];
-		[newMesh coalesceVertices];
-		[_document setRootMesh:newMesh];
-	}
+	[self sendMeshMessage:@selector(coalesceVertices) undoableWithName:@"Coalesce Vertices"];
 }
 
 
@@ -504,12 +563,29 @@
 		{
 			enabled = [[_document rootMesh] hasNonTriangles];
 		}
+		
+		if ((_meshOperation != nil || _loader != nil) && [self isMeshAction:action])  enabled = NO;
+		if (_loader != nil && (action == @selector(saveDocument:) || action == @selector(saveDocumentAs:) || action == @selector(saveDocumentTo:)))  enabled = NO;
 	}
 	
 	return enabled;
 }
 
 
+- (BOOL)isMeshAction:(SEL)inAction
+{
+	return inAction == @selector(recalcNormals:) ||
+		   inAction == @selector(triangulate:) ||
+		   inAction == @selector(flipX:) ||
+		   inAction == @selector(flipY:) ||
+		   inAction == @selector(flipZ:) ||
+		   inAction == @selector(reverseWinding:) ||
+		   inAction == @selector(coalesceVertices:) ||
+		   inAction == @selector(doScaleDialog:) ||
+		   inAction == @selector(doRecenterDialog:);
+}
+
+
 - (void)completeAsynchronousMeshReplacingActionWithName:(NSString *)inName mesh:(DDMesh *)inMesh
 {
 	[self setUpMeshReplacingUndoActionNamed:inName];
@@ -517,6 +593,129 @@
 }
 
 
+- (void)runMeshOperation:(DDMeshOperation *)inOperation
+{
+	if (inOperation == nil || _meshOperation != nil)
+	{
+		NSBeep();
+		return;
+	}
+	
+	_meshOperation = [inOperation retain];
+	[_meshOperation setDelegate:self];
+	[[DDMeshOperation sharedQueue] addOperation:_meshOperation];
+	
+	// Don't flash a sheet up for quick operations.
+	[self performSelector:@selector(showProgressSheet) withObject:nil afterDelay:0.4];
+}
+
+
+- (void)runMeshOperationWithName:(NSString *)inName invocation:(NSInvocation *)inInvocation
+{
+	DDMesh					*copy;
+	
+	// The copy is made here so that the worker thread never touches the live mesh.
+	copy = [[[_document rootMesh] copy] autorelease];
+	[self runMeshOperation:[[[DDMeshOperation alloc] initWithName:inName mesh:copy invocation:inInvocation] autorelease]];
+}
+
+
+- (IBAction)cancelMeshOperation:sender
+{
+	[_meshOperation cancel];
+}
+
+
+- (BOOL)isProcessingMesh
+{
+	return _meshOperation != nil;
+}
+
+
+- (void)meshOperationDidFinish:(DDMeshOperation *)inOperation
+{
+	if (inOperation != _meshOperation)  return;
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(showProgressSheet) object:nil];
+	[self hideProgressSheet];
+	
+	if (![inOperation isCancelled] && ![inOperation failed])
+	{
+		[self completeAsynchronousMeshReplacingActionWithName:[inOperation name] mesh:[inOperation mesh]];
+	}
+	else if ([inOperation failed])
+	{
+		NSBeep();
+	}
+	
+	[_meshOperation setDelegate:nil];
+	Release(_meshOperation);
+}
+
+
+- (void)showProgressSheet
+{
+	NSTextField				*label;
+	NSButton				*button;
+	NSView					*content;
+	
+	if (_meshOperation == nil || _progressSheet != nil)  return;
+	
+	_progressSheet = [[NSPanel alloc] initWithContentRect:NSMakeRect(0, 0, 360, 116) styleMask:NSTitledWindowMask backing:NSBackingStoreBuffered defer:YES];
+	content = [_progressSheet contentView];
+	
+	label = [[NSTextField alloc] initWithFrame:NSMakeRect(17, 80, 326, 17)];
+	[label setStringValue:[NSString stringWithFormat:@"%@%C", NSLocalizedString([_meshOperation name], NULL), (unichar)0x2026]];
+	[label setEditable:NO];
+	[label setSelectable:NO];
+	[label setBezeled:NO];
+	[label setDrawsBackground:NO];
+	[content addSubview:label];
+	[label release];
+	
+	_progressIndicator = [[NSProgressIndicator alloc] initWithFrame:NSMakeRect(20, 54, 320, 20)];
+	[_progressIndicator setStyle:NSProgressIndicatorBarStyle];
+	[_progressIndicator setIndeterminate:NO];
+	[_progressIndicator setMinValue:0.0];
+	[_progressIndicator setMaxValue:1.0];
+	[content addSubview:_progressIndicator];
+	
+	button = [[NSButton alloc] initWithFrame:NSMakeRect(256, 12, 90, 32)];
+	[button setBezelStyle:NSRoundedBezelStyle];
+	[button setTitle:NSLocalizedString(@"Cancel", NULL)];
+	[button setKeyEquivalent:@"\e"];
+	[button setTarget:self];
+	[button setAction:@selector(cancelMeshOperation:)];
+	[content addSubview:button];
+	[button release];
+	
+	[self updateProgress:nil];
+	[NSApp beginSheet:_progressSheet modalForWindow:[self windowForSheet] modalDelegate:nil didEndSelector:NULL contextInfo:NULL];
+	_progressTimer = [[NSTimer scheduledTimerWithTimeInterval:0.1 target:self selector:@selector(updateProgress:) userInfo:nil repeats:YES] retain];
+}
+
+
+- (void)hideProgressSheet
+{
+	[_progressTimer invalidate];
+	Release(_progressTimer);
+	
+	if (_progressSheet != nil)
+	{
+		[NSApp endSheet:_progressSheet];
+		[_progressSheet orderOut:nil];
+		Release(_progressSheet);
+	}
+	Release(_progressIndicator);
+}
+
+
+- (void)updateProgress:(NSTimer *)inTimer
+{
+	[_progressIndicator setDoubleValue:[_meshOperation progress]];
+}
+
+
 - (IBAction)doCompareDialog:sender
 {
 	[DDCompareDialogController runCompareDialogForDocument:self];
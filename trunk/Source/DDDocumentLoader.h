@@ -0,0 +1,74 @@
+/*
+	DDDocumentLoader.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Loads a model document on a worker thread. The geometry is handed over as
+		soon as it has been read, and textures are loaded afterwards.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#import <Foundation/Foundation.h>
+
+@class DDModelDocument, DDProblemReportManager;
+
+
+@interface DDDocumentLoader: NSOperation
+{
+	NSURL					*_url;
+	NSString				*_type;
+	id						_delegate;
+	DDModelDocument			*_modelDocument;
+	NSArray					*_materials;
+	DDProblemReportManager	*_issues;
+	DDProblemReportManager	*_textureIssues;
+}
+
+/*	Loaders are run on +[DDMeshOperation sharedQueue], so opening many
+	documents at once keeps every core busy.
+*/
+- (id)initWithURL:(NSURL *)inURL type:(NSString *)inType;
+
+@property (readonly) NSURL *URL;
+@property (readonly) NSString *type;
+
+// nil until the geometry has been loaded, or if loading failed.
+@property (readonly) DDModelDocument *modelDocument;
+
+// Problems found while parsing; complete when the geometry has been loaded.
+@property (readonly) DDProblemReportManager *issues;
+
+// Problems found while loading textures; complete when the loader finishes.
+@property (readonly) DDProblemReportManager *textureIssues;
+
+/*	The delegate receives these on the main thread. -documentLoaderDidLoadGeometry:
+	is sent first, even if loading failed, unless the loader was cancelled
+	before it started. Textures are installed one by one as they load, and
+	-documentLoaderDidFinish: is sent last, even if cancelled.
+*/
+@property (assign) id delegate;
+
+@end
+
+
+@interface NSObject (DDDocumentLoaderDelegate)
+
+- (void)documentLoaderDidLoadGeometry:(DDDocumentLoader *)inLoader;
+- (void)documentLoaderDidFinish:(DDDocumentLoader *)inLoader;
+
+@end
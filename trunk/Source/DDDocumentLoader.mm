@@ -0,0 +1,250 @@
+/*
+	DDDocumentLoader.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#define ENABLE_TRACE 0
+
+#import "DDDocumentLoader.h"
+#import "DDModelDocument.h"
+#import "DDMesh.h"
+#import "DDMaterial.h"
+#import "DDMeshOperation.h"
+#import "DDProblemReportManager.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+
+
+@interface DDDocumentLoader (Private)
+
+- (BOOL)loadGeometry;
+- (void)loadTextures;
+
+- (void)installTexture:(NSArray *)inMaterialAndTexture;
+- (void)notifyGeometryLoaded;
+- (void)notifyFinished;
+
+@end
+
+
+@implementation DDDocumentLoader
+
+- (id)initWithURL:(NSURL *)inURL type:(NSString *)inType
+{
+	if (inURL == nil || inType == nil)
+	{
+		[self release];
+		return nil;
+	}
+	
+	self = [super init];
+	if (self != nil)
+	{
+		_url = [inURL copy];
+		_type = [inType copy];
+		
+		_issues = [[DDProblemReportManager alloc] init];
+		[_issues setContext:kContextOpen];
+		_textureIssues = [[DDProblemReportManager alloc] init];
+		[_textureIssues setContext:kContextOpen];
+	}
+	return self;
+}
+
+
+- (void)dealloc
+{
+	Release(_url);
+	Release(_type);
+	Release(_modelDocument);
+	Release(_materials);
+	Release(_issues);
+	Release(_textureIssues);
+	
+	[super dealloc];
+}
+
+
+- (void)main
+{
+	NSAutoreleasePool		*pool;
+	BOOL					geometryLoaded;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	
+	if (![self isCancelled])
+	{
+		geometryLoaded = [self loadGeometry];
+		[self performSelectorOnMainThread:@selector(notifyGeometryLoaded) withObject:nil waitUntilDone:NO];
+		if (geometryLoaded)  [self loadTextures];
+	}
+	
+	// Not in modal modes, so that a texture report can't pile up on top of a parsing report.
+	[self performSelectorOnMainThread:@selector(notifyFinished) withObject:nil waitUntilDone:NO modes:[NSArray arrayWithObject:NSDefaultRunLoopMode]];
+	[pool release];
+}
+
+
+@synthesize URL = _url;
+@synthesize type = _type;
+@synthesize modelDocument = _modelDocument;
+@synthesize issues = _issues;
+@synthesize textureIssues = _textureIssues;
+@synthesize delegate = _delegate;
+
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %p>{%@%@}", [self className], self, [_url path], [self isCancelled] ? @", cancelled" : @""];
+}
+
+@end
+
+
+@implementation DDDocumentLoader (Private)
+
+- (BOOL)loadGeometry
+{
+	TraceEnterMsg(@"Called for %@ of type \"%@\".", _url, _type);
+	
+	DDModelDocument			*document = nil;
+	DDMesh					*mesh;
+	NSMutableArray			*materials;
+	DDMaterial				*material;
+	NSUInteger				i, count;
+	
+	// Textures are left for -loadTextures, so that the geometry can be shown sooner.
+	[DDMaterial setDefersTextureLoading:YES];
+	
+	@try
+	{
+		if ([_type isEqualToString:@"org.aegidian.oolite.mesh"] || [_type isEqualToString:@"Oolite Model"])
+		{
+			document = [[DDModelDocument alloc] initWithOoliteDAT:_url issues:_issues];
+		}
+		else if ([_type isEqualToString:@"com.newtek.lightwave.obj"] || [_type isEqualToString:@"WaveFront OBJ Model"])
+		{
+			document = [[DDModelDocument alloc] initWithWaveFrontOBJ:_url issues:_issues];
+		}
+		else if ([_type isEqualToString:@"de.berlios.drydock.document"] || [_type isEqualToString:@"Dry Dock Document"])
+		{
+			document = [[DDModelDocument alloc] initWithDryDockDocument:_url issues:_issues];
+		}
+		else if ([_type isEqualToString:@"de.berlios.drydock.binary-mesh"] || [_type isEqualToString:@"Dry Dock Binary Mesh"])
+		{
+			document = [[DDModelDocument alloc] initWithBinaryMesh:_url issues:_issues];
+		}
+		else
+		{
+			[_issues addStopIssueWithKey:@"unknownFormat" localizedFormat:@"The document could not be opened, because the file type could not be recognised."];
+		}
+	}
+	@catch (id localException)
+	{
+		LogMessage(@"Caught %@", localException);
+		
+		NSString			*desc;
+		
+		if ([localException isKindOfClass:[NSException class]])
+		{
+			desc = [NSString stringWithFormat:@"%@: %@", [localException name], [localException reason]];
+		}
+		else
+		{
+			desc = [localException description];
+		}
+		
+		[document release];
+		document = nil;
+		[_issues addStopIssueWithKey:@"exception" localizedFormat:@"An uncaught exception occurred. This is almost certainly a programming error; please report it.\n%@", desc];
+	}
+	
+	[DDMaterial setDefersTextureLoading:NO];
+	
+	if (document == nil)  return NO;
+	
+	/*	Take note of the materials still waiting for textures now, since the
+		main thread owns the document once it has been handed over.
+	*/
+	mesh = [document rootMesh];
+	count = [mesh materialCount];
+	materials = [NSMutableArray arrayWithCapacity:count];
+	for (i = 0; i != count; ++i)
+	{
+		material = [mesh materialAtIndex:i];
+		if ([material hasPendingDiffuseMap])  [materials addObject:material];
+	}
+	
+	_materials = [materials copy];
+	_modelDocument = document;
+	return YES;
+	TraceExit();
+}
+
+
+- (void)loadTextures
+{
+	NSEnumerator			*materialEnum;
+	DDMaterial				*material;
+	DDTextureBuffer			*texture;
+	NSAutoreleasePool		*pool;
+	
+	for (materialEnum = [_materials objectEnumerator]; (material = [materialEnum nextObject]); )
+	{
+		if ([self isCancelled])  break;
+		
+		pool = [[NSAutoreleasePool alloc] init];
+		
+		// -loadPendingDiffuseMapWithIssues: only reads state the main thread leaves alone until the texture is installed.
+		texture = [material loadPendingDiffuseMapWithIssues:_textureIssues];
+		[self performSelectorOnMainThread:@selector(installTexture:) withObject:[NSArray arrayWithObjects:material, texture, nil] waitUntilDone:NO];
+		
+		[pool release];
+	}
+}
+
+
+- (void)installTexture:(NSArray *)inMaterialAndTexture
+{
+	DDMaterial				*material;
+	DDTextureBuffer			*texture = nil;
+	
+	material = [inMaterialAndTexture objectAtIndex:0];
+	if ([inMaterialAndTexture count] > 1)  texture = [inMaterialAndTexture objectAtIndex:1];
+	
+	[material setPendingDiffuseTexture:texture];
+	
+	// Rebuild display lists so the texture shows up. Changes are coalesced, so this happens at most once per event.
+	if (_delegate != nil)  [[_modelDocument rootMesh] noteChanges:kDDMeshChangeMaterials];
+}
+
+
+- (void)notifyGeometryLoaded
+{
+	[_delegate documentLoaderDidLoadGeometry:self];
+}
+
+
+- (void)notifyFinished
+{
+	[_delegate documentLoaderDidFinish:self];
+}
+
+@end
@@ -24,8 +24,8 @@
 #import <Cocoa/Cocoa.h>
 
 @class DDPreviewView;
-@class SceneNode, DDMeshNode, SimpleTag;
-@class DDMesh, DDModelDocument;
+@class SceneNode, DDMeshNode, DDOctreeNode, SimpleTag;
+@class DDMesh, DDModelDocument, DDMeshOperation;
 @class DDDimensionFormatter;
 
 
@@ -49,16 +49,26 @@ enum
 	SimpleTag						*_showWireframeTag,
 									*_showFacesTag,
 									*_showNormalsTag,
-									*_showBBoxTag;
+									*_showBBoxTag,
+									*_showOctreeTag,
+									*_showOcclusionTag;
+	DDOctreeNode					*_octreeNode;
+	DDMeshOperation					*_octreeOperation;
+	DDMeshOperation					*_occlusionOperation;
 	
 	float							_objectRadius;
 	
+	// Shown over the GL view while the document is loading.
+	NSWindow						*_loadingIndicatorWindow;
+	
 	unsigned						_tool;
 	
 	BOOL							_showWireframe,
 									_showFaces,
 									_showNormals,
-									_showBBox;
+									_showBBox,
+									_showOctree,
+									_showOcclusion;
 }
 
 - (IBAction)nameAction:sender;
@@ -69,6 +79,7 @@ enum
 - (void)setNeedsDisplay;
 
 - (void)setModelDocument:(DDModelDocument *)inMesh;
+- (void)setLoading:(BOOL)inFlag;
 
 - (BOOL)showWireframe;
 - (void)setShowWireframe:(BOOL)inFlag;
@@ -78,6 +89,10 @@ enum
 - (void)setShowNormals:(BOOL)inFlag;
 - (BOOL)showBoundingBox;
 - (void)setShowBoundingBox:(BOOL)inFlag;
+- (BOOL)showCollisionOctree;
+- (void)setShowCollisionOctree:(BOOL)inFlag;
+- (BOOL)showAmbientOcclusion;
+- (void)setShowAmbientOcclusion:(BOOL)inFlag;
 
 - (unsigned)tool;
 - (void)setTool:(unsigned)inTool;
@@ -34,6 +34,10 @@
 #import "SimpleTag.h"
 #import "DDModelDocument.h"
 #import "DDDocumentInspector.h"
+#import "DDOctreeNode.h"
+#import "DDCollisionOctree.h"
+#import "DDUtilities.h"
+#import "DDMeshOperation.h"
 
 
 #define kMinPaneSize 200.0f
@@ -46,6 +50,17 @@ NSString		*kToolbarToggleNormals				= @"de.berlios.drydock toolbar toggleNormals
 NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 
 
+@interface DDDocumentWindowController (Private)
+
+- (void)updateOctreeNode;
+- (void)setOctreeNodeOctree:(DDCollisionOctree *)inOctree;
+- (void)cancelOctreeOperation;
+- (void)updateOcclusionTag;
+- (void)cancelOcclusionOperation;
+
+@end
+
+
 @implementation DDDocumentWindowController
 
 - (id)initWithWindow:(NSWindow *)window
@@ -65,6 +80,10 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 	TraceMessage(@"Deallocating controller.");
 	TraceIndent();
 	
+	[self setLoading:NO];
+	[self cancelOctreeOperation];
+	[self cancelOcclusionOperation];
+	
 	[[glView openGLContext] makeCurrentContext];
 	[_sceneRoot release];
 	[_modelDocument release];
@@ -156,10 +175,19 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 		_showFacesTag = [SimpleTag tagWithKey:@"shading" boolValue:_showFaces];
 		_showNormalsTag = [SimpleTag tagWithKey:@"normals" boolValue:_showNormals];
 		_showBBoxTag = [SimpleTag tagWithKey:@"bounding box" boolValue:_showBBox];
+		_showOctreeTag = [SimpleTag tagWithKey:@"collision octree" boolValue:_showOctree];
 		[_sceneRoot addTag:_showWireframeTag];
 		[_sceneRoot addTag:_showFacesTag];
 		[_sceneRoot addTag:_showNormalsTag];
 		[_sceneRoot addTag:_showBBoxTag];
+		[_sceneRoot addTag:_showOctreeTag];
+		
+		// Carries the document's occlusion data itself, since DDMeshNode has no document to ask.
+		_showOcclusionTag = [SimpleTag tagWithKey:@"ambient occlusion" value:nil];
+		[_sceneRoot addTag:_showOcclusionTag];
+		
+		if (_showOctree) [self updateOctreeNode];
+		if (_showOcclusion) [self updateOcclusionTag];
 	}
 	
 	return [[_sceneRoot retain] autorelease];
@@ -175,6 +203,136 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 	_showFacesTag = nil;
 	_showNormalsTag = nil;
 	_showBBoxTag = nil;
+	_showOctreeTag = nil;
+	_showOcclusionTag = nil;
+	_octreeNode = nil;
+}
+
+
+/*	The octree is only built once it's first asked for, and since that can
+	take a while at high depths it is built in the background; the node is
+	updated when it finishes. Any build already running is for a mesh that has
+	since changed, so it is replaced.
+*/
+- (void)updateOctreeNode
+{
+	DDCollisionOctree		*octree;
+	
+	if (nil == _sceneRoot) return;
+	
+	[self cancelOctreeOperation];
+	
+	octree = [_modelDocument cachedCollisionOctree];
+	if (nil == octree)
+	{
+		_octreeOperation = [[_modelDocument collisionOctreeOperation] retain];
+		[_octreeOperation setDelegate:self];
+		if (nil != _octreeOperation)  [[DDMeshOperation sharedQueue] addOperation:_octreeOperation];
+	}
+	
+	[self setOctreeNodeOctree:octree];
+}
+
+
+- (void)setOctreeNodeOctree:(DDCollisionOctree *)inOctree
+{
+	if (nil == _sceneRoot) return;
+	
+	if (nil == _octreeNode)
+	{
+		_octreeNode = [DDOctreeNode nodeWithOctree:inOctree];
+		[_sceneRoot addChild:_octreeNode];
+	}
+	else
+	{
+		[_octreeNode setOctree:inOctree];
+	}
+}
+
+
+- (void)cancelOctreeOperation
+{
+	[_octreeOperation setDelegate:nil];
+	[_octreeOperation cancel];
+	Release(_octreeOperation);
+}
+
+
+- (void)collisionOctreeChanged:notification
+{
+	if (_showOctree) [self updateOctreeNode];
+	else
+	{
+		[self cancelOctreeOperation];
+		[_octreeNode setOctree:nil];
+	}
+}
+
+
+// Occlusion is baked in the background in the same way as the octree.
+- (void)updateOcclusionTag
+{
+	NSData					*occlusion = nil;
+	
+	[self cancelOcclusionOperation];
+	
+	if (_showOcclusion)
+	{
+		occlusion = [_modelDocument cachedVertexOcclusion];
+		if (nil == occlusion)
+		{
+			_occlusionOperation = [[_modelDocument vertexOcclusionOperation] retain];
+			[_occlusionOperation setDelegate:self];
+			if (nil != _occlusionOperation)  [[DDMeshOperation sharedQueue] addOperation:_occlusionOperation];
+		}
+	}
+	
+	[_showOcclusionTag setValue:occlusion];
+}
+
+
+- (void)cancelOcclusionOperation
+{
+	[_occlusionOperation setDelegate:nil];
+	[_occlusionOperation cancel];
+	Release(_occlusionOperation);
+}
+
+
+- (void)meshOperationDidFinish:(DDMeshOperation *)inOperation
+{
+	BOOL					succeeded;
+	
+	succeeded = ![inOperation isCancelled] && ![inOperation failed];
+	
+	if (inOperation == _octreeOperation)
+	{
+		if (succeeded)
+		{
+			[_modelDocument adoptCollisionOctree:[inOperation result]];
+			[self setOctreeNodeOctree:[_modelDocument cachedCollisionOctree]];
+		}
+		
+		[_octreeOperation setDelegate:nil];
+		Release(_octreeOperation);
+	}
+	else if (inOperation == _occlusionOperation)
+	{
+		if (succeeded)
+		{
+			[_modelDocument adoptVertexOcclusion:[inOperation result]];
+			[_showOcclusionTag setValue:[_modelDocument cachedVertexOcclusion]];
+		}
+		
+		[_occlusionOperation setDelegate:nil];
+		Release(_occlusionOperation);
+	}
+}
+
+
+- (void)vertexOcclusionChanged:notification
+{
+	[self updateOcclusionTag];
 }
 
 
@@ -200,14 +358,19 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 	{
 		notificationCenter = [NSNotificationCenter defaultCenter];
 		[notificationCenter removeObserver:self name:nil object:_modelDocument];
+		[self cancelOctreeOperation];
+		[self cancelOcclusionOperation];
 		
 		[_modelDocument release];
 		_modelDocument = [inDocument retain];
 		
 		[notificationCenter addObserver:self selector:@selector(documentRootMeshChanged:) name:kNotificationDDModelDocumentRootMeshChanged object:_modelDocument];
+		[notificationCenter addObserver:self selector:@selector(collisionOctreeChanged:) name:kNotificationDDModelDocumentCollisionOctreeChanged object:_modelDocument];
+		[notificationCenter addObserver:self selector:@selector(vertexOcclusionChanged:) name:kNotificationDDModelDocumentVertexOcclusionChanged object:_modelDocument];
 		
 		_objectRadius = _modelDocument.rootMesh.boundingRadius;
 		if (_objectRadius < 1.0) _objectRadius = 1.0;
+		[glView setObjectSize:_objectRadius];
 		
 		[self invalidateSceneGraph];
 		[self setNeedsDisplay];
@@ -217,6 +380,50 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 }
 
 
+- (void)setLoading:(BOOL)inFlag
+{
+	NSProgressIndicator		*spinner;
+	NSRect					frame;
+	
+	if (inFlag == (_loadingIndicatorWindow != nil))  return;
+	
+	if (inFlag)
+	{
+		if (![[self window] isVisible])  return;
+		
+		/*	Subviews don't draw reliably over an NSOpenGLView, so the spinner
+			goes in a transparent child window centred over it.
+		*/
+		frame = [glView convertRect:[glView bounds] toView:nil];
+		frame.origin = [[self window] convertBaseToScreen:frame.origin];
+		frame = NSMakeRect(NSMidX(frame) - 16.0f, NSMidY(frame) - 16.0f, 32.0f, 32.0f);
+		
+		_loadingIndicatorWindow = [[NSWindow alloc] initWithContentRect:frame styleMask:NSBorderlessWindowMask backing:NSBackingStoreBuffered defer:NO];
+		[_loadingIndicatorWindow setOpaque:NO];
+		[_loadingIndicatorWindow setBackgroundColor:[NSColor clearColor]];
+		[_loadingIndicatorWindow setIgnoresMouseEvents:YES];
+		[_loadingIndicatorWindow setReleasedWhenClosed:NO];
+		
+		spinner = [[NSProgressIndicator alloc] initWithFrame:NSMakeRect(0.0f, 0.0f, 32.0f, 32.0f)];
+		[spinner setStyle:NSProgressIndicatorSpinningStyle];
+		[spinner setIndeterminate:YES];
+		[spinner setDisplayedWhenStopped:NO];
+		[_loadingIndicatorWindow setContentView:spinner];
+		[spinner startAnimation:nil];
+		[spinner release];
+		
+		[[self window] addChildWindow:_loadingIndicatorWindow ordered:NSWindowAbove];
+	}
+	else
+	{
+		[(NSProgressIndicator *)[_loadingIndicatorWindow contentView] stopAnimation:nil];
+		[[self window] removeChildWindow:_loadingIndicatorWindow];
+		[_loadingIndicatorWindow orderOut:nil];
+		Release(_loadingIndicatorWindow);
+	}
+}
+
+
 - (BOOL)showWireframe
 {
 	return _showWireframe;
@@ -285,6 +492,41 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 }
 
 
+- (BOOL)showCollisionOctree
+{
+	return _showOctree;
+}
+
+
+- (void)setShowCollisionOctree:(BOOL)inFlag
+{
+	if (inFlag != _showOctree)
+	{
+		_showOctree = inFlag;
+		if (_showOctree) [self updateOctreeNode];
+		[_showOctreeTag setBoolValue:inFlag];
+		[[[self window] toolbar] validateVisibleItems];
+	}
+}
+
+
+- (BOOL)showAmbientOcclusion
+{
+	return _showOcclusion;
+}
+
+
+- (void)setShowAmbientOcclusion:(BOOL)inFlag
+{
+	if (inFlag != _showOcclusion)
+	{
+		_showOcclusion = inFlag;
+		[self updateOcclusionTag];
+		[[[self window] toolbar] validateVisibleItems];
+	}
+}
+
+
 - (IBAction)toggleWireframe:sender
 {
 	[self setShowWireframe:!_showWireframe];
@@ -321,6 +563,18 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 }
 
 
+- (IBAction)toggleCollisionOctree:sender
+{
+	[self setShowCollisionOctree:!_showOctree];
+}
+
+
+- (IBAction)toggleAmbientOcclusion:sender
+{
+	[self setShowAmbientOcclusion:!_showOcclusion];
+}
+
+
 - (void)documentRootMeshChanged:notification
 {
 	[self invalidateSceneGraph];
@@ -357,6 +611,14 @@ NSString		*kToolbarCompare					= @"de.berlios.drydock toolbar compare";
 		{
 			[item setState:[self showBoundingBox]];
 		}
+		else if (action == @selector(toggleCollisionOctree:))
+		{
+			[item setState:[self showCollisionOctree]];
+		}
+		else if (action == @selector(toggleAmbientOcclusion:))
+		{
+			[item setState:[self showAmbientOcclusion]];
+		}
 	}
 	
 	return enabled;
@@ -0,0 +1,41 @@
+/*
+	DDImageFile.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Writing of generated images, such as baked maps, independent of AppKit so
+	that ddoolite can use it too.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class DDProblemReportManager;
+
+
+/*	Write 8-bit RGBX pixels (the fourth byte is ignored), top row first, as a
+	PNG file. inPixels must hold 4 * inWidth * inHeight bytes.
+*/
+BOOL DDWritePNGToURL(NSURL *inURL, NSData *inPixels, unsigned inWidth, unsigned inHeight, DDProblemReportManager *ioIssues);
+
+
+/*	Read an image file in any format ImageIO understands, as 8-bit RGBX pixels
+	in the same layout. Returns nil and reports an issue on failure.
+*/
+NSData *DDReadImageFromURL(NSURL *inURL, unsigned *outWidth, unsigned *outHeight, DDProblemReportManager *ioIssues);
@@ -0,0 +1,120 @@
+/*
+	DDImageFile.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDImageFile.h"
+#import "DDProblemReportManager.h"
+#import "CocoaExtensions.h"
+#import <ApplicationServices/ApplicationServices.h>
+
+
+BOOL DDWritePNGToURL(NSURL *inURL, NSData *inPixels, unsigned inWidth, unsigned inHeight, DDProblemReportManager *ioIssues)
+{
+	BOOL					OK = YES;
+	CGDataProviderRef		provider = NULL;
+	CGColorSpaceRef			colorSpace = NULL;
+	CGImageRef				image = NULL;
+	CGImageDestinationRef	destination = NULL;
+	
+	if ([inPixels length] < (NSUInteger)inWidth * inHeight * 4 || inWidth == 0 || inHeight == 0)  OK = NO;
+	
+	if (OK)
+	{
+		provider = CGDataProviderCreateWithCFData((CFDataRef)inPixels);
+		// Device RGB, so maps that aren't colours (such as normal maps) aren't colour matched.
+		colorSpace = CGColorSpaceCreateDeviceRGB();
+		if (provider != NULL && colorSpace != NULL)
+		{
+			image = CGImageCreate(inWidth, inHeight, 8, 32, inWidth * 4, colorSpace, kCGImageAlphaNoneSkipLast, provider, NULL, false, kCGRenderingIntentDefault);
+		}
+		OK = (image != NULL);
+	}
+	
+	if (OK)
+	{
+		destination = CGImageDestinationCreateWithURL((CFURLRef)inURL, CFSTR("public.png"), 1, NULL);
+		OK = (destination != NULL);
+	}
+	if (OK)
+	{
+		CGImageDestinationAddImage(destination, image, NULL);
+		OK = CGImageDestinationFinalize(destination);
+	}
+	
+	if (!OK)  [ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The image %@ could not be written.", [inURL displayString]];
+	
+	if (destination != NULL)  CFRelease(destination);
+	if (image != NULL)  CGImageRelease(image);
+	if (colorSpace != NULL)  CGColorSpaceRelease(colorSpace);
+	if (provider != NULL)  CGDataProviderRelease(provider);
+	
+	return OK;
+}
+
+
+NSData *DDReadImageFromURL(NSURL *inURL, unsigned *outWidth, unsigned *outHeight, DDProblemReportManager *ioIssues)
+{
+	BOOL					OK = YES;
+	CGImageSourceRef		source = NULL;
+	CGImageRef				image = NULL;
+	CGColorSpaceRef			colorSpace = NULL;
+	CGContextRef			context = NULL;
+	NSMutableData			*pixels = nil;
+	size_t					width = 0, height = 0;
+	
+	source = CGImageSourceCreateWithURL((CFURLRef)inURL, NULL);
+	if (source != NULL)  image = CGImageSourceCreateImageAtIndex(source, 0, NULL);
+	OK = (image != NULL);
+	
+	if (OK)
+	{
+		width = CGImageGetWidth(image);
+		height = CGImageGetHeight(image);
+		pixels = [NSMutableData dataWithLength:width * height * 4];
+		colorSpace = CGColorSpaceCreateDeviceRGB();
+		if (pixels != nil && colorSpace != NULL && width != 0 && height != 0)
+		{
+			context = CGBitmapContextCreate([pixels mutableBytes], width, height, 8, width * 4, colorSpace, kCGImageAlphaNoneSkipLast);
+		}
+		OK = (context != NULL);
+	}
+	
+	if (OK)
+	{
+		// Bitmap contexts are stored top row first, matching DDWritePNGToURL().
+		CGContextDrawImage(context, CGRectMake(0, 0, width, height), image);
+		if (outWidth != NULL)  *outWidth = width;
+		if (outHeight != NULL)  *outHeight = height;
+	}
+	else
+	{
+		[ioIssues addStopIssueWithKey:@"noDataLoaded" localizedFormat:@"The image %@ could not be read.", [inURL displayString]];
+		pixels = nil;
+	}
+	
+	if (context != NULL)  CGContextRelease(context);
+	if (colorSpace != NULL)  CGColorSpaceRelease(colorSpace);
+	if (image != NULL)  CGImageRelease(image);
+	if (source != NULL)  CFRelease(source);
+	
+	return pixels;
+}
@@ -0,0 +1,320 @@
+/*
+	DDLZCompression.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDLZCompression.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+
+/*	Block format (the LZ4 block format): a series of sequences, each a token
+	byte whose high nibble is a literal count and low nibble a match length
+	less kMinMatch, optional length extension bytes for the literal count,
+	the literals, a two-byte little-endian match offset, and optional length
+	extension bytes for the match. A nibble of 15 is followed by extension
+	bytes, which are added to it up to and including the first byte that
+	isn't 255. The last sequence has literals only, and ends the block.
+*/
+enum
+{
+	kMinMatch				= 4,
+	kLastLiterals			= 5,	// Matches stop this far from the end of the block...
+	kMatchStartMargin		= 12,	// ...and can't start closer to it than this.
+	kMaxOffset				= 0xFFFF,
+	
+	kHashBits				= 16,
+	kHashSize				= 1 << kHashBits,
+	kChainSize				= kMaxOffset + 1,
+	kChainMask				= kChainSize - 1,
+	
+	kRunMask				= 15
+};
+
+
+typedef struct
+{
+	uint32_t				head[kHashSize];	// Position + 1 of most recent occurrence of each hash; 0 for none.
+	uint16_t				chain[kChainSize];	// Distance to previous position with same hash; 0 for none.
+} MatchFinder;
+
+
+static inline uint32_t Read32(const uint8_t *p)
+{
+	uint32_t				result;
+	memcpy(&result, p, sizeof result);
+	return result;
+}
+
+
+static inline uint32_t Hash(const uint8_t *p)
+{
+	return (Read32(p) * 2654435761U) >> (32 - kHashBits);
+}
+
+
+static inline void Insert(MatchFinder *finder, const uint8_t *base, size_t pos)
+{
+	uint32_t				h = Hash(base + pos);
+	uint32_t				prev = finder->head[h];
+	size_t					delta = 0;
+	
+	if (0 != prev)
+	{
+		delta = pos - (prev - 1);
+		if (kMaxOffset < delta) delta = 0;
+	}
+	finder->chain[pos & kChainMask] = delta;
+	finder->head[h] = pos + 1;
+}
+
+
+static inline size_t MatchLength(const uint8_t *a, const uint8_t *b, const uint8_t *limit)
+{
+	const uint8_t			*start = b;
+	uint64_t				x, y, diff;
+	
+	// Compare eight bytes at a time; the first differing byte is found from the lowest (or on PPC, highest) set bit.
+	while (8 <= limit - b)
+	{
+		memcpy(&x, a, sizeof x);
+		memcpy(&y, b, sizeof y);
+		diff = x ^ y;
+		if (0 != diff)
+		{
+#if __BIG_ENDIAN__
+			return b - start + (__builtin_clzll(diff) >> 3);
+#else
+			return b - start + (__builtin_ctzll(diff) >> 3);
+#endif
+		}
+		a += 8;
+		b += 8;
+	}
+	
+	while (b < limit && *a == *b)
+	{
+		a++;
+		b++;
+	}
+	return b - start;
+}
+
+
+// Find the longest match for pos among up to inAttempts earlier positions with the same hash.
+static size_t FindMatch(const MatchFinder *finder, const uint8_t *base, size_t pos, const uint8_t *limit, unsigned inAttempts, size_t *outOffset)
+{
+	uint32_t				candidate = finder->head[Hash(base + pos)];
+	uint32_t				next = Read32(base + pos);
+	size_t					bestLength = 0, length, matchPos, delta;
+	
+	while (0 != candidate && inAttempts--)
+	{
+		matchPos = candidate - 1;
+		if (kMaxOffset < pos - matchPos) break;
+		
+		if (Read32(base + matchPos) == next)
+		{
+			length = kMinMatch + MatchLength(base + matchPos + kMinMatch, base + pos + kMinMatch, limit);
+			if (bestLength < length)
+			{
+				bestLength = length;
+				*outOffset = pos - matchPos;
+			}
+		}
+		
+		delta = finder->chain[matchPos & kChainMask];
+		if (0 == delta || matchPos < delta) break;
+		candidate = matchPos - delta + 1;
+	}
+	
+	return bestLength;
+}
+
+
+static inline uint8_t *WriteLength(uint8_t *op, size_t inLength)
+{
+	while (255 <= inLength)
+	{
+		*op++ = 255;
+		inLength -= 255;
+	}
+	*op++ = inLength;
+	return op;
+}
+
+
+// Write one sequence. inMatchLength is 0 for the final, literal-only sequence. Returns NULL if out of space.
+static uint8_t *EmitSequence(uint8_t *op, const uint8_t *oend, const uint8_t *inLiterals, size_t inLiteralCount, size_t inOffset, size_t inMatchLength)
+{
+	uint8_t					*token = op;
+	size_t					matchCode = (0 != inMatchLength) ? inMatchLength - kMinMatch : 0;
+	
+	if ((size_t)(oend - op) < 1 + inLiteralCount / 255 + 1 + inLiteralCount + 2 + matchCode / 255 + 1) return NULL;
+	op++;
+	
+	*token = (uint8_t)(((inLiteralCount < kRunMask) ? inLiteralCount : (size_t)kRunMask) << 4);
+	if (kRunMask <= inLiteralCount) op = WriteLength(op, inLiteralCount - kRunMask);
+	if (0 != inLiteralCount) memcpy(op, inLiterals, inLiteralCount);
+	op += inLiteralCount;
+	
+	if (0 != inMatchLength)
+	{
+		*op++ = inOffset & 0xFF;
+		*op++ = inOffset >> 8;
+		*token |= (uint8_t)((matchCode < kRunMask) ? matchCode : (size_t)kRunMask);
+		if (kRunMask <= matchCode) op = WriteLength(op, matchCode - kRunMask);
+	}
+	
+	return op;
+}
+
+
+size_t DDLZCompressBound(size_t inSize)
+{
+	return inSize + inSize / 255 + 16;
+}
+
+
+size_t DDLZCompress(const void *inSrc, size_t inSize, void *outDst, size_t inCapacity, int inLevel)
+{
+	const uint8_t			*base = (const uint8_t *)inSrc;
+	uint8_t					*op = (uint8_t *)outDst;
+	const uint8_t			*oend = op + inCapacity;
+	const uint8_t			*matchLimit = NULL;
+	MatchFinder				*finder = NULL;
+	size_t					pos = 0, anchor = 0, length, offset = 0, end, misses = 0;
+	unsigned				attempts;
+	
+	if (inLevel < kDDLZMinLevel) inLevel = kDDLZMinLevel;
+	if (kDDLZMaxLevel < inLevel) inLevel = kDDLZMaxLevel;
+	attempts = 1U << (inLevel - 1);
+	
+	if (kMatchStartMargin < inSize)
+	{
+		finder = (MatchFinder *)calloc(1, sizeof *finder);
+		if (NULL == finder) return 0;
+		
+		matchLimit = base + inSize - kLastLiterals;
+		end = inSize - kMatchStartMargin;
+		while (pos < end)
+		{
+			length = FindMatch(finder, base, pos, matchLimit, attempts, &offset);
+			Insert(finder, base, pos);
+			
+			if (0 == length)
+			{
+				// Step faster through data that isn't compressing, as LZ4 does.
+				pos += 1 + (++misses >> 6);
+				continue;
+			}
+			
+			op = EmitSequence(op, oend, base + anchor, pos - anchor, offset, length);
+			if (NULL == op) break;
+			
+			// Positions inside the match are only worth indexing when searching deeper.
+			if (kDDLZMinLevel != inLevel)
+			{
+				size_t stop = pos + length;
+				if (end < stop) stop = end;
+				for (size_t i = pos + 1; i < stop; i++) Insert(finder, base, i);
+			}
+			pos = anchor = pos + length;
+			misses = 0;
+		}
+		
+		free(finder);
+		if (NULL == op) return 0;
+	}
+	
+	op = EmitSequence(op, oend, base + anchor, inSize - anchor, 0, 0);
+	if (NULL == op) return 0;
+	return op - (uint8_t *)outDst;
+}
+
+
+static inline bool ReadLength(const uint8_t **ioIP, const uint8_t *iend, size_t *ioLength)
+{
+	const uint8_t			*ip = *ioIP;
+	unsigned				b;
+	
+	do
+	{
+		if (ip == iend) return false;
+		b = *ip++;
+		*ioLength += b;
+	}  while (255 == b);
+	
+	*ioIP = ip;
+	return true;
+}
+
+
+bool DDLZDecompress(const void *inSrc, size_t inSrcSize, void *outDst, size_t inDstSize)
+{
+	const uint8_t			*ip = (const uint8_t *)inSrc;
+	const uint8_t			*iend = ip + inSrcSize;
+	uint8_t					*op = (uint8_t *)outDst;
+	uint8_t					*ostart = op;
+	uint8_t					*oend = op + inDstSize;
+	unsigned				token;
+	size_t					length, offset;
+	
+	for (;;)
+	{
+		if (ip == iend) return false;
+		token = *ip++;
+		
+		length = token >> 4;
+		if (kRunMask == length && !ReadLength(&ip, iend, &length)) return false;
+		if ((size_t)(iend - ip) < length || (size_t)(oend - op) < length) return false;
+		memcpy(op, ip, length);
+		ip += length;
+		op += length;
+		
+		if (ip == iend) break;	// Last sequence.
+		
+		if (iend - ip < 2) return false;
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (0 == offset || (size_t)(op - ostart) < offset) return false;
+		
+		length = token & kRunMask;
+		if (kRunMask == length && !ReadLength(&ip, iend, &length)) return false;
+		length += kMinMatch;
+		if ((size_t)(oend - op) < length) return false;
+		
+		const uint8_t *match = op - offset;
+		if (length <= offset)
+		{
+			memcpy(op, match, length);
+			op += length;
+		}
+		else
+		{
+			// Overlapping match, i.e. a repeating pattern; must be copied forwards byte by byte.
+			for (uint8_t *mend = op + length; op < mend; ) *op++ = *match++;
+		}
+	}
+	
+	return op == oend;
+}
@@ -0,0 +1,68 @@
+/*
+	DDLZCompression.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Small, fast LZ77 block codec in the style of LZ4, used for Dry Dock
+	documents. Much faster than deflate in both directions, at some cost in
+	compression ratio. Each call compresses a self-contained block; there is no
+	stream state.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDLZCOMPRESSION_h
+#define INCLUDED_DDLZCOMPRESSION_h
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+enum
+{
+	kDDLZMinLevel				= 1,	// Single hash probe per position.
+	kDDLZMaxLevel				= 9,	// Searches 256 candidates per position.
+	kDDLZDefaultLevel			= 3
+};
+
+
+// Largest possible compressed size for inSize bytes of input.
+size_t DDLZCompressBound(size_t inSize);
+
+/*	Compress inSize bytes from inSrc into outDst. Returns the compressed size,
+	or 0 if outDst is too small or memory could not be allocated. Levels
+	outside [kDDLZMinLevel, kDDLZMaxLevel] are clamped. Thread safe.
+*/
+size_t DDLZCompress(const void *inSrc, size_t inSize, void *outDst, size_t inCapacity, int inLevel);
+
+/*	Decompress a block produced by DDLZCompress(). Returns true only if the
+	block is well-formed and decompresses to exactly inDstSize bytes; damaged
+	input never reads or writes out of bounds.
+*/
+bool DDLZDecompress(const void *inSrc, size_t inSrcSize, void *outDst, size_t inDstSize);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* INCLUDED_DDLZCOMPRESSION_h */
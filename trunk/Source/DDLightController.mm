@@ -22,6 +22,7 @@
 */
 
 #import "DDLightController.h"
+#import "DDSoftwareRenderer.h"
 #import "GLUtilities.h"
 #import "Logging.h"
 
@@ -45,8 +46,8 @@
 	self = [super init];
 	if (nil != self)
 	{
-		_elevation = -60;
-		_azimuth = -80;
+		_elevation = kDDDefaultLightElevation;
+		_azimuth = kDDDefaultLightAzimuth;
 		_distance = 1;
 		_view = inView;
 		[self updatePosition];
@@ -57,8 +58,9 @@
 
 - (void)updateLightState
 {
-	float				l0[4] = { 0.8, 0.8, 0.8, 1.0 },
-						l1[4] = { 0.1, 0.1, 0.1, 1.0 };
+	float				l0[4] = { kDDKeyLightIntensity, kDDKeyLightIntensity, kDDKeyLightIntensity, 1.0 },
+						l1[4] = { kDDFillLightIntensity, kDDFillLightIntensity, kDDFillLightIntensity, 1.0 },
+						ambient[4] = { kDDAmbientLightIntensity, kDDAmbientLightIntensity, kDDAmbientLightIntensity, 1.0 };
 	
 	glEnable(GL_LIGHT0);
 	glLightfv(GL_LIGHT0, GL_DIFFUSE, l0);
@@ -68,7 +70,7 @@
 	glLightfv(GL_LIGHT1, GL_DIFFUSE, l1);
 	glLightfv(GL_LIGHT1, GL_SPECULAR, l1);
 	
-	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, l1);
+	glLightModelfv(GL_LIGHT_MODEL_AMBIENT, ambient);
 	
 	_pos.glLight(GL_LIGHT0);
 	(-_pos).glLight(GL_LIGHT1);
@@ -119,14 +121,8 @@
 
 - (void)updatePosition
 {
-	float				phi, sphi, theta;
-	
-	phi = _elevation * 3.1415f / 180.0f;
-	theta = _azimuth * 3.1415f / 180.0f;
-	sphi = sinf(phi);
-	_pos[0] = sphi * cosf(theta) * _distance;
-	_pos[2] = sphi * sinf(theta) * _distance;
-	_pos[1] = cosf(phi) * _distance;
+	// Shared with DDSoftwareRenderer, so that previews drawn without OpenGL are lit the same way.
+	_pos = _distance * DDLightDirection(_elevation, _azimuth);
 }
 
 
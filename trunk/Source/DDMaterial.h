@@ -37,6 +37,8 @@
 #ifndef FACELESS
 	DDTextureBuffer			*_diffuseTexture;
 	GLuint					_diffuseGLName;
+	BOOL					_diffuseGLNameStale;	// _diffuseTexture has changed; -makeActive deletes the old GL texture
+	NSURL					*_pendingDiffuseMapBase;
 #endif
 }
 
@@ -50,8 +52,34 @@
 - (void)setDiffuseMap:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues;
 - (NSString *)diffuseMapName;
 
+/*	Where a diffuse map is looked for, in order: beside the base file, in
+	Textures/ and ../Textures/ relative to it, then in Oolite's resources.
+	-diffuseMapURLRelativeTo: returns the first of these that exists, or nil.
+	It (and -setDiffuseMap:relativeTo:issues:) looks the name up, ignoring
+	case, in an index of each directory kept for the life of the process,
+	rather than trying each location in turn.
+*/
++ (NSArray *)diffuseMapSearchURLsForName:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile;
+- (NSURL *)diffuseMapURLRelativeTo:(NSURL *)inBaseFile;
+
+// Call after writing a texture into inDirectory, so that it can be found straight away.
++ (void)noteTextureDirectoryChanged:(NSString *)inDirectory;
+
 #ifndef FACELESS
 - (void)makeActive;
+
+/*	While texture loading is deferred on the current thread, -setDiffuseMap:
+	relativeTo:issues: only records the file name and where to look for it.
+	The placeholder texture is used until the texture is loaded: find it with
+	-loadPendingDiffuseMapWithIssues: (on any thread), then install it with
+	-setPendingDiffuseTexture: on the main thread.
+*/
++ (void)setDefersTextureLoading:(BOOL)inDefer;
++ (BOOL)defersTextureLoading;
+
+- (BOOL)hasPendingDiffuseMap;
+- (DDTextureBuffer *)loadPendingDiffuseMapWithIssues:(DDProblemReportManager *)ioIssues;
+- (void)setPendingDiffuseTexture:(DDTextureBuffer *)inTexture;
 #endif
 
 @end
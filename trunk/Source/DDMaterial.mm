@@ -31,10 +31,45 @@
 #import "DDUtilities.h"
 
 
+static NSString * const kDeferTextureLoadingKey = @"DDMaterial defers texture loading";
+
+// How long a directory index is trusted before its modification date is checked again.
+#define kTextureIndexRecheckInterval	1.0
+
+/*	A directory modified this recently may change again within the same tick of
+	its (one-second) modification date, so an index of it isn't kept.
+*/
+#define kTextureIndexSettleInterval		2.0
+
+
+/*	Index of the files in each directory textures are looked for in, so that
+	finding a texture is a dictionary lookup rather than a failed open() in
+	each place it might be. Keys are file names, exact and folded to lower
+	case; values are the names on disk. The indices are shared by every
+	document (and every ddoolite job) in the process, and an index is rebuilt
+	when its directory's modification date changes. Like the MTL cache, the
+	number kept is bounded, since a ddoolite --serve process can be asked
+	about any number of directories.
+*/
+#define kMaxCachedTextureDirectories	64
+
+static NSMutableDictionary *sTextureDirectoryIndices = nil;
+static NSMutableArray *sTextureDirectoryOrder = nil;		// Keys, least recently used first
+
+
+static NSURL *FindTextureFile(NSString *inFileName, NSURL *inBaseFile);
+static NSArray *TextureSearchDirectories(NSURL *inBaseFile);
+static NSDictionary *TextureDirectoryIndex(NSString *inDirectory);
+
+
 @interface DDMaterial(Private)
 
 - (id)initWithTexture:(DDTextureBuffer *)inTexture;
 
+#ifndef FACELESS
++ (DDTextureBuffer *)findDiffuseMap:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues;
+#endif
+
 @end
 
 
@@ -65,73 +100,99 @@
 }
 
 
-#ifndef FACELESS
-
-- (void)setDiffuseMap:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues
++ (NSArray *)diffuseMapSearchURLsForName:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile
 {
-	TraceEnterMsg(@"Called for %@ relative to %@.", inFileName, inBaseFile);
-	
-	DDTextureBuffer			*texture;
+	NSMutableArray			*result;
 	NSURL					*url;
 	NSString				*ooliteResources;
-	NSString				*path;
 	
-	// Look for texture in same folder as base file
-	TraceMessage(@"Looking in same folder");
+	result = [NSMutableArray arrayWithCapacity:5];
+	
+	// Same folder as base file, then base/Textures/file, then base/../Textures/file
 	url = [NSURL URLWithString:inFileName relativeToURL:inBaseFile];
-	texture = [DDTextureBuffer textureWithFile:url issues:ioIssues];
+	if (nil != url) [result addObject:url];
+	url = [NSURL URLWithString:[@"Textures" stringByAppendingPathComponent:inFileName] relativeToURL:inBaseFile];
+	if (nil != url) [result addObject:url];
+	url = [NSURL URLWithString:[[@".." stringByAppendingPathComponent:@"Textures"] stringByAppendingPathComponent:inFileName] relativeToURL:inBaseFile];
+	if (nil != url) [result addObject:[url standardizedURL]];
 	
-	if (nil == texture)
+	ooliteResources = LocationOfOoliteResources();
+	if (nil != ooliteResources)
 	{
-		// Try in base/Textures/file
-		TraceMessage(@"Looking in Textures/");
-		url = [NSURL URLWithString:[@"Textures" stringByAppendingPathComponent:inFileName] relativeToURL:inBaseFile];
-		texture = [DDTextureBuffer textureWithFile:url issues:ioIssues];
+		// $OOLITE/Contents/Resources/Textures/file, then $OOLITE/Contents/Resources/file (because development builds don’t have a Textures subfolder)
+		[result addObject:[NSURL fileURLWithPath:[[ooliteResources stringByAppendingPathComponent:@"Textures"] stringByAppendingPathComponent:inFileName]]];
+		[result addObject:[NSURL fileURLWithPath:[ooliteResources stringByAppendingPathComponent:inFileName]]];
 	}
 	
-	if (nil == texture)
+	return result;
+}
+
+
+- (NSURL *)diffuseMapURLRelativeTo:(NSURL *)inBaseFile
+{
+	if (nil == _diffuseMapName) return nil;
+	return FindTextureFile(_diffuseMapName, inBaseFile);
+}
+
+
++ (void)noteTextureDirectoryChanged:(NSString *)inDirectory
+{
+	@synchronized ([DDMaterial class])
 	{
-		// Try in base/../Textures/file
-		url = [NSURL URLWithString:[[@".." stringByAppendingPathComponent:@"Textures"] stringByAppendingPathComponent:inFileName] relativeToURL:inBaseFile];
-		url = [url standardizedURL];
-		TraceMessage(@"Looking in ../Textures/ (%@)", url);
-		texture = [DDTextureBuffer textureWithFile:url issues:ioIssues];
+		[sTextureDirectoryIndices removeObjectForKey:[inDirectory stringByStandardizingPath]];
+		[sTextureDirectoryOrder removeObject:[inDirectory stringByStandardizingPath]];
 	}
+}
+
+
+#ifndef FACELESS
+
++ (DDTextureBuffer *)findDiffuseMap:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@ relative to %@.", inFileName, inBaseFile);
 	
-	if (nil == texture)
-	{
-		// Find Oolite bundle if we haven’t already
-		ooliteResources = LocationOfOoliteResources();
-		
-		if (nil != ooliteResources)
-		{
-			// Try in $OOLITE/Contents/Resources/Textures/file
-			TraceMessage(@"Looking in [oolite]/Contents/Resources/Textures/");
-			path = [ooliteResources stringByAppendingPathComponent:@"Textures"];
-			path = [path stringByAppendingPathComponent:inFileName];
-			if (nil != path) texture = [DDTextureBuffer textureWithFile:[NSURL fileURLWithPath:path] issues:ioIssues];
-			
-			if (nil == texture)
-			{
-				// Try in $OOLITE/Contents/Resources/file (because development builds don’t have a Textures subfolder)
-				TraceMessage(@"Looking in [oolite]/Contents/Resources/");
-				path = [ooliteResources stringByAppendingPathComponent:inFileName];
-				if (nil != path) texture = [DDTextureBuffer textureWithFile:[NSURL fileURLWithPath:path] issues:ioIssues];
-			}
-		}
-	}
+	DDTextureBuffer			*texture = nil;
+	NSURL					*url;
+	
+	url = FindTextureFile(inFileName, inBaseFile);
+	TraceMessage(@"Found %@", url);
+	if (nil != url) texture = [DDTextureBuffer textureWithFile:url issues:ioIssues];
 	
 	if (nil == texture)
 	{
 		TraceMessage(@"Not found, using placeholder.");
 		[ioIssues addNoteIssueWithKey:@"textureNotFound" localizedFormat:@"No texture named \"%@\" could be found, using fallback texture.", inFileName];
 		texture = [DDTextureBuffer placeholderTextureWithIssues:ioIssues];
-		if (nil == texture)
-		{
-			TraceMessage(@"Couldn't load placeholder, using nil material.");
-			[self release];
-			self = nil;
-		}
+	}
+	
+	return texture;
+	TraceExit();
+}
+
+
+- (void)setDiffuseMap:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@ relative to %@.", inFileName, inBaseFile);
+	
+	DDTextureBuffer			*texture;
+	
+	if ([DDMaterial defersTextureLoading])
+	{
+		[_diffuseMapName release];
+		_diffuseMapName = [inFileName copy];
+		[_pendingDiffuseMapBase release];
+		_pendingDiffuseMapBase = [inBaseFile retain];
+		Release(_diffuseTexture);
+		_diffuseGLNameStale = YES;
+		return;
+	}
+	
+	texture = [DDMaterial findDiffuseMap:inFileName relativeTo:inBaseFile issues:ioIssues];
+	if (nil == texture)
+	{
+		TraceMessage(@"Couldn't load placeholder, using nil material.");
+		[self release];
+		self = nil;
 	}
 	
 	if (nil != texture)
@@ -139,16 +200,56 @@
 		[_diffuseMapName release];
 		_diffuseMapName = [inFileName copy];
 		
-		#ifndef FACELESS
-			[_diffuseTexture release];
-			_diffuseTexture = [texture retain];
-			_diffuseGLName = 0;
-		#endif
+		[_diffuseTexture release];
+		_diffuseTexture = [texture retain];
+		_diffuseGLNameStale = YES;
 	}
 	
 	TraceExit();
 }
 
+
++ (void)setDefersTextureLoading:(BOOL)inDefer
+{
+	NSMutableDictionary		*threadDict;
+	
+	threadDict = [[NSThread currentThread] threadDictionary];
+	if (inDefer)  [threadDict setObject:[NSNumber numberWithBool:YES] forKey:kDeferTextureLoadingKey];
+	else  [threadDict removeObjectForKey:kDeferTextureLoadingKey];
+}
+
+
++ (BOOL)defersTextureLoading
+{
+	return [[[[NSThread currentThread] threadDictionary] objectForKey:kDeferTextureLoadingKey] boolValue];
+}
+
+
+- (BOOL)hasPendingDiffuseMap
+{
+	return _pendingDiffuseMapBase != nil;
+}
+
+
+- (DDTextureBuffer *)loadPendingDiffuseMapWithIssues:(DDProblemReportManager *)ioIssues
+{
+	if (_pendingDiffuseMapBase == nil || _diffuseMapName == nil)  return nil;
+	return [DDMaterial findDiffuseMap:_diffuseMapName relativeTo:_pendingDiffuseMapBase issues:ioIssues];
+}
+
+
+- (void)setPendingDiffuseTexture:(DDTextureBuffer *)inTexture
+{
+	Release(_pendingDiffuseMapBase);
+	if (inTexture != nil)
+	{
+		[_diffuseTexture release];
+		_diffuseTexture = [inTexture retain];
+		_diffuseGLNameStale = YES;
+	}
+}
+
+
 #else
 
 - (void)setDiffuseMap:(NSString *)inFileName relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues
@@ -168,6 +269,7 @@
 	[_diffuseMapName autorelease];
 	#ifndef FACELESS
 		[_diffuseTexture autorelease];
+		[_pendingDiffuseMapBase release];
 	#endif
 	
 	[super dealloc];
@@ -185,6 +287,7 @@
 	
 	#ifndef FACELESS
 		result->_diffuseTexture = [_diffuseTexture retain];
+		result->_pendingDiffuseMapBase = [_pendingDiffuseMapBase retain];
 	#endif
 	
 	return result;
@@ -217,7 +320,16 @@
 {
 	if (nil == _diffuseTexture)
 	{
-		_diffuseTexture = [DDTextureBuffer placeholderTextureWithIssues:nil];
+		// Retained, since -setPendingDiffuseTexture: may replace it once the real texture has loaded.
+		_diffuseTexture = [[DDTextureBuffer placeholderTextureWithIssues:nil] retain];
+	}
+	
+	// The texture was replaced outside a GL context; delete its predecessor here, where one is current.
+	if (_diffuseGLNameStale)
+	{
+		if (0 != _diffuseGLName)  glDeleteTextures(1, &_diffuseGLName);
+		_diffuseGLName = 0;
+		_diffuseGLNameStale = NO;
 	}
 	
 	if (0 == _diffuseGLName)
@@ -313,3 +425,142 @@
 }
 
 @end
+
+
+static NSURL *FindTextureFile(NSString *inFileName, NSURL *inBaseFile)
+{
+	NSEnumerator			*dirEnum, *urlEnum;
+	NSString				*directory, *name;
+	NSDictionary			*index;
+	NSURL					*url;
+	NSFileManager			*fmgr;
+	
+	if (nil == inFileName) return nil;
+	
+	if ([inBaseFile isFileURL] && [[inFileName pathComponents] count] == 1)
+	{
+		for (dirEnum = [TextureSearchDirectories(inBaseFile) objectEnumerator]; (directory = [dirEnum nextObject]); )
+		{
+			index = TextureDirectoryIndex(directory);
+			name = [index objectForKey:inFileName];
+			if (nil == name) name = [index objectForKey:[inFileName lowercaseString]];
+			if (nil != name) return [NSURL fileURLWithPath:[directory stringByAppendingPathComponent:name]];
+		}
+		return nil;
+	}
+	
+	// Names with directories in them, and models that aren't files, are looked for the slow way.
+	fmgr = [NSFileManager defaultManager];
+	for (urlEnum = [[DDMaterial diffuseMapSearchURLsForName:inFileName relativeTo:inBaseFile] objectEnumerator]; (url = [urlEnum nextObject]); )
+	{
+		if ([url isFileURL] && [fmgr fileExistsAtPath:[url path]]) return url;
+	}
+	return nil;
+}
+
+
+// The directories of +diffuseMapSearchURLsForName:relativeTo:, in the same order.
+static NSArray *TextureSearchDirectories(NSURL *inBaseFile)
+{
+	NSMutableArray			*result;
+	NSString				*baseDirectory, *ooliteResources;
+	
+	result = [NSMutableArray arrayWithCapacity:5];
+	baseDirectory = [[[inBaseFile path] stringByDeletingLastPathComponent] stringByStandardizingPath];
+	
+	[result addObject:baseDirectory];
+	[result addObject:[baseDirectory stringByAppendingPathComponent:@"Textures"]];
+	[result addObject:[[baseDirectory stringByDeletingLastPathComponent] stringByAppendingPathComponent:@"Textures"]];
+	
+	ooliteResources = LocationOfOoliteResources();
+	if (nil != ooliteResources)
+	{
+		[result addObject:[ooliteResources stringByAppendingPathComponent:@"Textures"]];
+		[result addObject:ooliteResources];
+	}
+	
+	return result;
+}
+
+
+/*	Returns nil if inDirectory doesn't exist. Each entry in
+	sTextureDirectoryIndices is an array of the index (or NSNull for a missing
+	directory), the directory's modification date (or NSNull) and when that
+	was last checked.
+*/
+static NSDictionary *TextureDirectoryIndex(NSString *inDirectory)
+{
+	NSArray					*entry, *names;
+	NSMutableDictionary		*index;
+	NSEnumerator			*nameEnum;
+	NSString				*name;
+	NSDate					*date;
+	NSTimeInterval			now;
+	id						cachedIndex, cachedDate;
+	
+	now = [NSDate timeIntervalSinceReferenceDate];
+	@synchronized ([DDMaterial class])
+	{
+		entry = [[[sTextureDirectoryIndices objectForKey:inDirectory] retain] autorelease];
+		if (nil != entry)
+		{
+			[sTextureDirectoryOrder removeObject:inDirectory];
+			[sTextureDirectoryOrder addObject:inDirectory];
+		}
+	}
+	
+	cachedIndex = [entry objectAtIndex:0];
+	cachedDate = [entry objectAtIndex:1];
+	if (nil != entry && now - [[entry objectAtIndex:2] doubleValue] < kTextureIndexRecheckInterval)
+	{
+		return (cachedIndex != [NSNull null]) ? cachedIndex : nil;
+	}
+	
+	date = [[[NSFileManager defaultManager] attributesOfItemAtPath:inDirectory error:NULL] fileModificationDate];
+	if (nil != entry && (nil != date ? [date isEqual:cachedDate] : cachedDate == [NSNull null]))
+	{
+		// Unchanged; trust it for another interval.
+		index = (cachedIndex != [NSNull null]) ? cachedIndex : nil;
+	}
+	else if (nil != date)
+	{
+		names = [[NSFileManager defaultManager] contentsOfDirectoryAtPath:inDirectory error:NULL];
+		index = [NSMutableDictionary dictionaryWithCapacity:[names count] * 2];
+		for (nameEnum = [names objectEnumerator]; (name = [nameEnum nextObject]); )
+		{
+			if (nil == [index objectForKey:[name lowercaseString]]) [index setObject:name forKey:[name lowercaseString]];
+			[index setObject:name forKey:name];
+		}
+		index = [[index copy] autorelease];
+		
+		if ([date timeIntervalSinceNow] > -kTextureIndexSettleInterval) return index;
+	}
+	else
+	{
+		index = nil;
+	}
+	
+	entry = [NSArray arrayWithObjects:(nil != index) ? (id)index : (id)[NSNull null],
+										(nil != date) ? (id)date : (id)[NSNull null],
+										[NSNumber numberWithDouble:now], nil];
+	@synchronized ([DDMaterial class])
+	{
+		if (nil == sTextureDirectoryIndices)
+		{
+			sTextureDirectoryIndices = [[NSMutableDictionary alloc] init];
+			sTextureDirectoryOrder = [[NSMutableArray alloc] init];
+		}
+		
+		[sTextureDirectoryOrder removeObject:inDirectory];
+		while (kMaxCachedTextureDirectories <= [sTextureDirectoryOrder count])
+		{
+			[sTextureDirectoryIndices removeObjectForKey:[sTextureDirectoryOrder objectAtIndex:0]];
+			[sTextureDirectoryOrder removeObjectAtIndex:0];
+		}
+		[sTextureDirectoryIndices setObject:entry forKey:inDirectory];
+		[sTextureDirectoryOrder addObject:inDirectory];
+	}
+	
+	return index;
+}
+
@@ -0,0 +1,717 @@
+/*
+	DDMesh+Baking.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Texture and vertex baking by ray casting: tangent-space normal maps from a
+	detailed source mesh, and ambient occlusion per vertex or per texel.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMesh.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import "DDTriangleBVH.h"
+#import "DDParallel.h"
+
+
+enum
+{
+	kBakeTileSize				= 32,		// Texels; tiles are the unit of parallel work
+	kBakePaddingTexels			= 8,		// Uncovered texels within this distance of a chart are filled from it
+	kOcclusionVertexGranularity	= 64
+};
+
+
+// Default ray lengths, relative to the diagonal of the mesh's bounding box.
+#define kDefaultBakeDistanceFactor			0.05f
+#define kDefaultOcclusionDistanceFactor		0.25f
+
+// Occlusion rays start this far (relative to the diagonal) off the surface, so they don't hit their own face.
+#define kOcclusionBiasFactor				1e-4f
+
+
+// A fan triangle of the low-polygon mesh, with everything needed to interpolate across it.
+typedef struct BakeTriangle
+{
+	Vector2					uv[3];			// In texels
+	Vector					position[3];
+	Vector					normal[3];
+	Vector					tangent[3];
+	Scalar					sign;
+} BakeTriangle;
+
+
+// Surface at the centre of a covered texel.
+typedef struct BakeTexel
+{
+	Vector					position;
+	Vector					normal;
+	Vector					tangent;
+	Vector					bitangent;
+	uint32_t				index;			// y * width + x
+} BakeTexel;
+
+
+typedef void (*BakeTexelShader)(const void *inContext, const BakeTexel *inTexel, unsigned inWorker, uint8_t outColour[3]);
+
+
+typedef struct BakeContext
+{
+	const BakeTriangle		*triangles;
+	const uint32_t			*tileStarts;	// Index into tileTriangles of each tile's first triangle, plus one past the end
+	const uint32_t			*tileTriangles;
+	unsigned				tilesAcross;
+	unsigned				width, height;
+	BakeTexelShader			shader;
+	const void				*shaderContext;
+	uint8_t					*pixels;
+	uint8_t					*coverage;
+} BakeContext;
+
+
+typedef struct NormalMapContext
+{
+	const DDTriangleBVH		*source;
+	const Vector			*sourceNormals;	// Three per source triangle, in BVH triangle order
+	Scalar					maxDistance;
+} NormalMapContext;
+
+
+typedef struct OcclusionContext
+{
+	const DDTriangleBVH		*bvh;
+	const Vector2			*pattern;		// sampleCount points in [0, 1)²
+	unsigned				sampleCount;
+	Scalar					maxDistance;
+	Scalar					bias;
+	NSUInteger				*rayCounts;		// Per worker
+	
+	// Per-vertex baking only.
+	const Vector			*positions;
+	const Vector			*normals;
+	Scalar					*visibility;
+} OcclusionContext;
+
+
+@interface DDMesh (Baking_Private)
+
+/*	Rasterize the u/v layout of the faces using inMaterial (or all faces, for
+	NSNotFound) and call inShader for each covered texel, a tile per task.
+	The result is a malloced RGBX buffer, with charts padded and the rest
+	filled with inBackground.
+*/
+- (uint8_t *)copyBakedTexelsWithWidth:(unsigned)inWidth height:(unsigned)inHeight material:(NSUInteger)inMaterial shader:(BakeTexelShader)inShader context:(const void *)inContext background:(const uint8_t *)inBackground;
+
+- (BOOL)setUpOcclusionContext:(OcclusionContext *)outContext sampleCount:(unsigned)inSampleCount maxDistance:(Scalar)inMaxDistance;
+- (void)tearDownOcclusionContext:(OcclusionContext *)ioContext rayCount:(NSUInteger *)outRayCount;
+
+@end
+
+
+static void BakeTiles(void *context, size_t start, size_t end, unsigned worker);
+static void ShadeNormalMapTexel(const void *inContext, const BakeTexel *inTexel, unsigned inWorker, uint8_t outColour[3]);
+static void ShadeOcclusionTexel(const void *inContext, const BakeTexel *inTexel, unsigned inWorker, uint8_t outColour[3]);
+static void BakeVertexOcclusion(void *context, size_t start, size_t end, unsigned worker);
+static Scalar Visibility(const OcclusionContext *inContext, const Vector &inPosition, const Vector &inNormal, uint32_t inSeed);
+static void PadCharts(uint8_t *ioPixels, uint8_t *ioCoverage, unsigned inWidth, unsigned inHeight, const uint8_t *inBackground);
+static inline void TileRange(Scalar inMin, Scalar inMax, unsigned inLimit, unsigned *outFirst, unsigned *outLast);
+static inline unsigned ClampTexel(Scalar inValue)  { return (0 < inValue) ? (unsigned)inValue : 0; }
+static inline uint32_t HashIndex(uint32_t inValue);
+static inline Scalar RadicalInverse(uint32_t inValue);
+
+
+@implementation DDMesh (Baking)
+
+- (NSData *)bakeNormalMapFromMesh:(DDMesh *)inSource width:(unsigned)inWidth height:(unsigned)inHeight maxDistance:(Scalar)inMaxDistance
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	DDTriangleBVH			*source = NULL;
+	Vector					*sourceNormals = NULL;
+	uint8_t					*pixels = NULL;
+	uint32_t				i, j, triIdx = 0;
+	DDMeshFaceData			*face;
+	Vector					boundsMin, boundsMax;
+	NormalMapContext		context;
+	const uint8_t			flat[3] = { 128, 128, 255 };
+	
+	if (nil == inSource)  return nil;
+	
+	if (inMaxDistance <= 0)
+	{
+		[self getBoundsMin:&boundsMin max:&boundsMax];
+		inMaxDistance = (boundsMax - boundsMin).Magnitude() * kDefaultBakeDistanceFactor;
+	}
+	
+	source = [inSource newTriangleBVH];
+	OK = (NULL != source);
+	if (OK)
+	{
+		sourceNormals = (Vector *)malloc(sizeof *sourceNormals * 3 * source->TriangleCount() + 1);
+		OK = (NULL != sourceNormals);
+	}
+	
+	if (OK)
+	{
+		// Source vertex normals in the same fan order as -copyTriangleSoup:faceTags:, which the BVH is built from.
+		for (i = 0; i != inSource->_faceCount; ++i)
+		{
+			face = &inSource->_faces[i];
+			for (j = 2; j < face->vertexCount; ++j)
+			{
+				sourceNormals[triIdx * 3] = inSource->_normals[inSource->_vertexNormalIndices[face->firstVertex]];
+				sourceNormals[triIdx * 3 + 1] = inSource->_normals[inSource->_vertexNormalIndices[face->firstVertex + j - 1]];
+				sourceNormals[triIdx * 3 + 2] = inSource->_normals[inSource->_vertexNormalIndices[face->firstVertex + j]];
+				++triIdx;
+			}
+		}
+		
+		context.source = source;
+		context.sourceNormals = sourceNormals;
+		context.maxDistance = inMaxDistance;
+		pixels = [self copyBakedTexelsWithWidth:inWidth height:inHeight material:NSNotFound shader:ShadeNormalMapTexel context:&context background:flat];
+	}
+	
+	delete source;
+	Free(sourceNormals);
+	
+	if (NULL == pixels)  return nil;
+	return [NSData dataWithBytesNoCopy:pixels length:(NSUInteger)inWidth * inHeight * 4 freeWhenDone:YES];
+	
+	TraceExit();
+}
+
+
+- (NSData *)bakeVertexOcclusionWithSampleCount:(unsigned)inSampleCount maxDistance:(Scalar)inMaxDistance rayCount:(NSUInteger *)outRayCount
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	OcclusionContext		context;
+	Vector					*normals = NULL;
+	Scalar					*visibility = NULL;
+	uint32_t				i;
+	
+	if (NULL != outRayCount)  *outRayCount = 0;
+	if (0 == _vertexCount)  return nil;
+	
+	OK = [self setUpOcclusionContext:&context sampleCount:inSampleCount maxDistance:inMaxDistance];
+	if (OK)
+	{
+		normals = (Vector *)calloc(_vertexCount, sizeof *normals);
+		visibility = (Scalar *)malloc(sizeof *visibility * _vertexCount);
+		OK = (NULL != normals && NULL != visibility);
+	}
+	
+	if (OK)
+	{
+		// Vertices are shared between faces with different normals, so each looks out along the average of its corners'.
+		for (i = 0; i != _faceVertexIndexCount; ++i)
+		{
+			normals[_faceVertexIndices[i]] += _normals[_vertexNormalIndices[i]];
+		}
+		
+		context.positions = _vertices;
+		context.normals = normals;
+		context.visibility = visibility;
+		DDParallelApply(_vertexCount, kOcclusionVertexGranularity, BakeVertexOcclusion, &context);
+	}
+	
+	[self tearDownOcclusionContext:&context rayCount:outRayCount];
+	Free(normals);
+	
+	if (!OK)
+	{
+		Free(visibility);
+		return nil;
+	}
+	return [NSData dataWithBytesNoCopy:visibility length:sizeof *visibility * _vertexCount freeWhenDone:YES];
+	
+	TraceExit();
+}
+
+
+- (NSData *)bakeOcclusionMapWithWidth:(unsigned)inWidth height:(unsigned)inHeight material:(NSUInteger)inMaterial sampleCount:(unsigned)inSampleCount maxDistance:(Scalar)inMaxDistance rayCount:(NSUInteger *)outRayCount
+{
+	TraceEnter();
+	
+	OcclusionContext		context;
+	uint8_t					*pixels = NULL;
+	const uint8_t			open[3] = { 255, 255, 255 };
+	
+	if (NULL != outRayCount)  *outRayCount = 0;
+	
+	if ([self setUpOcclusionContext:&context sampleCount:inSampleCount maxDistance:inMaxDistance])
+	{
+		pixels = [self copyBakedTexelsWithWidth:inWidth height:inHeight material:inMaterial shader:ShadeOcclusionTexel context:&context background:open];
+	}
+	[self tearDownOcclusionContext:&context rayCount:outRayCount];
+	
+	if (NULL == pixels)  return nil;
+	return [NSData dataWithBytesNoCopy:pixels length:(NSUInteger)inWidth * inHeight * 4 freeWhenDone:YES];
+	
+	TraceExit();
+}
+
+@end
+
+
+@implementation DDMesh (Baking_Private)
+
+- (uint8_t *)copyBakedTexelsWithWidth:(unsigned)inWidth height:(unsigned)inHeight material:(NSUInteger)inMaterial shader:(BakeTexelShader)inShader context:(const void *)inContext background:(const uint8_t *)inBackground
+{
+	BOOL					OK = YES;
+	const DDMeshTangent		*tangents = NULL;
+	BakeTriangle			*triangles = NULL;
+	uint32_t				*tileStarts = NULL, *tileTriangles = NULL, *tileFill = NULL;
+	uint8_t					*pixels = NULL, *coverage = NULL;
+	uint32_t				i, j, k, count = 0, triIdx = 0, binCount = 0;
+	unsigned				tilesAcross, tilesDown, tileCount, x0, x1, y0, y1, x, y;
+	DDMeshFaceData			*face;
+	unsigned				slots[3];
+	BakeContext				context;
+	
+	if (0 == inWidth || 0 == inHeight || 0 == _faceCount || 0 == _texCoordCount)  return NULL;
+	
+	tilesAcross = (inWidth + kBakeTileSize - 1) / kBakeTileSize;
+	tilesDown = (inHeight + kBakeTileSize - 1) / kBakeTileSize;
+	tileCount = tilesAcross * tilesDown;
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		if (inMaterial != NSNotFound && _faces[i].material != inMaterial)  continue;
+		if (2 < _faces[i].vertexCount)  count += _faces[i].vertexCount - 2;
+	}
+	
+	tangents = [self cornerTangents];
+	triangles = (BakeTriangle *)malloc(sizeof *triangles * count + 1);
+	tileStarts = (uint32_t *)calloc(tileCount + 1, sizeof *tileStarts);
+	tileFill = (uint32_t *)malloc(sizeof *tileFill * tileCount);
+	pixels = (uint8_t *)malloc((size_t)inWidth * inHeight * 4);
+	coverage = (uint8_t *)calloc((size_t)inWidth * inHeight, 1);
+	OK = (NULL != tangents && NULL != triangles && NULL != tileStarts && NULL != tileFill && NULL != pixels && NULL != coverage);
+	
+	if (OK)
+	{
+		// Fan triangles in texel space, binned by the tiles their u/v bounds touch.
+		for (i = 0; i != _faceCount; ++i)
+		{
+			face = &_faces[i];
+			if (inMaterial != NSNotFound && face->material != inMaterial)  continue;
+			
+			for (j = 2; j < face->vertexCount; ++j)
+			{
+				BakeTriangle *tri = &triangles[triIdx];
+				slots[0] = face->firstVertex;
+				slots[1] = face->firstVertex + j - 1;
+				slots[2] = face->firstVertex + j;
+				for (k = 0; k != 3; ++k)
+				{
+					Vector2 uv = _texCoords[_faceTexCoordIndices[slots[k]]];
+					tri->uv[k] = Vector2(uv.x * inWidth, uv.y * inHeight);
+					tri->position[k] = _vertices[_faceVertexIndices[slots[k]]];
+					tri->normal[k] = _normals[_vertexNormalIndices[slots[k]]];
+					tri->tangent[k] = tangents[slots[k]].tangent;
+				}
+				tri->sign = tangents[slots[0]].sign;
+				
+				TileRange(fmin(tri->uv[0].x, fmin(tri->uv[1].x, tri->uv[2].x)), fmax(tri->uv[0].x, fmax(tri->uv[1].x, tri->uv[2].x)), inWidth, &x0, &x1);
+				TileRange(fmin(tri->uv[0].y, fmin(tri->uv[1].y, tri->uv[2].y)), fmax(tri->uv[0].y, fmax(tri->uv[1].y, tri->uv[2].y)), inHeight, &y0, &y1);
+				for (y = y0; y < y1; ++y)  for (x = x0; x < x1; ++x)
+				{
+					++tileStarts[y * tilesAcross + x];
+					++binCount;
+				}
+				++triIdx;
+			}
+		}
+		
+		tileTriangles = (uint32_t *)malloc(sizeof *tileTriangles * binCount + 1);
+		OK = (NULL != tileTriangles);
+	}
+	
+	if (OK)
+	{
+		// Counts to starts, then fill in triangle order so the result doesn't depend on threading.
+		for (i = 0, k = 0; i != tileCount; ++i)
+		{
+			j = tileStarts[i];
+			tileStarts[i] = tileFill[i] = k;
+			k += j;
+		}
+		tileStarts[tileCount] = k;
+		
+		for (triIdx = 0; triIdx != count; ++triIdx)
+		{
+			const BakeTriangle *tri = &triangles[triIdx];
+			TileRange(fmin(tri->uv[0].x, fmin(tri->uv[1].x, tri->uv[2].x)), fmax(tri->uv[0].x, fmax(tri->uv[1].x, tri->uv[2].x)), inWidth, &x0, &x1);
+			TileRange(fmin(tri->uv[0].y, fmin(tri->uv[1].y, tri->uv[2].y)), fmax(tri->uv[0].y, fmax(tri->uv[1].y, tri->uv[2].y)), inHeight, &y0, &y1);
+			for (y = y0; y < y1; ++y)  for (x = x0; x < x1; ++x)
+			{
+				tileTriangles[tileFill[y * tilesAcross + x]++] = triIdx;
+			}
+		}
+		
+		context.triangles = triangles;
+		context.tileStarts = tileStarts;
+		context.tileTriangles = tileTriangles;
+		context.tilesAcross = tilesAcross;
+		context.width = inWidth;
+		context.height = inHeight;
+		context.shader = inShader;
+		context.shaderContext = inContext;
+		context.pixels = pixels;
+		context.coverage = coverage;
+		DDParallelApply(tileCount, 1, BakeTiles, &context);
+		
+		PadCharts(pixels, coverage, inWidth, inHeight, inBackground);
+	}
+	
+	Free(triangles);
+	Free(tileStarts);
+	Free(tileTriangles);
+	Free(tileFill);
+	Free(coverage);
+	if (!OK)  Free(pixels);
+	
+	return pixels;
+}
+
+
+- (BOOL)setUpOcclusionContext:(OcclusionContext *)outContext sampleCount:(unsigned)inSampleCount maxDistance:(Scalar)inMaxDistance
+{
+	Vector					boundsMin, boundsMax;
+	Vector2					*pattern;
+	Scalar					diagonal;
+	unsigned				i;
+	
+	bzero(outContext, sizeof *outContext);
+	if (0 == inSampleCount)  inSampleCount = kDDMeshDefaultOcclusionSampleCount;
+	
+	[self getBoundsMin:&boundsMin max:&boundsMax];
+	diagonal = (boundsMax - boundsMin).Magnitude();
+	if (inMaxDistance <= 0)  inMaxDistance = diagonal * kDefaultOcclusionDistanceFactor;
+	
+	// A Hammersley set, rotated per vertex or texel in Visibility(). Being fixed, it makes results reproducible.
+	pattern = (Vector2 *)malloc(sizeof *pattern * inSampleCount);
+	if (NULL != pattern)
+	{
+		for (i = 0; i != inSampleCount; ++i)
+		{
+			pattern[i].Set((i + 0.5f) / inSampleCount, RadicalInverse(i));
+		}
+	}
+	
+	outContext->pattern = pattern;
+	outContext->sampleCount = inSampleCount;
+	outContext->maxDistance = inMaxDistance;
+	outContext->bias = diagonal * kOcclusionBiasFactor;
+	outContext->bvh = [self newTriangleBVH];
+	outContext->rayCounts = (NSUInteger *)calloc(DDParallelWorkerCount(), sizeof *outContext->rayCounts);
+	
+	return (NULL != outContext->pattern && NULL != outContext->bvh && NULL != outContext->rayCounts);
+}
+
+
+- (void)tearDownOcclusionContext:(OcclusionContext *)ioContext rayCount:(NSUInteger *)outRayCount
+{
+	unsigned				i, workerCount;
+	
+	if (NULL != outRayCount && NULL != ioContext->rayCounts)
+	{
+		*outRayCount = 0;
+		workerCount = DDParallelWorkerCount();
+		for (i = 0; i != workerCount; ++i)  *outRayCount += ioContext->rayCounts[i];
+	}
+	
+	delete ioContext->bvh;
+	free((void *)ioContext->pattern);
+	free(ioContext->rayCounts);
+	bzero(ioContext, sizeof *ioContext);
+}
+
+@end
+
+
+/*	Texels are sampled at their centres; those in more than one triangle take
+	the last one's value.
+*/
+static void BakeTiles(void *context, size_t start, size_t end, unsigned worker)
+{
+	const BakeContext		*ctx = (const BakeContext *)context;
+	size_t					tile;
+	uint32_t				i;
+	unsigned				tx, ty, x, y, x0, x1, y0, y1;
+	Scalar					area, w0, w1, w2, px, py;
+	BakeTexel				texel;
+	uint8_t					*colour;
+	
+	for (tile = start; tile != end; ++tile)
+	{
+		tx = (tile % ctx->tilesAcross) * kBakeTileSize;
+		ty = (tile / ctx->tilesAcross) * kBakeTileSize;
+		
+		for (i = ctx->tileStarts[tile]; i != ctx->tileStarts[tile + 1]; ++i)
+		{
+			const BakeTriangle *tri = &ctx->triangles[ctx->tileTriangles[i]];
+			const Vector2 *uv = tri->uv;
+			
+			area = (uv[1].x - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (uv[1].y - uv[0].y);
+			if (fabs(area) < 1e-12f)  continue;
+			
+			// Texels in both this tile and the triangle's bounds.
+			x0 = MAX(tx, ClampTexel(floorf(fmin(uv[0].x, fmin(uv[1].x, uv[2].x)))));
+			y0 = MAX(ty, ClampTexel(floorf(fmin(uv[0].y, fmin(uv[1].y, uv[2].y)))));
+			x1 = MIN(MIN(tx + kBakeTileSize, ctx->width), ClampTexel(ceilf(fmax(uv[0].x, fmax(uv[1].x, uv[2].x)))));
+			y1 = MIN(MIN(ty + kBakeTileSize, ctx->height), ClampTexel(ceilf(fmax(uv[0].y, fmax(uv[1].y, uv[2].y)))));
+			
+			for (y = y0; y < y1; ++y)
+			{
+				py = y + 0.5f;
+				for (x = x0; x < x1; ++x)
+				{
+					px = x + 0.5f;
+					
+					// Barycentric co-ordinates in u/v space; either winding is accepted.
+					w1 = ((px - uv[0].x) * (uv[2].y - uv[0].y) - (uv[2].x - uv[0].x) * (py - uv[0].y)) / area;
+					w2 = ((uv[1].x - uv[0].x) * (py - uv[0].y) - (px - uv[0].x) * (uv[1].y - uv[0].y)) / area;
+					w0 = 1.0f - w1 - w2;
+					if (w0 < -1e-5f || w1 < -1e-5f || w2 < -1e-5f)  continue;
+					
+					texel.position = tri->position[0] * w0 + tri->position[1] * w1 + tri->position[2] * w2;
+					texel.normal = tri->normal[0] * w0 + tri->normal[1] * w1 + tri->normal[2] * w2;
+					if (0 == texel.normal.SquareMagnitude())  continue;
+					texel.normal.Normalize();
+					
+					texel.tangent = tri->tangent[0] * w0 + tri->tangent[1] * w1 + tri->tangent[2] * w2;
+					texel.tangent -= texel.normal * (texel.normal * texel.tangent);
+					if (0 == texel.tangent.SquareMagnitude())  texel.tangent = texel.normal % ((fabs(texel.normal.x) < 0.9f) ? Vector(1, 0, 0) : Vector(0, 1, 0));
+					texel.tangent.Normalize();
+					texel.bitangent = (texel.normal % texel.tangent) * tri->sign;
+					texel.index = y * ctx->width + x;
+					
+					colour = &ctx->pixels[(size_t)texel.index * 4];
+					ctx->shader(ctx->shaderContext, &texel, worker, colour);
+					colour[3] = 255;
+					ctx->coverage[texel.index] = 1;
+				}
+			}
+		}
+	}
+}
+
+
+/*	Cast rays both ways along the texel's normal and take the nearer hit. The
+	source's interpolated normal there is expressed in the texel's tangent
+	frame and stored as RGB = 0.5 * n + 0.5. Misses get the unperturbed normal.
+*/
+static void ShadeNormalMapTexel(const void *inContext, const BakeTexel *inTexel, unsigned inWorker, uint8_t outColour[3])
+{
+	const NormalMapContext	*ctx = (const NormalMapContext *)inContext;
+	DDTriangleBVHHit		hit, backHit;
+	bool					haveHit;
+	Vector					result(0, 0, 1), sourceNormal;
+	const Vector			*n;
+	
+	haveHit = ctx->source->IntersectRay(inTexel->position, inTexel->normal, 0, ctx->maxDistance, hit);
+	if (ctx->source->IntersectRay(inTexel->position, -inTexel->normal, 0, ctx->maxDistance, backHit) && (!haveHit || backHit.distance < hit.distance))
+	{
+		hit = backHit;
+		haveHit = true;
+	}
+	
+	if (haveHit)
+	{
+		n = &ctx->sourceNormals[hit.triangle * 3];
+		sourceNormal = n[0] * (1.0f - hit.u - hit.v) + n[1] * hit.u + n[2] * hit.v;
+		if (0 != sourceNormal.SquareMagnitude())
+		{
+			sourceNormal.Normalize();
+			result.Set(sourceNormal * inTexel->tangent, sourceNormal * inTexel->bitangent, sourceNormal * inTexel->normal);
+		}
+	}
+	
+	outColour[0] = (uint8_t)lrintf((result.x * 0.5f + 0.5f) * 255.0f);
+	outColour[1] = (uint8_t)lrintf((result.y * 0.5f + 0.5f) * 255.0f);
+	outColour[2] = (uint8_t)lrintf((result.z * 0.5f + 0.5f) * 255.0f);
+}
+
+
+static void ShadeOcclusionTexel(const void *inContext, const BakeTexel *inTexel, unsigned inWorker, uint8_t outColour[3])
+{
+	const OcclusionContext	*ctx = (const OcclusionContext *)inContext;
+	uint8_t					value;
+	
+	value = (uint8_t)lrintf(Visibility(ctx, inTexel->position, inTexel->normal, inTexel->index) * 255.0f);
+	outColour[0] = outColour[1] = outColour[2] = value;
+	ctx->rayCounts[inWorker] += ctx->sampleCount;
+}
+
+
+static void BakeVertexOcclusion(void *context, size_t start, size_t end, unsigned worker)
+{
+	const OcclusionContext	*ctx = (const OcclusionContext *)context;
+	size_t					i;
+	Vector					normal;
+	
+	for (i = start; i != end; ++i)
+	{
+		normal = ctx->normals[i];
+		if (0 == normal.SquareMagnitude())
+		{
+			// Not used by any face.
+			ctx->visibility[i] = 1.0f;
+			continue;
+		}
+		
+		normal.Normalize();
+		ctx->visibility[i] = Visibility(ctx, ctx->positions[i], normal, i);
+		ctx->rayCounts[worker] += ctx->sampleCount;
+	}
+}
+
+
+/*	Fraction of cosine-weighted rays over the hemisphere around inNormal that
+	escape within maxDistance. The sample pattern is shifted (Cranley-Patterson
+	rotation) by a hash of inSeed, so neighbouring points don't share artefacts
+	but every run gives the same answer.
+*/
+static Scalar Visibility(const OcclusionContext *inContext, const Vector &inPosition, const Vector &inNormal, uint32_t inSeed)
+{
+	Vector					tangent, bitangent, origin, direction;
+	Scalar					shiftU, shiftV, u, v, radius, phi;
+	uint32_t				hash;
+	unsigned				i, open = 0;
+	
+	tangent = inNormal % ((fabs(inNormal.x) < 0.9f) ? Vector(1, 0, 0) : Vector(0, 1, 0));
+	tangent.Normalize();
+	bitangent = inNormal % tangent;
+	origin = inPosition + inNormal * inContext->bias;
+	
+	hash = HashIndex(inSeed);
+	shiftU = (hash & 0xFFFF) / 65536.0f;
+	shiftV = (hash >> 16) / 65536.0f;
+	
+	for (i = 0; i != inContext->sampleCount; ++i)
+	{
+		u = inContext->pattern[i].x + shiftU;
+		if (1.0f <= u)  u -= 1.0f;
+		v = inContext->pattern[i].y + shiftV;
+		if (1.0f <= v)  v -= 1.0f;
+		
+		radius = sqrtf(u);
+		phi = 2.0f * (Scalar)M_PI * v;
+		direction = tangent * (radius * cosf(phi)) + bitangent * (radius * sinf(phi)) + inNormal * sqrtf(1.0f - u);
+		
+		if (!inContext->bvh->Occluded(origin, direction, 0, inContext->maxDistance))  ++open;
+	}
+	
+	return (Scalar)open / inContext->sampleCount;
+}
+
+
+/*	Grow each chart outwards by kBakePaddingTexels, one ring per pass, with
+	each new texel the average of its covered neighbours, so that filtering and
+	mip-mapping don't pull in the background.
+*/
+static void PadCharts(uint8_t *ioPixels, uint8_t *ioCoverage, unsigned inWidth, unsigned inHeight, const uint8_t *inBackground)
+{
+	unsigned				pass, x, y, n, c;
+	int						dx, dy;
+	unsigned				sum[3];
+	size_t					i, neighbour;
+	
+	for (pass = 1; pass <= kBakePaddingTexels; ++pass)
+	{
+		for (y = 0; y != inHeight; ++y)  for (x = 0; x != inWidth; ++x)
+		{
+			i = (size_t)y * inWidth + x;
+			if (0 != ioCoverage[i])  continue;
+			
+			n = 0;
+			sum[0] = sum[1] = sum[2] = 0;
+			for (dy = -1; dy <= 1; ++dy)  for (dx = -1; dx <= 1; ++dx)
+			{
+				if ((0 == dx && 0 == dy) || (int)x + dx < 0 || (int)y + dy < 0 || inWidth <= x + dx || inHeight <= y + dy)  continue;
+				neighbour = i + dy * (int)inWidth + dx;
+				// Only texels filled before this pass, so each pass grows by exactly one ring.
+				if (0 == ioCoverage[neighbour] || ioCoverage[neighbour] > pass)  continue;
+				for (c = 0; c != 3; ++c)  sum[c] += ioPixels[neighbour * 4 + c];
+				++n;
+			}
+			
+			if (0 != n)
+			{
+				for (c = 0; c != 3; ++c)  ioPixels[i * 4 + c] = (sum[c] + n / 2) / n;
+				ioPixels[i * 4 + 3] = 255;
+				ioCoverage[i] = pass + 1;
+			}
+		}
+	}
+	
+	for (i = 0; i != (size_t)inWidth * inHeight; ++i)
+	{
+		if (0 == ioCoverage[i])
+		{
+			for (c = 0; c != 3; ++c)  ioPixels[i * 4 + c] = inBackground[c];
+			ioPixels[i * 4 + 3] = 255;
+		}
+	}
+}
+
+
+// Range of tiles [*outFirst, *outLast) touched by texel co-ordinates [inMin, inMax], clamped to the image.
+static inline void TileRange(Scalar inMin, Scalar inMax, unsigned inLimit, unsigned *outFirst, unsigned *outLast)
+{
+	if (inMax < 0 || inLimit <= inMin)
+	{
+		*outFirst = *outLast = 0;
+		return;
+	}
+	if (inMin < 0)  inMin = 0;
+	if (inLimit <= inMax)  inMax = inLimit - 1;
+	*outFirst = (unsigned)inMin / kBakeTileSize;
+	*outLast = (unsigned)inMax / kBakeTileSize + 1;
+}
+
+
+// Integer finalizer from MurmurHash3.
+static inline uint32_t HashIndex(uint32_t inValue)
+{
+	inValue ^= inValue >> 16;
+	inValue *= 0x85EBCA6B;
+	inValue ^= inValue >> 13;
+	inValue *= 0xC2B2AE35;
+	inValue ^= inValue >> 16;
+	return inValue;
+}
+
+
+// Van der Corput sequence in base 2.
+static inline Scalar RadicalInverse(uint32_t inValue)
+{
+	inValue = (inValue << 16) | (inValue >> 16);
+	inValue = ((inValue & 0x55555555) << 1) | ((inValue & 0xAAAAAAAA) >> 1);
+	inValue = ((inValue & 0x33333333) << 2) | ((inValue & 0xCCCCCCCC) >> 2);
+	inValue = ((inValue & 0x0F0F0F0F) << 4) | ((inValue & 0xF0F0F0F0) >> 4);
+	inValue = ((inValue & 0x00FF00FF) << 8) | ((inValue & 0xFF00FF00) >> 8);
+	return (Scalar)(inValue * 2.3283064365386963e-10);
+}
@@ -0,0 +1,583 @@
+/*
+	DDMesh+BinaryMesh.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMesh.h"
+#import "Logging.h"
+#import "DDProblemReportManager.h"
+#import "DDMaterial.h"
+#import "DDUtilities.h"
+#import "DDParallel.h"
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <errno.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+
+/*	Layout (see also “Dry Dock document format.txt”): a BinaryMeshHeader, then
+	sectionCount BinaryMeshSections, then the sections' contents, each
+	starting at a multiple of kBinaryMeshAlignment bytes from the start of the
+	file. All values are little-endian. Arrays have the same layout as the
+	corresponding DDMesh ivars; their element sizes are recorded so that a
+	build with different types (such as double Scalars) rejects the file
+	instead of misreading it. Unknown sections are ignored.
+*/
+typedef struct
+{
+	uint8_t					cookie[4];		// 'D', 'r', 'y', 'M'
+	uint32_t				version;		// kBinaryMeshVersion
+	uint32_t				flags;
+	uint32_t				sectionCount;
+} BinaryMeshHeader;
+
+
+typedef struct
+{
+	uint32_t				tag;
+	uint32_t				elementSize;
+	uint32_t				count;
+	uint32_t				reserved;
+	uint64_t				offset;
+} BinaryMeshSection;
+
+
+enum
+{
+	kBinaryMeshVersion			= 1,
+	kBinaryMeshAlignment		= 16,
+	
+	kFlagHasNonTriangles		= 1UL << 0,
+	kFlagHasBadPolygons			= 1UL << 1,
+	kFlagHasBadEdges			= 1UL << 2
+};
+
+
+typedef enum
+{
+	kSectionVertices,
+	kSectionNormals,
+	kSectionTexCoords,
+	kSectionFaces,
+	kSectionFaceVertexIndices,
+	kSectionFaceTexCoordIndices,
+	kSectionVertexNormalIndices,
+	kSectionBounds,
+	kSectionInfo,
+	
+	kSectionTypeCount
+} SectionType;
+
+
+static const struct
+{
+	uint32_t				tag;
+	uint32_t				elementSize;
+} kSections[kSectionTypeCount] =
+{
+	{ 'vert', sizeof (Vector) },
+	{ 'norm', sizeof (Vector) },
+	{ 'texc', sizeof (Vector2) },
+	{ 'face', sizeof (DDMeshFaceData) },
+	{ 'fvix', sizeof (DDMeshIndex) },
+	{ 'ftix', sizeof (DDMeshIndex) },
+	{ 'vnix', sizeof (DDMeshIndex) },
+	{ 'bnds', sizeof (Scalar) },		// xMin, xMax, yMin, yMax, zMin, zMax, rMax
+	{ 'info', 1 }						// Binary property list: name, materials
+};
+
+
+enum
+{
+	kBoundsCount				= 7
+};
+
+
+typedef struct
+{
+	const DDMeshFaceData	*faces;
+	const DDMeshIndex		*faceVertexIndices;
+	const DDMeshIndex		*faceTexCoordIndices;
+	const DDMeshIndex		*vertexNormalIndices;
+	unsigned				faceVertexIndexCount;
+	DDMeshIndex				vertexCount, normalCount, texCoordCount, materialCount;
+	volatile BOOL			failed;
+} ValidateContext;
+
+
+static void ValidateFaces(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+static void ValidateIndices(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+
+#if __BIG_ENDIAN__
+static void *CopySwappedSection(const uint8_t *inBytes, SectionType inType, uint32_t inCount);
+#endif
+
+
+@implementation DDMesh (BinaryMesh)
+
+- (id)initWithBinaryMesh:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@", inFile);
+	
+	BOOL					OK = YES;
+	int						fd;
+	struct stat				statBuf;
+	uint8_t					*bytes = NULL;
+	size_t					length = 0;
+	const BinaryMeshHeader	*header = NULL;
+	const BinaryMeshSection	*table, *section;
+	const BinaryMeshSection	*found[kSectionTypeCount] = { NULL };
+	uint32_t				i, j, sectionCount, flags = 0;
+	uint64_t				end;
+	void					*arrays[kSectionTypeCount] = { NULL };
+	Scalar					bounds[kBoundsCount];
+	NSDictionary			*info = nil;
+	NSArray					*materials = nil;
+	NSData					*infoData;
+	ValidateContext			context = { 0 };
+	
+	self = [super init];
+	if (nil == self) return nil;
+	
+	fd = open([[inFile path] fileSystemRepresentation], O_RDONLY);
+	if (fd < 0 || fstat(fd, &statBuf) < 0)
+	{
+		OK = NO;
+		[ioIssues addStopIssueWithKey:@"noDataLoaded" localizedFormat:@"No data could be loaded from %@. %@", [inFile displayString], [NSString stringWithUTF8String:strerror(errno)]];
+	}
+	
+	if (OK)
+	{
+		length = statBuf.st_size;
+		if (length < sizeof *header) OK = NO;
+		else
+		{
+			/*	Private and writable, so that mutators can modify the arrays in
+				place; pages are copied only when written to.
+			*/
+			bytes = (uint8_t *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+			if (MAP_FAILED == bytes)
+			{
+				bytes = NULL;
+				OK = NO;
+			}
+		}
+		if (!OK) [ioIssues addStopIssueWithKey:@"notValidBinaryMesh" localizedFormat:@"%@ is not a valid Dry Dock binary mesh.", [inFile displayString]];
+	}
+	if (0 <= fd) close(fd);
+	
+	#if !__BIG_ENDIAN__
+		// The arrays are used in place, so the mapping lives as long as the mesh.
+		_mappedBytes = bytes;
+		_mappedLength = length;
+	#endif
+	
+	if (OK)
+	{
+		header = (const BinaryMeshHeader *)bytes;
+		sectionCount = CFSwapInt32LittleToHost(header->sectionCount);
+		if (header->cookie[0] != 'D' || header->cookie[1] != 'r' || header->cookie[2] != 'y' || header->cookie[3] != 'M' || (length - sizeof *header) / sizeof *table < sectionCount)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"notValidBinaryMesh" localizedFormat:@"%@ is not a valid Dry Dock binary mesh.", [inFile displayString]];
+		}
+		else if (kBinaryMeshVersion < CFSwapInt32LittleToHost(header->version))
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"outOfDateBinaryMesh" localizedFormat:@"%@ appears to be generated by a newer version of Dry Dock; it is in an incompatible format.", [inFile displayString]];
+		}
+		flags = CFSwapInt32LittleToHost(header->flags);
+	}
+	
+	// Find the sections and check that they lie within the file.
+	if (OK)
+	{
+		table = (const BinaryMeshSection *)(header + 1);
+		for (i = 0; OK && i != sectionCount; ++i)
+		{
+			section = &table[i];
+			for (j = 0; j != kSectionTypeCount; ++j)
+			{
+				if (CFSwapInt32LittleToHost(section->tag) == kSections[j].tag)  break;
+			}
+			if (j == kSectionTypeCount || NULL != found[j])  continue;
+			
+			end = CFSwapInt64LittleToHost(section->offset) + (uint64_t)CFSwapInt32LittleToHost(section->count) * kSections[j].elementSize;
+			if (CFSwapInt32LittleToHost(section->elementSize) != kSections[j].elementSize ||
+				CFSwapInt64LittleToHost(section->offset) % kBinaryMeshAlignment != 0 ||
+				length < end || end < CFSwapInt64LittleToHost(section->offset))
+			{
+				OK = NO;
+			}
+			found[j] = section;
+		}
+		
+		for (j = 0; OK && j != kSectionTypeCount; ++j)
+		{
+			if (NULL == found[j]) OK = NO;
+		}
+		if (OK && CFSwapInt32LittleToHost(found[kSectionBounds]->count) != kBoundsCount) OK = NO;
+		if (OK && (kDDMeshIndexMax < CFSwapInt32LittleToHost(found[kSectionVertices]->count) ||
+				   kDDMeshIndexMax < CFSwapInt32LittleToHost(found[kSectionNormals]->count) ||
+				   kDDMeshIndexMax < CFSwapInt32LittleToHost(found[kSectionTexCoords]->count) ||
+				   kDDMeshIndexMax < CFSwapInt32LittleToHost(found[kSectionFaces]->count) ||
+				   CFSwapInt32LittleToHost(found[kSectionFaceTexCoordIndices]->count) != CFSwapInt32LittleToHost(found[kSectionFaceVertexIndices]->count) ||
+				   CFSwapInt32LittleToHost(found[kSectionVertexNormalIndices]->count) != CFSwapInt32LittleToHost(found[kSectionFaceVertexIndices]->count)))
+		{
+			OK = NO;
+		}
+		
+		if (!OK)  [ioIssues addStopIssueWithKey:@"notValidBinaryMesh" localizedFormat:@"%@ is not a valid Dry Dock binary mesh.", [inFile displayString]];
+	}
+	
+	// Adopt the arrays.
+	if (OK)
+	{
+		for (j = 0; j != kSectionInfo; ++j)
+		{
+			#if __BIG_ENDIAN__
+				arrays[j] = CopySwappedSection(bytes + CFSwapInt64LittleToHost(found[j]->offset), (SectionType)j, CFSwapInt32LittleToHost(found[j]->count));
+				if (NULL == arrays[j])  OK = NO;
+			#else
+				arrays[j] = bytes + found[j]->offset;
+			#endif
+		}
+		
+		_vertices = (Vector *)arrays[kSectionVertices];
+		_vertexCount = CFSwapInt32LittleToHost(found[kSectionVertices]->count);
+		_normals = (Vector *)arrays[kSectionNormals];
+		_normalCount = CFSwapInt32LittleToHost(found[kSectionNormals]->count);
+		_texCoords = (Vector2 *)arrays[kSectionTexCoords];
+		_texCoordCount = CFSwapInt32LittleToHost(found[kSectionTexCoords]->count);
+		_faces = (DDMeshFaceData *)arrays[kSectionFaces];
+		_faceCount = CFSwapInt32LittleToHost(found[kSectionFaces]->count);
+		_faceVertexIndices = (DDMeshIndex *)arrays[kSectionFaceVertexIndices];
+		_faceTexCoordIndices = (DDMeshIndex *)arrays[kSectionFaceTexCoordIndices];
+		_vertexNormalIndices = (DDMeshIndex *)arrays[kSectionVertexNormalIndices];
+		_faceVertexIndexCount = CFSwapInt32LittleToHost(found[kSectionFaceVertexIndices]->count);
+		
+		if (!OK) [ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+	}
+	
+	if (OK)
+	{
+		bcopy(arrays[kSectionBounds], bounds, sizeof bounds);
+		#if __BIG_ENDIAN__
+			free(arrays[kSectionBounds]);
+		#endif
+		_xMin = bounds[0];
+		_xMax = bounds[1];
+		_yMin = bounds[2];
+		_yMax = bounds[3];
+		_zMin = bounds[4];
+		_zMax = bounds[5];
+		_rMax = bounds[6];
+		
+		_hasNonTriangles = (flags & kFlagHasNonTriangles) != 0;
+		_hasBadPolygons = (flags & kFlagHasBadPolygons) != 0;
+		_hasBadEdges = (flags & kFlagHasBadEdges) != 0;
+		
+		infoData = [NSData dataWithBytes:bytes + CFSwapInt64LittleToHost(found[kSectionInfo]->offset) length:CFSwapInt32LittleToHost(found[kSectionInfo]->count)];
+		info = [NSPropertyListSerialization propertyListFromData:infoData mutabilityOption:NSPropertyListImmutable format:NULL errorDescription:NULL];
+		if ([info isKindOfClass:[NSDictionary class]])  materials = [info objectForKey:@"materials"];
+		if (![materials isKindOfClass:[NSArray class]] || kDDMeshIndexMax < [materials count])
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"notValidBinaryMesh" localizedFormat:@"%@ is not a valid Dry Dock binary mesh.", [inFile displayString]];
+		}
+	}
+	
+	if (OK)
+	{
+		if ([[info objectForKey:@"name"] isKindOfClass:[NSString class]])  _name = [[info objectForKey:@"name"] copy];
+		
+		_materialCount = [materials count];
+		_materials = (DDMaterial **)calloc(sizeof (DDMaterial *), _materialCount ? _materialCount : 1);
+		if (NULL == _materials)
+		{
+			OK = NO;
+			_materialCount = 0;
+			[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+		}
+		for (i = 0; OK && i != _materialCount; ++i)
+		{
+			_materials[i] = [[DDMaterial alloc] initWithPropertyListRepresentation:[materials objectAtIndex:i] issues:ioIssues];
+			if (nil == _materials[i])  OK = NO;
+			else  [_materials[i] setDiffuseMap:[_materials[i] diffuseMapName] relativeTo:inFile issues:ioIssues];
+		}
+	}
+	
+	/*	Only the indices are checked, since bad ones would make the mesh read
+		out of bounds; other arrays aren't touched, so their pages aren't read
+		until something uses them.
+	*/
+	if (OK)
+	{
+		context.faces = _faces;
+		context.faceVertexIndices = _faceVertexIndices;
+		context.faceTexCoordIndices = _faceTexCoordIndices;
+		context.vertexNormalIndices = _vertexNormalIndices;
+		context.faceVertexIndexCount = _faceVertexIndexCount;
+		context.vertexCount = _vertexCount;
+		context.normalCount = _normalCount;
+		context.texCoordCount = _texCoordCount;
+		context.materialCount = _materialCount;
+		
+		DDParallelApply(_faceCount, 0, ValidateFaces, &context);
+		if (!context.failed)  DDParallelApply(_faceVertexIndexCount, 0, ValidateIndices, &context);
+		if (context.failed)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"notValidBinaryMesh" localizedFormat:@"%@ is not a valid Dry Dock binary mesh.", [inFile displayString]];
+		}
+	}
+	
+	#if __BIG_ENDIAN__
+		if (NULL != bytes)  munmap(bytes, length);
+	#endif
+	
+	if (!OK)
+	{
+		[self release];
+		self = nil;
+	}
+	
+	return self;
+	TraceExit();
+}
+
+
+- (BOOL)writeBinaryMeshToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	NSMutableData			*data = nil;
+	NSMutableArray			*materials;
+	NSMutableDictionary		*info;
+	NSData					*infoData = nil;
+	NSString				*errorDesc = nil;
+	NSError					*error = nil;
+	const void				*arrays[kSectionTypeCount];
+	uint32_t				counts[kSectionTypeCount];
+	BinaryMeshHeader		header = {{ 'D', 'r', 'y', 'M' }, 0, 0, 0 };
+	BinaryMeshSection		table[kSectionTypeCount];
+	Scalar					bounds[kBoundsCount];
+	Vector					min, max;
+	uint64_t				offset;
+	id						plist;
+	unsigned				i;
+	
+	[self getBoundsMin:&min max:&max];
+	bounds[0] = min.x;
+	bounds[1] = max.x;
+	bounds[2] = min.y;
+	bounds[3] = max.y;
+	bounds[4] = min.z;
+	bounds[5] = max.z;
+	bounds[6] = [self boundingRadius];
+	
+	materials = [NSMutableArray arrayWithCapacity:_materialCount];
+	for (i = 0; OK && i != _materialCount; ++i)
+	{
+		plist = [_materials[i] propertyListRepresentationWithIssues:ioIssues];
+		if (nil != plist)  [materials addObject:plist];
+		else  OK = NO;
+	}
+	
+	if (OK)
+	{
+		info = [NSMutableDictionary dictionaryWithObject:materials forKey:@"materials"];
+		if (nil != _name)  [info setObject:_name forKey:@"name"];
+		infoData = [NSPropertyListSerialization dataFromPropertyList:info format:NSPropertyListBinaryFormat_v1_0 errorDescription:&errorDesc];
+		if (nil == infoData)
+		{
+			OK = NO;
+			[ioIssues addNoteIssueWithKey:@"noConvertToPList" localizedFormat:@"The data generated by the document could not be converted to the required format (%@).", errorDesc];
+		}
+	}
+	
+	if (OK)
+	{
+		arrays[kSectionVertices] = _vertices;						counts[kSectionVertices] = _vertexCount;
+		arrays[kSectionNormals] = _normals;							counts[kSectionNormals] = _normalCount;
+		arrays[kSectionTexCoords] = _texCoords;						counts[kSectionTexCoords] = _texCoordCount;
+		arrays[kSectionFaces] = _faces;								counts[kSectionFaces] = _faceCount;
+		arrays[kSectionFaceVertexIndices] = _faceVertexIndices;		counts[kSectionFaceVertexIndices] = _faceVertexIndexCount;
+		arrays[kSectionFaceTexCoordIndices] = _faceTexCoordIndices;	counts[kSectionFaceTexCoordIndices] = _faceVertexIndexCount;
+		arrays[kSectionVertexNormalIndices] = _vertexNormalIndices;	counts[kSectionVertexNormalIndices] = _faceVertexIndexCount;
+		arrays[kSectionBounds] = bounds;							counts[kSectionBounds] = kBoundsCount;
+		arrays[kSectionInfo] = [infoData bytes];					counts[kSectionInfo] = [infoData length];
+		
+		header.version = CFSwapInt32HostToLittle(kBinaryMeshVersion);
+		header.flags = CFSwapInt32HostToLittle((_hasNonTriangles ? kFlagHasNonTriangles : 0) |
+											   (_hasBadPolygons ? kFlagHasBadPolygons : 0) |
+											   (_hasBadEdges ? kFlagHasBadEdges : 0));
+		header.sectionCount = CFSwapInt32HostToLittle(kSectionTypeCount);
+		
+		offset = sizeof header + sizeof table;
+		for (i = 0; i != kSectionTypeCount; ++i)
+		{
+			offset = (offset + kBinaryMeshAlignment - 1) & ~(uint64_t)(kBinaryMeshAlignment - 1);
+			table[i].tag = CFSwapInt32HostToLittle(kSections[i].tag);
+			table[i].elementSize = CFSwapInt32HostToLittle(kSections[i].elementSize);
+			table[i].count = CFSwapInt32HostToLittle(counts[i]);
+			table[i].reserved = 0;
+			table[i].offset = CFSwapInt64HostToLittle(offset);
+			offset += (uint64_t)counts[i] * kSections[i].elementSize;
+		}
+		
+		data = [NSMutableData dataWithCapacity:offset];
+		if (nil == data || (NSUInteger)offset != offset)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage."];
+		}
+	}
+	
+	if (OK)
+	{
+		[data appendBytes:&header length:sizeof header];
+		[data appendBytes:table length:sizeof table];
+		for (i = 0; i != kSectionTypeCount; ++i)
+		{
+			[data setLength:CFSwapInt64LittleToHost(table[i].offset)];	// Zero padding
+			#if __BIG_ENDIAN__
+				void *swapped = CopySwappedSection((const uint8_t *)arrays[i], (SectionType)i, counts[i]);
+				if (NULL != swapped)  [data appendBytes:swapped length:counts[i] * kSections[i].elementSize];
+				else  OK = NO;
+				free(swapped);
+			#else
+				[data appendBytes:arrays[i] length:counts[i] * kSections[i].elementSize];
+			#endif
+		}
+		if (!OK)  [ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage."];
+	}
+	
+	if (OK)
+	{
+		OK = [data writeToURL:inFile options:NSAtomicWrite error:&error];
+		if (!OK)
+		{
+			if (nil != error) [ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %@", [error localizedFailureReason]];
+			else [ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved, because an unknown error occured."];
+		}
+	}
+	
+	return OK;
+	TraceExit();
+}
+
+@end
+
+
+static void ValidateFaces(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	ValidateContext			*context = (ValidateContext *)inContext;
+	const DDMeshFaceData	*face;
+	size_t					i;
+	
+	for (i = inStart; i != inEnd; ++i)
+	{
+		face = &context->faces[i];
+		if (face->vertexCount < 3 || kMaxVertsPerFace < face->vertexCount ||
+			context->faceVertexIndexCount < face->vertexCount ||
+			context->faceVertexIndexCount - face->vertexCount < face->firstVertex ||
+			context->normalCount <= face->normal || context->materialCount <= face->material)
+		{
+			context->failed = YES;
+			return;
+		}
+	}
+}
+
+
+static void ValidateIndices(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	ValidateContext			*context = (ValidateContext *)inContext;
+	size_t					i;
+	
+	for (i = inStart; i != inEnd; ++i)
+	{
+		if (context->vertexCount <= context->faceVertexIndices[i] ||
+			context->texCoordCount <= context->faceTexCoordIndices[i] ||
+			context->normalCount <= context->vertexNormalIndices[i])
+		{
+			context->failed = YES;
+			return;
+		}
+	}
+}
+
+
+#if __BIG_ENDIAN__
+// Malloced copy of a section, converted between little-endian and native order.
+static void *CopySwappedSection(const uint8_t *inBytes, SectionType inType, uint32_t inCount)
+{
+	size_t					size = (size_t)inCount * kSections[inType].elementSize;
+	size_t					i, j, wordSize, wordsPerElement;
+	uint8_t					*result, *word;
+	
+	result = (uint8_t *)malloc(size ? size : 1);
+	if (NULL == result)  return NULL;
+	bcopy(inBytes, result, size);
+	
+	switch (inType)
+	{
+		case kSectionInfo:
+			return result;
+		
+		case kSectionFaces:
+			// normal, material and firstVertex; the rest are bytes.
+			wordSize = sizeof (DDMeshIndex);
+			wordsPerElement = 3;
+			break;
+		
+		case kSectionFaceVertexIndices:
+		case kSectionFaceTexCoordIndices:
+		case kSectionVertexNormalIndices:
+			wordSize = sizeof (DDMeshIndex);
+			wordsPerElement = 1;
+			break;
+		
+		default:
+			wordSize = sizeof (Scalar);
+			wordsPerElement = kSections[inType].elementSize / sizeof (Scalar);
+	}
+	
+	for (i = 0; i != inCount; ++i)
+	{
+		for (j = 0; j != wordsPerElement; ++j)
+		{
+			word = result + i * kSections[inType].elementSize + j * wordSize;
+			for (size_t k = 0; k != wordSize / 2; ++k)
+			{
+				uint8_t t = word[k];
+				word[k] = word[wordSize - 1 - k];
+				word[wordSize - 1 - k] = t;
+			}
+		}
+	}
+	
+	return result;
+}
+#endif
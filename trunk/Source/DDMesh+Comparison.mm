@@ -0,0 +1,286 @@
+/*
+	DDMesh+Comparison.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Surface deviation measurement between two meshes: one-sided and symmetric
+	(Hausdorff) distances, estimated by closest-point queries from area-weighted
+	surface samples into a BVH of the other mesh.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMesh.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import "DDTriangleBVH.h"
+#import "DDParallel.h"
+
+
+enum
+{
+	kDefaultComparisonSampleCount	= 50000
+};
+
+
+typedef struct DeviationSampleContext
+{
+	const Vector			*triangles;			// 3 vertices per triangle
+	const NSUInteger		*sampleStart;		// Index of first sample for each triangle, plus one past the end
+	const DDTriangleBVH		*target;
+	double					*triangleSum;		// Per-triangle partial results, reduced serially for determinism
+	double					*triangleSumSq;
+	Scalar					*triangleMax;
+} DeviationSampleContext;
+
+
+typedef struct DeviationVertexContext
+{
+	const Vector			*vertices;
+	const DDTriangleBVH		*target;
+	Scalar					*deviations;
+} DeviationVertexContext;
+
+
+static void SampleTriangles(void *context, size_t start, size_t end, unsigned worker);
+static void MeasureVertices(void *context, size_t start, size_t end, unsigned worker);
+
+
+@implementation DDMesh (Comparison)
+
+- (DDTriangleBVH *)newTriangleBVH
+{
+	Vector					*soup = NULL;
+	uint32_t				*tags = NULL;
+	uint32_t				triangleCount;
+	DDTriangleBVH			*result = NULL;
+	
+	soup = [self copyTriangleSoup:&triangleCount faceTags:&tags];
+	if (soup != NULL)
+	{
+		result = new DDTriangleBVH(soup, triangleCount, tags);
+		if (!result->IsValid())
+		{
+			delete result;
+			result = NULL;
+		}
+	}
+	
+	Free(soup);
+	Free(tags);
+	return result;
+}
+
+
+- (BOOL)getDeviationFromMesh:(DDMesh *)inOther sampleCount:(NSUInteger)inSampleCount result:(DDMeshDeviation *)outResult vertexDeviations:(NSData **)outVertexDeviations
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	Vector					*soup = NULL;
+	uint32_t				i, triangleCount = 0;
+	DDTriangleBVH			*target = NULL;
+	double					*areas = NULL, totalArea = 0, carry = 0, sum = 0, sumSq = 0;
+	NSUInteger				*sampleStart = NULL, sampleCount = 0, n;
+	double					*triangleSum = NULL, *triangleSumSq = NULL;
+	Scalar					*triangleMax = NULL, *vertexDeviations = NULL, maximum = 0;
+	DeviationSampleContext	sampleContext;
+	DeviationVertexContext	vertexContext;
+	
+	if (outResult == NULL || inOther == nil || _faceCount == 0 || inOther->_faceCount == 0)  OK = NO;
+	if (inSampleCount == 0)  inSampleCount = kDefaultComparisonSampleCount;
+	
+	if (OK)
+	{
+		target = [inOther newTriangleBVH];
+		soup = [self copyTriangleSoup:&triangleCount faceTags:NULL];
+		if (target == NULL || soup == NULL)  OK = NO;
+	}
+	
+	if (OK)
+	{
+		areas = (double *)malloc(sizeof *areas * triangleCount);
+		sampleStart = (NSUInteger *)malloc(sizeof *sampleStart * (triangleCount + 1));
+		triangleSum = (double *)malloc(sizeof *triangleSum * triangleCount);
+		triangleSumSq = (double *)malloc(sizeof *triangleSumSq * triangleCount);
+		triangleMax = (Scalar *)malloc(sizeof *triangleMax * triangleCount);
+		vertexDeviations = (Scalar *)malloc(sizeof *vertexDeviations * _vertexCount);
+		if (areas == NULL || sampleStart == NULL || triangleSum == NULL || triangleSumSq == NULL || triangleMax == NULL || vertexDeviations == NULL)  OK = NO;
+	}
+	
+	if (OK)
+	{
+		/*	Distribute samples in proportion to area, carrying the fractional
+			part forward so the total comes out right and the distribution
+			doesn't depend on anything but the geometry. Each triangle gets at
+			least one sample (its centroid, in effect), so small details aren't
+			missed entirely.
+		*/
+		for (i = 0; i != triangleCount; ++i)
+		{
+			const Vector *t = soup + i * 3;
+			areas[i] = ((t[1] - t[0]) % (t[2] - t[0])).Magnitude() * 0.5;
+			totalArea += areas[i];
+		}
+		
+		for (i = 0; i != triangleCount; ++i)
+		{
+			sampleStart[i] = sampleCount;
+			carry += (totalArea > 0) ? areas[i] / totalArea * inSampleCount : 0;
+			n = (NSUInteger)carry;
+			carry -= n;
+			if (n == 0)  n = 1;
+			sampleCount += n;
+		}
+		sampleStart[triangleCount] = sampleCount;
+		
+		sampleContext.triangles = soup;
+		sampleContext.sampleStart = sampleStart;
+		sampleContext.target = target;
+		sampleContext.triangleSum = triangleSum;
+		sampleContext.triangleSumSq = triangleSumSq;
+		sampleContext.triangleMax = triangleMax;
+		DDParallelApply(triangleCount, 0, SampleTriangles, &sampleContext);
+		
+		// Vertices are sampled separately; corners are where deviations tend to peak.
+		vertexContext.vertices = _vertices;
+		vertexContext.target = target;
+		vertexContext.deviations = vertexDeviations;
+		DDParallelApply(_vertexCount, 0, MeasureVertices, &vertexContext);
+		
+		for (i = 0; i != triangleCount; ++i)
+		{
+			sum += triangleSum[i];
+			sumSq += triangleSumSq[i];
+			if (maximum < triangleMax[i])  maximum = triangleMax[i];
+		}
+		for (i = 0; i != _vertexCount; ++i)
+		{
+			sum += vertexDeviations[i];
+			sumSq += (double)vertexDeviations[i] * vertexDeviations[i];
+			if (maximum < vertexDeviations[i])  maximum = vertexDeviations[i];
+		}
+		sampleCount += _vertexCount;
+		
+		outResult->maximum = maximum;
+		outResult->mean = sum / sampleCount;
+		outResult->rms = sqrt(sumSq / sampleCount);
+		outResult->sampleCount = sampleCount;
+		
+		if (outVertexDeviations != NULL)
+		{
+			*outVertexDeviations = [NSData dataWithBytesNoCopy:vertexDeviations length:sizeof *vertexDeviations * _vertexCount freeWhenDone:YES];
+			vertexDeviations = NULL;
+		}
+	}
+	
+	delete target;
+	Free(soup);
+	Free(areas);
+	Free(sampleStart);
+	Free(triangleSum);
+	Free(triangleSumSq);
+	Free(triangleMax);
+	Free(vertexDeviations);
+	
+	return OK;
+	TraceExit();
+}
+
+
+- (BOOL)compareWithMesh:(DDMesh *)inOther sampleCount:(NSUInteger)inSampleCount result:(DDMeshDeviation *)outResult forward:(DDMeshDeviation *)outForward backward:(DDMeshDeviation *)outBackward
+{
+	DDMeshDeviation			forward, backward;
+	NSUInteger				total;
+	
+	if (outResult == NULL)  return NO;
+	if (![self getDeviationFromMesh:inOther sampleCount:inSampleCount result:&forward vertexDeviations:NULL])  return NO;
+	if (![inOther getDeviationFromMesh:self sampleCount:inSampleCount result:&backward vertexDeviations:NULL])  return NO;
+	
+	total = forward.sampleCount + backward.sampleCount;
+	outResult->maximum = (forward.maximum < backward.maximum) ? backward.maximum : forward.maximum;
+	outResult->mean = (forward.mean * forward.sampleCount + backward.mean * backward.sampleCount) / total;
+	outResult->rms = sqrt((forward.rms * forward.rms * forward.sampleCount + backward.rms * backward.rms * backward.sampleCount) / total);
+	outResult->sampleCount = total;
+	
+	if (outForward != NULL)  *outForward = forward;
+	if (outBackward != NULL)  *outBackward = backward;
+	
+	return YES;
+}
+
+@end
+
+
+/*	Samples within a triangle follow the R2 low-discrepancy sequence, folded
+	into the triangle. This is deterministic and spreads samples more evenly
+	than a pseudo-random sequence would.
+*/
+static void SampleTriangles(void *context, size_t start, size_t end, unsigned worker)
+{
+	DeviationSampleContext	*ctxt = (DeviationSampleContext *)context;
+	const double			kR2A = 0.7548776662466927, kR2B = 0.5698402909980532;
+	size_t					i;
+	NSUInteger				j, n;
+	double					u, v, sum, sumSq;
+	Scalar					maximum;
+	DDTriangleBVHHit		hit;
+	
+	for (i = start; i != end; ++i)
+	{
+		const Vector *t = ctxt->triangles + i * 3;
+		Vector e1 = t[1] - t[0], e2 = t[2] - t[0];
+		
+		n = ctxt->sampleStart[i + 1] - ctxt->sampleStart[i];
+		sum = sumSq = 0;
+		maximum = 0;
+		
+		for (j = 0; j != n; ++j)
+		{
+			u = fmod(0.5 + kR2A * (j + 1), 1.0);
+			v = fmod(0.5 + kR2B * (j + 1), 1.0);
+			if (1.0 < u + v)  { u = 1.0 - u; v = 1.0 - v; }
+			
+			Vector p = t[0] + e1 * (Scalar)u + e2 * (Scalar)v;
+			if (ctxt->target->ClosestPoint(p, INFINITY, hit))
+			{
+				sum += hit.distance;
+				sumSq += (double)hit.distance * hit.distance;
+				if (maximum < hit.distance)  maximum = hit.distance;
+			}
+		}
+		
+		ctxt->triangleSum[i] = sum;
+		ctxt->triangleSumSq[i] = sumSq;
+		ctxt->triangleMax[i] = maximum;
+	}
+}
+
+
+static void MeasureVertices(void *context, size_t start, size_t end, unsigned worker)
+{
+	DeviationVertexContext	*ctxt = (DeviationVertexContext *)context;
+	size_t					i;
+	DDTriangleBVHHit		hit;
+	
+	for (i = start; i != end; ++i)
+	{
+		if (ctxt->target->ClosestPoint(ctxt->vertices[i], INFINITY, hit))  ctxt->deviations[i] = hit.distance;
+		else  ctxt->deviations[i] = 0;
+	}
+}
@@ -32,6 +32,16 @@
 #define DRAW(vec)		do { Vector v = (vec); glVertex3f(v.x, v.y, v.z); } while (0)
 #define NORMAL(vec)		do { Vector v = (vec); glNormal3f(v.x, v.y, v.z); } while (0)
 #define TEXCOORDS(vec2)	do { Vector2 v = (vec2); glTexCoord2f(v.x, v.y); } while (0)
+#define OCCLUSION(idx)	do { if (NULL != inVisibility) { GLfloat o = inVisibility[(idx)]; glColor3f(o, o, o); } } while (0)
+
+#if USE_SHORT_INDICES
+	#define GL_MESH_INDEX	GL_UNSIGNED_SHORT
+#else
+	#define GL_MESH_INDEX	GL_UNSIGNED_INT
+#endif
+
+
+static void DeviationColour(Scalar inDeviation, Scalar inRange, GLfloat outColour[4]);
 
 
 @implementation DDMesh (GLRendering)
@@ -39,10 +49,7 @@
 - (void)glRenderWireframe
 {
 	WFModeContext			wfmc;
-	unsigned				i;
-	uint8_t					j;
-	DDMeshFaceData			*face;
-	unsigned				vertIdx;
+	const DDMeshEdge		*edges;
 	
 	CGL_MACRO_DECLARE_VARIABLES();
 	
@@ -51,27 +58,16 @@
 	glVertexPointer(3, GL_SCALAR, 0, _vertices);
 	glEnableClientState(GL_VERTEX_ARRAY);
 	
-	face = _faces;
-	glColor3f(0.6f, 0.6f, 0.0f);
-	for (i = 0; i != _faceCount; ++i)
+	// Each shared edge is drawn once, rather than once per face as with a line loop per face.
+	edges = [self edges];
+	if (edges != NULL)
 	{
-		glBegin(GL_LINE_LOOP);
-		vertIdx = face->firstVertex;
-		for (j = 0; j != face->vertexCount; ++j)
-		{
-			glArrayElement(_faceVertexIndices[vertIdx++]);
-		}
-		glEnd();
-		face++;
+		glColor3f(0.6f, 0.6f, 0.0f);
+		glDrawElements(GL_LINES, _edgeCount * 2, GL_MESH_INDEX, edges);
 	}
 	
 	glColor3f(1.0f, 1.0f, 0.0f);
-	glBegin(GL_POINTS);
-	for (i = 0; i != _vertexCount; ++i)
-	{
-		DRAW(_vertices[i]);
-	}
-	glEnd();
+	glDrawArrays(GL_POINTS, 0, _vertexCount);
 	
 	glDisableClientState(GL_VERTEX_ARRAY);
 	glBindTexture(GL_TEXTURE_2D, 0);
@@ -81,6 +77,12 @@
 
 
 - (void)glRenderShaded
+{
+	[self glRenderShadedWithOcclusion:NULL];
+}
+
+
+- (void)glRenderShadedWithOcclusion:(const Scalar *)inVisibility
 {
 	unsigned				i, j, matIdx;
 	DDMeshFaceData			*face;
@@ -94,6 +96,14 @@
 	glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, white);
 	glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, white);
 	
+	// Occlusion darkens the material's ambient and diffuse response per vertex.
+	if (NULL != inVisibility)
+	{
+		glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT);
+		glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+		glEnable(GL_COLOR_MATERIAL);
+	}
+	
 	matIdx = _faces[0].material;
 	NSAssert(matIdx < _materialCount, @"Material index out of range");
 	currentMaterial = _materials[matIdx];
@@ -122,6 +132,7 @@
 			for (j = 0; j != face->vertexCount; ++j)
 			{
 				TEXCOORDS(_texCoords[_faceTexCoordIndices[vertIdx]]);
+				OCCLUSION(_faceVertexIndices[vertIdx]);
 				glArrayElement(_faceVertexIndices[vertIdx]);
 				++vertIdx;
 			}
@@ -150,12 +161,15 @@
 			vertIdx = face->firstVertex;
 			
 			TEXCOORDS(_texCoords[_faceTexCoordIndices[vertIdx]]);
+			OCCLUSION(_faceVertexIndices[vertIdx]);
 			glArrayElement(_faceVertexIndices[vertIdx]);
 			
 			TEXCOORDS(_texCoords[_faceTexCoordIndices[vertIdx + 1]]);
+			OCCLUSION(_faceVertexIndices[vertIdx + 1]);
 			glArrayElement(_faceVertexIndices[vertIdx + 1]);
 			
 			TEXCOORDS(_texCoords[_faceTexCoordIndices[vertIdx + 2]]);
+			OCCLUSION(_faceVertexIndices[vertIdx + 2]);
 			glArrayElement(_faceVertexIndices[vertIdx + 2]);
 			
 			++face;
@@ -165,40 +179,33 @@
 	
 	glDisableClientState(GL_VERTEX_ARRAY);
 	glBindTexture(GL_TEXTURE_2D, 0);
+	if (NULL != inVisibility)  glPopAttrib();
 }
 
 
 - (void)glRenderNormals
 {
 	WFModeContext			wfmc;
-	unsigned				i, j;
+	unsigned				i;
 	DDMeshFaceData			*face;
-	Vector					c;
+	const Vector			*centroids;
 	Scalar					normLength;
-	unsigned				vertIdx;
 	
 	CGL_MACRO_DECLARE_VARIABLES();
 	
+	centroids = [self faceCentroids];
+	if (centroids == NULL)  return;
+	
 	EnterWireframeMode(wfmc);
 	glColor3f(0, 1, 1);
-	normLength = _rMax / 16.0f;
+	normLength = self.boundingRadius / 16.0f;
 	
 	face = _faces;
 	glBegin(GL_LINES);
 	for (i = 0; i != _faceCount; ++i)
 	{
-		// Find centre of polygon by averaging vertices
-		c.Set(0, 0, 0);
-		vertIdx = face->firstVertex;
-		for (j = 0; j != face->vertexCount; ++j)
-		{
-			c += _vertices[_faceVertexIndices[vertIdx++]];
-		}
-		c /= face->vertexCount;
-		
-		// Draw normal
-		DRAW(c);
-		DRAW((c + normLength * _normals[face->normal]));
+		DRAW(centroids[i]);
+		DRAW((centroids[i] + normLength * _normals[face->normal]));
 		
 		++face;
 	}
@@ -210,37 +217,58 @@
 
 - (void)glRenderBadPolygons
 {
-	uint32_t				count, j, vertIdx;
+	uint32_t				count, i, j, vertIdx;
 	DDMeshFaceData			*face;
+	const DDMeshEdge		*edges;
 	WFModeContext			wfmc;
 	
-	if (!_hasBadPolygons) return;
+	if (!_hasBadPolygons && !_hasBadEdges) return;
 	
 	CGL_MACRO_DECLARE_VARIABLES();
 	
 	EnterWireframeMode(wfmc);
-	glColor3f(1, 0, 0);
 	glLineWidth(2);
 	
 	glVertexPointer(3, GL_SCALAR, 0, _vertices);
 	glEnableClientState(GL_VERTEX_ARRAY);
 	
-	count = _faceCount;
-	face = _faces;
-	do
+	if (_hasBadPolygons)
 	{
-		if (face->nonCoplanar || face->nonConvex)
+		glColor3f(1, 0, 0);
+		count = _faceCount;
+		face = _faces;
+		do
 		{
-			glBegin(GL_LINE_LOOP);
-			vertIdx = face->firstVertex;
-			for (j = 0; j != face->vertexCount; ++j)
+			if (face->nonCoplanar || face->nonConvex)
 			{
-				glArrayElement(_faceVertexIndices[vertIdx++]);
+				glBegin(GL_LINE_LOOP);
+				vertIdx = face->firstVertex;
+				for (j = 0; j != face->vertexCount; ++j)
+				{
+					glArrayElement(_faceVertexIndices[vertIdx++]);
+				}
+				glEnd();
+			}
+			face++;
+		} while (--count);
+	}
+	
+	if (_hasBadEdges && (edges = [self edges]) != NULL)
+	{
+		// Open and non-manifold edges.
+		glColor3f(1, 0, 1);
+		glBegin(GL_LINES);
+		for (i = 0; i != _edgeCount; ++i)
+		{
+			count = _edgeFaceStarts[i + 1] - _edgeFaceStarts[i];
+			if (count != 2)
+			{
+				glArrayElement(edges[i].vertices[0]);
+				glArrayElement(edges[i].vertices[1]);
 			}
-			glEnd();
 		}
-		face++;
-	} while (--count);
+		glEnd();
+	}
 	
 	glDisableClientState(GL_VERTEX_ARRAY);
 	glLineWidth(1);
@@ -251,33 +279,103 @@
 - (void)glRenderBoundingBox
 {
 	WFModeContext			wfmc;
+	Vector					min, max;
 	
 	CGL_MACRO_DECLARE_VARIABLES();
 	
+	[self getBoundsMin:&min max:&max];
+	
 	EnterWireframeMode(wfmc);
 	glColor3f(1, 1, 1);
 	
 	glBegin(GL_LINE_LOOP);
-		glVertex3f(_xMin, _yMin, _zMin);
-		glVertex3f(_xMax, _yMin, _zMin);
-		glVertex3f(_xMax, _yMax, _zMin);
-		glVertex3f(_xMin, _yMax, _zMin);
-		glVertex3f(_xMin, _yMax, _zMax);
-		glVertex3f(_xMax, _yMax, _zMax);
-		glVertex3f(_xMax, _yMin, _zMax);
-		glVertex3f(_xMin, _yMin, _zMax);
+		glVertex3f(min.x, min.y, min.z);
+		glVertex3f(max.x, min.y, min.z);
+		glVertex3f(max.x, max.y, min.z);
+		glVertex3f(min.x, max.y, min.z);
+		glVertex3f(min.x, max.y, max.z);
+		glVertex3f(max.x, max.y, max.z);
+		glVertex3f(max.x, min.y, max.z);
+		glVertex3f(min.x, min.y, max.z);
 	glEnd();
 	glBegin(GL_LINES);
-		glVertex3f(_xMax, _yMin, _zMin);
-		glVertex3f(_xMax, _yMin, _zMax);
-		glVertex3f(_xMax, _yMax, _zMin);
-		glVertex3f(_xMax, _yMax, _zMax);
-		glVertex3f(_xMin, _yMin, _zMin);
-		glVertex3f(_xMin, _yMax, _zMin);
-		glVertex3f(_xMin, _yMin, _zMax);
-		glVertex3f(_xMin, _yMax, _zMax);
+		glVertex3f(max.x, min.y, min.z);
+		glVertex3f(max.x, min.y, max.z);
+		glVertex3f(max.x, max.y, min.z);
+		glVertex3f(max.x, max.y, max.z);
+		glVertex3f(min.x, min.y, min.z);
+		glVertex3f(min.x, max.y, min.z);
+		glVertex3f(min.x, min.y, max.z);
+		glVertex3f(min.x, max.y, max.z);
 	glEnd();
 	
-	ExitWireframeMode(wfmc);}
+	ExitWireframeMode(wfmc);
+}
+
+
+- (void)glRenderDeviations:(const Scalar *)inDeviations range:(Scalar)inRange
+{
+	unsigned				i, j;
+	DDMeshFaceData			*face;
+	GLfloat					colour[4];
+	unsigned				vertIdx;
+	DDMeshIndex				vertex;
+	
+	if (inDeviations == NULL)  return;
+	
+	CGL_MACRO_DECLARE_VARIABLES();
+	
+	glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT);
+	glDisable(GL_TEXTURE_2D);
+	glColorMaterial(GL_FRONT_AND_BACK, GL_AMBIENT_AND_DIFFUSE);
+	glEnable(GL_COLOR_MATERIAL);
+	
+	face = _faces;
+	for (i = 0; i != _faceCount; ++i)
+	{
+		glBegin(GL_POLYGON);
+		NORMAL(_normals[face->normal]);
+		
+		vertIdx = face->firstVertex;
+		for (j = 0; j != face->vertexCount; ++j)
+		{
+			vertex = _faceVertexIndices[vertIdx++];
+			DeviationColour(inDeviations[vertex], inRange, colour);
+			glColor4fv(colour);
+			DRAW(_vertices[vertex]);
+		}
+		glEnd();
+		++face;
+	}
+	
+	glPopAttrib();
+}
 
 @end
+
+
+// Blue for no deviation, green at half range, red at or beyond full range.
+static void DeviationColour(Scalar inDeviation, Scalar inRange, GLfloat outColour[4])
+{
+	Scalar					t;
+	
+	t = (0 < inRange) ? inDeviation / inRange : 0;
+	if (t < 0)  t = 0;
+	if (1 < t)  t = 1;
+	
+	if (t < 0.5f)
+	{
+		t *= 2;
+		outColour[0] = 0;
+		outColour[1] = t;
+		outColour[2] = 1 - t;
+	}
+	else
+	{
+		t = (t - 0.5f) * 2;
+		outColour[0] = t;
+		outColour[1] = 1 - t;
+		outColour[2] = 0;
+	}
+	outColour[3] = 1;
+}
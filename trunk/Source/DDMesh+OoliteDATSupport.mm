@@ -51,6 +51,16 @@ enum
 	kMaxDATMaterials		= 8
 };
 
+// NAMES, NORMALS and TANGENTS sections are understood by 1.74 and later.
+#define kMinVersionForVertexNormals		@"1.74"
+
+
+@interface DDMesh (OoliteDATSupport_Private)
+
+- (BOOL)getOoliteDATVertexSources:(DDMeshIndex **)outSources corners:(DDMeshIndex **)outCorners normals:(Vector **)outNormals tangents:(Vector **)outTangents count:(unsigned *)outCount;
+
+@end
+
 
 @implementation DDMesh (OoliteDATSupport)
 
@@ -70,9 +80,14 @@ enum
 							zMin = 0, zMax = 0,
 							rMax = 0, r;
 	NSMutableDictionary		*materialDict = nil;
+	NSMutableArray			*textureNames = nil;
+	NSMutableArray			*materialNames = nil;
+	NSNumber				*materialIndexObj;
+	unsigned				nameCount, nameIndex;
 	DDMaterialSet			*materials = nil;
 	NSString				*texFileName;
 	DDMaterial				*material;
+	Vector					*vertexNormals = NULL;
 	float					s, t, max_s, max_t;
 	DDDATLexer				*lexer;
 	NSString				*tokString;
@@ -395,9 +410,9 @@ enum
 		
 		if (readTextures)
 		{
-			materials = [DDMaterialSet setWithCapacity:faceCount];
+			textureNames = [NSMutableArray array];
 			materialDict = [NSMutableDictionary dictionaryWithCapacity:faceCount];
-			if (nil == materials || nil == materialDict)
+			if (nil == textureNames || nil == materialDict)
 			{
 				OK = NO;
 				[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
@@ -416,20 +431,15 @@ enum
 						break;
 					}
 					
-					faces[i].material = [materials indexForName:texFileName];
-					if (kDDMeshIndexNotFound == faces[i].material)
+					// Materials are created once we know whether a NAMES section follows, in which case texFileName is an index into it.
+					materialIndexObj = [materialDict objectForKey:texFileName];
+					if (nil == materialIndexObj)
 					{
-						material = [DDMaterial materialWithName:texFileName];
-						[material setDiffuseMap:texFileName relativeTo:inFile issues:ioIssues];
-						if (nil == material)
-						{
-							TraceMessage(@"** Failed to create material for face index %u.", i + 1);
-							OK = NO;
-							[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
-							break;
-						}
-						faces[i].material = [materials addMaterial:material];
+						materialIndexObj = [NSNumber numberWithUnsignedInt:[textureNames count]];
+						[materialDict setObject:materialIndexObj forKey:texFileName];
+						[textureNames addObject:texFileName];
 					}
+					faces[i].material = [materialIndexObj unsignedIntValue];
 					
 					// Read texture scale
 					if (![lexer readReal:&max_s] ||
@@ -488,11 +498,86 @@ enum
 		}
 	}
 	
-	// Look for END
+	// Look for optional NAMES, NORMALS and TANGENTS sections, then END
 	if (OK && readTextures)
 	{
 		tokString = [lexer nextToken];
-		if (tokString == nil)
+		
+		if (OK && [tokString isEqualToString:@"NAMES"])
+		{
+			OK = [lexer readInteger:&nameCount];
+			if (!OK)  [ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], NSLocalizedString(@"material count", NULL), [lexer currentTokenString]];
+			
+			if (OK)
+			{
+				materialNames = [NSMutableArray arrayWithCapacity:nameCount];
+				for (i = 0; i != nameCount; ++i)
+				{
+					if (![lexer readString:&texFileName])
+					{
+						[ioIssues addStopIssueWithKey:@"noMaterialNameLoaded" localizedFormat:@"Material name %u could not be read (line %u).", i + 1, [lexer lineNumber]];
+						OK = NO;
+						break;
+					}
+					[materialNames addObject:texFileName];
+				}
+			}
+			
+			// Faces’ texture names are indices into the NAMES table.
+			for (i = 0; OK && i != faceCount; ++i)
+			{
+				nameIndex = [[textureNames objectAtIndex:faces[i].material] intValue];
+				if (nameCount <= nameIndex)
+				{
+					[ioIssues addStopIssueWithKey:@"materialRange" localizedFormat:@"Face %u specifies a material index of %u, but there are only %u materials in the document.", i + 1, nameIndex, nameCount];
+					OK = NO;
+					break;
+				}
+				faces[i].material = nameIndex;
+			}
+			
+			if (OK)  tokString = [lexer nextToken];
+		}
+		
+		if (OK && [tokString isEqualToString:@"NORMALS"])
+		{
+			vertexNormals = (Vector *)malloc(sizeof(Vector) * vertexCount);
+			if (NULL == vertexNormals)
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+			}
+			
+			for (i = 0; OK && i != vertexCount; ++i)
+			{
+				if (![lexer readReal:&x] ||
+					![lexer readReal:&y] ||
+					![lexer readReal:&z])
+				{
+					[ioIssues addStopIssueWithKey:@"noVertexNormalLoaded" localizedFormat:@"Normal could not be read for vertex %u (line %u).", i + 1, [lexer lineNumber]];
+					OK = NO;
+					break;
+				}
+				vertexNormals[i] = Vector(-x, y, z);
+			}
+			
+			if (OK)  tokString = [lexer nextToken];
+		}
+		
+		if (OK && [tokString isEqualToString:@"TANGENTS"])
+		{
+			// Dry Dock has nowhere to keep tangents; they are recalculated on writing.
+			OK = [lexer skipTokens:vertexCount * 3];
+			if (!OK)  [ioIssues addStopIssueWithKey:@"noTangentsLoaded" localizedFormat:@"Tangent data could not be read (line %u).", [lexer lineNumber]];
+			
+			if (OK)  tokString = [lexer nextToken];
+		}
+		
+		if (!OK)
+		{
+			// Error already reported.
+		}
+		else if (tokString == nil)
 		{
 			[ioIssues addWarningIssueWithKey:@"missingEnd" localizedFormat:@"The document is missing an END line. This is not serious, but should be fixed by resaving the document."];
 		}
@@ -506,6 +591,33 @@ enum
 		}
 	}
 	
+	// Create materials
+	if (OK && readTextures)
+	{
+		if (nil == materialNames)  materialNames = textureNames;
+		materials = [DDMaterialSet setWithCapacity:[materialNames count]];
+		if (nil == materials)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+		}
+		
+		for (i = 0; OK && i != [materialNames count]; ++i)
+		{
+			texFileName = [materialNames objectAtIndex:i];
+			material = [DDMaterial materialWithName:texFileName];
+			[material setDiffuseMap:texFileName relativeTo:inFile issues:ioIssues];
+			if (nil == material)
+			{
+				TraceMessage(@"** Failed to create material %@.", texFileName);
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+				break;
+			}
+			[materials addMaterial:material];
+		}
+	}
+	
 	[lexer release];
 	
 	if (OK)
@@ -513,8 +625,16 @@ enum
 		_vertexCount = vertexCount;
 		_vertices = vertices;
 		
-		[normals getArray:&_normals andCount:&_normalCount];
 		[buffer getVertexIndices:&_faceVertexIndices textureCoordIndices:&_faceTexCoordIndices vertexNormals:&_vertexNormalIndices andCount:&_faceVertexIndexCount];
+		if (NULL != vertexNormals)
+		{
+			// Use the file’s vertex normals rather than the face normals.
+			for (i = 0; i != _faceVertexIndexCount; ++i)
+			{
+				_vertexNormalIndices[i] = [normals indexForVector:vertexNormals[_faceVertexIndices[i]]];
+			}
+		}
+		[normals getArray:&_normals andCount:&_normalCount];
 		
 		_faceCount = faceCount;
 		_faces = faces;
@@ -540,6 +660,8 @@ enum
 		self = nil;
 	}
 	
+	if (NULL != vertexNormals) free(vertexNormals);
+	
 	return self;
 	TraceExit();
 }
@@ -547,11 +669,17 @@ enum
 
 - (NSString *) minimumOoliteVersionString
 {
-	if (kMaxDATVerticesPre173 < _vertexCount || kMaxDATFacesPre173 < _faceCount)
+	return [DDMesh minimumOoliteVersionStringForVertexCount:_vertexCount faceCount:_faceCount materialCount:_materialCount];
+}
+
+
++ (NSString *)minimumOoliteVersionStringForVertexCount:(unsigned)inVertexCount faceCount:(unsigned)inFaceCount materialCount:(unsigned)inMaterialCount
+{
+	if (kMaxDATVerticesPre173 < inVertexCount || kMaxDATFacesPre173 < inFaceCount)
 	{
 		return @"1.73";
 	}
-	if (kMaxDATVerticesPre168 < _vertexCount || kMaxDATFacesPre168 < _faceCount || kMaxDATMaterialsPre168 < _materialCount)
+	if (kMaxDATVerticesPre168 < inVertexCount || kMaxDATFacesPre168 < inFaceCount || kMaxDATMaterialsPre168 < inMaterialCount)
 	{
 		return @"1.68";
 	}
@@ -559,11 +687,29 @@ enum
 }
 
 
++ (unsigned)maximumOoliteDATMaterialCount
+{
+	return kMaxDATMaterials;
+}
+
+
++ (BOOL)isValidOoliteDATTextureName:(NSString *)inName
+{
+	return [inName rangeOfCharacterFromSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]].length == 0
+		&& [inName rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@",#"]].length == 0
+		&& [inName rangeOfString:@"//"].length == 0;
+}
+
+
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile
 {
-	DDMaterial				*material;
+	[self gatherIssues:ioManager withWritingOoliteDATToURL:inFile options:0];
+}
+
+
+- (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions
+{
 	NSString				*name;
-	NSCharacterSet			*whiteSpace, *miscChars;
 	DDMeshIndex				i;
 	
 	[self findBadPolygonsWithIssues:ioManager];
@@ -578,6 +724,10 @@ enum
 	{
 		[ioManager addStopIssueWithKey:@"tooManyMaterials" localizedFormat:@"This model contains %u materials; the selected format allows no more than %u.", _materialCount, kMaxDATMaterials];
 	}
+	else if (inOptions & kDDOoliteDATVertexNormals)
+	{
+		[ioManager addNoteIssueWithKey:@"vertexNormalsDATOutput" localizedFormat:@"Models saved with vertex normals and tangents cannot be used with versions of Oolite earlier than %@.", kMinVersionForVertexNormals];
+	}
 	else
 	{
 		NSString *minVersion = [self minimumOoliteVersionString];
@@ -588,15 +738,10 @@ enum
 	}
 	
 	// Check for invalid texture names
-	whiteSpace = [NSCharacterSet whitespaceAndNewlineCharacterSet];
-	miscChars = [NSCharacterSet characterSetWithCharactersInString:@",#"];
 	for (i = 0; i != _materialCount; ++i)
 	{
-		material = _materials[i];
-		name = [material name];
-		if ([name rangeOfCharacterFromSet:whiteSpace].length != 0
-			|| [name rangeOfCharacterFromSet:miscChars].length != 0
-			|| [name rangeOfString:@"//"].length != 0)
+		name = [_materials[i] name];
+		if (![DDMesh isValidOoliteDATTextureName:name])
 		{
 			[ioManager addStopIssueWithKey:@"invalidTextureName" localizedFormat:@"This document contains a texture named \"%@\". The specified format does not support texture names containing spaces, commas, line breaks, \"#\" or \"//\".", name];
 		}
@@ -605,6 +750,12 @@ enum
 
 
 - (BOOL)writeOoliteDATToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioManager
+{
+	return [self writeOoliteDATToURL:inFile options:0 issues:ioManager];
+}
+
+
+- (BOOL)writeOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions issues:(DDProblemReportManager *)ioManager
 {
 	BOOL					OK =YES;
 	NSError					*error = nil;
@@ -618,9 +769,24 @@ enum
 	Vector					normal;
 	Vector2					texCoords;
 	unsigned				vertIdx;
+	BOOL					writeVertexNormals;
+	unsigned				vertexCount;
+	DDMeshIndex				*vertexSources = NULL, *cornerVertices = NULL;
+	Vector					*vertexNormals = NULL, *vertexTangents = NULL;
 	
 	if (_hasNonTriangles) [self triangulate];
 	
+	writeVertexNormals = (inOptions & kDDOoliteDATVertexNormals) != 0;
+	vertexCount = _vertexCount;
+	if (writeVertexNormals)
+	{
+		if (![self getOoliteDATVertexSources:&vertexSources corners:&cornerVertices normals:&vertexNormals tangents:&vertexTangents count:&vertexCount])
+		{
+			[ioManager addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+			return NO;
+		}
+	}
+	
 	dataString = [NSMutableString string];
 	
 	// Get formatted date string for header comment
@@ -642,15 +808,15 @@ enum
 	if (nil == texNameString) texNameString = @"none";
 	
 	// Write header comment
-	NSString *minVersion = [self minimumOoliteVersionString];
-	if (minVersion != nil)  minVersion = [NSString stringWithFormat:@"// Minimum Oolite version: %@\n"];
+	NSString *minVersion = writeVertexNormals ? kMinVersionForVertexNormals : [self minimumOoliteVersionString];
+	if (minVersion != nil)  minVersion = [NSString stringWithFormat:@"//	Minimum Oolite version: %@\n", minVersion];
 	else  minVersion = @"";
 	
 	[dataString appendFormat:  @"//	Written by %@ on %@\n"
 								"//	\n"
 								"//	Model dimensions: %g x %g x %g (w x h x l)\n"
 								"//	Textures used: %@\n"
-								"%@",
+								"%@"
 								"\n",
 								ApplicationNameAndVersionString(), dateString,
 								[self width], [self height], [self length],
@@ -658,12 +824,13 @@ enum
 								minVersion];
 	
 	// Write vertex and face counts
-	[dataString appendFormat:@"NVERTS %u\nNFACES %u\n\nVERTEX\n", _vertexCount, _faceCount];
+	[dataString appendFormat:@"NVERTS %u\nNFACES %u\n\nVERTEX\n", vertexCount, _faceCount];
 	
-	// Write vertices
-	for (i = 0; i != _vertexCount; ++i)
+	// Write vertices; with vertex normals, a vertex may be written more than once.
+	for (i = 0; i != vertexCount; ++i)
 	{
-		[dataString appendFormat:@"%10f,%10f,%10f\n", -_vertices[i].x, _vertices[i].y, _vertices[i].z];
+		const Vector &vertex = _vertices[writeVertexNormals ? vertexSources[i] : i];
+		[dataString appendFormat:@"%10f,%10f,%10f\n", -vertex.x, vertex.y, vertex.z];
 	}
 	
 	// Write faces
@@ -679,20 +846,28 @@ enum
 		
 		for (j = 0; j != faceVertexCount; ++j)
 		{
-			[dataString appendFormat:@",%s%u", j ? "" : "\t", _faceVertexIndices[face->firstVertex + j]];
+			vertIdx = face->firstVertex + j;
+			[dataString appendFormat:@",%s%u", j ? "" : "\t", writeVertexNormals ? cornerVertices[vertIdx] : _faceVertexIndices[vertIdx]];
 		}
 		++face;
 	}
 	
-	// Write textures
+	// Write textures. With a NAMES table, faces give the material's index instead of its texture name.
 	[dataString appendString:@"\n\nTEXTURES"];
 	for (i = 0; i != _faceCount; ++i)
 	{
 		face = _faces + i;
 		faceVertexCount = face->vertexCount;
 		
-		// Really ought to build material pointer -> UTF8String CFDictionary
-		[dataString appendFormat:@"\n%-16s\t1.0 1.0   ", [[_materials[face->material] diffuseMapName] UTF8String]];
+		if (writeVertexNormals)
+		{
+			[dataString appendFormat:@"\n%-16u\t1.0 1.0   ", face->material];
+		}
+		else
+		{
+			// Really ought to build material pointer -> UTF8String CFDictionary
+			[dataString appendFormat:@"\n%-16s\t1.0 1.0   ", [[_materials[face->material] diffuseMapName] UTF8String]];
+		}
 		
 		vertIdx = face->firstVertex;
 		for (j = 0; j != faceVertexCount; ++j)
@@ -701,6 +876,34 @@ enum
 			[dataString appendFormat:@" %f %f", texCoords.x, texCoords.y];
 		}
 	}
+	
+	if (writeVertexNormals)
+	{
+		[dataString appendFormat:@"\n\nNAMES %u", _materialCount];
+		for (i = 0; i != _materialCount; ++i)
+		{
+			texName = [_materials[i] diffuseMapName];
+			if (nil == texName)  texName = [_materials[i] name];
+			[dataString appendFormat:@"\n%@", texName];
+		}
+		
+		[dataString appendString:@"\n\nNORMALS"];
+		for (i = 0; i != vertexCount; ++i)
+		{
+			[dataString appendFormat:@"\n%10f,%10f,%10f", -vertexNormals[i].x, vertexNormals[i].y, vertexNormals[i].z];
+		}
+		
+		[dataString appendString:@"\n\nTANGENTS"];
+		for (i = 0; i != vertexCount; ++i)
+		{
+			[dataString appendFormat:@"\n%10f,%10f,%10f", -vertexTangents[i].x, vertexTangents[i].y, vertexTangents[i].z];
+		}
+		
+		free(vertexSources);
+		free(cornerVertices);
+		free(vertexNormals);
+		free(vertexTangents);
+	}
 	[dataString appendString:@"\n\nEND\n"];
 	
 	// Finish up
@@ -716,5 +919,117 @@ enum
 	return OK;
 }
 
+@end
+
+
+@implementation DDMesh (OoliteDATSupport_Private)
+
+/*	One DAT vertex is made for each source vertex and smoothing group, and one
+	for each corner of a face with no smoothing group. Its normal is the
+	area-weighted average of the normals of the faces sharing it; its tangent
+	is averaged the same way from the mesh's corner tangents, then made
+	perpendicular to the normal. Expects a triangulated mesh.
+	outCorners maps face vertex slots (as in _faceVertexIndices) to DAT
+	vertices, and outSources DAT vertices to source vertices. Caller frees all
+	four arrays.
+*/
+- (BOOL)getOoliteDATVertexSources:(DDMeshIndex **)outSources corners:(DDMeshIndex **)outCorners normals:(Vector **)outNormals tangents:(Vector **)outTangents count:(unsigned *)outCount
+{
+	const DDMeshPlane		*planes;
+	const Scalar			*areas;
+	const DDMeshTangent		*cornerTangents;
+	unsigned				*heads, *next;
+	uint8_t					*groups;
+	DDMeshIndex				*sources, *corners;
+	Vector					*normals, *tangents;
+	unsigned				i, j, slot, entry, count = 0;
+	DDMeshFaceData			*face;
+	DDMeshIndex				vertex;
+	Vector					tangent;
+	Scalar					weight;
+	
+	planes = [self facePlanes];
+	areas = [self faceAreas];
+	cornerTangents = [self cornerTangents];
+	
+	heads = (unsigned *)malloc(sizeof *heads * _vertexCount);
+	next = (unsigned *)malloc(sizeof *next * _faceVertexIndexCount);
+	groups = (uint8_t *)malloc(sizeof *groups * _faceVertexIndexCount);
+	sources = (DDMeshIndex *)malloc(sizeof *sources * _faceVertexIndexCount);
+	corners = (DDMeshIndex *)malloc(sizeof *corners * _faceVertexIndexCount);
+	normals = (Vector *)calloc(_faceVertexIndexCount, sizeof *normals);
+	tangents = (Vector *)calloc(_faceVertexIndexCount, sizeof *tangents);
+	if (NULL == planes || NULL == areas || NULL == cornerTangents || NULL == heads || NULL == next || NULL == groups || NULL == sources || NULL == corners || NULL == normals || NULL == tangents)
+	{
+		free(heads);
+		free(next);
+		free(groups);
+		free(sources);
+		free(corners);
+		free(normals);
+		free(tangents);
+		return NO;
+	}
+	
+	memset(heads, 0xFF, sizeof *heads * _vertexCount);
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		face = &_faces[i];
+		
+		// Degenerate faces still get a say in their own corners.
+		weight = (0 < areas[i]) ? areas[i] : 1e-6;
+		
+		for (j = 0; j != face->vertexCount; ++j)
+		{
+			slot = face->firstVertex + j;
+			vertex = _faceVertexIndices[slot];
+			
+			entry = UINT_MAX;
+			if (0 != face->smoothingGroup)
+			{
+				for (entry = heads[vertex]; UINT_MAX != entry && groups[entry] != face->smoothingGroup; entry = next[entry])  {}
+			}
+			if (UINT_MAX == entry)
+			{
+				entry = count++;
+				sources[entry] = vertex;
+				groups[entry] = face->smoothingGroup;
+				next[entry] = heads[vertex];
+				heads[vertex] = entry;
+			}
+			
+			corners[slot] = entry;
+			normals[entry] += planes[i].normal * weight;
+			tangents[entry] += cornerTangents[slot].tangent * weight;
+		}
+	}
+	
+	for (entry = 0; entry != count; ++entry)
+	{
+		if (0 != normals[entry].SquareMagnitude())  normals[entry].Normalize();
+		else  normals[entry].Set(0, 0, 1);
+		
+		// Gram-Schmidt; faces without usable texture co-ordinates get an arbitrary perpendicular.
+		tangent = tangents[entry] - normals[entry] * (normals[entry] * tangents[entry]);
+		if (tangent.SquareMagnitude() < 1e-12)
+		{
+			tangent = normals[entry] % ((fabs(normals[entry].x) < 0.9f) ? Vector(1, 0, 0) : Vector(0, 1, 0));
+		}
+		tangents[entry] = tangent.Normalize();
+	}
+	
+	free(heads);
+	free(next);
+	free(groups);
+	
+	*outSources = sources;
+	*outCorners = corners;
+	*outNormals = normals;
+	*outTangents = tangents;
+	*outCount = count;
+	return YES;
+}
+
 
 @end
@@ -0,0 +1,150 @@
+/*
+	DDMesh+SoftwareRendering.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMesh.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import "DDSoftwareRenderer.h"
+
+
+// The view of a new document window; see DDSceneView.
+#define kDefaultViewYaw				-30.0f
+#define kDefaultViewPitch			20.0f
+#define kCameraDistanceFactor		2.5f
+
+
+@implementation DDMesh (SoftwareRendering)
+
+- (NSData *)renderImageWithWidth:(unsigned)inWidth height:(unsigned)inHeight yaw:(Scalar)inYaw textures:(const DDSoftwareTexture *)inTextures wireframe:(BOOL)inWireframe parallel:(BOOL)inParallel triangleCount:(NSUInteger *)outTriangleCount
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	DDSoftwareRenderer		*renderer = NULL;
+	DDSoftwareRenderMesh	mesh;
+	uint32_t				*indices = NULL, *textureIndices = NULL, *lines = NULL;
+	Vector					*normals = NULL;
+	Vector2					*texCoords = NULL;
+	uint32_t				triangleCount = 0, t = 0;
+	NSUInteger				i, j, edgeCount = 0;
+	const DDMeshFaceData	*face;
+	const DDMeshEdge		*edges = NULL;
+	unsigned				first;
+	Matrix					rotation;
+	Scalar					radius;
+	NSData					*result = nil;
+	
+	if (outTriangleCount != NULL)  *outTriangleCount = 0;
+	
+	// Fan-triangulate the faces, as the GL view's GL_POLYGONs do.
+	for (i = 0; i != _faceCount; ++i)
+	{
+		if (3 <= _faces[i].vertexCount)  triangleCount += _faces[i].vertexCount - 2;
+	}
+	
+	renderer = new DDSoftwareRenderer(inWidth, inHeight);
+	indices = (uint32_t *)malloc(sizeof *indices * 3 * (triangleCount + 1));
+	normals = (Vector *)malloc(sizeof *normals * (triangleCount + 1));
+	texCoords = (Vector2 *)malloc(sizeof *texCoords * 3 * (triangleCount + 1));
+	textureIndices = (uint32_t *)malloc(sizeof *textureIndices * (triangleCount + 1));
+	if (!renderer->IsValid() || indices == NULL || normals == NULL || texCoords == NULL || textureIndices == NULL)  OK = NO;
+	
+	if (OK)
+	{
+		for (i = 0; i != _faceCount; ++i)
+		{
+			face = &_faces[i];
+			first = face->firstVertex;
+			for (j = 2; j < face->vertexCount; ++j)
+			{
+				indices[t * 3] = _faceVertexIndices[first];
+				indices[t * 3 + 1] = _faceVertexIndices[first + j - 1];
+				indices[t * 3 + 2] = _faceVertexIndices[first + j];
+				texCoords[t * 3] = _texCoords[_faceTexCoordIndices[first]];
+				texCoords[t * 3 + 1] = _texCoords[_faceTexCoordIndices[first + j - 1]];
+				texCoords[t * 3 + 2] = _texCoords[_faceTexCoordIndices[first + j]];
+				normals[t] = _normals[face->normal];
+				textureIndices[t] = face->material;
+				++t;
+			}
+		}
+	}
+	
+	if (OK && inWireframe)
+	{
+		edges = [self edges];
+		edgeCount = [self edgeCount];
+		lines = (uint32_t *)malloc(sizeof *lines * 2 * (edgeCount + 1));
+		if (lines == NULL)  OK = NO;
+		for (i = 0; OK && i != edgeCount; ++i)
+		{
+			lines[i * 2] = edges[i].vertices[0];
+			lines[i * 2 + 1] = edges[i].vertices[1];
+		}
+	}
+	
+	if (OK)
+	{
+		bzero(&mesh, sizeof mesh);
+		mesh.vertices = _vertices;
+		mesh.vertexCount = _vertexCount;
+		mesh.indices = indices;
+		mesh.normals = normals;
+		mesh.texCoords = texCoords;
+		mesh.textureIndices = textureIndices;
+		mesh.triangleCount = triangleCount;
+		mesh.textures = inTextures;
+		mesh.textureCount = (inTextures != NULL) ? _materialCount : 0;
+		mesh.lines = lines;
+		mesh.lineCount = (lines != NULL) ? edgeCount : 0;
+		
+		// The turntable turns the model about its own y axis, then it's seen as in a new document window.
+		rotation.RotateY(inYaw * M_PI / 180.0f);
+		rotation.RotateY(kDefaultViewYaw * M_PI / 180.0f);
+		rotation.RotateX(kDefaultViewPitch * M_PI / 180.0f);
+		radius = [self boundingRadius];
+		if (radius < 1)  radius = 1;
+		
+		renderer->SetView(rotation, radius * kCameraDistanceFactor);
+		renderer->SetParallel(inParallel);
+		OK = renderer->Render(mesh, NULL);
+	}
+	
+	if (OK)
+	{
+		result = [NSData dataWithBytes:renderer->Pixels() length:(NSUInteger)inWidth * inHeight * 4];
+		if (outTriangleCount != NULL)  *outTriangleCount = triangleCount;
+	}
+	
+	delete renderer;
+	Free(indices);
+	Free(normals);
+	Free(texCoords);
+	Free(textureIndices);
+	Free(lines);
+	
+	return result;
+	TraceExit();
+}
+
+@end
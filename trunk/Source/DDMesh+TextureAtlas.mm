@@ -0,0 +1,513 @@
+/*
+	DDMesh+TextureAtlas.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Texture atlases: packing the diffuse maps of several materials into one
+	texture, and moving their faces onto a single material that uses it.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ENABLE_TRACE 0
+
+#import "DDMesh.h"
+#import "DDMaterial.h"
+#import "DDImageFile.h"
+#import "DDProblemReportManager.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import "MathsUtils.h"
+#import "CocoaExtensions.h"
+
+
+// Texture co-ordinates this far outside [0, 1] mean a texture repeats, and can't go in an atlas.
+#define kWrapTolerance				1e-3f
+
+
+// One material's texture in the atlas.
+typedef struct AtlasTile
+{
+	DDMeshIndex				material;
+	unsigned				width, height;
+	unsigned				x, y;			// Top left texel of the texture itself, inside its padding
+	const uint8_t			*texels;		// RGBX, top row first
+} AtlasTile;
+
+
+// A horizontal stretch of the skyline: everything below y is filled from x to x + width.
+typedef struct SkylineSegment
+{
+	unsigned				x, y, width;
+} SkylineSegment;
+
+
+typedef struct AtlasSize
+{
+	unsigned				width, height;
+} AtlasSize;
+
+
+static BOOL PackTiles(AtlasTile *ioTiles, unsigned inCount, unsigned inPadding, unsigned inWidth, unsigned inHeight);
+static void CopyTile(uint8_t *outAtlas, unsigned inAtlasWidth, const AtlasTile *inTile, unsigned inPadding);
+static int CompareTileHeights(const void *a, const void *b);
+static int CompareAtlasSizes(const void *a, const void *b);
+
+
+@interface DDMesh (TextureAtlasInternal)
+
+- (BOOL)getAtlasTiles:(AtlasTile **)outTiles count:(unsigned *)outCount textureData:(NSMutableArray *)ioTextureData relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues;
+- (BOOL)moveTiles:(const AtlasTile *)inTiles count:(unsigned)inCount toMaterial:(DDMaterial *)inMaterial atlasWidth:(unsigned)inWidth height:(unsigned)inHeight;
+
+@end
+
+
+@implementation DDMesh (TextureAtlas)
+
+- (BOOL)packTexturesIntoAtlasAtURL:(NSURL *)inAtlasFile relativeTo:(NSURL *)inBaseFile maxSize:(unsigned)inMaxSize padding:(unsigned)inPadding packedCount:(NSUInteger *)outPackedCount issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnter();
+	
+	BOOL					OK = YES, packed = NO;
+	NSMutableArray			*textureData;
+	AtlasTile				*tiles = NULL;
+	unsigned				i, tileCount = 0, maxWidth = 0, maxHeight = 0, sizeCount = 0, w = 0, h = 0;
+	uint64_t				area = 0;
+	AtlasSize				sizes[32 * 32];
+	NSMutableData			*atlas = nil;
+	DDMaterial				*material = nil;
+	NSString				*name;
+	
+	if (outPackedCount != NULL)  *outPackedCount = 0;
+	
+	textureData = [NSMutableArray array];
+	OK = [self getAtlasTiles:&tiles count:&tileCount textureData:textureData relativeTo:inBaseFile issues:ioIssues];
+	if (OK && tileCount < 2)
+	{
+		[ioIssues addNoteIssueWithKey:@"atlasNotNeeded" localizedFormat:@"There are fewer than two textures that could be packed into an atlas, so none was made."];
+		Free(tiles);
+		return YES;
+	}
+	
+	if (OK)
+	{
+		// Try power-of-two sizes big enough to hold every tile, smallest and squarest first.
+		for (i = 0; i != tileCount; ++i)
+		{
+			maxWidth = MAX(maxWidth, tiles[i].width + inPadding * 2);
+			maxHeight = MAX(maxHeight, tiles[i].height + inPadding * 2);
+			area += (uint64_t)(tiles[i].width + inPadding * 2) * (tiles[i].height + inPadding * 2);
+		}
+		for (w = 1; w <= inMaxSize && w != 0; w *= 2)
+		{
+			for (h = 1; h <= inMaxSize && h != 0; h *= 2)
+			{
+				if (maxWidth <= w && maxHeight <= h && area <= (uint64_t)w * h && sizeCount < sizeof sizes / sizeof *sizes)
+				{
+					sizes[sizeCount].width = w;
+					sizes[sizeCount].height = h;
+					++sizeCount;
+				}
+			}
+		}
+		qsort(sizes, sizeCount, sizeof *sizes, CompareAtlasSizes);
+		qsort(tiles, tileCount, sizeof *tiles, CompareTileHeights);
+		
+		for (i = 0; !packed && i != sizeCount; ++i)
+		{
+			packed = PackTiles(tiles, tileCount, inPadding, sizes[i].width, sizes[i].height);
+		}
+		if (!packed)
+		{
+			[ioIssues addStopIssueWithKey:@"atlasTooSmall" localizedFormat:@"The %u textures to be packed won't fit in an atlas of %u x %u pixels.", tileCount, inMaxSize, inMaxSize];
+			OK = NO;
+		}
+		else
+		{
+			w = sizes[i - 1].width;
+			h = sizes[i - 1].height;
+		}
+	}
+	
+	if (OK)
+	{
+		atlas = [NSMutableData dataWithLength:(NSUInteger)w * h * 4];
+		OK = (nil != atlas);
+	}
+	if (OK)
+	{
+		for (i = 0; i != tileCount; ++i)
+		{
+			CopyTile((uint8_t *)[atlas mutableBytes], w, &tiles[i], inPadding);
+		}
+		OK = DDWritePNGToURL(inAtlasFile, atlas, w, h, ioIssues);
+	}
+	
+	if (OK)
+	{
+		// Like a DAT material, the atlas material is named after its texture.
+		[DDMaterial noteTextureDirectoryChanged:[[inAtlasFile path] stringByDeletingLastPathComponent]];
+		name = [[inAtlasFile path] lastPathComponent];
+		material = [DDMaterial materialWithName:name];
+		[material setDiffuseMap:name relativeTo:inAtlasFile issues:ioIssues];
+		OK = (nil != material);
+	}
+	if (OK)  OK = [self moveTiles:tiles count:tileCount toMaterial:material atlasWidth:w height:h];
+	if (!OK)  [ioIssues addStopIssueWithKey:@"atlasFailed" localizedFormat:@"The texture atlas could not be made."];
+	
+	if (OK && outPackedCount != NULL)  *outPackedCount = tileCount;
+	Free(tiles);
+	
+	return OK;
+	TraceExit();
+}
+
+@end
+
+
+@implementation DDMesh (TextureAtlasInternal)
+
+/*	A tile for each material with a readable diffuse map whose faces' texture
+	co-ordinates stay within it. Materials whose textures repeat are left out
+	with a warning, as are unused materials and those without textures.
+*/
+- (BOOL)getAtlasTiles:(AtlasTile **)outTiles count:(unsigned *)outCount textureData:(NSMutableArray *)ioTextureData relativeTo:(NSURL *)inBaseFile issues:(DDProblemReportManager *)ioIssues
+{
+	BOOL					*repeats = NULL, *used = NULL;
+	AtlasTile				*tiles = NULL;
+	unsigned				tileCount = 0, width, height;
+	DDMeshIndex				i, m;
+	unsigned				j;
+	const DDMeshFaceData	*face;
+	Vector2					uv;
+	NSURL					*url;
+	NSData					*texels;
+	
+	*outTiles = NULL;
+	*outCount = 0;
+	if (0 == _materialCount || 0 == _texCoordCount)  return YES;
+	
+	repeats = (BOOL *)calloc(_materialCount, sizeof *repeats);
+	used = (BOOL *)calloc(_materialCount, sizeof *used);
+	tiles = (AtlasTile *)calloc(_materialCount, sizeof *tiles);
+	if (NULL == repeats || NULL == used || NULL == tiles)
+	{
+		Free(repeats);
+		Free(used);
+		Free(tiles);
+		return NO;
+	}
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		face = &_faces[i];
+		used[face->material] = YES;
+		for (j = 0; j != face->vertexCount && !repeats[face->material]; ++j)
+		{
+			uv = _texCoords[_faceTexCoordIndices[face->firstVertex + j]];
+			if (!(-kWrapTolerance <= uv.x && uv.x <= 1.0f + kWrapTolerance && -kWrapTolerance <= uv.y && uv.y <= 1.0f + kWrapTolerance))  repeats[face->material] = YES;
+		}
+	}
+	
+	for (m = 0; m != _materialCount; ++m)
+	{
+		if (!used[m])  continue;
+		url = [_materials[m] diffuseMapURLRelativeTo:inBaseFile];
+		if (nil == url)  continue;
+		if (repeats[m])
+		{
+			[ioIssues addWarningIssueWithKey:@"atlasTextureRepeats" localizedFormat:@"The texture %@ repeats across its faces, so it has been left out of the atlas.", [url displayString]];
+			continue;
+		}
+		
+		texels = DDReadImageFromURL(url, &width, &height, nil);
+		if (nil == texels)
+		{
+			[ioIssues addWarningIssueWithKey:@"atlasTextureUnreadable" localizedFormat:@"The texture %@ could not be read, so it has been left out of the atlas.", [url displayString]];
+			continue;
+		}
+		
+		[ioTextureData addObject:texels];
+		tiles[tileCount].material = m;
+		tiles[tileCount].width = width;
+		tiles[tileCount].height = height;
+		tiles[tileCount].texels = (const uint8_t *)[texels bytes];
+		++tileCount;
+	}
+	
+	Free(repeats);
+	Free(used);
+	*outTiles = tiles;
+	*outCount = tileCount;
+	return YES;
+}
+
+
+/*	Replace the tiles' materials with inMaterial, at the position of the first
+	of them, and map their faces' texture co-ordinates into the atlas. Faces
+	are grouped by tile, and each texture co-ordinate is copied once per group
+	that uses it, so co-ordinates shared between materials are split.
+*/
+- (BOOL)moveTiles:(const AtlasTile *)inTiles count:(unsigned)inCount toMaterial:(DDMaterial *)inMaterial atlasWidth:(unsigned)inWidth height:(unsigned)inHeight
+{
+	BOOL					OK = YES;
+	DDMeshIndex				*tileForMaterial = NULL, *materialRemap = NULL, *groupStarts = NULL, *faceOrder = NULL;
+	DDMeshIndex				*stamps = NULL, *newIndices = NULL;
+	DDMaterial				**materials = NULL;
+	Vector2					*texCoords = NULL, uv;
+	DDMeshIndex				i, m, g, f, old, atlasIndex = kDDMeshIndexNotFound, materialCount = 0, texCoordCount = 0;
+	unsigned				j;
+	DDMeshFaceData			*face;
+	const AtlasTile			*tile;
+	
+	tileForMaterial = (DDMeshIndex *)malloc(sizeof *tileForMaterial * _materialCount);
+	materialRemap = (DDMeshIndex *)malloc(sizeof *materialRemap * _materialCount);
+	materials = (DDMaterial **)calloc(_materialCount, sizeof *materials);
+	groupStarts = (DDMeshIndex *)calloc(inCount + 2, sizeof *groupStarts);
+	faceOrder = (DDMeshIndex *)malloc(sizeof *faceOrder * (_faceCount + 1));
+	stamps = (DDMeshIndex *)malloc(sizeof *stamps * _texCoordCount);
+	newIndices = (DDMeshIndex *)malloc(sizeof *newIndices * _texCoordCount);
+	texCoords = (Vector2 *)malloc(sizeof *texCoords * (_faceVertexIndexCount + 1));
+	if (NULL == tileForMaterial || NULL == materialRemap || NULL == materials || NULL == groupStarts || NULL == faceOrder || NULL == stamps || NULL == newIndices || NULL == texCoords)  OK = NO;
+	
+	if (OK)
+	{
+		for (m = 0; m != _materialCount; ++m)  tileForMaterial[m] = kDDMeshIndexNotFound;
+		for (i = 0; i != inCount; ++i)  tileForMaterial[inTiles[i].material] = i;
+		
+		for (m = 0; m != _materialCount; ++m)
+		{
+			if (kDDMeshIndexNotFound == tileForMaterial[m])
+			{
+				materials[materialCount] = _materials[m];
+				materialRemap[m] = materialCount++;
+			}
+			else
+			{
+				if (kDDMeshIndexNotFound == atlasIndex)
+				{
+					atlasIndex = materialCount;
+					materials[materialCount++] = [inMaterial retain];
+				}
+				materialRemap[m] = atlasIndex;
+				[_materials[m] release];
+			}
+		}
+		
+		// Counting sort of faces by group: a tile each, then inCount for faces outside the atlas.
+		for (f = 0; f != _faceCount; ++f)
+		{
+			g = tileForMaterial[_faces[f].material];
+			if (kDDMeshIndexNotFound == g)  g = inCount;
+			++groupStarts[g + 1];
+		}
+		for (g = 0; g != inCount + 1; ++g)  groupStarts[g + 1] += groupStarts[g];
+		for (f = 0; f != _faceCount; ++f)
+		{
+			g = tileForMaterial[_faces[f].material];
+			if (kDDMeshIndexNotFound == g)  g = inCount;
+			faceOrder[groupStarts[g]++] = f;
+		}
+		
+		// groupStarts[g] now holds the end of group g.
+		for (m = 0; m != _texCoordCount; ++m)  stamps[m] = kDDMeshIndexNotFound;
+		for (g = 0, i = 0; g != inCount + 1; ++g)
+		{
+			tile = (g < inCount) ? &inTiles[g] : NULL;
+			for (; i != groupStarts[g]; ++i)
+			{
+				face = &_faces[faceOrder[i]];
+				for (j = 0; j != face->vertexCount; ++j)
+				{
+					old = _faceTexCoordIndices[face->firstVertex + j];
+					if (stamps[old] != g)
+					{
+						stamps[old] = g;
+						uv = _texCoords[old];
+						if (NULL != tile)
+						{
+							uv.x = (tile->x + uv.x * tile->width) / inWidth;
+							uv.y = (tile->y + uv.y * tile->height) / inHeight;
+						}
+						newIndices[old] = texCoordCount;
+						texCoords[texCoordCount++] = uv;
+					}
+					_faceTexCoordIndices[face->firstVertex + j] = newIndices[old];
+				}
+				face->material = materialRemap[face->material];
+			}
+		}
+		
+		Free(_materials);
+		_materials = materials;
+		_materialCount = materialCount;
+		materials = NULL;
+		
+		[self freeMeshArray:_texCoords];
+		_texCoords = (Vector2 *)realloc(texCoords, sizeof *texCoords * (texCoordCount + 1));
+		if (NULL == _texCoords)  _texCoords = texCoords;
+		_texCoordCount = texCoordCount;
+		texCoords = NULL;
+		
+		[self noteChanges:kDDMeshChangeMaterials | kDDMeshChangeTexCoords];
+	}
+	
+	Free(tileForMaterial);
+	Free(materialRemap);
+	Free(materials);
+	Free(groupStarts);
+	Free(faceOrder);
+	Free(stamps);
+	Free(newIndices);
+	Free(texCoords);
+	
+	return OK;
+}
+
+@end
+
+
+/*	Skyline bottom-left packing: each tile, tallest first, goes wherever its
+	top edge would be lowest. ioTiles must be sorted by height; their x and y
+	are set on success.
+*/
+static BOOL PackTiles(AtlasTile *ioTiles, unsigned inCount, unsigned inPadding, unsigned inWidth, unsigned inHeight)
+{
+	SkylineSegment			*skyline = NULL, *next = NULL;
+	unsigned				segmentCount = 1, nextCount, i, j, t, w, h, x, y, end;
+	unsigned				bestIndex, bestX = 0, bestY = 0, bestTop;
+	BOOL					OK = YES;
+	
+	// Each tile adds at most two segments.
+	skyline = (SkylineSegment *)malloc(sizeof *skyline * (inCount * 2 + 2));
+	next = (SkylineSegment *)malloc(sizeof *next * (inCount * 2 + 2));
+	if (NULL == skyline || NULL == next)  OK = NO;
+	else
+	{
+		skyline[0].x = 0;
+		skyline[0].y = 0;
+		skyline[0].width = inWidth;
+	}
+	
+	for (t = 0; OK && t != inCount; ++t)
+	{
+		w = ioTiles[t].width + inPadding * 2;
+		h = ioTiles[t].height + inPadding * 2;
+		bestIndex = UINT_MAX;
+		bestTop = UINT_MAX;
+		
+		for (i = 0; i != segmentCount && skyline[i].x + w <= inWidth; ++i)
+		{
+			// The tile rests on the highest segment under it.
+			y = 0;
+			for (j = i; j != segmentCount && skyline[j].x < skyline[i].x + w; ++j)  y = MAX(y, skyline[j].y);
+			if (y + h <= inHeight && y + h < bestTop)
+			{
+				bestIndex = i;
+				bestTop = y + h;
+				bestX = skyline[i].x;
+				bestY = y;
+			}
+		}
+		if (UINT_MAX == bestIndex)
+		{
+			OK = NO;
+			break;
+		}
+		
+		ioTiles[t].x = bestX + inPadding;
+		ioTiles[t].y = bestY + inPadding;
+		
+		// Raise the skyline under the tile, then merge neighbours at the same height.
+		end = bestX + w;
+		nextCount = 0;
+		for (i = 0; i != bestIndex; ++i)  next[nextCount++] = skyline[i];
+		next[nextCount].x = bestX;
+		next[nextCount].y = bestTop;
+		next[nextCount].width = w;
+		++nextCount;
+		for (i = bestIndex; i != segmentCount; ++i)
+		{
+			x = skyline[i].x;
+			if (x + skyline[i].width <= end)  continue;
+			next[nextCount] = skyline[i];
+			if (x < end)
+			{
+				next[nextCount].x = end;
+				next[nextCount].width -= end - x;
+			}
+			++nextCount;
+		}
+		
+		segmentCount = 0;
+		for (i = 0; i != nextCount; ++i)
+		{
+			if (0 != segmentCount && skyline[segmentCount - 1].y == next[i].y)  skyline[segmentCount - 1].width += next[i].width;
+			else  skyline[segmentCount++] = next[i];
+		}
+	}
+	
+	free(skyline);
+	free(next);
+	return OK;
+}
+
+
+// Copy a tile into the atlas, repeating its edge texels out into the padding so that filtering and mip-mapping don't pick up its neighbours.
+static void CopyTile(uint8_t *outAtlas, unsigned inAtlasWidth, const AtlasTile *inTile, unsigned inPadding)
+{
+	unsigned				row, column, srcRow, w = inTile->width, h = inTile->height;
+	const uint8_t			*src;
+	uint8_t					*dst;
+	
+	for (row = 0; row != h + inPadding * 2; ++row)
+	{
+		srcRow = (row < inPadding) ? 0 : MIN(row - inPadding, h - 1);
+		src = inTile->texels + (size_t)srcRow * w * 4;
+		dst = outAtlas + ((size_t)(inTile->y - inPadding + row) * inAtlasWidth + inTile->x - inPadding) * 4;
+		
+		for (column = 0; column != inPadding; ++column)  memcpy(dst + column * 4, src, 4);
+		memcpy(dst + inPadding * 4, src, (size_t)w * 4);
+		for (column = 0; column != inPadding; ++column)  memcpy(dst + (inPadding + w + column) * 4, src + (w - 1) * 4, 4);
+	}
+}
+
+
+static int CompareTileHeights(const void *a, const void *b)
+{
+	const AtlasTile			*tileA = (const AtlasTile *)a, *tileB = (const AtlasTile *)b;
+	
+	if (tileA->height != tileB->height)  return (tileA->height < tileB->height) ? 1 : -1;
+	if (tileA->width != tileB->width)  return (tileA->width < tileB->width) ? 1 : -1;
+	return (tileA->material < tileB->material) ? -1 : (tileA->material > tileB->material);
+}
+
+
+// Smallest area first, then the squarer, then the wider.
+static int CompareAtlasSizes(const void *a, const void *b)
+{
+	const AtlasSize			*sizeA = (const AtlasSize *)a, *sizeB = (const AtlasSize *)b;
+	uint64_t				areaA = (uint64_t)sizeA->width * sizeA->height, areaB = (uint64_t)sizeB->width * sizeB->height;
+	unsigned				skewA, skewB;
+	
+	if (areaA != areaB)  return (areaA < areaB) ? -1 : 1;
+	skewA = MAX(sizeA->width, sizeA->height) / MIN(sizeA->width, sizeA->height);
+	skewB = MAX(sizeB->width, sizeB->height) / MIN(sizeB->width, sizeB->height);
+	if (skewA != skewB)  return (skewA < skewB) ? -1 : 1;
+	return (sizeA->width > sizeB->width) ? -1 : (sizeA->width < sizeB->width);
+}
@@ -33,6 +33,12 @@
 @implementation DDMesh (Utilities)
 
 - (SceneNode *)sceneGraphForMesh
+{
+	return [self sceneGraphForMeshWithVertexDeviations:nil range:0];
+}
+
+
+- (SceneNode *)sceneGraphForMeshWithVertexDeviations:(NSData *)inDeviations range:(Scalar)inRange
 {
 	/*
 		Set up simple scene graph:
@@ -47,6 +53,7 @@
 	root = [SceneNode node];
 	cache = [DisplayListCacheNode node];
 	mesh = [DDMeshNode nodeWithMesh:self];
+	if (inDeviations != nil)  [mesh setVertexDeviations:inDeviations range:inRange];
 	
 	[root addChild:cache];
 	[cache addChild:mesh];
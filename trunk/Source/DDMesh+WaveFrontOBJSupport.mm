@@ -51,11 +51,13 @@ static NSArray *ObjFaceToArrayOfArrays(NSString *inData);
 static NSColor *ObjColorToNSColor(NSString *inColor);
 #endif
 
+static NSDictionary *CachedMaterialLibrary(NSURL *inURL, NSDate **outModificationDate);
+static void CacheMaterialLibrary(NSURL *inURL, NSDictionary *inLibrary, NSDate *inModificationDate);
+
 
 @interface DDMesh (WaveFrontOBJSupport_Private)
 
-- (NSMutableArray *)objTokenize:(NSURL *)inFile error:(NSError **)outError;
-- (NSDictionary *)loadObjMaterialLibraryNamed:(NSString *)inString relativeTo:(NSURL *)inBase issues:(DDProblemReportManager *)ioIssues;
++ (NSMutableArray *)objTokenize:(NSURL *)inFile error:(NSError **)outError;
 
 @end
 
@@ -119,7 +121,7 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 	self = [super init];
 	if (nil == self) return nil;
 	
-	lines = [self objTokenize:inFile error:&error];
+	lines = [[self class] objTokenize:inFile error:&error];
 	if (!lines)
 	{
 		OK = NO;
@@ -210,7 +212,7 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 				// Material Library
 				if (nil == materialLibrary)
 				{
-					materialLibrary = [[self loadObjMaterialLibraryNamed:params relativeTo:inFile issues:ioIssues] retain];
+					materialLibrary = [[[self class] loadObjMaterialLibraryNamed:params relativeTo:inFile issues:ioIssues] retain];
 					if (nil != materialLibrary) materials = [[DDMaterialSet alloc] initWithCapacity:[materialLibrary count]];
 				}
 				else
@@ -647,7 +649,25 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 }
 
 
-- (NSMutableArray *)objTokenize:(NSURL *)inFile error:(NSError **)outError
++ (NSString *)objMaterialLibraryNameForURL:(NSURL *)inFile
+{
+	NSString				*mtlName;
+	
+	/*	Build material library name. For “Foo.obj” or “Foo”, use “Foo.mtl”; for “Bar.baz”, use
+		“Bar.baz.mtl”. Material library names can’t contain spaces (OBJ allows multiple material
+		library names separated by space), so replace them with underscores.
+	*/
+	mtlName = [[inFile path] lastPathComponent];
+	if ([[mtlName lowercaseString] hasSuffix:@".obj"])
+	{
+		mtlName = [mtlName substringToIndex:[mtlName length] - 4];
+	}
+	mtlName = [mtlName stringByAppendingString:@".mtl"];
+	return [[mtlName componentsSeparatedByString:@" "] componentsJoinedByString:@"_"];
+}
+
+
++ (NSMutableArray *)objTokenize:(NSURL *)inFile error:(NSError **)outError
 {
 	TraceEnterMsg(@"Called for %@", inFile);
 	
@@ -714,7 +734,7 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 }
 
 
-- (NSDictionary *)loadObjMaterialLibraryNamed:(NSString *)inString relativeTo:(NSURL *)inBase issues:(DDProblemReportManager *)ioIssues
++ (NSDictionary *)loadObjMaterialLibraryNamed:(NSString *)inString relativeTo:(NSURL *)inBase issues:(DDProblemReportManager *)ioIssues
 {
 	TraceEnterMsg(@"Called for %@", inString);
 	
@@ -728,8 +748,15 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 	NSMutableDictionary		*current = nil;
 	NSString				*currentName;
 	NSError					*error;
+	NSDictionary			*cached;
+	NSDate					*modificationDate = nil;
 	
 	url = [NSURL URLWithString:[inString stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding] relativeToURL:inBase];
+	
+	// Many models in a set often share a library, so it's only read again if it has changed.
+	cached = CachedMaterialLibrary(url, &modificationDate);
+	if (nil != cached) return cached;
+	
 	lines = [self objTokenize:url error:&error];
 	if (nil == lines)
 	{
@@ -848,6 +875,8 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 			[result setObject:current forKey:currentName];
 			LogOutdent();
 		}
+		
+		CacheMaterialLibrary(url, result, modificationDate);
 	}
 	
 	return result;
@@ -869,31 +898,18 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 	NSString				*dateString;
 	NSString				*mtlName;
 	NSURL					*mtlURL;
-	unsigned				i, j, faceVertexCount, count, ni;
-	NSNumber				*index;
-	NSMutableDictionary		*materialToFaceArray;
-	NSMutableArray			*facesForMaterial;
-	id						materialKey;
-	NSString				*materialName;
-	NSEnumerator			*materialEnumerator;
+	FILE					*file;
+	unsigned				i, j, faceVertexCount, count, ni, materialsUsed;
+	unsigned				*materialStarts = NULL;
+	DDMeshIndex				*facesByMaterial = NULL;
+	const char				*materialName;
 	DDMeshFaceData			*currentFace;
-	NSAutoreleasePool		*pool;
-	NSArray					*materialsUsed;
 	DDMaterial				*material;
 	unsigned				vertIdx, materialIdx;
 	uint8_t					activeSmoothingGroup = 0;
+	BOOL					OK = YES;
 	
-	/*	Build material library name. For “Foo.obj” or “Foo”, use “Foo.mtl”; for “Bar.baz”, use
-		“Bar.baz.mtl”. Material library names can’t contain spaces (OBJ allows multiple material
-		library names separated by space), so replace them with underscores.
-	*/
-	mtlName = [[inFile path] lastPathComponent];
-	if ([[mtlName lowercaseString] hasSuffix:@".obj"])
-	{
-		mtlName = [mtlName substringToIndex:[mtlName length] - 4];
-	}
-	mtlName = [mtlName stringByAppendingString:@".mtl"];
-	mtlName = [[mtlName componentsSeparatedByString:@" "] componentsJoinedByString:@"_"];
+	mtlName = [DDMesh objMaterialLibraryNameForURL:inFile];
 	
 	// Get formatted date string for header comment
 	formatter = [[NSDateFormatter alloc] initWithDateFormat:@"%Y-%m-%d" allowNaturalLanguage:NO];	// ISO date format
@@ -901,102 +917,100 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 	[formatter release];
 	NSString *version = ApplicationNameAndVersionString();
 	
-	pool = [[NSAutoreleasePool alloc] init];
+	/*	Group faces by material with a counting sort: materialStarts[m] is the
+		offset in facesByMaterial of the first face using material m. The sort
+		is stable, so faces keep their relative order within each group and
+		the output is the same from run to run.
+	*/
+	materialStarts = (unsigned *)calloc(_materialCount + 1, sizeof *materialStarts);
+	facesByMaterial = (DDMeshIndex *)malloc(sizeof *facesByMaterial * (_faceCount + 1));
+	if (NULL == materialStarts || NULL == facesByMaterial)
+	{
+		free(materialStarts);
+		free(facesByMaterial);
+		[ioManager addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+		return NO;
+	}
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		++materialStarts[_faces[i].material + 1];
+	}
+	for (i = 0; i != _materialCount; ++i)
+	{
+		materialStarts[i + 1] += materialStarts[i];
+	}
+	for (i = 0; i != _faceCount; ++i)
+	{
+		facesByMaterial[materialStarts[_faces[i].material]++] = i;
+	}
+	// The last pass advanced each start to the following group's; shift back.
+	for (i = _materialCount; i != 0; --i)
+	{
+		materialStarts[i] = materialStarts[i - 1];
+	}
+	materialStarts[0] = 0;
+	
+	file = fopen([[inFile path] fileSystemRepresentation], "w");
+	if (NULL == file)
+	{
+		free(materialStarts);
+		free(facesByMaterial);
+		[ioManager addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %s", strerror(errno)];
+		return NO;
+	}
+	setvbuf(file, NULL, _IOFBF, 64 * 1024);
 	
 	// Write header comment
-	dataString = [NSMutableString string];
-	[dataString appendFormat:  @"# Written by %@ on %@\n"
-								"# \n"
-								"# Model dimensions: %g x %g x %g (w x h x l)\n"
-								"# %i vertices, %i faces\n"
-								"\n",
-								version, dateString,
-								[self length], [self height], [self length],
-								_vertexCount, _faceCount];
+	fprintf(file, "# Written by %s on %s\n"
+				  "# \n"
+				  "# Model dimensions: %g x %g x %g (w x h x l)\n"
+				  "# %u vertices, %u faces\n"
+				  "\n",
+				  [version UTF8String], [dateString UTF8String],
+				  [self width], [self height], [self length],
+				  _vertexCount, _faceCount);
 	
 	// Write material library and object name
-	[dataString appendFormat:@"mtllib %@\no %@\n", mtlName, [self name]];
+	fprintf(file, "mtllib %s\no %s\n", [mtlName UTF8String], [[self name] UTF8String]);
 	
 	// Write vertices
-	[dataString appendFormat:@"\n# Vertices (%u):\n", _vertexCount];
+	fprintf(file, "\n# Vertices (%u):\n", _vertexCount);
 	for (i = 0; i != _vertexCount; ++i)
 	{
-		[dataString appendFormat:@"v %f %f %f\n", _vertices[i].x, _vertices[i].y, _vertices[i].z];
+		fprintf(file, "v %f %f %f\n", _vertices[i].x, _vertices[i].y, _vertices[i].z);
 	}
 	
 	//	Write texture co-ordinates.
-	[dataString appendFormat:@"\n# Texture co-ordinates (%u):\n", _texCoordCount];
+	fprintf(file, "\n# Texture co-ordinates (%u):\n", _texCoordCount);
 	for (i = 0; i != _texCoordCount; ++i)
 	{
-		[dataString appendFormat:@"vt %f %f\n", _texCoords[i].x, 1.0 - _texCoords[i].y];
+		fprintf(file, "vt %f %f\n", _texCoords[i].x, 1.0 - _texCoords[i].y);
 	}
 	
 	// Write normals
-	[dataString appendFormat:@"\n# Normals (%u):\n", _normalCount];
+	fprintf(file, "\n# Normals (%u):\n", _normalCount);
 	for (i = 0; i != _normalCount; ++i)
 	{
-		[dataString appendFormat:@"vn %f %f %f\n", _normals[i].x, _normals[i].y, _normals[i].z];
+		fprintf(file, "vn %f %f %f\n", _normals[i].x, _normals[i].y, _normals[i].z);
 	}
 	
-	/*	Sort faces by texture. Basic approach: create a dictionary keyed by material index, with
-		mutable arrays as the values. These arrays are populated with indices into _faces, as
-		NSNumbers.
-	*/
-	materialToFaceArray = [NSMutableDictionary dictionary];
-	for (i = 0; i != _faceCount; ++i)
-	{
-		materialKey = [NSNumber numberWithUnsignedInt:_faces[i].material];
-		facesForMaterial = [materialToFaceArray objectForKey:materialKey];
-		if (nil == facesForMaterial)
-		{
-			facesForMaterial = [NSMutableArray array];
-			[materialToFaceArray setObject:facesForMaterial forKey:materialKey];
-		}
-		[facesForMaterial addObject:[NSNumber numberWithInt:i]];
-	}
-	
-	#if 0
-	// FIXME: possibly ought to look for "$placeholder" material here?
-	// Write faces with no texture, if any
-	facesForMaterial = [materialToFaceArray objectForKey:[NSNull null]];
-	if (nil != facesForMaterial)
+	// FIXME: possibly ought to look for "$placeholder" material here, and write untextured faces without usemtl?
+	// Write faces for each material, in material order
+	materialsUsed = 0;
+	for (materialIdx = 0; materialIdx != _materialCount; ++materialIdx)
 	{
-		count = [facesForMaterial count];
-		[dataString appendFormat:@"\n# Untextured faces (%u):\ng untextured", count];
-		for (i = 0; i != count; ++i)
-		{
-			index = [facesForMaterial objectAtIndex:i];
-			currentFace = &_faces[[index intValue]];
-			faceVertexCount = currentFace->vertexCount;
-			[value release];
-			ni = currentFace->normal + 1;
-			vertIdx = currentFace->firstVertex;
-			
-			[dataString appendString:@"\nf"];
-			for (j = 0; j != faceVertexCount; ++j)
-			{
-				[dataString appendFormat:@" %i//%i", _faceVertexIndices[vertIdx] + 1, ni];
-			}
-		}
-		[dataString appendString:@"\n"];
+		count = materialStarts[materialIdx + 1] - materialStarts[materialIdx];
+		if (0 == count) continue;
+		++materialsUsed;
 		
-		[materialToFaceArray removeObjectForKey:[NSNull null]];
-	}
-	#endif
-	// Write faces for named textures
-	for (materialEnumerator = [materialToFaceArray keyEnumerator]; (materialKey = [materialEnumerator nextObject]); )
-	{
-		facesForMaterial = [materialToFaceArray objectForKey:materialKey];
-		materialIdx = [materialKey intValue];
-		materialName = [_materials[materialIdx] name];
-		if (nil == materialName) materialName = [NSString stringWithFormat:@"anon-%u", materialIdx];
+		materialName = [[_materials[materialIdx] name] UTF8String];
+		if (NULL == materialName) materialName = [[NSString stringWithFormat:@"anon-%u", materialIdx] UTF8String];
 		
-		count = [facesForMaterial count];
-		[dataString appendFormat:@"\n# Faces with texture %@ (%u):\ng %@\nusemtl %@", materialName, count, materialName, materialName];
-		for (i = 0; i != count; ++i)
+		fprintf(file, "\n# Faces with texture %s (%u):\ng %s\nusemtl %s", materialName, count, materialName, materialName);
+		for (i = materialStarts[materialIdx]; i != materialStarts[materialIdx + 1]; ++i)
 		{
-			index = [facesForMaterial objectAtIndex:i];
-			currentFace = &_faces[[index intValue]];
+			currentFace = &_faces[facesByMaterial[i]];
 			faceVertexCount = currentFace->vertexCount;
 			ni = currentFace->normal + 1;
 			vertIdx = currentFace->firstVertex;
@@ -1006,56 +1020,56 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 				activeSmoothingGroup = currentFace->smoothingGroup;
 				if (0 == activeSmoothingGroup)
 				{
-					[dataString appendString:@"\ns off"];
+					fputs("\ns off", file);
 				}
 				else
 				{
-					[dataString appendFormat:@"\ns %u", activeSmoothingGroup];
+					fprintf(file, "\ns %u", activeSmoothingGroup);
 				}
 			}
 			
-			[dataString appendString:@"\nf"];
+			fputs("\nf", file);
 			for (j = 0; j != faceVertexCount; ++j)
-			{			
-				[dataString appendFormat:@" %i/%i/%i", _faceVertexIndices[vertIdx] + 1, _faceTexCoordIndices[vertIdx] + 1, ni];
+			{
+				fprintf(file, " %u/%u/%u", _faceVertexIndices[vertIdx] + 1, _faceTexCoordIndices[vertIdx] + 1, ni);
 				++vertIdx;
 			}
 		}
-		[dataString appendString:@"\n"];
+		fputc('\n', file);
 	}
 	
 	// Write OBJ file
-	if (![dataString writeToURL:inFile atomically:NO encoding:NSUTF8StringEncoding error:&error])
+	if (ferror(file)) OK = NO;
+	if (0 != fclose(file)) OK = NO;
+	if (!OK)
 	{
-		if (nil != error) [ioManager addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %@", [error localizedFailureReason]];
-		else [ioManager addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved, because an unknown error occured."];
+		free(materialStarts);
+		free(facesByMaterial);
+		[ioManager addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %s", strerror(errno)];
 		return NO;
 	}
 	
-	materialsUsed = [[materialToFaceArray allKeys] retain];
-	[pool release];
-	pool = [[NSAutoreleasePool alloc] init];
-	[materialsUsed autorelease];
-	count = [materialsUsed count];
-	
 	// Create material library file
 	dataString = [NSMutableString string];
 	[dataString appendFormat:  @"# Written by %@ on %@\n"
 								"# \n"
-								"# %i materials\n"
+								"# %u materials\n"
 								"\n",
 								version, dateString,
-								count];
+								materialsUsed];
 	
-	for (i = 0; i != count; ++i)
+	for (materialIdx = 0; materialIdx != _materialCount; ++materialIdx)
 	{
-		materialIdx = [[materialsUsed objectAtIndex:i] intValue];
+		if (materialStarts[materialIdx] == materialStarts[materialIdx + 1]) continue;
+		
 		material = _materials[materialIdx];
 		[dataString appendFormat:  @"newmtl %@\n"
 									"map_Kd %@\n\n",
 									[material name],
 									[material diffuseMapName]];
 	}
+	free(materialStarts);
+	free(facesByMaterial);
 	
 	// Write MTL file
 	mtlURL = [NSURL URLWithString:mtlName relativeToURL:inFinalLocation];
@@ -1064,7 +1078,6 @@ static NSColor *ObjColorToNSColor(NSString *inColor);
 		if (nil != error) [ioManager addWarningIssueWithKey:@"mtllibWriteFailed" localizedFormat:@"The material library for the document could not be saved. %@", [error localizedFailureReason]];
 		else [ioManager addWarningIssueWithKey:@"mtllibWriteFailed" localizedFormat:@"The material library for the document could not be saved, because an unknown error occured."];
 	}
-	[pool release];
 	
 	return YES;
 }
@@ -1093,6 +1106,86 @@ static NSColor *ObjColorToNSColor(NSString *inColor)
 #endif
 
 
+// Libraries are small, but a long-running ddoolite --serve can read any number of them.
+#define kMaxCachedMaterialLibraries		64
+
+static NSMutableDictionary *sMaterialLibraryCache = nil;
+static NSMutableArray *sMaterialLibraryCacheOrder = nil;	// Keys, least recently used first
+
+
+/*	Returns the cached library for inURL if the file hasn't changed since it
+	was read. Otherwise returns nil, and the file's current modification date
+	in *outModificationDate for CacheMaterialLibrary().
+*/
+static NSDictionary *CachedMaterialLibrary(NSURL *inURL, NSDate **outModificationDate)
+{
+	NSString				*key;
+	NSDate					*date;
+	NSArray					*entry;
+	
+	if (![inURL isFileURL]) return nil;
+	
+	key = [[inURL absoluteURL] path];
+	date = [[[NSFileManager defaultManager] attributesOfItemAtPath:key error:NULL] fileModificationDate];
+	*outModificationDate = date;
+	if (nil == date) return nil;
+	
+	@synchronized ([DDMesh class])
+	{
+		entry = [[[sMaterialLibraryCache objectForKey:key] retain] autorelease];
+		if (nil != entry)
+		{
+			[sMaterialLibraryCacheOrder removeObject:key];
+			[sMaterialLibraryCacheOrder addObject:key];
+		}
+	}
+	
+	if (nil != entry && [[entry objectAtIndex:1] isEqualToDate:date]) return [entry objectAtIndex:0];
+	return nil;
+}
+
+
+/*	The cached library is shared by every document that uses it, so it is
+	copied all the way down to immutable material dictionaries.
+*/
+static void CacheMaterialLibrary(NSURL *inURL, NSDictionary *inLibrary, NSDate *inModificationDate)
+{
+	NSMutableDictionary		*library;
+	NSEnumerator			*materialEnum;
+	NSString				*name;
+	NSArray					*entry;
+	NSString				*key;
+	
+	if (nil == inModificationDate || nil == inLibrary) return;
+	
+	library = [NSMutableDictionary dictionaryWithCapacity:[inLibrary count]];
+	for (materialEnum = [inLibrary keyEnumerator]; (name = [materialEnum nextObject]); )
+	{
+		[library setObject:[NSDictionary dictionaryWithDictionary:[inLibrary objectForKey:name]] forKey:name];
+	}
+	
+	entry = [NSArray arrayWithObjects:[NSDictionary dictionaryWithDictionary:library], inModificationDate, nil];
+	key = [[inURL absoluteURL] path];
+	@synchronized ([DDMesh class])
+	{
+		if (nil == sMaterialLibraryCache)
+		{
+			sMaterialLibraryCache = [[NSMutableDictionary alloc] init];
+			sMaterialLibraryCacheOrder = [[NSMutableArray alloc] init];
+		}
+		
+		[sMaterialLibraryCacheOrder removeObject:key];
+		while (kMaxCachedMaterialLibraries <= [sMaterialLibraryCacheOrder count])
+		{
+			[sMaterialLibraryCache removeObjectForKey:[sMaterialLibraryCacheOrder objectAtIndex:0]];
+			[sMaterialLibraryCacheOrder removeObjectAtIndex:0];
+		}
+		[sMaterialLibraryCache setObject:entry forKey:key];
+		[sMaterialLibraryCacheOrder addObject:key];
+	}
+}
+
+
 static Vector ObjVertexToVector(NSString *inVertex)
 {
 	TraceEnter();
@@ -23,33 +23,15 @@
 
 #import <Foundation/Foundation.h>
 #import "phystypes.h"
+#import "DDMeshTypes.h"
 #import "DDPropertyListRepresentation.h"
 
 @class DDMaterial;
+@class DDMeshChangeSet;
 @class DDProblemReportManager;
 @class SceneNode;
-
-
-#define USE_SHORT_INDICES		0
-
-#if USE_SHORT_INDICES
-	typedef uint_least16_t		DDMeshIndex;
-#else
-	typedef uint_least32_t		DDMeshIndex;
-#endif
-
-
-enum
-{
-	#if USE_SHORT_INDICES
-		kDDMeshIndexMax			= UINT_LEAST16_MAX - 1,
-		kDDMeshIndexNotFound	= UINT_LEAST16_MAX,
-	#else
-		kDDMeshIndexMax			= UINT_LEAST32_MAX - 1,
-		kDDMeshIndexNotFound	= UINT_LEAST32_MAX,
-	#endif
-	kMaxVertsPerFace			= 16	// Hard-coded limit from Oolite
-};
+class DDTriangleBVH;
+struct DDSoftwareTexture;
 
 
 typedef enum
@@ -61,16 +43,60 @@ typedef enum
 } DDMeshRecenterMethod;
 
 
-typedef struct DDMeshFaceData
+/*	What a mutator changed. Derived data depending on a changed aspect of the
+	mesh is discarded the next time it is requested; other derived data is kept.
+*/
+typedef enum
+{
+	kDDMeshChangePositions		= 0x01,		// Vertex positions
+	kDDMeshChangeTopology		= 0x02,		// Faces, their vertex indices or vertex order
+	kDDMeshChangeMaterials		= 0x04,		// Materials or face material assignments
+	kDDMeshChangeNormals		= 0x08,		// Face or vertex normals
+	kDDMeshChangeTexCoords		= 0x10,		// Texture co-ordinates
+	kDDMeshChangeAll			= 0x1F,
+	
+	kDDMeshChangeChannelCount	= 5
+} DDMeshChangeFlags;
+
+
+// Derived data cached by DDMesh. For internal use.
+typedef enum
+{
+	kDDMeshDerivedBounds,
+	kDDMeshDerivedFaceCentroids,
+	kDDMeshDerivedFaceAreas,
+	kDDMeshDerivedFacePlanes,
+	kDDMeshDerivedEdges,
+	kDDMeshDerivedCornerTangents,
+	
+	kDDMeshDerivedProductCount
+} DDMeshDerivedProduct;
+
+
+/*	A unique edge of a mesh. Arrays of DDMeshEdges are laid out so that they
+	can be used directly as GL_LINES index buffers.
+*/
+typedef struct DDMeshEdge
+{
+	DDMeshIndex				vertices[2];	// Lower index first
+} DDMeshEdge;
+
+
+// Plane of a face: normal * p == distance for points p on the plane.
+typedef struct DDMeshPlane
 {
-	DDMeshIndex				normal;
-	DDMeshIndex				material;
-	unsigned				firstVertex;	// Index into _faceVertexIndices, _faceTexCoordIndices and _vertexNormalIndices
-	uint8_t					vertexCount;
-	uint8_t					nonCoplanar;
-	uint8_t					nonConvex;
-	uint8_t					smoothingGroup;
-} DDMeshFaceData;
+	Vector					normal;
+	Scalar					distance;
+} DDMeshPlane;
+
+
+typedef struct DDMeshDeviation
+{
+	Scalar					maximum;		// For symmetric comparisons, the Hausdorff distance
+	Scalar					mean;
+	Scalar					rms;
+	NSUInteger				sampleCount;
+} DDMeshDeviation;
 
 
 @interface DDMesh: NSObject<NSCopying>
@@ -103,23 +129,109 @@ typedef struct DDMeshFaceData
 	// Greatest distance from origin
 	Scalar					_rMax;
 	
+	// Average of all vertices; part of the bounds product.
+	Vector					_vertexAverage;
+	
+	/*	Edit versioning. _changeVersions records the _editVersion at which each
+		change channel was last touched, and _derivedVersions the _editVersion
+		at which each derived product was computed.
+	*/
+	uint32_t				_editVersion;
+	uint32_t				_changeVersions[kDDMeshChangeChannelCount];
+	uint32_t				_derivedVersions[kDDMeshDerivedProductCount];
+	BOOL					_haveVertexAverage;
+	
+	// Changes not yet announced by kNotificationDDMeshModified.
+	DDMeshChangeSet			*_pendingChanges;
+	
+	// Per-face derived data, built on demand.
+	Vector					*_faceCentroids;
+	Scalar					*_faceAreas;
+	DDMeshPlane				*_facePlanes;
+	DDMeshTangent			*_cornerTangents;
+	
 	NSString				*_name;
 	NSURL					*_sourceFile;
 	
 	BOOL					_hasNonTriangles;
 	BOOL					_hasBadPolygons;
+	BOOL					_hasBadEdges;
+	
+	// Edge adjacency, built on demand.
+	DDMeshIndex				_edgeCount;
+	DDMeshEdge				*_edges;
+	unsigned				*_edgeFaceStarts;	// _edgeCount + 1 entries; faces of edge i are _edgeFaces[_edgeFaceStarts[i]] to _edgeFaces[_edgeFaceStarts[i + 1] - 1]
+	DDMeshIndex				*_edgeFaces;
+	DDMeshIndex				_openEdgeCount,
+							_nonManifoldEdgeCount,
+							_inconsistentEdgeCount;
+	
+	/*	Binary mesh file whose pages the vertex, normal, texture co-ordinate,
+		face and index arrays may point into; see DDMesh (BinaryMesh).
+	*/
+	void					*_mappedBytes;
+	size_t					_mappedLength;
 }
 
 @property (readonly, nonatomic) Scalar length;
 @property (readonly, nonatomic) Scalar width;
 @property (readonly, nonatomic) Scalar height;
 @property (readonly) Scalar boundingRadius;
+- (void)getBoundsMin:(Vector *)outMin max:(Vector *)outMax;
 
 @property (readonly) NSUInteger vertexCount;
 @property (readonly) NSUInteger faceCount;
 
 @property (readonly) NSString *name;
 
+@property (readonly) NSUInteger materialCount;
+- (DDMaterial *)materialAtIndex:(NSUInteger)inIndex;
+
+// Incremented by every change to the mesh.
+@property (readonly) uint32_t editVersion;
+
+/*	Mutators, including those in categories and outside DDMesh, must call one
+	of these after changing the mesh. They bump the edit version, so that
+	derived data depending on inChanges is recalculated when next needed, and
+	queue a kNotificationDDMeshModified whose user info holds a
+	DDMeshChangeSet under kDDMeshChangeSetKey. The first form marks each
+	channel's whole index range as changed.
+	
+	While the current thread's run loop is running, changes are coalesced and
+	posted as one notification at the end of the run loop turn; otherwise the
+	notification is posted immediately.
+*/
+- (void)noteChanges:(DDMeshChangeFlags)inChanges;
+- (void)noteChanges:(DDMeshChangeFlags)inChanges range:(NSRange)inRange;
+
+// Post any queued change notification now.
+- (void)flushChangeNotifications;
+
+/*	Mutators which replace the vertex, normal, texture co-ordinate, face or
+	index arrays must release the old ones with this rather than free(), since
+	they may be pages of a mapped binary mesh file. Modifying them in place is
+	fine; mapped pages are copy-on-write.
+*/
+- (void)freeMeshArray:(void *)inArray;
+
+/*	Per-face derived data, computed on first use and kept until the vertex
+	positions or topology change. Centroids are vertex averages; areas are
+	those of the polygons' fan triangulations; planes pass through the first
+	vertex of each face with the same normal as -recalculateNormals uses.
+*/
+- (const Vector *)faceCentroids;
+- (const Scalar *)faceAreas;
+- (const DDMeshPlane *)facePlanes;
+
+/*	Tangent space for each face vertex, indexed like the face vertex index
+	buffer (face->firstVertex + n). Kept until positions, topology, normals or
+	texture co-ordinates change.
+*/
+- (const DDMeshTangent *)cornerTangents;
+
+// Average of all vertex positions, cached with the bounds.
+@property (readonly) Vector vertexAverage;
+
 - (void)recalculateNormals;
 - (void)reverseWinding;
 - (void)triangulate;
@@ -128,7 +240,13 @@ typedef struct DDMeshFaceData
 - (void)flipZ;
 - (void)recenterWithMethod:(DDMeshRecenterMethod)inMethod;
 - (void)scaleX:(Scalar)inX y:(Scalar)inY z:(Scalar)inZ;
-- (void)coalesceVertices;
+- (void)coalesceVertices;		// Merges vertices at identical positions.
+
+/*	Merge vertices no further than inTolerance apart, then drop polygon sides
+	that have collapsed to a point and polygons with fewer than three sides
+	left. Returns the number of vertices removed.
+*/
+- (NSUInteger)weldVerticesWithTolerance:(Scalar)inTolerance;
 
 @property (readonly) BOOL hasNonTriangles;
 @property (readonly) BOOL hasBadPolygons;		// “Bad polygons” are not coplanar or not convex.
@@ -136,15 +254,57 @@ typedef struct DDMeshFaceData
 // This is mostly used by loaders and manipulators. Returns NO for serious errors.
 - (BOOL)findBadPolygonsWithIssues:(DDProblemReportManager *)ioManager;
 
+/*	Unique edges and edge-to-face adjacency. These are built on first use, in
+	time linear in the number of polygon sides, and rebuilt after the mesh's
+	topology changes. Degenerate edges (from a vertex to itself) are ignored.
+*/
+@property (readonly) NSUInteger edgeCount;
+- (const DDMeshEdge *)edges;
+- (NSUInteger)getFaces:(const DDMeshIndex **)outFaces forEdge:(NSUInteger)inEdge;
+
+@property (readonly) NSUInteger openEdgeCount;				// Edges used by one face; holes in the surface.
+@property (readonly) NSUInteger nonManifoldEdgeCount;		// Edges used by more than two faces.
+@property (readonly) NSUInteger inconsistentEdgeCount;		// Edges shared by two faces with opposite winding.
+@property (readonly) BOOL hasBadEdges;						// Open or non-manifold edges found by -findOpenEdgesWithIssues:.
+
+// Called by -findBadPolygonsWithIssues:. Problems are reported as warnings.
+- (void)findOpenEdgesWithIssues:(DDProblemReportManager *)ioManager;
+
+/*	Fan-triangulate every face into a malloced array of 3 * triangle count
+	vertices. If outTags is not NULL, it receives a malloced array giving the
+	face index of each triangle. Caller frees both. Returns NULL on failure.
+*/
+- (Vector *)copyTriangleSoup:(uint32_t *)outTriangleCount faceTags:(uint32_t **)outTags;
+
 @end
 
 
+/*	DAT writing options. kDDOoliteDATVertexNormals adds a NAMES material table
+	and per-vertex NORMALS and TANGENTS, which Oolite 1.74 and later use
+	instead of calculating its own. Vertices are split where faces in
+	different smoothing groups, or in none, need different normals.
+*/
+enum
+{
+	kDDOoliteDATVertexNormals		= 1UL << 0
+};
+typedef unsigned DDOoliteDATOptions;
+
+
 @interface DDMesh (OoliteDATSupport)
 
+// Also reads NAMES and NORMALS sections; TANGENTS are skipped, since they're recalculated on export.
 - (id)initWithOoliteDAT:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
 
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile;
 - (BOOL)writeOoliteDATToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioManager;
+- (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions;
+- (BOOL)writeOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions issues:(DDProblemReportManager *)ioManager;
+
+// Oolite's limits, for writers that don't build a DDMesh. The version is nil if any will do.
++ (NSString *)minimumOoliteVersionStringForVertexCount:(unsigned)inVertexCount faceCount:(unsigned)inFaceCount materialCount:(unsigned)inMaterialCount;
++ (unsigned)maximumOoliteDATMaterialCount;
++ (BOOL)isValidOoliteDATTextureName:(NSString *)inName;
 
 @end
 
@@ -156,23 +316,155 @@ typedef struct DDMeshFaceData
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingWaveFrontOBJToURL:(NSURL *)inFile;
 - (BOOL)writeWaveFrontOBJToURL:(NSURL *)inFile finalLocationURL:(NSURL *)inFinalLocation issues:(DDProblemReportManager *)ioManager;
 
+// Name of the material library written alongside inFile: Foo.obj gets Foo.mtl.
++ (NSString *)objMaterialLibraryNameForURL:(NSURL *)inFile;
+
+/*	Material library inString, relative to inBase, as a dictionary of material
+	names to attributes ("diffuse map name"). Libraries are cached until the
+	file changes.
+*/
++ (NSDictionary *)loadObjMaterialLibraryNamed:(NSString *)inString relativeTo:(NSURL *)inBase issues:(DDProblemReportManager *)ioIssues;
+
 @end
 
 
 @interface DDMesh (GLRendering)
 
 - (void)glRenderShaded;
+// Shaded, with ambient and diffuse lighting scaled by per-vertex visibility as from -bakeVertexOcclusion... (NULL for none).
+- (void)glRenderShadedWithOcclusion:(const Scalar *)inVisibility;
 - (void)glRenderWireframe;
 - (void)glRenderNormals;
 - (void)glRenderBadPolygons;
 - (void)glRenderBoundingBox;
 
+// Render faces coloured by per-vertex deviation, from blue (none) through green to red (inRange or more).
+- (void)glRenderDeviations:(const Scalar *)inDeviations range:(Scalar)inRange;
+
+@end
+
+
+@interface DDMesh (Comparison)
+
+// BVH over the mesh's faces, fan-triangulated and tagged with face indices. Caller deletes.
+- (DDTriangleBVH *)newTriangleBVH;
+
+/*	One-sided distance from the surface of the receiver to the surface of
+	inOther, estimated from about inSampleCount area-weighted samples (0 for a
+	sensible default) plus every vertex. Results are deterministic. If
+	outVertexDeviations is not NULL, it receives an NSData containing one
+	Scalar per vertex of the receiver.
+*/
+- (BOOL)getDeviationFromMesh:(DDMesh *)inOther sampleCount:(NSUInteger)inSampleCount result:(DDMeshDeviation *)outResult vertexDeviations:(NSData **)outVertexDeviations;
+
+/*	Symmetric comparison; outResult->maximum is the Hausdorff distance. The
+	one-sided results are returned in outForward and outBackward if not NULL.
+*/
+- (BOOL)compareWithMesh:(DDMesh *)inOther sampleCount:(NSUInteger)inSampleCount result:(DDMeshDeviation *)outResult forward:(DDMeshDeviation *)outForward backward:(DDMeshDeviation *)outBackward;
+
+@end
+
+
+@interface DDMesh (TangentSpace)
+
+/*	Uncached tangent generation behind -cornerTangents. outTangents has an
+	entry per face vertex.
+*/
+- (BOOL)generateCornerTangents:(DDMeshTangent *)outTangents;
+
+@end
+
+
+// Hemisphere rays per vertex or texel when ambient occlusion is baked with a sample count of 0.
+#define kDDMeshDefaultOcclusionSampleCount		64
+
+
+@interface DDMesh (Baking)
+
+/*	Tangent-space normal map for the receiver's u/v layout, taken from the
+	surface of inSource (typically a more detailed version of the same model)
+	by casting rays both ways along the receiver's interpolated normals, up to
+	inMaxDistance (0 for a default based on the receiver's size). The result
+	is inWidth * inHeight RGBX texels, top row first, suitable for
+	DDWritePNGToURL(); green follows increasing v. Texels outside every u/v
+	chart are padded from the nearest chart, or flat.
+*/
+- (NSData *)bakeNormalMapFromMesh:(DDMesh *)inSource width:(unsigned)inWidth height:(unsigned)inHeight maxDistance:(Scalar)inMaxDistance;
+
+/*	Ambient occlusion, as the fraction of cosine-weighted hemisphere rays that
+	escape the receiver within inMaxDistance (0 for a default based on its
+	size). Sampling is deterministic, so a given mesh always gives the same
+	result. If outRayCount is not NULL it receives the number of rays cast.
+	
+	-bakeVertexOcclusion... returns an NSData containing one Scalar per
+	vertex, looking out along the average of the vertex's corner normals.
+	-bakeOcclusionMap... returns grey RGBX texels like -bakeNormalMap...,
+	covering the faces using material inMaterial, or all faces for
+	NSNotFound; faces of every material cast shadows.
+*/
+- (NSData *)bakeVertexOcclusionWithSampleCount:(unsigned)inSampleCount maxDistance:(Scalar)inMaxDistance rayCount:(NSUInteger *)outRayCount;
+- (NSData *)bakeOcclusionMapWithWidth:(unsigned)inWidth height:(unsigned)inHeight material:(NSUInteger)inMaterial sampleCount:(unsigned)inSampleCount maxDistance:(Scalar)inMaxDistance rayCount:(NSUInteger *)outRayCount;
+
+@end
+
+
+@interface DDMesh (SoftwareRendering)
+
+/*	Draw the receiver without OpenGL, as a new document window shows it after
+	turning it inYaw degrees about its y axis, with the default lighting and
+	optionally its edges drawn over the faces. inTextures has one entry per
+	material, or is NULL to leave every face white. The result is inWidth *
+	inHeight RGBX pixels, top row first, suitable for DDWritePNGToURL().
+	Unless inParallel is NO, the image is drawn in tiles on all processors.
+	If outTriangleCount is not NULL it receives the number of triangles the
+	faces were split into.
+*/
+- (NSData *)renderImageWithWidth:(unsigned)inWidth height:(unsigned)inHeight yaw:(Scalar)inYaw textures:(const struct DDSoftwareTexture *)inTextures wireframe:(BOOL)inWireframe parallel:(BOOL)inParallel triangleCount:(NSUInteger *)outTriangleCount;
+
+@end
+
+
+// Texels of edge colour around each texture in an atlas, so that filtering and mip-mapping don't bleed between them.
+#define kDDMeshDefaultAtlasPadding				8
+
+
+@interface DDMesh (TextureAtlas)
+
+/*	Pack the diffuse maps of the materials in use into a single power-of-two
+	texture, at most inMaxSize texels on each side, written as a PNG to
+	inAtlasFile, and move their faces onto one new material using it, so that
+	Oolite can draw them together. Textures are found relative to inBaseFile.
+	Materials whose texture co-ordinates go outside [0, 1] (repeating
+	textures) are left alone, as are those without textures; so is the whole
+	mesh if fewer than two textures could be packed. Alpha channels are not
+	preserved. If outPackedCount is not NULL, it receives the number of
+	materials merged.
+*/
+- (BOOL)packTexturesIntoAtlasAtURL:(NSURL *)inAtlasFile relativeTo:(NSURL *)inBaseFile maxSize:(unsigned)inMaxSize padding:(unsigned)inPadding packedCount:(NSUInteger *)outPackedCount issues:(DDProblemReportManager *)ioIssues;
+
+@end
+
+
+/*	Dry Dock binary mesh: the mesh's arrays exactly as DDMesh holds them in
+	memory (little-endian, 16-byte aligned), behind a fixed header and a
+	section table. Reading maps the file and adopts its pages copy-on-write
+	instead of copying, and validates only the indices, so opening touches
+	only the pages of the arrays which are actually used; bounds and polygon
+	checks are stored rather than recalculated. Big-endian hosts read a
+	byte-swapped copy instead. Documented in “Dry Dock document format.txt”.
+*/
+@interface DDMesh (BinaryMesh)
+
+- (id)initWithBinaryMesh:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+- (BOOL)writeBinaryMeshToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+
 @end
 
 
 @interface DDMesh (Utilities)
 
 - (SceneNode *)sceneGraphForMesh;
+- (SceneNode *)sceneGraphForMeshWithVertexDeviations:(NSData *)inDeviations range:(Scalar)inRange;
 
 @end
 
@@ -182,4 +474,4 @@ typedef struct DDMeshFaceData
 @end
 
 
-extern NSString *kNotificationDDMeshModified;
+extern NSString *kNotificationDDMeshModified;	// User info: kDDMeshChangeSetKey (see DDMeshChangeSet.h)
@@ -32,6 +32,9 @@
 #import "DDNormalSet.h"
 #import "DDUtilities.h"
 #import "DDFaceVertexBuffer.h"
+#import "DDMeshChangeSet.h"
+#import "DDMeshOperation.h"
+#import <sys/mman.h>
 
 
 #define VERTEX_FOR_FACE(face, vi) ({ DDMeshFaceData *face_ = (face); _vertices[_faceVertexIndices[face_->firstVertex + (vi)]]; })
@@ -44,10 +47,62 @@ NSString *kNotificationDDMeshModified = @"de.berlios.drydock DDMeshModified";
 static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, DDMeshIndex *inVertexIndices);
 
 
+// A run loop with no current mode isn't running, so a delayed perform would never fire.
+static inline BOOL CoalesceChangeNotifications(void)
+{
+	return [[NSRunLoop currentRunLoop] currentMode] != nil;
+}
+
+
+// One side of a polygon, filed under the lower of its two vertex indices while building edges.
+typedef struct DDMeshEdgeSide
+{
+	DDMeshIndex				hi;
+	DDMeshIndex				face;
+	uint8_t					reversed;
+} DDMeshEdgeSide;
+
+
+// Change channels each derived product depends on, indexed by DDMeshDerivedProduct.
+static const unsigned sDerivedProductDependencies[kDDMeshDerivedProductCount] =
+{
+	kDDMeshChangePositions,								// kDDMeshDerivedBounds
+	kDDMeshChangePositions | kDDMeshChangeTopology,		// kDDMeshDerivedFaceCentroids
+	kDDMeshChangePositions | kDDMeshChangeTopology,		// kDDMeshDerivedFaceAreas
+	kDDMeshChangePositions | kDDMeshChangeTopology,		// kDDMeshDerivedFacePlanes
+	kDDMeshChangeTopology,								// kDDMeshDerivedEdges
+	kDDMeshChangeAll & ~kDDMeshChangeMaterials			// kDDMeshDerivedCornerTangents
+};
+
+
+// Greatest distance of a vertex from a polygon's plane, relative to the square root of the polygon's area.
+#define kCoplanarityTolerance		0.01
+
+// Grid cell size used to find exactly coincident vertices when welding.
+#define kExactWeldCellSize			(1.0f / 1024.0f)
+
+
+static inline unsigned WeldCellHash(const long long inCell[3])
+{
+	return (unsigned)(inCell[0] * 73856093LL) ^ (unsigned)(inCell[1] * 19349663LL) ^ (unsigned)(inCell[2] * 83492791LL);
+}
+
+
 @interface DDMesh (Private)
 
 - (id)initAsCopyOf:(DDMesh *)inMesh;
 
+- (BOOL)isDerivedProductCurrent:(DDMeshDerivedProduct)inProduct;
+- (void)markDerivedProductCurrent:(DDMeshDerivedProduct)inProduct;
+- (void)updateBounds;
+- (void)recalculateBounds;
+
+- (void)queueChanges:(DDMeshChangeFlags)inChanges range:(NSRange)inRange;
+
+- (BOOL)buildEdges;
+- (void)discardEdges;
+- (void)freeMeshArrays;
+
 @end
 
 
@@ -145,6 +200,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		
 		_hasNonTriangles = inMesh->_hasNonTriangles;
 		_hasBadPolygons = inMesh->_hasBadPolygons;
+		_hasBadEdges = inMesh->_hasBadEdges;
 		_name = [inMesh->_name copyWithZone:zone];
 	}
 	
@@ -174,10 +230,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 {
 	TraceEnter();
 	
-	Free(_vertices);
-	Free(_normals);
-	Free(_faces);
-	Free(_texCoords);
+	[self freeMeshArrays];
 	if(_materials != NULL)
 	{
 		for (DDMeshIndex i = 0; i != _materialCount; ++i)
@@ -186,11 +239,14 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		}
 		Free(_materials);
 	}
-	Free(_faceVertexIndices);
-	Free(_faceTexCoordIndices);
-	Free(_vertexNormalIndices);
+	Free(_faceCentroids);
+	Free(_faceAreas);
+	Free(_facePlanes);
+	Free(_cornerTangents);
+	[self discardEdges];
 	
 	Release(_name);
+	Release(_pendingChanges);
 	
 	[[NSNotificationCenter defaultCenter] removeObserver:nil name:kNotificationDDMeshModified object:self];
 	
@@ -202,19 +258,51 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 
 - (void) finalize
 {
-	Free(_vertices);
-	Free(_normals);
-	Free(_faces);
-	Free(_texCoords);
+	[self freeMeshArrays];
 	Free(_materials);
-	Free(_faceVertexIndices);
-	Free(_faceTexCoordIndices);
-	Free(_vertexNormalIndices);
+	Free(_faceCentroids);
+	Free(_faceAreas);
+	Free(_facePlanes);
+	Free(_cornerTangents);
+	[self discardEdges];
 	
 	[super finalize];
 }
 
 
+- (void)freeMeshArray:(void *)inArray
+{
+	if (NULL != _mappedBytes && (char *)_mappedBytes <= (char *)inArray && (char *)inArray < (char *)_mappedBytes + _mappedLength)  return;
+	free(inArray);
+}
+
+
+- (void)freeMeshArrays
+{
+	[self freeMeshArray:_vertices];
+	[self freeMeshArray:_normals];
+	[self freeMeshArray:_faces];
+	[self freeMeshArray:_texCoords];
+	[self freeMeshArray:_faceVertexIndices];
+	[self freeMeshArray:_faceTexCoordIndices];
+	[self freeMeshArray:_vertexNormalIndices];
+	_vertices = NULL;
+	_normals = NULL;
+	_faces = NULL;
+	_texCoords = NULL;
+	_faceVertexIndices = NULL;
+	_faceTexCoordIndices = NULL;
+	_vertexNormalIndices = NULL;
+	
+	if (NULL != _mappedBytes)
+	{
+		munmap(_mappedBytes, _mappedLength);
+		_mappedBytes = NULL;
+		_mappedLength = 0;
+	}
+}
+
+
 - (id)copyWithZone:(NSZone *)inZone
 {
 	DDMesh					*copy;
@@ -234,7 +322,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 	Vector					normal;
 	DDNormalSet				*normals;
 	
-	free(_normals);
+	[self freeMeshArray:_normals];
 	normals = [DDNormalSet setWithCapacity:_faceCount];
 	face = _faces;
 	count = _faceCount;
@@ -243,11 +331,13 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		normal = NormalForFace(face, _vertices, _faceVertexIndices);
 		face->normal = [normals indexForVector:normal];
 		++face;
+		
+		if ((count & 0xFFF) == 0 && !DDMeshOperationReportProgress(1.0f - (float)count / _faceCount))  break;
 	} while (--count);
 	
 	[normals getArray:&_normals andCount:&_normalCount];
 	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangeNormals];
 	
 	TraceExit();
 }
@@ -289,7 +379,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		++face;
 	}
 	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangeTopology];
 	
 	TraceExit();
 }
@@ -326,6 +416,13 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 	j = 0;
 	for (i = 0; i != count; ++i)
 	{
+		if ((i & 0xFFF) == 0 && !DDMeshOperationReportProgress((float)i / count))
+		{
+			[buffer release];
+			free(newFaces);
+			return;
+		}
+		
 		// Convert face into triangle fan
 		subCount = _faces[i].vertexCount - 2;
 		vertIdx = _faces[i].firstVertex;
@@ -353,10 +450,10 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		}
 	}
 	
-	free(_faces);
-	free(_faceVertexIndices);
-	free(_faceTexCoordIndices);
-	free(_vertexNormalIndices);
+	[self freeMeshArray:_faces];
+	[self freeMeshArray:_faceVertexIndices];
+	[self freeMeshArray:_faceTexCoordIndices];
+	[self freeMeshArray:_vertexNormalIndices];
 	
 	_faces = newFaces;
 	_faceCount = total;
@@ -365,7 +462,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 	_hasNonTriangles = NO;
 	_hasBadPolygons = NO;
 	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangeTopology];
 	
 	TraceExit();
 }
@@ -375,9 +472,8 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 {
 	TraceEnter();
 	
-	// Negate X co-ordinate of each vertex, and each face normal, and also X extremes
+	// Negate X co-ordinate of each vertex and each face normal. Bounds are recalculated on demand.
 	unsigned			i;
-	Scalar				temp;
 	
 	for (i = 0; i != _vertexCount; ++i)
 	{
@@ -388,11 +484,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		_normals[i].x *= -1.0;
 	}
 	
-	temp = _xMax;
-	_xMin = -_xMax;
-	_xMax = -temp;
-	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangePositions | kDDMeshChangeNormals];
 	
 	TraceExit();
 }
@@ -402,9 +494,8 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 {
 	TraceEnter();
 	
-	// Negate Y co-ordinate of each vertex, and each face normal, and also Y extremes
+	// Negate Y co-ordinate of each vertex and each face normal. Bounds are recalculated on demand.
 	unsigned			i;
-	Scalar				temp;
 	
 	for (i = 0; i != _vertexCount; ++i)
 	{
@@ -415,11 +506,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		_normals[i].y *= -1.0;
 	}
 	
-	temp = _yMax;
-	_yMin = -_yMax;
-	_yMax = -temp;
-	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangePositions | kDDMeshChangeNormals];
 	
 	TraceExit();
 }
@@ -429,9 +516,8 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 {
 	TraceEnter();
 	
-	// Negate Z co-ordinate of each vertex, and each face normal, and also Z extremes
+	// Negate Z co-ordinate of each vertex and each face normal. Bounds are recalculated on demand.
 	unsigned			i;
-	Scalar				temp;
 	
 	for (i = 0; i != _vertexCount; ++i)
 	{
@@ -442,11 +528,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		_normals[i].z *= -1.0;
 	}
 	
-	temp = _zMax;
-	_zMin = -_zMax;
-	_zMax = -temp;
-	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangePositions | kDDMeshChangeNormals];
 	
 	TraceExit();
 }
@@ -457,21 +539,16 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 	TraceEnter();
 	
 	unsigned			i;
-	Vector				v, centre(0, 0, 0);
-	Scalar				r;
+	Vector				centre(0, 0, 0);
 	
 	if (kDDMeshRecenterNone == inMethod) return;
 	if (kDDMeshRecenterByAveragingVertices == inMethod)
 	{
-		// Average all the vertices together
-		for (i = 0; i != _vertexCount; ++i)
-		{
-			centre += _vertices[i];
-		}
-		centre /= _vertexCount;
+		centre = self.vertexAverage;
 	}
 	else if (kDDMeshRecenterUsingBoundingBox == inMethod)
 	{
+		[self updateBounds];
 		centre.x = (_xMax + _xMin) / 2.0;
 		centre.y = (_yMax + _yMin) / 2.0;
 		centre.z = (_zMax + _zMin) / 2.0;
@@ -481,24 +558,13 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		LogMessage(@"Invalid rescale method %u.", (unsigned int)inMethod);
 	}
 	
-	// Shift all the vertices over, and recalculate rMax
-	_rMax = 0;
-	_xMin -= centre.x; _xMax -= centre.x;
-	_yMin -= centre.y; _yMax -= centre.y;
-	_zMin -= centre.z; _zMax -= centre.z;
-	
+	// Shift all the vertices over. Bounds are recalculated on demand.
 	for (i = 0; i != _vertexCount; ++i)
 	{
-		v = _vertices[i] - centre;
-		_vertices[i] = v;
-		
-		r = v.SquareMagnitude();
-		if (_rMax < r) _rMax = r;
+		_vertices[i] -= centre;
 	}
 	
-	_rMax = sqrt(_rMax);
-	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangePositions];
 	
 	TraceExit();
 }
@@ -509,31 +575,19 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 	TraceEnter();
 	
 	unsigned			i;
-	Scalar				r;
 	
 	if (1.0f == inX && 1.0f == inY && 1.0f == inZ) return;
 	
-	_rMax = 0;
 	for (i = 0; i != _vertexCount; ++i)
 	{
 		_vertices[i].x *= inX;
 		_vertices[i].y *= inY;
 		_vertices[i].z *= inZ;
 		
-		r = _vertices[i].SquareMagnitude();
-		if (_rMax < r) _rMax = r;
+		if ((i & 0xFFFF) == 0 && !DDMeshOperationReportProgress((float)i / _vertexCount))  return;
 	}
 	
-	_rMax = sqrt(_rMax);
-	
-	_xMin *= inX;
-	_xMax *= inX;
-	_yMin *= inY;
-	_yMax *= inY;
-	_zMin *= inZ;
-	_zMax *= inZ;
-	
-	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified object:self];
+	[self noteChanges:kDDMeshChangePositions];
 	
 	TraceExit();
 }
@@ -541,83 +595,208 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 
 - (void)coalesceVertices
 {
-	
+	[self weldVerticesWithTolerance:0.0f];
 }
 
 
-- (BOOL)findBadPolygonsWithIssues:(DDProblemReportManager *)ioManager
+- (NSUInteger)weldVerticesWithTolerance:(Scalar)inTolerance
 {
 	TraceEnter();
 	
+	DDMeshIndex				i, j, kept = 0, faceCount = 0;
+	unsigned				k, n, bucketMask, bucket;
+	DDMeshIndex				*remap = NULL, *buckets = NULL, *chain = NULL;
+	Vector					*newVertices = NULL, v, delta;
+	Scalar					cellSize, toleranceSq;
+	long long				cell[3], neighbour[3];
+	int						dx, dy, dz, reach;
+	DDMeshFaceData			*newFaces = NULL, *face;
+	DDFaceVertexBuffer		*buffer = nil;
+	DDMeshIndex				verts[256], texCoords[256], normals[256];
 	BOOL					OK = YES;
-	unsigned				i, faceCount, vertexCount, notCoplanar = 0;
-	DDMeshFaceData			*face;
-	Vector					normal, a, b, edge;
-	Scalar					dot;
-	BOOL					reportedNonCoplanar = NO;
 	
-	// These values will be regenerated.
-	_hasNonTriangles = NO;
-	_hasBadPolygons = NO;
+	if (_vertexCount == 0)  return 0;
+	if (inTolerance < 0.0f)  inTolerance = 0.0f;
 	
-	faceCount = _faceCount;
-	face = _faces;
-	while (faceCount--)
+	/*	Vertices are filed in a hash table of grid cells the size of the
+		tolerance, so each one need only be compared with those in its own and
+		neighbouring cells. Exact matches always share a cell, so for a zero
+		tolerance only the vertex's own cell is searched.
+	*/
+	cellSize = (inTolerance > 0.0f) ? inTolerance : kExactWeldCellSize;
+	toleranceSq = inTolerance * inTolerance;
+	reach = (inTolerance > 0.0f) ? 1 : 0;
+	
+	for (n = 64; n < _vertexCount * 2; n *= 2) {}
+	bucketMask = n - 1;
+	
+	remap = (DDMeshIndex *)malloc(sizeof *remap * _vertexCount);
+	chain = (DDMeshIndex *)malloc(sizeof *chain * _vertexCount);
+	buckets = (DDMeshIndex *)malloc(sizeof *buckets * n);
+	newVertices = (Vector *)malloc(sizeof *newVertices * _vertexCount);
+	if (remap == NULL || chain == NULL || buckets == NULL || newVertices == NULL)  OK = NO;
+	
+	if (OK)
 	{
-		face->nonCoplanar = NO;
-		face->nonConvex = NO;
+		for (k = 0; k != n; ++k)  buckets[k] = kDDMeshIndexNotFound;
 		
-		vertexCount = face->vertexCount;
-		if (3 != vertexCount)
+		for (i = 0; i != _vertexCount; ++i)
 		{
-			if (vertexCount < 3)
+			if ((i & 0xFFF) == 0 && !DDMeshOperationReportProgress(0.5f * i / _vertexCount))
 			{
-				[NSException raise:NSRangeException format:@"%s: invalid vertex count %u.", __PRETTY_FUNCTION__, vertexCount];
+				OK = NO;
+				break;
 			}
 			
-			_hasNonTriangles = YES;
-			
-			LogIndent();
-			Vector				x1, x2, x3;
-			Vector				x3mx1;
-			Vector				x2mx1;
-			Vector				xNmx3;
+			v = _vertices[i];
+			cell[0] = (long long)floor(v.x / cellSize);
+			cell[1] = (long long)floor(v.y / cellSize);
+			cell[2] = (long long)floor(v.z / cellSize);
 			
-			x1 = VERTEX_FOR_FACE(face, 0);
-			x2 = VERTEX_FOR_FACE(face, 1);
-			x3 = VERTEX_FOR_FACE(face, 2);
-			x3mx1 = x3 - x1;
-			x2mx1 = x2 - x1;
-			
-			for (i = 3; i != vertexCount; ++i)
+			remap[i] = kDDMeshIndexNotFound;
+			for (dx = -reach; dx <= reach && remap[i] == kDDMeshIndexNotFound; ++dx)
 			{
-				xNmx3 = _vertices[_faceVertexIndices[face->firstVertex + i]] - x3;
-				dot = fabs(x3mx1 * (x2mx1 % xNmx3));
-				if (0.1 < dot)
+				for (dy = -reach; dy <= reach && remap[i] == kDDMeshIndexNotFound; ++dy)
 				{
-				//	LogMessage(@"Dot product is %g for vertex %u of polygon %u", dot, i, _faceCount - faceCount);
-					
-					face->nonCoplanar = YES;
-					++notCoplanar;
-					if (!reportedNonCoplanar)
+					for (dz = -reach; dz <= reach && remap[i] == kDDMeshIndexNotFound; ++dz)
 					{
-						reportedNonCoplanar = YES;
-						_hasBadPolygons = YES;
-						[ioManager addWarningIssueWithKey:@"hasNonCoplanarPolygons" localizedFormat:@"The document contains one or more polygons which are not coplanar. These polygons will be highlighted in red."];
+						neighbour[0] = cell[0] + dx;
+						neighbour[1] = cell[1] + dy;
+						neighbour[2] = cell[2] + dz;
+						bucket = WeldCellHash(neighbour) & bucketMask;
+						
+						for (j = buckets[bucket]; j != kDDMeshIndexNotFound; j = chain[j])
+						{
+							delta = newVertices[j] - v;
+							if (delta * delta <= toleranceSq)
+							{
+								remap[i] = j;
+								break;
+							}
+						}
 					}
-					break;
 				}
 			}
-			LogOutdent();
+			
+			if (remap[i] == kDDMeshIndexNotFound)
+			{
+				// Keep this vertex; later vertices within tolerance merge into it.
+				bucket = WeldCellHash(cell) & bucketMask;
+				newVertices[kept] = v;
+				chain[kept] = buckets[bucket];
+				buckets[bucket] = kept;
+				remap[i] = kept++;
+			}
 		}
-		++face;
 	}
 	
+	Free(chain);
+	Free(buckets);
+	
+	if (OK && kept == _vertexCount)
+	{
+		// Nothing to merge.
+		Free(remap);
+		Free(newVertices);
+		return 0;
+	}
+	
+	// Rebuild the faces, dropping collapsed sides and faces.
+	if (OK)
+	{
+		buffer = [[DDFaceVertexBuffer alloc] initForFaceCount:_faceCount];
+		newFaces = (DDMeshFaceData *)malloc(sizeof *newFaces * _faceCount);
+		if (buffer == nil || newFaces == NULL)  OK = NO;
+	}
+	
+	if (OK)
+	{
+		for (i = 0; i != _faceCount; ++i)
+		{
+			if ((i & 0xFFF) == 0 && !DDMeshOperationReportProgress(0.5f + 0.5f * i / _faceCount))
+			{
+				OK = NO;
+				break;
+			}
+			
+			face = &_faces[i];
+			n = 0;
+			for (k = 0; k != face->vertexCount; ++k)
+			{
+				j = remap[_faceVertexIndices[face->firstVertex + k]];
+				if (n != 0 && verts[n - 1] == j)  continue;
+				
+				verts[n] = j;
+				texCoords[n] = _faceTexCoordIndices[face->firstVertex + k];
+				normals[n] = _vertexNormalIndices[face->firstVertex + k];
+				++n;
+			}
+			while (n > 1 && verts[n - 1] == verts[0])  --n;
+			if (n < 3)  continue;
+			
+			newFaces[faceCount] = *face;
+			newFaces[faceCount].vertexCount = n;
+			newFaces[faceCount].firstVertex = [buffer addVertexIndices:verts texCoordIndices:texCoords vertexNormals:normals count:n];
+			++faceCount;
+		}
+	}
+	
+	Free(remap);
+	
+	if (!OK)
+	{
+		Free(newVertices);
+		Free(newFaces);
+		[buffer release];
+		return 0;
+	}
+	
+	[self freeMeshArray:_vertices];
+	_vertices = (Vector *)realloc(newVertices, sizeof *newVertices * kept) ?: newVertices;
+	j = _vertexCount - kept;
+	_vertexCount = kept;
+	
+	[self freeMeshArray:_faces];
+	[self freeMeshArray:_faceVertexIndices];
+	[self freeMeshArray:_faceTexCoordIndices];
+	[self freeMeshArray:_vertexNormalIndices];
+	_faces = newFaces;
+	_faceCount = faceCount;
+	[buffer getVertexIndices:&_faceVertexIndices textureCoordIndices:&_faceTexCoordIndices vertexNormals:&_vertexNormalIndices andCount:&_faceVertexIndexCount];
+	[buffer release];
+	
+	[self noteChanges:kDDMeshChangePositions | kDDMeshChangeTopology];
+	
+	return j;
+	TraceExit();
+}
+
+
+- (BOOL)findBadPolygonsWithIssues:(DDProblemReportManager *)ioManager
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	unsigned				i, faceIdx, faceCount, vertexCount, notCoplanar = 0;
+	DDMeshFaceData			*face;
+	const DDMeshPlane		*planes = NULL;
+	const Scalar			*areas = NULL;
+	Scalar					tolerance, distance;
+	BOOL					reportedNonCoplanar = NO;
+	
+	// These values will be regenerated.
+	_hasNonTriangles = NO;
+	_hasBadPolygons = NO;
+	
 	// Verify vertex indices
 	faceCount = _faceCount;
 	face = _faces;
 	while (faceCount--)
 	{
+		if (face->vertexCount < 3)
+		{
+			[NSException raise:NSRangeException format:@"%s: invalid vertex count %u.", __PRETTY_FUNCTION__, face->vertexCount];
+		}
 		if (_faceVertexIndexCount < face->firstVertex + face->vertexCount)
 		{
 			OK = NO;
@@ -628,7 +807,7 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 		++face;
 	}
 	vertexCount = _faceVertexIndexCount;
-	for (i = 0; i != vertexCount; ++i)
+	for (i = 0; OK && i != vertexCount; ++i)
 	{
 		if (_vertexCount <= _faceVertexIndices[i])
 		{
@@ -642,38 +821,378 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 			[ioManager addStopIssueWithKey:@"badInternalStructure" localizedFormat:@"Dry Dock's internal representation of the document is invalid: %@", NSLocalizedString(@"texture co-ordinate index greater than size of texture co-ordianate buffer.", NULL)];
 			break;
 		}
+	}
+	
+	if (OK)
+	{
+		// Plane and area of each face are cached until the mesh is next changed.
+		planes = [self facePlanes];
+		areas = [self faceAreas];
+		OK = (planes != NULL && areas != NULL);
+	}
+	
+	for (faceIdx = 0, face = _faces; OK && faceIdx != _faceCount; ++faceIdx, ++face)
+	{
+		face->nonCoplanar = NO;
+		face->nonConvex = NO;
 		
-		++face;
+		vertexCount = face->vertexCount;
+		if (3 != vertexCount)
+		{
+			_hasNonTriangles = YES;
+			
+			tolerance = kCoplanarityTolerance * sqrt(areas[faceIdx]);
+			for (i = 3; i != vertexCount; ++i)
+			{
+				distance = fabs(planes[faceIdx].normal * VERTEX_FOR_FACE(face, i) - planes[faceIdx].distance);
+				if (tolerance < distance)
+				{
+					face->nonCoplanar = YES;
+					++notCoplanar;
+					if (!reportedNonCoplanar)
+					{
+						reportedNonCoplanar = YES;
+						_hasBadPolygons = YES;
+						[ioManager addWarningIssueWithKey:@"hasNonCoplanarPolygons" localizedFormat:@"The document contains one or more polygons which are not coplanar. These polygons will be highlighted in red."];
+					}
+					break;
+				}
+			}
+		}
 	}
 	
 	if (reportedNonCoplanar) LogMessage(@"%u of %u polygons were non-coplanar.", notCoplanar, _faceCount);
+	if (OK)  [self findOpenEdgesWithIssues:ioManager];
 	return OK;
 	
 	TraceExit();
 }
 
 
+- (NSUInteger)edgeCount
+{
+	[self buildEdges];
+	return _edgeCount;
+}
+
+
+- (const DDMeshEdge *)edges
+{
+	[self buildEdges];
+	return _edges;
+}
+
+
+- (NSUInteger)getFaces:(const DDMeshIndex **)outFaces forEdge:(NSUInteger)inEdge
+{
+	assert(outFaces != NULL);
+	
+	[self buildEdges];
+	if (_edgeCount <= inEdge)
+	{
+		[NSException raise:NSRangeException format:@"%s: edge index %u out of range.", __PRETTY_FUNCTION__, (unsigned)inEdge];
+	}
+	
+	*outFaces = &_edgeFaces[_edgeFaceStarts[inEdge]];
+	return _edgeFaceStarts[inEdge + 1] - _edgeFaceStarts[inEdge];
+}
+
+
+- (NSUInteger)openEdgeCount
+{
+	[self buildEdges];
+	return _openEdgeCount;
+}
+
+
+- (NSUInteger)nonManifoldEdgeCount
+{
+	[self buildEdges];
+	return _nonManifoldEdgeCount;
+}
+
+
+- (NSUInteger)inconsistentEdgeCount
+{
+	[self buildEdges];
+	return _inconsistentEdgeCount;
+}
+
+
+- (void)findOpenEdgesWithIssues:(DDProblemReportManager *)ioManager
+{
+	TraceEnter();
+	
+	_hasBadEdges = NO;
+	if (![self buildEdges])  return;
+	
+	_hasBadEdges = (0 != _openEdgeCount || 0 != _nonManifoldEdgeCount);
+	
+	// Open edges are common in models that work fine in Oolite, so they are only reported on request.
+	if ([[NSUserDefaults standardUserDefaults] boolForKey:@"report open edges"])
+	{
+		if (0 != _openEdgeCount)
+		{
+			[ioManager addWarningIssueWithKey:@"hasOpenEdges" localizedFormat:@"The document contains %u edges which belong to only one polygon, leaving holes in the surface. These can cause lighting problems in Oolite, and will be highlighted in magenta.", _openEdgeCount];
+		}
+		if (0 != _nonManifoldEdgeCount)
+		{
+			[ioManager addWarningIssueWithKey:@"hasNonManifoldEdges" localizedFormat:@"The document contains %u edges which are shared by more than two polygons. These will be highlighted in magenta.", _nonManifoldEdgeCount];
+		}
+		if (0 != _inconsistentEdgeCount)
+		{
+			[ioManager addNoteIssueWithKey:@"hasInconsistentWinding" localizedFormat:@"The document contains %u edges between polygons facing in opposite directions.", _inconsistentEdgeCount];
+		}
+	}
+	
+	if (_hasBadEdges || 0 != _inconsistentEdgeCount)
+	{
+		LogMessage(@"%u of %u edges are open, %u non-manifold, %u inconsistently wound.", _openEdgeCount, _edgeCount, _nonManifoldEdgeCount, _inconsistentEdgeCount);
+	}
+	
+	TraceExit();
+}
+
+
+- (Vector *)copyTriangleSoup:(uint32_t *)outTriangleCount faceTags:(uint32_t **)outTags
+{
+	Vector					*result = NULL;
+	uint32_t				*tags = NULL;
+	uint32_t				i, j, count = 0, triIdx = 0;
+	DDMeshFaceData			*face;
+	DDMeshIndex				*indices;
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		if (2 < _faces[i].vertexCount)  count += _faces[i].vertexCount - 2;
+	}
+	
+	result = (Vector *)malloc(sizeof *result * 3 * count);
+	if (outTags != NULL)  tags = (uint32_t *)malloc(sizeof *tags * count);
+	if (result == NULL || (outTags != NULL && tags == NULL))
+	{
+		Free(result);
+		Free(tags);
+		return NULL;
+	}
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		face = &_faces[i];
+		indices = &_faceVertexIndices[face->firstVertex];
+		for (j = 2; j < face->vertexCount; ++j)
+		{
+			result[triIdx * 3] = _vertices[indices[0]];
+			result[triIdx * 3 + 1] = _vertices[indices[j - 1]];
+			result[triIdx * 3 + 2] = _vertices[indices[j]];
+			if (tags != NULL)  tags[triIdx] = i;
+			++triIdx;
+		}
+	}
+	
+	*outTriangleCount = count;
+	if (outTags != NULL)  *outTags = tags;
+	return result;
+}
+
+
 - (Scalar)length
 {
+	[self updateBounds];
 	return _zMax - _zMin;
 }
 
 
 - (Scalar)width
 {
+	[self updateBounds];
 	return _xMax - _xMin;
 }
 
 
 - (Scalar)height
 {
+	[self updateBounds];
 	return _yMax - _yMin;
 }
 
 
-@synthesize boundingRadius = _rMax;
+- (Scalar)boundingRadius
+{
+	[self updateBounds];
+	return _rMax;
+}
+
+
+- (void)getBoundsMin:(Vector *)outMin max:(Vector *)outMax
+{
+	[self updateBounds];
+	if (outMin != NULL)  outMin->Set(_xMin, _yMin, _zMin);
+	if (outMax != NULL)  outMax->Set(_xMax, _yMax, _zMax);
+}
+
+
+- (Vector)vertexAverage
+{
+	// Bounds set up by loaders don't include the average.
+	if (!_haveVertexAverage || ![self isDerivedProductCurrent:kDDMeshDerivedBounds])  [self recalculateBounds];
+	return _vertexAverage;
+}
+
+
+@synthesize editVersion = _editVersion;
+
+
+- (void)noteChanges:(DDMeshChangeFlags)inChanges
+{
+	if (inChanges & kDDMeshChangePositions)  [self queueChanges:kDDMeshChangePositions range:NSMakeRange(0, _vertexCount)];
+	if (inChanges & kDDMeshChangeTopology)  [self queueChanges:kDDMeshChangeTopology range:NSMakeRange(0, _faceCount)];
+	if (inChanges & kDDMeshChangeMaterials)  [self queueChanges:kDDMeshChangeMaterials range:NSMakeRange(0, _materialCount)];
+	if (inChanges & kDDMeshChangeNormals)  [self queueChanges:kDDMeshChangeNormals range:NSMakeRange(0, _normalCount)];
+	if (inChanges & kDDMeshChangeTexCoords)  [self queueChanges:kDDMeshChangeTexCoords range:NSMakeRange(0, _texCoordCount)];
+	
+	if (!CoalesceChangeNotifications())  [self flushChangeNotifications];
+}
+
+
+- (void)noteChanges:(DDMeshChangeFlags)inChanges range:(NSRange)inRange
+{
+	[self queueChanges:inChanges range:inRange];
+	if (!CoalesceChangeNotifications())  [self flushChangeNotifications];
+}
+
+
+- (void)flushChangeNotifications
+{
+	DDMeshChangeSet			*changes;
+	
+	if (_pendingChanges == nil)  return;
+	
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(flushChangeNotifications) object:nil];
+	changes = [_pendingChanges autorelease];
+	_pendingChanges = nil;
+	
+	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDMeshModified
+														object:self
+													  userInfo:[NSDictionary dictionaryWithObject:changes forKey:kDDMeshChangeSetKey]];
+}
+
+
+- (const Vector *)faceCentroids
+{
+	unsigned				i, j;
+	DDMeshFaceData			*face;
+	Vector					c;
+	
+	if (_faceCentroids != NULL && [self isDerivedProductCurrent:kDDMeshDerivedFaceCentroids])  return _faceCentroids;
+	
+	Free(_faceCentroids);
+	_faceCentroids = (Vector *)malloc(sizeof *_faceCentroids * (_faceCount + 1));
+	if (_faceCentroids == NULL)  return NULL;
+	
+	for (i = 0, face = _faces; i != _faceCount; ++i, ++face)
+	{
+		c.Set(0, 0, 0);
+		for (j = 0; j != face->vertexCount; ++j)
+		{
+			c += VERTEX_FOR_FACE(face, j);
+		}
+		_faceCentroids[i] = c / face->vertexCount;
+	}
+	
+	[self markDerivedProductCurrent:kDDMeshDerivedFaceCentroids];
+	return _faceCentroids;
+}
+
+
+- (const Scalar *)faceAreas
+{
+	unsigned				i, j;
+	DDMeshFaceData			*face;
+	Vector					a;
+	Scalar					area;
+	
+	if (_faceAreas != NULL && [self isDerivedProductCurrent:kDDMeshDerivedFaceAreas])  return _faceAreas;
+	
+	Free(_faceAreas);
+	_faceAreas = (Scalar *)malloc(sizeof *_faceAreas * (_faceCount + 1));
+	if (_faceAreas == NULL)  return NULL;
+	
+	for (i = 0, face = _faces; i != _faceCount; ++i, ++face)
+	{
+		a = VERTEX_FOR_FACE(face, 0);
+		area = 0;
+		for (j = 2; j < face->vertexCount; ++j)
+		{
+			area += ((VERTEX_FOR_FACE(face, j - 1) - a) % (VERTEX_FOR_FACE(face, j) - a)).Magnitude();
+		}
+		_faceAreas[i] = area * 0.5f;
+	}
+	
+	[self markDerivedProductCurrent:kDDMeshDerivedFaceAreas];
+	return _faceAreas;
+}
+
+
+- (const DDMeshPlane *)facePlanes
+{
+	unsigned				i;
+	DDMeshFaceData			*face;
+	Vector					normal;
+	
+	if (_facePlanes != NULL && [self isDerivedProductCurrent:kDDMeshDerivedFacePlanes])  return _facePlanes;
+	
+	Free(_facePlanes);
+	_facePlanes = (DDMeshPlane *)malloc(sizeof *_facePlanes * (_faceCount + 1));
+	if (_facePlanes == NULL)  return NULL;
+	
+	for (i = 0, face = _faces; i != _faceCount; ++i, ++face)
+	{
+		normal = NormalForFace(face, _vertices, _faceVertexIndices);
+		_facePlanes[i].normal = normal;
+		_facePlanes[i].distance = normal * VERTEX_FOR_FACE(face, 0);
+	}
+	
+	[self markDerivedProductCurrent:kDDMeshDerivedFacePlanes];
+	return _facePlanes;
+}
+
+
+- (const DDMeshTangent *)cornerTangents
+{
+	if (NULL != _cornerTangents && [self isDerivedProductCurrent:kDDMeshDerivedCornerTangents])  return _cornerTangents;
+	
+	Free(_cornerTangents);
+	_cornerTangents = (DDMeshTangent *)malloc(sizeof *_cornerTangents * (_faceVertexIndexCount + 1));
+	if (NULL == _cornerTangents)  return NULL;
+	
+	if (![self generateCornerTangents:_cornerTangents])
+	{
+		Free(_cornerTangents);
+		return NULL;
+	}
+	
+	[self markDerivedProductCurrent:kDDMeshDerivedCornerTangents];
+	return _cornerTangents;
+}
+
+
+- (NSUInteger)materialCount
+{
+	return _materialCount;
+}
+
+
+- (DDMaterial *)materialAtIndex:(NSUInteger)inIndex
+{
+	if (inIndex < _materialCount)  return _materials[inIndex];
+	return nil;
+}
+
+
 @synthesize hasNonTriangles = _hasNonTriangles;
 @synthesize hasBadPolygons = _hasBadPolygons;
+@synthesize hasBadEdges = _hasBadEdges;
 @synthesize vertexCount = _vertexCount;
 @synthesize faceCount = _faceCount;
 @synthesize name = _name;
@@ -687,6 +1206,275 @@ static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, D
 @end
 
 
+@implementation DDMesh (Private)
+
+- (BOOL)isDerivedProductCurrent:(DDMeshDerivedProduct)inProduct
+{
+	unsigned				i, dependencies;
+	
+	assert(inProduct < kDDMeshDerivedProductCount);
+	
+	dependencies = sDerivedProductDependencies[inProduct];
+	for (i = 0; i != kDDMeshChangeChannelCount; ++i)
+	{
+		if ((dependencies & (1 << i)) && _derivedVersions[inProduct] < _changeVersions[i])  return NO;
+	}
+	return YES;
+}
+
+
+- (void)markDerivedProductCurrent:(DDMeshDerivedProduct)inProduct
+{
+	assert(inProduct < kDDMeshDerivedProductCount);
+	_derivedVersions[inProduct] = _editVersion;
+}
+
+
+- (void)updateBounds
+{
+	if (![self isDerivedProductCurrent:kDDMeshDerivedBounds])  [self recalculateBounds];
+}
+
+
+- (void)recalculateBounds
+{
+	unsigned				i;
+	Vector					v, sum(0, 0, 0);
+	Scalar					r, rMax = 0;
+	
+	if (_vertexCount == 0)
+	{
+		_xMin = _xMax = _yMin = _yMax = _zMin = _zMax = 0;
+	}
+	else
+	{
+		_xMin = _xMax = _vertices[0].x;
+		_yMin = _yMax = _vertices[0].y;
+		_zMin = _zMax = _vertices[0].z;
+	}
+	
+	for (i = 0; i != _vertexCount; ++i)
+	{
+		v = _vertices[i];
+		sum += v;
+		
+		if (v.x < _xMin)  _xMin = v.x;
+		if (_xMax < v.x)  _xMax = v.x;
+		if (v.y < _yMin)  _yMin = v.y;
+		if (_yMax < v.y)  _yMax = v.y;
+		if (v.z < _zMin)  _zMin = v.z;
+		if (_zMax < v.z)  _zMax = v.z;
+		
+		r = v.SquareMagnitude();
+		if (rMax < r)  rMax = r;
+	}
+	
+	_rMax = sqrt(rMax);
+	_vertexAverage = (_vertexCount != 0) ? sum / _vertexCount : sum;
+	_haveVertexAverage = YES;
+	[self markDerivedProductCurrent:kDDMeshDerivedBounds];
+}
+
+
+- (void)queueChanges:(DDMeshChangeFlags)inChanges range:(NSRange)inRange
+{
+	unsigned				i;
+	
+	++_editVersion;
+	for (i = 0; i != kDDMeshChangeChannelCount; ++i)
+	{
+		if (inChanges & (1 << i))  _changeVersions[i] = _editVersion;
+	}
+	
+	if (_pendingChanges == nil)
+	{
+		_pendingChanges = [[DDMeshChangeSet alloc] init];
+		if (CoalesceChangeNotifications())  [self performSelector:@selector(flushChangeNotifications) withObject:nil afterDelay:0.0];
+	}
+	[_pendingChanges addChanges:inChanges range:inRange];
+}
+
+
+/*	Build the unique edge list and edge-to-face table. Every polygon side is
+	bucketed by its lower vertex index with a counting sort; the sides in each
+	bucket are then grouped by their upper vertex index with a second counting
+	sort local to the bucket, using a stamp array so that only the entries the
+	bucket touches are reset. Each group is one edge, with its faces
+	contiguous, and the whole build is linear even around high-valence fan
+	hubs.
+*/
+- (BOOL)buildEdges
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	unsigned				i, j, k, sideCount = 0, start, end, reversed, groupCount, count;
+	unsigned				*buckets = NULL, *stamps = NULL, *groupEnds = NULL;
+	DDMeshIndex				*groupOrder = NULL;
+	DDMeshEdgeSide			*sides = NULL, *grouped = NULL;
+	DDMeshFaceData			*face;
+	DDMeshIndex				a, b, lo, hi, v, edgeCount = 0;
+	
+	if (_edgeFaceStarts != NULL && [self isDerivedProductCurrent:kDDMeshDerivedEdges])  return YES;
+	[self discardEdges];
+	
+	for (i = 0; i != _faceCount; ++i)
+	{
+		sideCount += _faces[i].vertexCount;
+	}
+	
+	// One extra of each so that empty meshes don't produce zero-sized allocations.
+	buckets = (unsigned *)calloc(_vertexCount + 1, sizeof *buckets);
+	sides = (DDMeshEdgeSide *)malloc(sizeof *sides * (sideCount + 1));
+	grouped = (DDMeshEdgeSide *)malloc(sizeof *grouped * (sideCount + 1));
+	stamps = (unsigned *)malloc(sizeof *stamps * (_vertexCount + 1));
+	groupEnds = (unsigned *)malloc(sizeof *groupEnds * (_vertexCount + 1));
+	groupOrder = (DDMeshIndex *)malloc(sizeof *groupOrder * (sideCount + 1));
+	_edges = (DDMeshEdge *)malloc(sizeof *_edges * (sideCount + 1));
+	_edgeFaceStarts = (unsigned *)malloc(sizeof *_edgeFaceStarts * (sideCount + 1));
+	_edgeFaces = (DDMeshIndex *)malloc(sizeof *_edgeFaces * (sideCount + 1));
+	OK = (NULL != buckets && NULL != sides && NULL != grouped && NULL != stamps && NULL != groupEnds && NULL != groupOrder && NULL != _edges && NULL != _edgeFaceStarts && NULL != _edgeFaces);
+	
+	if (OK)
+	{
+		// Count sides per lower vertex.
+		for (i = 0, face = _faces; OK && i != _faceCount; ++i, ++face)
+		{
+			for (j = 0; j != face->vertexCount; ++j)
+			{
+				a = _faceVertexIndices[face->firstVertex + j];
+				b = _faceVertexIndices[face->firstVertex + (j + 1) % face->vertexCount];
+				if (_vertexCount <= a || _vertexCount <= b)
+				{
+					OK = NO;
+					break;
+				}
+				if (a != b)  ++buckets[(a < b ? a : b) + 1];
+			}
+		}
+	}
+	
+	if (OK)
+	{
+		for (v = 0; v != _vertexCount; ++v)
+		{
+			buckets[v + 1] += buckets[v];
+		}
+		
+		// File sides; afterwards, buckets[v] is the end of bucket v (and the start of v + 1).
+		for (i = 0, face = _faces; i != _faceCount; ++i, ++face)
+		{
+			for (j = 0; j != face->vertexCount; ++j)
+			{
+				a = _faceVertexIndices[face->firstVertex + j];
+				b = _faceVertexIndices[face->firstVertex + (j + 1) % face->vertexCount];
+				if (a == b)  continue;
+				
+				lo = (a < b) ? a : b;
+				k = buckets[lo]++;
+				sides[k].hi = (a < b) ? b : a;
+				sides[k].face = i;
+				sides[k].reversed = (a != lo);
+			}
+		}
+		
+		memset(stamps, 0xFF, sizeof *stamps * (_vertexCount + 1));
+		
+		for (v = 0; v != _vertexCount; ++v)
+		{
+			start = (0 != v) ? buckets[v - 1] : 0;
+			end = buckets[v];
+			
+			// Count the bucket's sides per upper vertex, noting upper vertices in order of first appearance.
+			groupCount = 0;
+			for (j = start; j != end; ++j)
+			{
+				hi = sides[j].hi;
+				if (v != stamps[hi])
+				{
+					stamps[hi] = v;
+					groupEnds[hi] = 0;
+					groupOrder[groupCount++] = hi;
+				}
+				++groupEnds[hi];
+			}
+			
+			// Turn the counts into start positions and file the sides; afterwards groupEnds[hi] is the end of each group.
+			for (i = 0, k = start; i != groupCount; ++i)
+			{
+				count = groupEnds[groupOrder[i]];
+				groupEnds[groupOrder[i]] = k;
+				k += count;
+			}
+			for (j = start; j != end; ++j)
+			{
+				grouped[groupEnds[sides[j].hi]++] = sides[j];
+			}
+			
+			for (i = 0; i != groupCount; ++i)
+			{
+				hi = groupOrder[i];
+				k = groupEnds[hi];
+				
+				_edges[edgeCount].vertices[0] = v;
+				_edges[edgeCount].vertices[1] = hi;
+				_edgeFaceStarts[edgeCount] = start;
+				
+				reversed = 0;
+				for (j = start; j != k; ++j)
+				{
+					_edgeFaces[j] = grouped[j].face;
+					reversed += grouped[j].reversed;
+				}
+				
+				if (1 == k - start)  ++_openEdgeCount;
+				else if (2 < k - start)  ++_nonManifoldEdgeCount;
+				else if (1 != reversed)  ++_inconsistentEdgeCount;
+				
+				++edgeCount;
+				start = k;
+			}
+		}
+		
+		_edgeFaceStarts[edgeCount] = (_vertexCount != 0) ? buckets[_vertexCount - 1] : 0;
+		_edgeCount = edgeCount;
+		[self markDerivedProductCurrent:kDDMeshDerivedEdges];
+		
+		// Trim the edge list; sides shared by two faces leave it about half full.
+		if (edgeCount != 0)
+		{
+			DDMeshEdge *edges = (DDMeshEdge *)realloc(_edges, sizeof *_edges * edgeCount);
+			if (edges != NULL)  _edges = edges;
+		}
+	}
+	
+	Free(buckets);
+	Free(sides);
+	Free(grouped);
+	Free(stamps);
+	Free(groupEnds);
+	Free(groupOrder);
+	if (!OK)  [self discardEdges];
+	
+	return OK;
+	TraceExit();
+}
+
+
+- (void)discardEdges
+{
+	Free(_edges);
+	Free(_edgeFaceStarts);
+	Free(_edgeFaces);
+	_edgeCount = 0;
+	_openEdgeCount = 0;
+	_nonManifoldEdgeCount = 0;
+	_inconsistentEdgeCount = 0;
+}
+
+@end
+
+
 static inline Vector NormalForFace(DDMeshFaceData *inFace, Vector *inVertices, DDMeshIndex *inVertexIndices)
 {
 	assert(NULL != inFace && NULL != inVertices && NULL != inVertexIndices);
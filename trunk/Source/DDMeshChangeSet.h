@@ -0,0 +1,62 @@
+/*
+	DDMeshChangeSet.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Description of the parts of a DDMesh touched by one or more changes. Posted as
+		the kDDMeshChangeSetKey entry of kNotificationDDMeshModified’s user info.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMesh.h"
+
+
+extern NSString *kDDMeshChangeSetKey;
+
+
+@interface DDMeshChangeSet: NSObject <NSCopying>
+{
+	unsigned				_changes;
+	NSRange					_ranges[kDDMeshChangeChannelCount];
+}
+
++ (id)changeSet;
++ (id)changeSetWithAllChanges;		// Every channel, with unbounded ranges
+
+// The change set of a kNotificationDDMeshModified, or everything if there is none.
++ (DDMeshChangeSet *)changeSetForNotification:(NSNotification *)inNotification;
+
+@property (readonly) DDMeshChangeFlags changes;
+@property (readonly, getter=isEmpty) BOOL empty;
+
+// YES if any of inChanges were touched.
+- (BOOL)containsChanges:(DDMeshChangeFlags)inChanges;
+
+/*	Range of indices touched in a single channel: vertex indices for
+	positions, normal indices for normals, texture co-ordinate indices for
+	texture co-ordinates, face indices for topology and material indices for
+	materials. Empty if the channel was not touched.
+*/
+- (NSRange)rangeForChange:(DDMeshChangeFlags)inChannel;
+
+// Ranges are merged into the smallest range covering both.
+- (void)addChanges:(DDMeshChangeFlags)inChanges range:(NSRange)inRange;
+- (void)addChangeSet:(DDMeshChangeSet *)inChangeSet;
+
+@end
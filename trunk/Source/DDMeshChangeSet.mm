@@ -0,0 +1,153 @@
+/*
+	DDMeshChangeSet.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMeshChangeSet.h"
+
+
+NSString *kDDMeshChangeSetKey = @"changes";
+
+
+static inline unsigned ChannelIndex(DDMeshChangeFlags inChannel);
+
+
+@implementation DDMeshChangeSet
+
++ (id)changeSet
+{
+	return [[[self alloc] init] autorelease];
+}
+
+
++ (id)changeSetWithAllChanges
+{
+	DDMeshChangeSet			*result;
+	
+	result = [self changeSet];
+	[result addChanges:kDDMeshChangeAll range:NSMakeRange(0, NSUIntegerMax)];
+	return result;
+}
+
+
++ (DDMeshChangeSet *)changeSetForNotification:(NSNotification *)inNotification
+{
+	DDMeshChangeSet			*result;
+	
+	result = [[inNotification userInfo] objectForKey:kDDMeshChangeSetKey];
+	if (![result isKindOfClass:[DDMeshChangeSet class]])  result = [self changeSetWithAllChanges];
+	return result;
+}
+
+
+- (id)copyWithZone:(NSZone *)inZone
+{
+	DDMeshChangeSet			*result;
+	
+	result = [[[self class] allocWithZone:inZone] init];
+	[result addChangeSet:self];
+	return result;
+}
+
+
+- (DDMeshChangeFlags)changes
+{
+	return (DDMeshChangeFlags)_changes;
+}
+
+
+- (BOOL)isEmpty
+{
+	return _changes == 0;
+}
+
+
+- (BOOL)containsChanges:(DDMeshChangeFlags)inChanges
+{
+	return (_changes & inChanges) != 0;
+}
+
+
+- (NSRange)rangeForChange:(DDMeshChangeFlags)inChannel
+{
+	if (!(_changes & inChannel))  return NSMakeRange(0, 0);
+	return _ranges[ChannelIndex(inChannel)];
+}
+
+
+- (void)addChanges:(DDMeshChangeFlags)inChanges range:(NSRange)inRange
+{
+	unsigned				i;
+	
+	for (i = 0; i != kDDMeshChangeChannelCount; ++i)
+	{
+		if (!(inChanges & (1 << i)))  continue;
+		
+		if (_changes & (1 << i))  _ranges[i] = NSUnionRange(_ranges[i], inRange);
+		else  _ranges[i] = inRange;
+	}
+	_changes |= inChanges & kDDMeshChangeAll;
+}
+
+
+- (void)addChangeSet:(DDMeshChangeSet *)inChangeSet
+{
+	unsigned				i;
+	
+	if (inChangeSet == nil)  return;
+	
+	for (i = 0; i != kDDMeshChangeChannelCount; ++i)
+	{
+		if (inChangeSet->_changes & (1 << i))  [self addChanges:(DDMeshChangeFlags)(1 << i) range:inChangeSet->_ranges[i]];
+	}
+}
+
+
+- (NSString *)description
+{
+	NSMutableString			*result;
+	unsigned				i;
+	NSString * const		names[kDDMeshChangeChannelCount] = { @"positions", @"topology", @"materials", @"normals", @"texture co-ordinates" };
+	
+	result = [NSMutableString stringWithFormat:@"<%@ %p>{", [self className], self];
+	for (i = 0; i != kDDMeshChangeChannelCount; ++i)
+	{
+		if (_changes & (1 << i))  [result appendFormat:@" %@ %@", names[i], NSStringFromRange(_ranges[i])];
+	}
+	[result appendString:@" }"];
+	return result;
+}
+
+@end
+
+
+static inline unsigned ChannelIndex(DDMeshChangeFlags inChannel)
+{
+	unsigned				i;
+	
+	for (i = 0; i != kDDMeshChangeChannelCount; ++i)
+	{
+		if (inChannel & (1 << i))  return i;
+	}
+	
+	[NSException raise:NSInvalidArgumentException format:@"%s: no change channel specified.", __PRETTY_FUNCTION__];
+	return 0;
+}
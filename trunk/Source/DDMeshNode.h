@@ -29,6 +29,8 @@
 @interface DDMeshNode: SceneNode
 {
 	DDMesh				*_mesh;
+	NSData				*_deviations;
+	float				_deviationRange;
 }
 
 + (id)nodeWithMesh:(DDMesh *)inMesh;
@@ -36,4 +38,7 @@
 
 - (void)setMesh:(DDMesh *)inMesh;
 
+// Per-vertex deviations (as returned by -getDeviationFromMesh:...) to show instead of normal shading. Pass nil to clear.
+- (void)setVertexDeviations:(NSData *)inDeviations range:(float)inRange;
+
 @end
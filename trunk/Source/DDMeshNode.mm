@@ -25,7 +25,9 @@
 
 #import "DDMeshNode.h"
 #import "DDMesh.h"
+#import "DDMeshChangeSet.h"
 #import "Logging.h"
+#import "DDUtilities.h"
 
 
 @implementation DDMeshNode
@@ -63,6 +65,7 @@
 - (void)dealloc
 {
 	[_mesh release];
+	[_deviations release];
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	
 	[super dealloc];
@@ -77,6 +80,7 @@
 	BOOL			wireframe = NO;
 	BOOL			normals = NO;
 	BOOL			bbox = NO;
+	const Scalar	*occlusion = NULL;
 	id				val;
 	
 	val = [inState objectForKey:@"wireframe"];
@@ -103,7 +107,18 @@
 		bbox = [val boolValue];
 	}
 	
-	if (shading)	[_mesh glRenderShaded];
+	// Per-vertex visibility, as from -[DDModelDocument vertexOcclusion].
+	val = [inState objectForKey:@"ambient occlusion"];
+	if ([val isKindOfClass:[NSData class]] && sizeof (Scalar) * [_mesh vertexCount] <= [val length])
+	{
+		occlusion = (const Scalar *)[val bytes];
+	}
+	
+	if (shading)
+	{
+		if (_deviations != nil)  [_mesh glRenderDeviations:(const Scalar *)[_deviations bytes] range:_deviationRange];
+		else  [_mesh glRenderShadedWithOcclusion:occlusion];
+	}
 	if (wireframe)	[_mesh glRenderWireframe];
 	if (normals)	[_mesh glRenderNormals];
 	if (bbox)		[_mesh glRenderBoundingBox];
@@ -132,8 +147,28 @@
 }
 
 
+- (void)setVertexDeviations:(NSData *)inDeviations range:(float)inRange
+{
+	if (inDeviations != nil && [inDeviations length] < sizeof (Scalar) * [_mesh vertexCount])
+	{
+		LogMessage(@"Ignoring deviation data of wrong size for mesh %@.", [_mesh name]);
+		inDeviations = nil;
+	}
+	
+	[_deviations autorelease];
+	_deviations = [inDeviations retain];
+	_deviationRange = inRange;
+	[self becomeDirty];
+}
+
+
 - (void)meshModified:notification
 {
+	DDMeshChangeSet			*changes;
+	
+	// Deviations are per-vertex, so they can't be trusted after vertices move or faces change.
+	changes = [DDMeshChangeSet changeSetForNotification:notification];
+	if (_deviations != nil && [changes containsChanges:kDDMeshChangePositions | kDDMeshChangeTopology])  Release(_deviations);
 	[self becomeDirty];
 }
 
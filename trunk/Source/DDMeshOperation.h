@@ -0,0 +1,78 @@
+/*
+	DDMeshOperation.h
+	Dry Dock for Oolite
+	$Id$
+	
+	An operation on a copy of a mesh, run on a worker thread with progress
+		reporting and cancellation.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class DDMesh;
+
+
+@interface DDMeshOperation: NSOperation
+{
+	NSString				*_name;
+	DDMesh					*_mesh;
+	NSInvocation			*_invocation;
+	id						_result;
+	id						_delegate;
+	volatile float			_progress;
+	BOOL					_failed;
+}
+
+/*	Operations are run on a shared queue, which runs as many at once as the
+	system sees fit, so several documents can process concurrently.
+*/
++ (NSOperationQueue *)sharedQueue;
+
+/*	inMesh is the mesh to modify, normally a copy made on the main thread.
+	inInvocation is sent to it on a worker thread; its target is ignored.
+*/
+- (id)initWithName:(NSString *)inName mesh:(DDMesh *)inMesh invocation:(NSInvocation *)inInvocation;
++ (id)operationWithName:(NSString *)inName mesh:(DDMesh *)inMesh selector:(SEL)inSelector;
+
+@property (readonly) NSString *name;
+@property (readonly) DDMesh *mesh;
+@property (readonly) float progress;		// 0..1
+@property (readonly) id result;				// The invocation's return value, if it returns an object.
+@property (readonly) BOOL failed;			// The operation raised an exception; the mesh should be discarded.
+
+// The delegate receives -meshOperationDidFinish: on the main thread when the operation ends, even if cancelled.
+@property (assign) id delegate;
+
+@end
+
+
+@interface NSObject (DDMeshOperationDelegate)
+
+- (void)meshOperationDidFinish:(DDMeshOperation *)inOperation;
+
+@end
+
+
+/*	Called periodically by long-running mesh code. Records progress for the
+	DDMeshOperation running on the current thread, if any, and returns NO if it
+	has been cancelled; the caller should then stop as soon as possible. The
+	mesh is discarded, so it need not be left consistent.
+*/
+BOOL DDMeshOperationReportProgress(float inProgress);
@@ -0,0 +1,176 @@
+/*
+	DDMeshOperation.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDMeshOperation.h"
+#import "DDMesh.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import <pthread.h>
+
+
+static pthread_key_t		sCurrentOperationKey;
+static pthread_once_t		sCurrentOperationKeyOnce = PTHREAD_ONCE_INIT;
+
+static void InitCurrentOperationKey(void);
+
+
+@interface DDMeshOperation (Private)
+
+- (void)setProgress:(float)inProgress;
+
+@end
+
+
+@implementation DDMeshOperation
+
++ (NSOperationQueue *)sharedQueue
+{
+	static NSOperationQueue	*queue = nil;
+	
+	if (queue == nil)
+	{
+		queue = [[NSOperationQueue alloc] init];
+	}
+	return queue;
+}
+
+
+- (id)initWithName:(NSString *)inName mesh:(DDMesh *)inMesh invocation:(NSInvocation *)inInvocation
+{
+	if (inMesh == nil || inInvocation == nil)
+	{
+		[self release];
+		return nil;
+	}
+	
+	self = [super init];
+	if (self != nil)
+	{
+		_name = [inName copy];
+		_mesh = [inMesh retain];
+		_invocation = [inInvocation retain];
+		[_invocation retainArguments];
+	}
+	return self;
+}
+
+
++ (id)operationWithName:(NSString *)inName mesh:(DDMesh *)inMesh selector:(SEL)inSelector
+{
+	NSInvocation			*invocation;
+	
+	invocation = [NSInvocation invocationWithMethodSignature:[inMesh methodSignatureForSelector:inSelector]];
+	[invocation setSelector:inSelector];
+	
+	return [[[self alloc] initWithName:inName mesh:inMesh invocation:invocation] autorelease];
+}
+
+
+- (void)dealloc
+{
+	Release(_name);
+	Release(_mesh);
+	Release(_invocation);
+	Release(_result);
+	
+	[super dealloc];
+}
+
+
+- (void)main
+{
+	NSAutoreleasePool		*pool;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	pthread_once(&sCurrentOperationKeyOnce, InitCurrentOperationKey);
+	pthread_setspecific(sCurrentOperationKey, self);
+	
+	@try
+	{
+		if (![self isCancelled])
+		{
+			[_invocation invokeWithTarget:_mesh];
+			if ('@' == *[[_invocation methodSignature] methodReturnType])
+			{
+				[_invocation getReturnValue:&_result];
+				[_result retain];
+			}
+		}
+	}
+	@catch (id exception)
+	{
+		LogMessage(@"Mesh operation \"%@\" failed with exception %@.", _name, exception);
+		_failed = YES;
+	}
+	
+	pthread_setspecific(sCurrentOperationKey, NULL);
+	_progress = 1.0f;
+	
+	[_delegate performSelectorOnMainThread:@selector(meshOperationDidFinish:) withObject:self waitUntilDone:NO];
+	[pool release];
+}
+
+
+@synthesize name = _name;
+@synthesize mesh = _mesh;
+@synthesize progress = _progress;
+@synthesize result = _result;
+@synthesize failed = _failed;
+@synthesize delegate = _delegate;
+
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %p>{\"%@\", progress=%.0f%%%@}", [self className], self, _name, _progress * 100.0f, [self isCancelled] ? @", cancelled" : @""];
+}
+
+@end
+
+
+@implementation DDMeshOperation (Private)
+
+- (void)setProgress:(float)inProgress
+{
+	_progress = inProgress;
+}
+
+@end
+
+
+BOOL DDMeshOperationReportProgress(float inProgress)
+{
+	DDMeshOperation			*operation;
+	
+	pthread_once(&sCurrentOperationKeyOnce, InitCurrentOperationKey);
+	operation = (DDMeshOperation *)pthread_getspecific(sCurrentOperationKey);
+	if (operation == nil)  return YES;
+	
+	[operation setProgress:inProgress];
+	return ![operation isCancelled];
+}
+
+
+static void InitCurrentOperationKey(void)
+{
+	pthread_key_create(&sCurrentOperationKey, NULL);
+}
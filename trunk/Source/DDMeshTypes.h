@@ -0,0 +1,76 @@
+/*
+	DDMeshTypes.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Plain data types shared by DDMesh and its C++ helpers.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDMESHTYPES_h
+#define INCLUDED_DDMESHTYPES_h
+
+#include "phystypes.h"
+
+
+#define USE_SHORT_INDICES		0
+
+#if USE_SHORT_INDICES
+	typedef uint_least16_t		DDMeshIndex;
+#else
+	typedef uint_least32_t		DDMeshIndex;
+#endif
+
+
+enum
+{
+	#if USE_SHORT_INDICES
+		kDDMeshIndexMax			= UINT_LEAST16_MAX - 1,
+		kDDMeshIndexNotFound	= UINT_LEAST16_MAX,
+	#else
+		kDDMeshIndexMax			= UINT_LEAST32_MAX - 1,
+		kDDMeshIndexNotFound	= UINT_LEAST32_MAX,
+	#endif
+	kMaxVertsPerFace			= 16	// Hard-coded limit from Oolite
+};
+
+
+typedef struct DDMeshFaceData
+{
+	DDMeshIndex				normal;
+	DDMeshIndex				material;
+	unsigned				firstVertex;	// Index into _faceVertexIndices, _faceTexCoordIndices and _vertexNormalIndices
+	uint8_t					vertexCount;
+	uint8_t					nonCoplanar;
+	uint8_t					nonConvex;
+	uint8_t					smoothingGroup;
+} DDMeshFaceData;
+
+
+/*	Tangent space at a face vertex, following MikkTSpace conventions: tangent
+	is a unit vector perpendicular to the vertex normal, pointing along
+	increasing u, and the bitangent is sign * (normal % tangent).
+*/
+typedef struct DDMeshTangent
+{
+	Vector					tangent;
+	Scalar					sign;			// +1 or -1
+} DDMeshTangent;
+
+#endif	/* INCLUDED_DDMESHTYPES_h */
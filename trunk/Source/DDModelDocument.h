@@ -27,8 +27,10 @@
 #import <Foundation/Foundation.h>
 #import "DDPropertyListRepresentation.h"
 #import "phystypes.h"
+#import "DDMesh.h"
 
-@class DDMesh;
+@class DDCollisionOctree;
+@class DDMeshOperation;
 
 
 @interface DDModelDocument: NSObject <DDPropertyListRepresentation>
@@ -36,6 +38,8 @@
 	DDMesh					*_rootMesh;
 	NSString				*_name;
 	Scalar					_length, _width, _height;
+	DDCollisionOctree		*_collisionOctree;
+	NSData					*_vertexOcclusion;
 }
 
 - (id)init;
@@ -49,13 +53,55 @@
 @property (readonly) Scalar width;
 @property (readonly) Scalar height;
 
+/*	Collision octree for root mesh, at +[DDCollisionOctree defaultDepth]. Built
+	on demand, discarded when the mesh changes, and cached in Dry Dock
+	documents.
+*/
+@property (readonly) DDCollisionOctree *collisionOctree;
+
+/*	For building the octree without blocking, in the same way as occlusion
+	below: cachedCollisionOctree never builds, -collisionOctreeOperation
+	builds on a copy of the root mesh, and its result is handed back with
+	-adoptCollisionOctree:.
+*/
+@property (readonly) DDCollisionOctree *cachedCollisionOctree;
+- (DDMeshOperation *)collisionOctreeOperation;
+- (void)adoptCollisionOctree:(DDCollisionOctree *)inOctree;
+- (BOOL)writeCollisionOctreeForDATURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+
+/*	Ambient occlusion for each vertex of the root mesh, as an NSData of Scalars
+	from -[DDMesh bakeVertexOcclusionWithSampleCount:...], at
+	kDDMeshDefaultOcclusionSampleCount. Built on demand, discarded when the
+	mesh changes, and cached in Dry Dock documents.
+*/
+@property (readonly) NSData *vertexOcclusion;
+
+/*	For baking occlusion without blocking: cachedVertexOcclusion never bakes,
+	and -vertexOcclusionOperation returns an unstarted DDMeshOperation baking a
+	copy of the root mesh, whose result can be passed to -adoptVertexOcclusion:
+	when it finishes. It is the caller's job to discard results for a mesh that
+	has since changed.
+*/
+@property (readonly) NSData *cachedVertexOcclusion;
+- (DDMeshOperation *)vertexOcclusionOperation;
+- (void)adoptVertexOcclusion:(NSData *)inOcclusion;
+
 - (id)initWithDryDockDocument:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+// The document's property list, decompressed but not interpreted.
++ (id)propertyListFromDryDockDocument:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingDryDockDocumentToURL:(NSURL *)inFile;
 - (BOOL)writeDryDockDocumentToURL:(NSURL *)inAbsoluteURL issues:(DDProblemReportManager *)ioIssues;
 
 - (id)initWithOoliteDAT:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+// Without options, vertex normals are written if the "write vertex normals with DAT" default is set.
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile;
 - (BOOL)writeOoliteDATToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioManager;
+- (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions;
+- (BOOL)writeOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions issues:(DDProblemReportManager *)ioManager;
+
+// Binary meshes hold only the root mesh; see DDMesh (BinaryMesh).
+- (id)initWithBinaryMesh:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+- (BOOL)writeBinaryMeshToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
 
 - (id)initWithWaveFrontOBJ:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingWaveFrontOBJToURL:(NSURL *)inFile;
@@ -68,3 +114,5 @@ extern NSString *kNotificationDDModelDocumentRootMeshChanged;	// Sent on setRoot
 extern NSString *kNotificationDDModelDocumentNameChanged;		// Sent on setName:
 extern NSString *kNotificationDDModelDocumentOverallDimensionsChanged;
 extern NSString *kNotificationDDModelDocumentDestroyed;			// Sent on dealloc
+extern NSString *kNotificationDDModelDocumentCollisionOctreeChanged;	// Sent when cached octree is discarded
+extern NSString *kNotificationDDModelDocumentVertexOcclusionChanged;	// Sent when cached occlusion is discarded
@@ -25,17 +25,25 @@
 #import "DDMesh.h"
 #import "Logging.h"
 #import "NSData+Deflate.h"
+#import "NSData+ChunkedCompression.h"
+#import "DDLZCompression.h"
 #import "DDUtilities.h"
 #import "CocoaExtensions.h"
 #import "DDProblemReportManager.h"
+#import "DDCollisionOctree.h"
+#import "DDMeshChangeSet.h"
+#import "DDMeshOperation.h"
 
 
 NSString *kNotificationDDModelDocumentRootMeshChanged =				@"de.berlios.drydock DDModelDocumentRootMeshChanged";
 NSString *kNotificationDDModelDocumentNameChanged =					@"de.berlios.drydock DDModelDocumentNameChanged";
 NSString *kNotificationDDModelDocumentOverallDimensionsChanged =	@"de.berlios.drydock DDModelDocumentOverallDimensionsChanged";
 NSString *kNotificationDDModelDocumentDestroyed =					@"de.berlios.drydock DDModelDocumentDestroyed";
+NSString *kNotificationDDModelDocumentCollisionOctreeChanged =		@"de.berlios.drydock DDModelDocumentCollisionOctreeChanged";
+NSString *kNotificationDDModelDocumentVertexOcclusionChanged =		@"de.berlios.drydock DDModelDocumentVertexOcclusionChanged";
 
 
+// Original format: a single zlib stream. Read only.
 typedef struct
 {
 	uint8_t				cookie[4];	// 'D', 'r', 'y', 'D'
@@ -43,12 +51,39 @@ typedef struct
 } DryDockDocumentHeader;
 
 
+/*	Current format: independently compressed chunks, so saving and loading
+	can use all cores. Followed by the chunk index and the chunks, as
+	described in NSData+ChunkedCompression.h.
+*/
+typedef struct
+{
+	uint8_t				cookie[4];	// 'D', 'r', 'y', 'C'
+	uint8_t				version;	// kMaxContainerVersion
+	uint8_t				flags;		// Low four bits: DDCompressionCodec
+	uint8_t				reserved[2];
+	uint32_t			length;		// Decompressed length, little-endian
+	uint32_t			chunkSize;	// Decompressed length of each chunk but the last, little-endian
+} DryDockChunkedHeader;
+
+
 enum
 {
-	kMaxFormat			= 1
+	kMaxFormat			= 1,
+	
+	kMaxContainerVersion	= 1,
+	kContainerCodecMask	= 0x0F,
+	kContainerChunkSize	= 256 << 10
 };
 
 
+@interface DDModelDocument (Private)
+
+- (NSData *)vertexOcclusionFromPropertyListRepresentation:(id)inPList;
+- (id)vertexOcclusionPropertyListRepresentation;
+
+@end
+
+
 @implementation DDModelDocument
 
 - (id)init
@@ -122,6 +157,31 @@ enum
 }
 
 
+- (id)initWithBinaryMesh:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnter();
+	
+	DDMesh					*mesh;
+	
+	mesh = [[DDMesh alloc] initWithBinaryMesh:inFile issues:ioIssues];
+	if (nil != mesh)
+	{
+		self = [self initWithMesh:mesh];
+		if (nil != self) _name = [[mesh name] retain];
+		else [ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+		[mesh release];
+	}
+	else
+	{
+		[self release];
+		self = nil;
+	}
+	
+	return self;
+	TraceExit();
+}
+
+
 - (id)initWithPropertyListRepresentation:(id)inPList issues:(DDProblemReportManager *)ioIssues
 {
 	TraceEnter();
@@ -180,6 +240,13 @@ enum
 		object = [dict objectForKey:@"name"];
 		if ([object isKindOfClass:[NSString class]]) _name = [object retain];
 		if (nil == _name) _name = [[_rootMesh name] retain];
+		
+		// Cached collision octree is optional; it's simply rebuilt if missing or invalid.
+		object = [dict objectForKey:@"collision octree"];
+		if (nil != object) _collisionOctree = [[DDCollisionOctree alloc] initWithPropertyListRepresentation:object issues:ioIssues];
+		
+		// Likewise cached ambient occlusion.
+		_vertexOcclusion = [[self vertexOcclusionFromPropertyListRepresentation:[dict objectForKey:@"ambient occlusion"]] retain];
 	}
 	
 	if (!OK)
@@ -197,13 +264,39 @@ enum
 {
 	TraceEnterMsg(@"Called for %@", inFile);
 	
+	id						plist;
+	
+	plist = [DDModelDocument propertyListFromDryDockDocument:inFile issues:ioIssues];
+	if (nil != plist)
+	{
+		self = [self initWithPropertyListRepresentation:plist issues:ioIssues];
+	}
+	else
+	{
+		[self release];
+		self = nil;
+	}
+	
+	return self;
+	TraceExit();
+}
+
+
++ (id)propertyListFromDryDockDocument:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@", inFile);
+	
 	BOOL					OK = YES;
 	NSData					*data;
 	NSError					*error;
-	DryDockDocumentHeader	*header;
-	uint32_t				rawLength, decompressedLength;
+	const uint8_t			*bytes;
+	DryDockDocumentHeader	*header = NULL;
+	DryDockChunkedHeader	*chunkedHeader = NULL;
+	uint32_t				rawLength, decompressedLength = 0;
+	DDCompressionCodec		codec = kDDCompressionDeflate;
+	BOOL					newerFormat = NO;
 	NSData_InflateResult	result;
-	id						plist;
+	id						plist = nil;
 	NSString				*errorDesc = nil;
 	
 	data = [NSData dataWithContentsOfURL:inFile options:0 error:&error];
@@ -216,14 +309,28 @@ enum
 	if (OK)
 	{
 		rawLength = [data length];
-		if (rawLength < sizeof *header) OK = NO;
-		else
+		bytes = (const uint8_t *)[data bytes];
+		if (rawLength < sizeof *header || bytes[0] != 'D' || bytes[1] != 'r' || bytes[2] != 'y') OK = NO;
+		else if (bytes[3] == 'C' && sizeof *chunkedHeader <= rawLength)
 		{
-			header = (DryDockDocumentHeader *)[data bytes];
-			if (header->cookie[0] != 'D' || header->cookie[1] != 'r' || header->cookie[2] != 'y' || header->cookie[3] != 'D') OK = NO;
-			else decompressedLength = CFSwapInt32LittleToHost(header->length);
+			chunkedHeader = (DryDockChunkedHeader *)bytes;
+			decompressedLength = CFSwapInt32LittleToHost(chunkedHeader->length);
+			codec = (DDCompressionCodec)(chunkedHeader->flags & kContainerCodecMask);
+			newerFormat = kMaxContainerVersion < chunkedHeader->version || kDDCompressionCodecCount <= codec;
 		}
-		if (!OK)
+		else if (bytes[3] == 'D')
+		{
+			header = (DryDockDocumentHeader *)bytes;
+			decompressedLength = CFSwapInt32LittleToHost(header->length);
+		}
+		else OK = NO;
+		
+		if (newerFormat)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"outOfDateDryDock" localizedFormat:@"This document appears to be generated by a newer version of Dry Dock; it is in an incompatible format."];
+		}
+		else if (!OK)
 		{
 			[ioIssues addStopIssueWithKey:@"notValidDryDock" localizedFormat:@"This is not a valid Dry Dock document. %@", @""];
 		}
@@ -231,8 +338,16 @@ enum
 	
 	if (OK)
 	{
-		data = [data subdataWithRange:NSMakeRange(sizeof *header, rawLength - sizeof *header)];
-		result = [data inflatedData:&data outputSize:decompressedLength ifPrefixedWith:nil];
+		if (NULL != chunkedHeader)
+		{
+			result = [data chunkDecompressedData:&data fromOffset:sizeof *chunkedHeader outputSize:decompressedLength codec:codec chunkSize:CFSwapInt32LittleToHost(chunkedHeader->chunkSize)];
+		}
+		else
+		{
+			data = [data subdataWithRange:NSMakeRange(sizeof *header, rawLength - sizeof *header)];
+			result = [data inflatedData:&data outputSize:decompressedLength ifPrefixedWith:nil];
+		}
+		
 		if (kInflateSuccess != result)
 		{
 			OK = NO;
@@ -257,17 +372,7 @@ enum
 		}
 	}
 	
-	if (OK)
-	{
-		self = [self initWithPropertyListRepresentation:plist issues:ioIssues];
-	}
-	else
-	{
-		[self release];
-		self = nil;
-	}
-	
-	return self;
+	return OK ? plist : nil;
 	TraceExit();
 }
 
@@ -280,6 +385,8 @@ enum
 	
 	[_rootMesh autorelease];
 	[_name autorelease];
+	[_collisionOctree autorelease];
+	[_vertexOcclusion autorelease];
 	
 	[[NSNotificationCenter defaultCenter] removeObserver:nil name:nil object:self];
 	[super dealloc];
@@ -297,6 +404,25 @@ enum
 - (void)rootMeshModified:notification
 {
 	Scalar						l, w, h;
+	DDMeshChangeSet				*changes;
+	
+	changes = [DDMeshChangeSet changeSetForNotification:notification];
+	
+	// The octree only depends on the shape of the mesh.
+	if (nil != _collisionOctree && [changes containsChanges:kDDMeshChangePositions | kDDMeshChangeTopology])
+	{
+		Release(_collisionOctree);
+		[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDModelDocumentCollisionOctreeChanged object:self];
+	}
+	
+	// Occlusion also depends on the normals rays are cast along.
+	if (nil != _vertexOcclusion && [changes containsChanges:kDDMeshChangePositions | kDDMeshChangeTopology | kDDMeshChangeNormals])
+	{
+		Release(_vertexOcclusion);
+		[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDModelDocumentVertexOcclusionChanged object:self];
+	}
+	
+	if (![changes containsChanges:kDDMeshChangePositions])  return;
 	
 	// Check for changes in dimensions
 	l = [_rootMesh length];
@@ -382,22 +508,143 @@ enum
 }
 
 
+- (DDCollisionOctree *)collisionOctree
+{
+	if (nil != _collisionOctree && [_collisionOctree depth] != [DDCollisionOctree defaultDepth])
+	{
+		Release(_collisionOctree);
+	}
+	
+	if (nil == _collisionOctree && nil != _rootMesh)
+	{
+		_collisionOctree = [[DDCollisionOctree alloc] initWithMesh:_rootMesh depth:[DDCollisionOctree defaultDepth]];
+	}
+	
+	return _collisionOctree;
+}
+
+
+- (DDCollisionOctree *)cachedCollisionOctree
+{
+	if (nil != _collisionOctree && [_collisionOctree depth] != [DDCollisionOctree defaultDepth])  return nil;
+	return _collisionOctree;
+}
+
+
+- (DDMeshOperation *)collisionOctreeOperation
+{
+	NSInvocation			*invocation;
+	SEL						selector = @selector(collisionOctreeWithDepth:);
+	unsigned				depth = [DDCollisionOctree defaultDepth];
+	
+	if (nil == _rootMesh)  return nil;
+	
+	invocation = [NSInvocation invocationWithMethodSignature:[_rootMesh methodSignatureForSelector:selector]];
+	[invocation setSelector:selector];
+	[invocation setArgument:&depth atIndex:2];
+	
+	return [[[DDMeshOperation alloc] initWithName:@"Build Collision Octree" mesh:[[_rootMesh copy] autorelease] invocation:invocation] autorelease];
+}
+
+
+- (void)adoptCollisionOctree:(DDCollisionOctree *)inOctree
+{
+	if (nil == inOctree || nil != [self cachedCollisionOctree] || nil == _rootMesh)  return;
+	if ([inOctree depth] != [DDCollisionOctree defaultDepth])  return;
+	
+	[_collisionOctree autorelease];
+	_collisionOctree = [inOctree retain];
+}
+
+
+- (BOOL)writeCollisionOctreeForDATURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	DDCollisionOctree		*octree;
+	
+	octree = [self collisionOctree];
+	if (nil == octree)
+	{
+		[ioIssues addWarningIssueWithKey:@"noOctree" localizedFormat:@"A collision octree could not be generated for this document."];
+		return NO;
+	}
+	
+	return [octree writeToURL:[DDCollisionOctree octreeURLForDATURL:inFile] issues:ioIssues];
+}
+
+
+- (NSData *)vertexOcclusion
+{
+	if (nil == _vertexOcclusion && nil != _rootMesh)
+	{
+		_vertexOcclusion = [[_rootMesh bakeVertexOcclusionWithSampleCount:kDDMeshDefaultOcclusionSampleCount maxDistance:0 rayCount:NULL] retain];
+	}
+	
+	return _vertexOcclusion;
+}
+
+
+- (NSData *)cachedVertexOcclusion
+{
+	return _vertexOcclusion;
+}
+
+
+- (DDMeshOperation *)vertexOcclusionOperation
+{
+	NSInvocation			*invocation;
+	SEL						selector = @selector(bakeVertexOcclusionWithSampleCount:maxDistance:rayCount:);
+	unsigned				sampleCount = kDDMeshDefaultOcclusionSampleCount;
+	Scalar					maxDistance = 0;
+	NSUInteger				*rayCount = NULL;
+	
+	if (nil == _rootMesh)  return nil;
+	
+	invocation = [NSInvocation invocationWithMethodSignature:[_rootMesh methodSignatureForSelector:selector]];
+	[invocation setSelector:selector];
+	[invocation setArgument:&sampleCount atIndex:2];
+	[invocation setArgument:&maxDistance atIndex:3];
+	[invocation setArgument:&rayCount atIndex:4];
+	
+	return [[[DDMeshOperation alloc] initWithName:@"Bake Ambient Occlusion" mesh:[[_rootMesh copy] autorelease] invocation:invocation] autorelease];
+}
+
+
+- (void)adoptVertexOcclusion:(NSData *)inOcclusion
+{
+	if (nil != _vertexOcclusion || nil == _rootMesh)  return;
+	if ([inOcclusion length] != [_rootMesh vertexCount] * sizeof (Scalar))  return;
+	
+	_vertexOcclusion = [inOcclusion copy];
+}
+
+
 - (id)propertyListRepresentationWithIssues:(DDProblemReportManager *)ioIssues
 {
 	TraceEnter();
 	
 	id						plist;
+	NSMutableDictionary		*result;
+	id						octreePList;
+	id						occlusionPList;
 	
 	plist = [_rootMesh propertyListRepresentationWithIssues:ioIssues];
 	if (nil == plist) return nil;
 	
-	return [NSDictionary dictionaryWithObjectsAndKeys:
+	result = [NSMutableDictionary dictionaryWithObjectsAndKeys:
 							plist, @"root mesh",
 							[NSNumber numberWithInt:1], @"format",
 							ApplicationNameAndVersionString(), @"generator",
 							[NSDate date], @"modification date",
-							_name, @"name",	// Note: _name could be nil, stopping the plist here!
 							nil];
+	if (nil != _name) [result setObject:_name forKey:@"name"];
+	
+	// Only cache an octree that has already been built; saving shouldn't trigger the work.
+	octreePList = [_collisionOctree propertyListRepresentationWithIssues:ioIssues];
+	if (nil != octreePList) [result setObject:octreePList forKey:@"collision octree"];
+	occlusionPList = [self vertexOcclusionPropertyListRepresentation];
+	if (nil != occlusionPList) [result setObject:occlusionPList forKey:@"ambient occlusion"];
+	
+	return result;
 	
 	TraceExit();
 }
@@ -413,6 +660,27 @@ enum
 }
 
 
+/*	The codec is chosen with the "drydock document codec" default, "fast" or
+	"deflate", and its level with "drydock document compression level".
+	Debug-format documents are stored uncompressed.
+*/
+static void GetDryDockCompressionSettings(BOOL inDebugFormat, DDCompressionCodec *outCodec, int *outLevel)
+{
+	NSUserDefaults			*defaults = [NSUserDefaults standardUserDefaults];
+	
+	if (inDebugFormat)
+	{
+		*outCodec = kDDCompressionDeflate;
+		*outLevel = 0;
+		return;
+	}
+	
+	*outCodec = [[defaults stringForKey:@"drydock document codec"] isEqual:@"deflate"] ? kDDCompressionDeflate : kDDCompressionFastLZ;
+	if (nil != [defaults objectForKey:@"drydock document compression level"]) *outLevel = [defaults integerForKey:@"drydock document compression level"];
+	else *outLevel = (kDDCompressionDeflate == *outCodec) ? 9 : kDDLZDefaultLevel;
+}
+
+
 - (BOOL)writeDryDockDocumentToURL:(NSURL *)inAbsoluteURL issues:(DDProblemReportManager *)ioIssues
 {
 	TraceEnter();
@@ -422,11 +690,14 @@ enum
 	NSData					*data;
 	NSString				*errorDesc;
 	NSError					*error;
-	DryDockDocumentHeader	headerBytes = {{ 'D', 'r', 'y', 'D' }, 0 };
+	DryDockChunkedHeader	headerBytes = {{ 'D', 'r', 'y', 'C' }, kMaxContainerVersion, 0, { 0, 0 }, 0, 0 };
 	NSData					*header = nil;
 	BOOL					debugFormat;
+	DDCompressionCodec		codec;
+	int						level;
 	
 	debugFormat = [[NSUserDefaults standardUserDefaults] boolForKey:@"debug format drydock documents"];
+	GetDryDockCompressionSettings(debugFormat, &codec, &level);
 	
 	plist = [self propertyListRepresentationWithIssues:ioIssues];
 	if (nil == plist) OK = NO;
@@ -443,9 +714,11 @@ enum
 	
 	if (OK)
 	{
-		headerBytes.length = CFSwapInt32LittleToHost([data length]);
+		headerBytes.flags = codec;
+		headerBytes.length = CFSwapInt32HostToLittle([data length]);
+		headerBytes.chunkSize = CFSwapInt32HostToLittle(kContainerChunkSize);
 		header = [NSData dataWithBytes:&headerBytes length:sizeof headerBytes];
-		data = [data deflatedDataPrefixedWith:header level:debugFormat ? 0 : 9];
+		data = [data chunkCompressedDataPrefixedWith:header codec:codec level:level chunkSize:kContainerChunkSize];
 		if (nil == header || nil == data)
 		{
 			OK = NO;
@@ -468,15 +741,42 @@ enum
 }
 
 
+static DDOoliteDATOptions DefaultOoliteDATOptions(void)
+{
+	return [[NSUserDefaults standardUserDefaults] boolForKey:@"write vertex normals with DAT"] ? kDDOoliteDATVertexNormals : 0;
+}
+
+
 - (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile
 {
-	return [_rootMesh gatherIssues:ioManager withWritingOoliteDATToURL:inFile];
+	[self gatherIssues:ioManager withWritingOoliteDATToURL:inFile options:DefaultOoliteDATOptions()];
 }
 
 
 - (BOOL)writeOoliteDATToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioManager
 {
-	return [_rootMesh writeOoliteDATToURL:inFile issues:ioManager];
+	return [self writeOoliteDATToURL:inFile options:DefaultOoliteDATOptions() issues:ioManager];
+}
+
+
+- (void)gatherIssues:(DDProblemReportManager *)ioManager withWritingOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions
+{
+	return [_rootMesh gatherIssues:ioManager withWritingOoliteDATToURL:inFile options:inOptions];
+}
+
+
+- (BOOL)writeOoliteDATToURL:(NSURL *)inFile options:(DDOoliteDATOptions)inOptions issues:(DDProblemReportManager *)ioManager
+{
+	BOOL					OK;
+	
+	OK = [_rootMesh writeOoliteDATToURL:inFile options:inOptions issues:ioManager];
+	if (OK && [[NSUserDefaults standardUserDefaults] boolForKey:@"write collision octree with DAT"])
+	{
+		// Octree is a convenience; failure to write it doesn't fail the DAT export.
+		[self writeCollisionOctreeForDATURL:inFile issues:ioManager];
+	}
+	
+	return OK;
 }
 
 
@@ -492,9 +792,88 @@ enum
 }
 
 
+- (BOOL)writeBinaryMeshToURL:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	return [_rootMesh writeBinaryMeshToURL:inFile issues:ioIssues];
+}
+
+
 - (NSString *)description
 {
 	return [NSString stringWithFormat:@"<%@ %p>{rootMesh=%@}", [self className], self, _rootMesh];
 }
 
 @end
+
+
+@implementation DDModelDocument (Private)
+
+/*	Cached occlusion is stored as little-endian 32-bit floats, one per vertex.
+	It's ignored if it was baked with a different sample count or doesn't
+	match the mesh, and simply rebaked when wanted.
+*/
+- (NSData *)vertexOcclusionFromPropertyListRepresentation:(id)inPList
+{
+	NSNumber				*samples;
+	NSData					*data;
+	NSMutableData			*result;
+	NSUInteger				i, count;
+	const uint32_t			*src;
+	Scalar					*dst;
+	union { uint32_t u; float f; } value;
+	
+	if (![inPList isKindOfClass:[NSDictionary class]] || nil == _rootMesh) return nil;
+	
+	samples = [inPList objectForKey:@"samples"];
+	data = [inPList objectForKey:@"visibility"];
+	if (![samples isKindOfClass:[NSNumber class]] || [samples unsignedIntValue] != kDDMeshDefaultOcclusionSampleCount) return nil;
+	if (![data isKindOfClass:[NSData class]]) return nil;
+	
+	count = [_rootMesh vertexCount];
+	if ([data length] != count * sizeof (uint32_t)) return nil;
+	
+	result = [NSMutableData dataWithLength:count * sizeof (Scalar)];
+	if (nil == result) return nil;
+	
+	src = (const uint32_t *)[data bytes];
+	dst = (Scalar *)[result mutableBytes];
+	for (i = 0; i != count; ++i)
+	{
+		value.u = CFSwapInt32LittleToHost(src[i]);
+		dst[i] = value.f;
+	}
+	
+	return result;
+}
+
+
+- (id)vertexOcclusionPropertyListRepresentation
+{
+	NSMutableData			*data;
+	NSUInteger				i, count;
+	const Scalar			*src;
+	uint32_t				*dst;
+	union { uint32_t u; float f; } value;
+	
+	// As with the octree, only cache what has already been built.
+	if (nil == _vertexOcclusion) return nil;
+	
+	count = [_vertexOcclusion length] / sizeof (Scalar);
+	data = [NSMutableData dataWithLength:count * sizeof (uint32_t)];
+	if (nil == data) return nil;
+	
+	src = (const Scalar *)[_vertexOcclusion bytes];
+	dst = (uint32_t *)[data mutableBytes];
+	for (i = 0; i != count; ++i)
+	{
+		value.f = src[i];
+		dst[i] = CFSwapInt32HostToLittle(value.u);
+	}
+	
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+				[NSNumber numberWithUnsignedInt:kDDMeshDefaultOcclusionSampleCount], @"samples",
+				data, @"visibility",
+				nil];
+}
+
+@end
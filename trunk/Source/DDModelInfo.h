@@ -0,0 +1,71 @@
+/*
+	DDModelInfo.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Model metadata read without building a mesh: counts, bounds and the names
+	of materials, textures and material libraries. Used to index large
+	collections of models quickly.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import <Foundation/Foundation.h>
+#import "phystypes.h"
+
+@class DDProblemReportManager;
+
+
+@interface DDModelInfo: NSObject
+{
+	NSUInteger				_vertexCount;
+	NSUInteger				_faceCount;
+	Vector					_minimum, _maximum;
+	NSArray					*_materialNames;
+	NSArray					*_textureNames;
+	NSArray					*_materialLibraries;
+}
+
+/*	Each reader skims the file for what it needs. DAT faces and OBJ faces are
+	counted but not built, textures and OBJ material libraries are not
+	loaded, and Dry Dock documents are decompressed but not turned into a
+	mesh.
+*/
+- (id)initWithOoliteDAT:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+- (id)initWithWaveFrontOBJ:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+- (id)initWithDryDockDocument:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
+
+@property (readonly) NSUInteger vertexCount;
+@property (readonly) NSUInteger faceCount;
+
+// Bounding box, in Dry Dock's co-ordinate system (DAT x is flipped, as when loading).
+- (Vector)minimum;
+- (Vector)maximum;
+
+/*	Materials in order of first use. For DAT files these are the texture
+	names; for OBJ files, the usemtl names.
+*/
+@property (readonly) NSArray *materialNames;
+
+// Diffuse map names, where known without reading other files (not OBJ).
+@property (readonly) NSArray *textureNames;
+
+// OBJ mtllib references.
+@property (readonly) NSArray *materialLibraries;
+
+@end
@@ -0,0 +1,466 @@
+/*
+	DDModelInfo.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ENABLE_TRACE 0
+
+#import "DDModelInfo.h"
+#import "DDModelDocument.h"
+#import "DDDATLexer.h"
+#import "DDMesh.h"
+#import "DDProblemReportManager.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+
+
+// Collects strings in order of first appearance, ignoring repeats.
+@interface DDModelInfoNameList: NSObject
+{
+	NSMutableArray			*_names;
+	NSMutableSet			*_seen;
+	NSString				*_last;
+}
+
+- (void)addName:(NSString *)inName;
+- (NSArray *)names;
+
+@end
+
+
+@interface DDModelInfo (Private)
+
+- (void)resetBounds;
+- (void)includePoint:(const Vector &)inPoint;
+- (void)readOBJLine:(const char *)inLine length:(size_t)inLength materials:(DDModelInfoNameList *)ioMaterials libraries:(DDModelInfoNameList *)ioLibraries;
+
+@end
+
+
+static NSString *StringFromBytes(const char *inBytes, size_t inLength);
+static BOOL HasKeyword(const char *inLine, size_t inLength, const char *inKeyword);
+
+
+@implementation DDModelInfo
+
+@synthesize vertexCount = _vertexCount, faceCount = _faceCount;
+@synthesize materialNames = _materialNames, textureNames = _textureNames, materialLibraries = _materialLibraries;
+
+
+- (id)initWithOoliteDAT:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@", inFile);
+	
+	BOOL					OK = YES;
+	DDDATLexer				*lexer;
+	unsigned				i, vertexCount = 0, faceCount = 0, faceVertexCount, nameCount;
+	uint8_t					*faceVertexCounts = NULL;
+	float					x, y, z;
+	NSString				*expected = nil, *name;
+	DDModelInfoNameList		*textures;
+	
+	self = [super init];
+	if (nil == self) return nil;
+	
+	[self resetBounds];
+	
+	lexer = [[DDDATLexer alloc] initWithURL:inFile issues:ioIssues];
+	OK = (nil != lexer);
+	
+	if (OK)
+	{
+		expected = @"NVERTS";
+		OK = [lexer expectLiteral:"NVERTS"] && [lexer readInteger:&vertexCount];
+	}
+	if (OK)
+	{
+		expected = @"NFACES";
+		OK = [lexer expectLiteral:"NFACES"] && [lexer readInteger:&faceCount];
+	}
+	if (OK)
+	{
+		expected = @"VERTEX";
+		OK = [lexer expectLiteral:"VERTEX"];
+	}
+	
+	// Vertices are read only for the bounds.
+	for (i = 0; OK && i != vertexCount; ++i)
+	{
+		expected = NSLocalizedString(@"vertex data", NULL);
+		OK = [lexer readReal:&x] && [lexer readReal:&y] && [lexer readReal:&z];
+		if (OK) [self includePoint:Vector(-x, y, z)];
+	}
+	
+	if (OK)
+	{
+		expected = @"FACES";
+		OK = [lexer expectLiteral:"FACES"];
+	}
+	if (OK)
+	{
+		// The TEXTURES section has a u/v pair per face vertex, so the counts are needed to skip it.
+		faceVertexCounts = (uint8_t *)malloc(faceCount);
+		if (NULL == faceVertexCounts && 0 != faceCount)
+		{
+			OK = NO;
+			expected = nil;
+			[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+		}
+	}
+	for (i = 0; OK && i != faceCount; ++i)
+	{
+		// Smoothing group, two reserved fields, normal, then vertex count and indices.
+		expected = NSLocalizedString(@"face data", NULL);
+		OK = [lexer skipTokens:6] && [lexer readInteger:&faceVertexCount] && 3 <= faceVertexCount && faceVertexCount <= kMaxVertsPerFace;
+		if (OK)
+		{
+			faceVertexCounts[i] = faceVertexCount;
+			OK = [lexer skipTokens:faceVertexCount];
+		}
+	}
+	
+	if (OK)
+	{
+		textures = [[[DDModelInfoNameList alloc] init] autorelease];
+		if ([[lexer nextToken] isEqualToString:@"TEXTURES"])
+		{
+			for (i = 0; OK && i != faceCount; ++i)
+			{
+				expected = NSLocalizedString(@"texture data", NULL);
+				OK = [lexer readString:&name] && [lexer skipTokens:2 + 2 * faceVertexCounts[i]];
+				if (OK) [textures addName:name];
+			}
+			
+			// With a NAMES table, the face entries above are indices into it.
+			if (OK && [[lexer nextToken] isEqualToString:@"NAMES"])
+			{
+				textures = [[[DDModelInfoNameList alloc] init] autorelease];
+				expected = NSLocalizedString(@"material names", NULL);
+				OK = [lexer readInteger:&nameCount];
+				for (i = 0; OK && i != nameCount; ++i)
+				{
+					OK = [lexer readString:&name];
+					if (OK) [textures addName:name];
+				}
+			}
+		}
+		
+		_textureNames = [[textures names] retain];
+		_materialNames = [_textureNames retain];
+	}
+	
+	if (!OK && nil != expected)
+	{
+		[ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], expected, [lexer currentTokenString]];
+	}
+	
+	free(faceVertexCounts);
+	[lexer release];
+	
+	if (OK)
+	{
+		_vertexCount = vertexCount;
+		_faceCount = faceCount;
+	}
+	else
+	{
+		[self release];
+		self = nil;
+	}
+	
+	return self;
+	TraceExit();
+}
+
+
+- (id)initWithWaveFrontOBJ:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@", inFile);
+	
+	NSData					*data;
+	NSError					*error = nil;
+	const char				*cursor, *end, *lineEnd;
+	DDModelInfoNameList		*materials, *libraries;
+	
+	self = [super init];
+	if (nil == self) return nil;
+	
+	[self resetBounds];
+	
+	data = [NSData dataWithContentsOfURL:inFile options:NSMappedRead error:&error];
+	if (nil == data)
+	{
+		[ioIssues addStopIssueWithKey:@"noDataLoaded" localizedFormat:@"No data could be loaded from %@. %@", [inFile displayString], error ? [error localizedFailureReason] : @""];
+		[self release];
+		return nil;
+	}
+	
+	materials = [[[DDModelInfoNameList alloc] init] autorelease];
+	libraries = [[[DDModelInfoNameList alloc] init] autorelease];
+	
+	cursor = (const char *)[data bytes];
+	end = cursor + [data length];
+	while (cursor < end)
+	{
+		lineEnd = (const char *)memchr(cursor, '\n', end - cursor);
+		if (NULL == lineEnd) lineEnd = end;
+		
+		[self readOBJLine:cursor length:lineEnd - cursor materials:materials libraries:libraries];
+		cursor = lineEnd + 1;
+	}
+	
+	_materialNames = [[materials names] retain];
+	_materialLibraries = [[libraries names] retain];
+	_textureNames = [[NSArray alloc] init];
+	
+	return self;
+	TraceExit();
+}
+
+
+- (id)initWithDryDockDocument:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues
+{
+	TraceEnterMsg(@"Called for %@", inFile);
+	
+	id						plist, mesh, object;
+	NSData					*vertexData;
+	const uint32_t			*raw;
+	NSUInteger				i, count;
+	union { uint32_t u; float f; } x, y, z;
+	NSEnumerator			*materialEnum;
+	NSDictionary			*material;
+	DDModelInfoNameList		*materialNames, *textureNames;
+	
+	self = [super init];
+	if (nil == self) return nil;
+	
+	[self resetBounds];
+	
+	plist = [DDModelDocument propertyListFromDryDockDocument:inFile issues:ioIssues];
+	mesh = [plist isKindOfClass:[NSDictionary class]] ? [plist objectForKey:@"root mesh"] : nil;
+	vertexData = [mesh isKindOfClass:[NSDictionary class]] ? [mesh objectForKey:@"vertices"] : nil;
+	if (![vertexData isKindOfClass:[NSData class]])
+	{
+		if (nil != plist) [ioIssues addStopIssueWithKey:@"notValidDryDock" localizedFormat:@"This is not a valid Dry Dock document. %@", @""];
+		[self release];
+		return nil;
+	}
+	
+	// Vertices are stored as little-endian floats.
+	count = [vertexData length] / sizeof (Vector);
+	raw = (const uint32_t *)[vertexData bytes];
+	for (i = 0; i != count; ++i)
+	{
+		x.u = CFSwapInt32LittleToHost(raw[i * 3]);
+		y.u = CFSwapInt32LittleToHost(raw[i * 3 + 1]);
+		z.u = CFSwapInt32LittleToHost(raw[i * 3 + 2]);
+		[self includePoint:Vector(x.f, y.f, z.f)];
+	}
+	_vertexCount = count;
+	
+	object = [mesh objectForKey:@"faces"];
+	if ([object isKindOfClass:[NSArray class]]) _faceCount = [object count];
+	
+	// Same keys as DDMaterial's property list representation.
+	materialNames = [[[DDModelInfoNameList alloc] init] autorelease];
+	textureNames = [[[DDModelInfoNameList alloc] init] autorelease];
+	object = [mesh objectForKey:@"materials"];
+	if ([object isKindOfClass:[NSArray class]])
+	{
+		for (materialEnum = [object objectEnumerator]; (material = [materialEnum nextObject]); )
+		{
+			if (![material isKindOfClass:[NSDictionary class]]) continue;
+			
+			object = [material objectForKey:@"diffuse map"];
+			if ([object isKindOfClass:[NSString class]]) [textureNames addName:object];
+			else object = nil;
+			
+			if ([[material objectForKey:@"name"] isKindOfClass:[NSString class]]) object = [material objectForKey:@"name"];
+			if (nil != object) [materialNames addName:object];
+		}
+	}
+	_materialNames = [[materialNames names] retain];
+	_textureNames = [[textureNames names] retain];
+	
+	return self;
+	TraceExit();
+}
+
+
+- (Vector)minimum
+{
+	return _minimum;
+}
+
+
+- (Vector)maximum
+{
+	return _maximum;
+}
+
+
+- (void)dealloc
+{
+	[_materialNames release];
+	[_textureNames release];
+	[_materialLibraries release];
+	
+	[super dealloc];
+}
+
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %p>{%lu vertices, %lu faces, materials=(%@)}", [self className], self, (unsigned long)_vertexCount, (unsigned long)_faceCount, [_materialNames componentsJoinedByString:@", "]];
+}
+
+@end
+
+
+@implementation DDModelInfo (Private)
+
+- (void)resetBounds
+{
+	_minimum.Set(INFINITY, INFINITY, INFINITY);
+	_maximum.Set(-INFINITY, -INFINITY, -INFINITY);
+}
+
+
+- (void)includePoint:(const Vector &)inPoint
+{
+	if (inPoint.x < _minimum.x) _minimum.x = inPoint.x;
+	if (_maximum.x < inPoint.x) _maximum.x = inPoint.x;
+	if (inPoint.y < _minimum.y) _minimum.y = inPoint.y;
+	if (_maximum.y < inPoint.y) _maximum.y = inPoint.y;
+	if (inPoint.z < _minimum.z) _minimum.z = inPoint.z;
+	if (_maximum.z < inPoint.z) _maximum.z = inPoint.z;
+}
+
+
+- (void)readOBJLine:(const char *)inLine length:(size_t)inLength materials:(DDModelInfoNameList *)ioMaterials libraries:(DDModelInfoNameList *)ioLibraries
+{
+	char					buffer[128];
+	char					*cursor;
+	float					x, y, z;
+	const char				*name;
+	
+	while (0 != inLength && (' ' == *inLine || '\t' == *inLine))
+	{
+		++inLine;
+		--inLength;
+	}
+	while (0 != inLength && isspace(inLine[inLength - 1])) --inLength;
+	
+	if (HasKeyword(inLine, inLength, "v"))
+	{
+		// Copy so that strtod() can't run past the end of the data.
+		if (sizeof buffer <= inLength) inLength = sizeof buffer - 1;
+		memcpy(buffer, inLine + 1, inLength - 1);
+		buffer[inLength - 1] = '\0';
+		
+		x = strtod(buffer, &cursor);
+		y = strtod(cursor, &cursor);
+		z = strtod(cursor, &cursor);
+		[self includePoint:Vector(x, y, z)];
+		++_vertexCount;
+	}
+	else if (HasKeyword(inLine, inLength, "f"))
+	{
+		++_faceCount;
+	}
+	else if (HasKeyword(inLine, inLength, "usemtl") || HasKeyword(inLine, inLength, "mtllib"))
+	{
+		for (name = inLine + 6; ' ' == *name || '\t' == *name; ++name) {}
+		if ('u' == *inLine) [ioMaterials addName:StringFromBytes(name, inLine + inLength - name)];
+		else [ioLibraries addName:StringFromBytes(name, inLine + inLength - name)];
+	}
+}
+
+@end
+
+
+@implementation DDModelInfoNameList
+
+- (id)init
+{
+	self = [super init];
+	if (nil != self)
+	{
+		_names = [[NSMutableArray alloc] init];
+		_seen = [[NSMutableSet alloc] init];
+	}
+	return self;
+}
+
+
+- (void)dealloc
+{
+	[_names release];
+	[_seen release];
+	[_last release];
+	
+	[super dealloc];
+}
+
+
+- (void)addName:(NSString *)inName
+{
+	// Runs of the same name are common, so check the last one first.
+	if ([inName isEqualToString:_last]) return;
+	
+	[_last release];
+	_last = [inName copy];
+	
+	if (![_seen containsObject:inName])
+	{
+		[_seen addObject:_last];
+		[_names addObject:_last];
+	}
+}
+
+
+- (NSArray *)names
+{
+	return [[_names copy] autorelease];
+}
+
+@end
+
+
+static NSString *StringFromBytes(const char *inBytes, size_t inLength)
+{
+	NSString				*result;
+	
+	result = [[NSString alloc] initWithBytes:inBytes length:inLength encoding:NSUTF8StringEncoding];
+	if (nil == result) result = [[NSString alloc] initWithBytes:inBytes length:inLength encoding:NSISOLatin1StringEncoding];
+	
+	return [result autorelease];
+}
+
+
+// YES if the line starts with inKeyword followed by white space.
+static BOOL HasKeyword(const char *inLine, size_t inLength, const char *inKeyword)
+{
+	size_t					keywordLength;
+	
+	keywordLength = strlen(inKeyword);
+	return keywordLength < inLength && 0 == strncmp(inLine, inKeyword, keywordLength) && (' ' == inLine[keywordLength] || '\t' == inLine[keywordLength]);
+}
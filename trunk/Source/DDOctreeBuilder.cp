@@ -0,0 +1,348 @@
+/*
+	DDOctreeBuilder.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDOctreeBuilder.h"
+#include "DDTriangleBVH.h"
+#include "DDParallel.h"
+#include <string.h>
+
+
+enum
+{
+	kParallelSplitDepth		= 2		// Up to 64 independent subtrees
+};
+
+
+typedef struct OctreeBuffer
+{
+	int32_t					*nodes;
+	uint32_t				count;
+	uint32_t				capacity;
+} OctreeBuffer;
+
+
+typedef struct OctreeBuildContext
+{
+	const Vector			*triangles;
+	const DDTriangleBVH		*bvh;
+	unsigned				maxDepth;
+} OctreeBuildContext;
+
+
+// A subtree deferred for parallel building.
+typedef struct OctreeTask
+{
+	uint32_t				slot;			// Index in the main buffer to attach to
+	Vector					centre;
+	Scalar					halfSize;
+	uint32_t				*triangles;
+	uint32_t				triangleCount;
+	unsigned				depth;
+	OctreeBuffer			result;
+	bool					failed;
+} OctreeTask;
+
+
+typedef struct OctreeTaskList
+{
+	OctreeTask				*tasks;
+	uint32_t				count;
+	uint32_t				capacity;
+	const OctreeBuildContext *context;
+} OctreeTaskList;
+
+
+static bool BuildNode(const OctreeBuildContext *ctxt, OctreeBuffer *buffer, uint32_t nodeIdx, const Vector &centre, Scalar halfSize, const uint32_t *triangles, uint32_t triangleCount, unsigned depth, OctreeTaskList *deferred);
+static bool AppendNodes(OctreeBuffer *buffer, uint32_t count, uint32_t *outFirst);
+static bool IsInside(const OctreeBuildContext *ctxt, const Vector &point);
+static void BuildTasks(void *context, size_t start, size_t end, unsigned worker);
+
+
+int32_t *DDBuildCollisionOctree(const Vector *inTriangles, uint32_t inTriangleCount, Scalar inRadius, unsigned inDepth, uint32_t *outNodeCount)
+{
+	OctreeBuildContext		ctxt;
+	OctreeBuffer			buffer = { NULL, 0, 0 };
+	OctreeTaskList			tasks = { NULL, 0, 0, &ctxt };
+	DDTriangleBVH			*bvh = NULL;
+	uint32_t				*all = NULL, i, base;
+	bool					OK = true;
+	
+	if (NULL == outNodeCount || NULL == inTriangles)  return NULL;
+	if (kDDOctreeMaxDepth < inDepth)  inDepth = kDDOctreeMaxDepth;
+	
+	bvh = new DDTriangleBVH(inTriangles, inTriangleCount);
+	all = (uint32_t *)malloc(sizeof *all * (inTriangleCount ? inTriangleCount : 1));
+	if (!bvh->IsValid() || NULL == all || !AppendNodes(&buffer, 1, &base))  OK = false;
+	
+	if (OK)
+	{
+		for (i = 0; i != inTriangleCount; ++i)  all[i] = i;
+		
+		ctxt.triangles = inTriangles;
+		ctxt.bvh = bvh;
+		ctxt.maxDepth = inDepth;
+		
+		// Build the top levels here, leaving the busy subtrees to be built in parallel.
+		OK = BuildNode(&ctxt, &buffer, 0, Vector(0, 0, 0), inRadius, all, inTriangleCount, 0, &tasks);
+	}
+	
+	if (OK && 0 != tasks.count)
+	{
+		DDParallelApply(tasks.count, 1, BuildTasks, &tasks);
+		
+		/*	Splice subtrees in. Each task's root is at index 0 of its buffer and
+			its first child (if any) at index 1; since all offsets are
+			relative, everything but the root can be copied verbatim.
+		*/
+		for (i = 0; OK && i != tasks.count; ++i)
+		{
+			OctreeTask *task = &tasks.tasks[i];
+			if (task->failed)  OK = false;
+			else if (task->result.nodes[0] <= 0)  buffer.nodes[task->slot] = task->result.nodes[0];
+			else if (AppendNodes(&buffer, task->result.count - 1, &base))
+			{
+				memcpy(buffer.nodes + base, task->result.nodes + 1, sizeof *buffer.nodes * (task->result.count - 1));
+				buffer.nodes[task->slot] = (int32_t)(base + task->result.nodes[0] - 1 - task->slot);
+			}
+			else  OK = false;
+		}
+	}
+	
+	for (i = 0; i != tasks.count; ++i)
+	{
+		free(tasks.tasks[i].triangles);
+		free(tasks.tasks[i].result.nodes);
+	}
+	free(tasks.tasks);
+	free(all);
+	delete bvh;
+	
+	if (!OK)
+	{
+		free(buffer.nodes);
+		return NULL;
+	}
+	
+	*outNodeCount = buffer.count;
+	return buffer.nodes;
+}
+
+
+static bool BuildNode(const OctreeBuildContext *ctxt, OctreeBuffer *buffer, uint32_t nodeIdx, const Vector &centre, Scalar halfSize, const uint32_t *triangles, uint32_t triangleCount, unsigned depth, OctreeTaskList *deferred)
+{
+	uint32_t				first, i, j, childCount;
+	uint32_t				*childTriangles = NULL;
+	Scalar					childHalf = halfSize * 0.5f;
+	Vector					childCentre;
+	const Vector			*tri;
+	bool					OK = true;
+	
+	if (0 == triangleCount)
+	{
+		// No surface passes through, so the whole cube is on one side of it.
+		buffer->nodes[nodeIdx] = IsInside(ctxt, centre) ? kDDOctreeSolid : kDDOctreeEmpty;
+		return true;
+	}
+	
+	if (depth == ctxt->maxDepth)
+	{
+		buffer->nodes[nodeIdx] = kDDOctreeMixed;
+		return true;
+	}
+	
+	if (NULL != deferred && kParallelSplitDepth == depth)
+	{
+		if (deferred->count == deferred->capacity)
+		{
+			uint32_t newCapacity = deferred->capacity ? deferred->capacity * 2 : 64;
+			OctreeTask *newTasks = (OctreeTask *)realloc(deferred->tasks, sizeof *newTasks * newCapacity);
+			if (NULL == newTasks)  return false;
+			deferred->tasks = newTasks;
+			deferred->capacity = newCapacity;
+		}
+		
+		OctreeTask *task = &deferred->tasks[deferred->count];
+		task->triangles = (uint32_t *)malloc(sizeof *task->triangles * triangleCount);
+		if (NULL == task->triangles)  return false;
+		memcpy(task->triangles, triangles, sizeof *triangles * triangleCount);
+		task->slot = nodeIdx;
+		task->centre = centre;
+		task->halfSize = halfSize;
+		task->triangleCount = triangleCount;
+		task->depth = depth;
+		task->result.nodes = NULL;
+		task->result.count = task->result.capacity = 0;
+		task->failed = false;
+		++deferred->count;
+		
+		buffer->nodes[nodeIdx] = kDDOctreeMixed;	// Placeholder
+		return true;
+	}
+	
+	if (!AppendNodes(buffer, 8, &first))  return false;
+	buffer->nodes[nodeIdx] = (int32_t)(first - nodeIdx);
+	
+	childTriangles = (uint32_t *)malloc(sizeof *childTriangles * triangleCount);
+	if (NULL == childTriangles)  return false;
+	
+	for (i = 0; OK && i != 8; ++i)
+	{
+		childCentre.Set(centre.x + ((i & 4) ? childHalf : -childHalf),
+						centre.y + ((i & 2) ? childHalf : -childHalf),
+						centre.z + ((i & 1) ? childHalf : -childHalf));
+		
+		childCount = 0;
+		for (j = 0; j != triangleCount; ++j)
+		{
+			tri = ctxt->triangles + triangles[j] * 3;
+			if (DDTriangleOverlapsCube(tri[0], tri[1], tri[2], childCentre, childHalf))  childTriangles[childCount++] = triangles[j];
+		}
+		
+		OK = BuildNode(ctxt, buffer, first + i, childCentre, childHalf, childTriangles, childCount, depth + 1, deferred);
+	}
+	
+	free(childTriangles);
+	return OK;
+}
+
+
+static void BuildTasks(void *context, size_t start, size_t end, unsigned worker)
+{
+	OctreeTaskList			*list = (OctreeTaskList *)context;
+	OctreeTask				*task;
+	uint32_t				root;
+	
+	for (size_t i = start; i != end; ++i)
+	{
+		task = &list->tasks[i];
+		if (!AppendNodes(&task->result, 1, &root) ||
+			!BuildNode(list->context, &task->result, root, task->centre, task->halfSize, task->triangles, task->triangleCount, task->depth, NULL))
+		{
+			task->failed = true;
+		}
+	}
+}
+
+
+static bool AppendNodes(OctreeBuffer *buffer, uint32_t count, uint32_t *outFirst)
+{
+	uint32_t				newCapacity;
+	int32_t					*newNodes;
+	
+	if (buffer->capacity < buffer->count + count)
+	{
+		newCapacity = buffer->capacity ? buffer->capacity : 256;
+		while (newCapacity < buffer->count + count)  newCapacity *= 2;
+		newNodes = (int32_t *)realloc(buffer->nodes, sizeof *newNodes * newCapacity);
+		if (NULL == newNodes)  return false;
+		buffer->nodes = newNodes;
+		buffer->capacity = newCapacity;
+	}
+	
+	*outFirst = buffer->count;
+	memset(buffer->nodes + buffer->count, 0, sizeof *buffer->nodes * count);
+	buffer->count += count;
+	return true;
+}
+
+
+/*	Parity test along three skewed rays; the skew avoids running exactly
+	along edges of axis-aligned geometry, which would count crossings twice.
+	Voting makes the result robust against small holes in the mesh.
+*/
+static bool IsInside(const OctreeBuildContext *ctxt, const Vector &point)
+{
+	const Vector			directions[3] =
+							{
+								Vector(1.0f, 0.0013f, 0.0007f),
+								Vector(0.0011f, 1.0f, 0.0017f),
+								Vector(0.0019f, 0.0005f, 1.0f)
+							};
+	unsigned				i, votes = 0;
+	
+	for (i = 0; i != 3; ++i)
+	{
+		if (ctxt->bvh->CountIntersections(point, directions[i], 0, INFINITY) & 1)  ++votes;
+	}
+	return 2 <= votes;
+}
+
+
+// After Akenine-Möller, “Fast 3D Triangle-Box Overlap Testing”.
+static inline bool AxisSeparates(Scalar p0, Scalar p1, Scalar r)
+{
+	Scalar					lo = (p0 < p1) ? p0 : p1, hi = (p0 < p1) ? p1 : p0;
+	return r < lo || hi < -r;
+}
+
+
+bool DDTriangleOverlapsCube(const Vector &inA, const Vector &inB, const Vector &inC, const Vector &inCentre, Scalar h)
+{
+	Vector					v0 = inA - inCentre, v1 = inB - inCentre, v2 = inC - inCentre;
+	Vector					e0 = v1 - v0, e1 = v2 - v1, e2 = v0 - v2;
+	Vector					normal;
+	Scalar					fex, fey, fez, p0, p1, r, d;
+	unsigned				i;
+	
+	// Cube face normals: compare triangle extents with the cube.
+	for (i = 0; i != 3; ++i)
+	{
+		Scalar lo = v0[i], hi = v0[i];
+		if (v1[i] < lo)  lo = v1[i];
+		if (hi < v1[i])  hi = v1[i];
+		if (v2[i] < lo)  lo = v2[i];
+		if (hi < v2[i])  hi = v2[i];
+		if (h < lo || hi < -h)  return false;
+	}
+	
+	// Nine edge cross products.
+	fex = fabsf(e0.x); fey = fabsf(e0.y); fez = fabsf(e0.z);
+	p0 = e0.z * v0.y - e0.y * v0.z; p1 = e0.z * v2.y - e0.y * v2.z; r = (fez + fey) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	p0 = -e0.z * v0.x + e0.x * v0.z; p1 = -e0.z * v2.x + e0.x * v2.z; r = (fez + fex) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	p0 = e0.y * v1.x - e0.x * v1.y; p1 = e0.y * v2.x - e0.x * v2.y; r = (fey + fex) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	
+	fex = fabsf(e1.x); fey = fabsf(e1.y); fez = fabsf(e1.z);
+	p0 = e1.z * v0.y - e1.y * v0.z; p1 = e1.z * v2.y - e1.y * v2.z; r = (fez + fey) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	p0 = -e1.z * v0.x + e1.x * v0.z; p1 = -e1.z * v2.x + e1.x * v2.z; r = (fez + fex) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	p0 = e1.y * v0.x - e1.x * v0.y; p1 = e1.y * v1.x - e1.x * v1.y; r = (fey + fex) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	
+	fex = fabsf(e2.x); fey = fabsf(e2.y); fez = fabsf(e2.z);
+	p0 = e2.z * v0.y - e2.y * v0.z; p1 = e2.z * v1.y - e2.y * v1.z; r = (fez + fey) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	p0 = -e2.z * v0.x + e2.x * v0.z; p1 = -e2.z * v1.x + e2.x * v1.z; r = (fez + fex) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	p0 = e2.y * v1.x - e2.x * v1.y; p1 = e2.y * v2.x - e2.x * v2.y; r = (fey + fex) * h;
+	if (AxisSeparates(p0, p1, r))  return false;
+	
+	// Triangle plane.
+	normal = e0 % e1;
+	d = -(normal * v0);
+	r = h * (fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z));
+	return fabsf(d) <= r;
+}
@@ -0,0 +1,57 @@
+/*
+	DDOctreeBuilder.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Builds Oolite-style collision octrees from triangle soups.
+	
+	An octree is a flat array of int32_t. Each element is either a leaf value
+	(kDDOctreeEmpty, kDDOctreeSolid or kDDOctreeMixed) or, if positive, the
+	offset from that element to the first of its eight consecutive children.
+	Child n covers the octant on the positive side of the X axis if bit 2 of n
+	is set, Y for bit 1 and Z for bit 0. The root cube is centred on the origin.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDOCTREEBUILDER_h
+#define INCLUDED_DDOCTREEBUILDER_h
+
+#include "phystypes.h"
+
+
+enum
+{
+	kDDOctreeEmpty			= 0,
+	kDDOctreeSolid			= -1,	// Entirely inside the mesh
+	kDDOctreeMixed			= -2,	// Contains surface at the depth limit; Oolite treats this as solid
+	
+	kDDOctreeMaxDepth		= 10
+};
+
+
+/*	Build an octree of half-size inRadius and at most inDepth levels below the
+	root. inTriangles is an array of 3 * inTriangleCount vertices. Returns a
+	malloced array, or NULL on failure. Subtrees are built in parallel.
+*/
+int32_t *DDBuildCollisionOctree(const Vector *inTriangles, uint32_t inTriangleCount, Scalar inRadius, unsigned inDepth, uint32_t *outNodeCount);
+
+// Separating axis test for a triangle and an axis-aligned cube.
+bool DDTriangleOverlapsCube(const Vector &inA, const Vector &inB, const Vector &inC, const Vector &inCentre, Scalar inHalfSize);
+
+#endif	/* INCLUDED_DDOCTREEBUILDER_h */
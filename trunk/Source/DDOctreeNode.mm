@@ -0,0 +1,124 @@
+/*
+	DDOctreeNode.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "DDOctreeNode.h"
+#import "DDCollisionOctree.h"
+#import "DDOctreeBuilder.h"
+#import "GLUtilities.h"
+#import "Logging.h"
+
+
+static void DrawOctreeNode(const int32_t *inNodes, uint32_t inIndex, Vector inCentre, Scalar inHalfSize, int32_t inLeafType);
+
+
+@implementation DDOctreeNode
+
++ (id)nodeWithOctree:(DDCollisionOctree *)inOctree
+{
+	return [[[self alloc] initWithOctree:inOctree] autorelease];
+}
+
+
+- (id)initWithOctree:(DDCollisionOctree *)inOctree
+{
+	self = [super init];
+	if (nil != self)
+	{
+		[self setLocalizedName:@"Collision Octree"];
+		[self setOctree:inOctree];
+	}
+	
+	return self;
+}
+
+
+- (void)dealloc
+{
+	[_octree release];
+	
+	[super dealloc];
+}
+
+
+- (void)setOctree:(DDCollisionOctree *)inOctree
+{
+	if (inOctree != _octree)
+	{
+		[_octree release];
+		_octree = [inOctree retain];
+		[self becomeDirty];
+	}
+}
+
+
+- (void)performRenderWithState:(NSDictionary *)inState dirty:(BOOL)inDirty
+{
+	WFModeContext			wfmc;
+	float					oldPointSize;
+	id						val;
+	
+	val = [inState objectForKey:@"collision octree"];
+	if (![val respondsToSelector:@selector(boolValue)] || ![val boolValue])  return;
+	if (_octree == nil || [_octree nodeCount] == 0)  return;
+	
+	EnterWireframeMode(wfmc);
+	glGetFloatv(GL_POINT_SIZE, &oldPointSize);
+	glPointSize(2.0f);
+	
+	glBegin(GL_POINTS);
+	glColor3f(0.5f, 0.5f, 0.8f);
+	DrawOctreeNode([_octree nodes], 0, Vector(0, 0, 0), [_octree radius], kDDOctreeSolid);
+	glColor3f(1.0f, 0.6f, 0.0f);
+	DrawOctreeNode([_octree nodes], 0, Vector(0, 0, 0), [_octree radius], kDDOctreeMixed);
+	glEnd();
+	
+	glPointSize(oldPointSize);
+	ExitWireframeMode(wfmc);
+}
+
+@end
+
+
+static void DrawOctreeNode(const int32_t *inNodes, uint32_t inIndex, Vector inCentre, Scalar inHalfSize, int32_t inLeafType)
+{
+	int32_t					value = inNodes[inIndex];
+	Scalar					childHalf;
+	unsigned				i;
+	
+	if (value == inLeafType)
+	{
+		inCentre.glDraw();
+	}
+	else if (0 < value)
+	{
+		childHalf = inHalfSize * 0.5f;
+		for (i = 0; i != 8; ++i)
+		{
+			DrawOctreeNode(inNodes, inIndex + value + i,
+						   Vector(inCentre.x + ((i & 4) ? childHalf : -childHalf),
+								  inCentre.y + ((i & 2) ? childHalf : -childHalf),
+								  inCentre.z + ((i & 1) ? childHalf : -childHalf)),
+						   childHalf, inLeafType);
+		}
+	}
+}
@@ -0,0 +1,631 @@
+/*
+	DDPNGDecoder.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDPNGDecoder.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <zlib.h>
+
+
+enum
+{
+	kMaxDimension			= 1 << 16,		// Far beyond any texture size, but keeps row sizes sane.
+	
+	kColorGrey				= 0,
+	kColorRGB				= 2,
+	kColorPalette			= 3,
+	kColorGreyAlpha			= 4,
+	kColorRGBA				= 6
+};
+
+
+#define ChunkType(a, b, c, d)	(((uint32_t)(a) << 24) | ((uint32_t)(b) << 16) | ((uint32_t)(c) << 8) | (uint32_t)(d))
+#define IsCriticalChunk(type)	(((type) & 0x20000000) == 0)	// Upper-case first letter.
+
+
+static const uint32_t kReadBufferSize = 64 * 1024;	// Typed, as it is compared with chunk lengths.
+static const uint8_t kSignature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+
+
+// Adam7 passes: first column, first row, column step, row step.
+static const uint8_t kAdam7[7][4] =
+{
+	{ 0, 0, 8, 8 },
+	{ 4, 0, 8, 8 },
+	{ 0, 4, 4, 8 },
+	{ 2, 0, 4, 4 },
+	{ 0, 2, 2, 4 },
+	{ 1, 0, 2, 2 },
+	{ 0, 1, 1, 2 }
+};
+
+
+struct DDPNGDecoder
+{
+	FILE					*file;
+	uint32_t				width, height;
+	unsigned				bitDepth;
+	unsigned				colorType;
+	bool					interlaced;
+	unsigned				bitsPerPixel;
+	
+	uint8_t					palette[256][4];	// r, g, b, a
+	unsigned				paletteCount;
+	bool					hasTransparentKey;
+	uint16_t				transparentKey[3];	// Grey, or r, g, b, at the image's bit depth
+	
+	bool					decoded;
+};
+
+
+// Row state while decoding; one pass of an interlaced image at a time.
+typedef struct
+{
+	uint8_t					*pixels;
+	size_t					rowBytes;
+	
+	unsigned				pass;				// 0 to 6 if interlaced, else 0
+	uint32_t				passWidth, passHeight;
+	uint32_t				row;				// Row within pass
+	size_t					lineSize;			// Filter byte plus packed samples
+	size_t					lineFill;
+	uint8_t					*line, *previousLine;
+	bool					done;
+} RowState;
+
+
+static inline uint32_t ReadBE32(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+
+static bool ReadChunkHeader(FILE *file, uint32_t *outLength, uint32_t *outType);
+static DDPNGResult ReadChunkData(FILE *file, uint32_t inType, uint8_t *outData, uint32_t inLength);
+static DDPNGResult ReadHeader(DDPNGDecoder *decoder, const uint8_t *inData, uint32_t inLength);
+static void StartPass(const DDPNGDecoder *decoder, RowState *state, unsigned inPass);
+static bool FinishRow(const DDPNGDecoder *decoder, RowState *state);
+static bool Unfilter(uint8_t *ioRow, const uint8_t *inPrevious, size_t inCount, unsigned inBytesPerPixel, unsigned inFilter);
+static void ConvertRow(const DDPNGDecoder *decoder, const uint8_t *inSamples, uint32_t inCount, uint8_t *outPixels, size_t inStep);
+
+
+DDPNGResult DDPNGOpen(const char *inPath, DDPNGDecoder **outDecoder)
+{
+	DDPNGDecoder			*decoder = NULL;
+	DDPNGResult				result = kDDPNGOK;
+	uint8_t					signature[8], header[13];
+	uint32_t				length, type;
+	
+	if (NULL == outDecoder)  return kDDPNGReadError;
+	*outDecoder = NULL;
+	
+	decoder = (DDPNGDecoder *)calloc(1, sizeof *decoder);
+	if (NULL == decoder)  return kDDPNGOutOfMemory;
+	
+	decoder->file = fopen(inPath, "rb");
+	if (NULL == decoder->file)  result = kDDPNGReadError;
+	
+	if (kDDPNGOK == result)
+	{
+		if (1 != fread(signature, sizeof signature, 1, decoder->file) || 0 != memcmp(signature, kSignature, sizeof signature))  result = kDDPNGNotPNG;
+	}
+	
+	if (kDDPNGOK == result)
+	{
+		if (!ReadChunkHeader(decoder->file, &length, &type) || type != ChunkType('I', 'H', 'D', 'R') || length != sizeof header)  result = kDDPNGDamaged;
+	}
+	if (kDDPNGOK == result)  result = ReadChunkData(decoder->file, type, header, length);
+	if (kDDPNGOK == result)  result = ReadHeader(decoder, header, length);
+	
+	if (kDDPNGOK == result)  *outDecoder = decoder;
+	else  DDPNGClose(decoder);
+	
+	return result;
+}
+
+
+void DDPNGGetSize(const DDPNGDecoder *inDecoder, unsigned *outWidth, unsigned *outHeight)
+{
+	if (NULL != outWidth)  *outWidth = (NULL != inDecoder) ? inDecoder->width : 0;
+	if (NULL != outHeight)  *outHeight = (NULL != inDecoder) ? inDecoder->height : 0;
+}
+
+
+void DDPNGClose(DDPNGDecoder *inDecoder)
+{
+	if (NULL == inDecoder)  return;
+	if (NULL != inDecoder->file)  fclose(inDecoder->file);
+	free(inDecoder);
+}
+
+
+DDPNGResult DDPNGDecodePremultipliedARGB(DDPNGDecoder *decoder, uint8_t *outPixels, size_t inRowBytes)
+{
+	DDPNGResult				result = kDDPNGOK;
+	RowState				state;
+	z_stream				stream;
+	bool					inflating = false, streamEnded = false;
+	uint8_t					*readBuffer = NULL, small[768];
+	uint8_t					*lines = NULL;
+	uint32_t				length, type, remaining, count, crc;
+	unsigned				i;
+	int						err;
+	
+	if (NULL == decoder || NULL == outPixels || decoder->decoded)  return kDDPNGReadError;
+	decoder->decoded = true;
+	
+	bzero(&state, sizeof state);
+	bzero(&stream, sizeof stream);
+	state.pixels = outPixels;
+	state.rowBytes = inRowBytes;
+	
+	// The widest pass is the whole image, so both lines are sized for that.
+	state.lineSize = 1 + ((size_t)decoder->width * decoder->bitsPerPixel + 7) / 8;
+	readBuffer = (uint8_t *)malloc(kReadBufferSize);
+	lines = (uint8_t *)malloc(state.lineSize * 2);
+	if (NULL == readBuffer || NULL == lines)  result = kDDPNGOutOfMemory;
+	state.line = lines;
+	state.previousLine = (NULL != lines) ? lines + state.lineSize : NULL;
+	
+	if (kDDPNGOK == result)
+	{
+		if (Z_OK != inflateInit(&stream))  result = kDDPNGOutOfMemory;
+		else  inflating = true;
+	}
+	if (kDDPNGOK == result)  StartPass(decoder, &state, 0);
+	
+	while (kDDPNGOK == result && !state.done)
+	{
+		if (!ReadChunkHeader(decoder->file, &length, &type))
+		{
+			result = kDDPNGDamaged;
+			break;
+		}
+		
+		switch (type)
+		{
+			case ChunkType('P', 'L', 'T', 'E'):
+				if (0 != length % 3 || 256 * 3 < length || kColorGrey == decoder->colorType || kColorGreyAlpha == decoder->colorType)
+				{
+					result = kDDPNGDamaged;
+					break;
+				}
+				result = ReadChunkData(decoder->file, type, small, length);
+				decoder->paletteCount = length / 3;
+				for (i = 0; i != decoder->paletteCount; ++i)
+				{
+					decoder->palette[i][0] = small[i * 3];
+					decoder->palette[i][1] = small[i * 3 + 1];
+					decoder->palette[i][2] = small[i * 3 + 2];
+					decoder->palette[i][3] = 255;
+				}
+				break;
+			
+			case ChunkType('t', 'R', 'N', 'S'):
+				if (sizeof small < length)
+				{
+					result = kDDPNGDamaged;
+					break;
+				}
+				result = ReadChunkData(decoder->file, type, small, length);
+				if (kDDPNGOK != result)  break;
+				if (kColorPalette == decoder->colorType)
+				{
+					for (i = 0; i < length && i < 256; ++i)  decoder->palette[i][3] = small[i];
+				}
+				else if (kColorGrey == decoder->colorType && 2 == length)
+				{
+					decoder->transparentKey[0] = (uint16_t)((small[0] << 8) | small[1]);
+					decoder->hasTransparentKey = true;
+				}
+				else if (kColorRGB == decoder->colorType && 6 == length)
+				{
+					for (i = 0; i != 3; ++i)  decoder->transparentKey[i] = (uint16_t)((small[i * 2] << 8) | small[i * 2 + 1]);
+					decoder->hasTransparentKey = true;
+				}
+				break;
+			
+			case ChunkType('I', 'D', 'A', 'T'):
+				if (kColorPalette == decoder->colorType && 0 == decoder->paletteCount)
+				{
+					result = kDDPNGDamaged;
+					break;
+				}
+				
+				// Inflated a line at a time into the line buffer, and each line unfiltered and expanded into place as it completes.
+				small[0] = (uint8_t)(type >> 24);
+				small[1] = (uint8_t)(type >> 16);
+				small[2] = (uint8_t)(type >> 8);
+				small[3] = (uint8_t)type;
+				crc = crc32(crc32(0, NULL, 0), small, 4);
+				for (remaining = length; result == kDDPNGOK && remaining != 0; remaining -= count)
+				{
+					count = (remaining < kReadBufferSize) ? remaining : kReadBufferSize;
+					if (1 != fread(readBuffer, count, 1, decoder->file))
+					{
+						result = kDDPNGDamaged;
+						break;
+					}
+					crc = crc32(crc, readBuffer, count);
+					
+					stream.next_in = readBuffer;
+					stream.avail_in = count;
+					while (!streamEnded && !state.done)
+					{
+						stream.next_out = state.line + state.lineFill;
+						stream.avail_out = (uInt)(state.lineSize - state.lineFill);
+						err = inflate(&stream, Z_NO_FLUSH);
+						state.lineFill = state.lineSize - stream.avail_out;
+						
+						if (Z_STREAM_END == err)  streamEnded = true;
+						else if (Z_OK != err && Z_BUF_ERROR != err)
+						{
+							result = kDDPNGDamaged;
+							break;
+						}
+						
+						if (state.lineFill == state.lineSize)
+						{
+							if (!FinishRow(decoder, &state))
+							{
+								result = kDDPNGDamaged;
+								break;
+							}
+						}
+						else if (0 == stream.avail_in || Z_BUF_ERROR == err)  break;	// Needs the next piece.
+					}
+				}
+				if (kDDPNGOK == result)
+				{
+					if (1 != fread(small, 4, 1, decoder->file) || ReadBE32(small) != crc)  result = kDDPNGDamaged;
+				}
+				break;
+			
+			case ChunkType('I', 'E', 'N', 'D'):
+				// Only reached if the image data ran out early.
+				result = kDDPNGDamaged;
+				break;
+			
+			default:
+				if (IsCriticalChunk(type))  result = kDDPNGUnsupported;
+				else if (0 != fseek(decoder->file, (long)length + 4, SEEK_CUR))  result = kDDPNGDamaged;
+		}
+		
+		if (kDDPNGOK == result && streamEnded && !state.done)  result = kDDPNGDamaged;
+	}
+	
+	if (inflating)  inflateEnd(&stream);
+	free(readBuffer);
+	free(lines);
+	
+	return result;
+}
+
+
+static bool ReadChunkHeader(FILE *file, uint32_t *outLength, uint32_t *outType)
+{
+	uint8_t					bytes[8];
+	
+	if (1 != fread(bytes, sizeof bytes, 1, file))  return false;
+	*outLength = ReadBE32(bytes);
+	*outType = ReadBE32(bytes + 4);
+	return *outLength <= 0x7FFFFFFF;
+}
+
+
+// Reads a chunk's data and CRC, and checks the CRC.
+static DDPNGResult ReadChunkData(FILE *file, uint32_t inType, uint8_t *outData, uint32_t inLength)
+{
+	uint8_t					typeBytes[4], crcBytes[4];
+	uLong					crc;
+	
+	if (fread(outData, 1, inLength, file) != inLength || 1 != fread(crcBytes, sizeof crcBytes, 1, file))  return kDDPNGDamaged;
+	
+	typeBytes[0] = (uint8_t)(inType >> 24);
+	typeBytes[1] = (uint8_t)(inType >> 16);
+	typeBytes[2] = (uint8_t)(inType >> 8);
+	typeBytes[3] = (uint8_t)inType;
+	crc = crc32(crc32(0, NULL, 0), typeBytes, sizeof typeBytes);
+	crc = crc32(crc, outData, inLength);
+	
+	return (crc == ReadBE32(crcBytes)) ? kDDPNGOK : kDDPNGDamaged;
+}
+
+
+static DDPNGResult ReadHeader(DDPNGDecoder *decoder, const uint8_t *inData, uint32_t inLength)
+{
+	unsigned				channels;
+	bool					depthOK;
+	unsigned				depth;
+	
+	if (13 != inLength)  return kDDPNGDamaged;
+	
+	decoder->width = ReadBE32(inData);
+	decoder->height = ReadBE32(inData + 4);
+	decoder->bitDepth = depth = inData[8];
+	decoder->colorType = inData[9];
+	decoder->interlaced = (1 == inData[12]);
+	
+	// Compression and filter methods 0 are the only ones defined.
+	if (0 != inData[10] || 0 != inData[11] || 1 < inData[12])  return kDDPNGUnsupported;
+	if (0 == decoder->width || 0 == decoder->height || kMaxDimension < decoder->width || kMaxDimension < decoder->height)  return kDDPNGUnsupported;
+	
+	switch (decoder->colorType)
+	{
+		case kColorGrey:
+			channels = 1;
+			depthOK = (1 == depth || 2 == depth || 4 == depth || 8 == depth || 16 == depth);
+			break;
+		
+		case kColorPalette:
+			channels = 1;
+			depthOK = (1 == depth || 2 == depth || 4 == depth || 8 == depth);
+			break;
+		
+		case kColorGreyAlpha:
+			channels = 2;
+			depthOK = (8 == depth || 16 == depth);
+			break;
+		
+		case kColorRGB:
+			channels = 3;
+			depthOK = (8 == depth || 16 == depth);
+			break;
+		
+		case kColorRGBA:
+			channels = 4;
+			depthOK = (8 == depth || 16 == depth);
+			break;
+		
+		default:
+			return kDDPNGUnsupported;
+	}
+	if (!depthOK)  return kDDPNGUnsupported;
+	
+	decoder->bitsPerPixel = channels * depth;
+	return kDDPNGOK;
+}
+
+
+// Moves on to the first pass at or after inPass with any pixels in it, or sets state->done.
+static void StartPass(const DDPNGDecoder *decoder, RowState *state, unsigned inPass)
+{
+	const uint8_t			*pass;
+	
+	state->row = 0;
+	state->lineFill = 0;
+	
+	if (!decoder->interlaced)
+	{
+		if (0 == inPass)
+		{
+			state->pass = 0;
+			state->passWidth = decoder->width;
+			state->passHeight = decoder->height;
+			bzero(state->previousLine, state->lineSize);
+		}
+		else  state->done = true;
+		return;
+	}
+	
+	for (; inPass < 7; ++inPass)
+	{
+		pass = kAdam7[inPass];
+		state->passWidth = (decoder->width > pass[0]) ? (decoder->width - pass[0] + pass[2] - 1) / pass[2] : 0;
+		state->passHeight = (decoder->height > pass[1]) ? (decoder->height - pass[1] + pass[3] - 1) / pass[3] : 0;
+		if (0 != state->passWidth && 0 != state->passHeight)
+		{
+			state->pass = inPass;
+			state->lineSize = 1 + ((size_t)state->passWidth * decoder->bitsPerPixel + 7) / 8;
+			bzero(state->previousLine, state->lineSize);
+			return;
+		}
+	}
+	state->done = true;
+}
+
+
+// Unfilter the completed line, expand it into the image and move on to the next.
+static bool FinishRow(const DDPNGDecoder *decoder, RowState *state)
+{
+	uint8_t					*swap;
+	uint32_t				x = 0, y = state->row, xStep = 1;
+	unsigned				bytesPerPixel;
+	
+	bytesPerPixel = (decoder->bitsPerPixel + 7) / 8;
+	if (!Unfilter(state->line + 1, state->previousLine + 1, state->lineSize - 1, bytesPerPixel, state->line[0]))  return false;
+	
+	if (decoder->interlaced)
+	{
+		x = kAdam7[state->pass][0];
+		y = kAdam7[state->pass][1] + state->row * kAdam7[state->pass][3];
+		xStep = kAdam7[state->pass][2];
+	}
+	ConvertRow(decoder, state->line + 1, state->passWidth, state->pixels + y * state->rowBytes + x * 4, xStep * 4);
+	
+	swap = state->line;
+	state->line = state->previousLine;
+	state->previousLine = swap;
+	state->lineFill = 0;
+	
+	if (++state->row == state->passHeight)  StartPass(decoder, state, state->pass + 1);
+	return true;
+}
+
+
+static bool Unfilter(uint8_t *ioRow, const uint8_t *inPrevious, size_t inCount, unsigned inBytesPerPixel, unsigned inFilter)
+{
+	size_t					i;
+	int						a, b, c, p, pa, pb, pc;
+	
+	switch (inFilter)
+	{
+		case 0:		// None
+			break;
+		
+		case 1:		// Sub
+			for (i = inBytesPerPixel; i < inCount; ++i)  ioRow[i] += ioRow[i - inBytesPerPixel];
+			break;
+		
+		case 2:		// Up
+			for (i = 0; i < inCount; ++i)  ioRow[i] += inPrevious[i];
+			break;
+		
+		case 3:		// Average
+			for (i = 0; i < inBytesPerPixel && i < inCount; ++i)  ioRow[i] += inPrevious[i] >> 1;
+			for (; i < inCount; ++i)  ioRow[i] += (ioRow[i - inBytesPerPixel] + inPrevious[i]) >> 1;
+			break;
+		
+		case 4:		// Paeth
+			for (i = 0; i < inBytesPerPixel && i < inCount; ++i)  ioRow[i] += inPrevious[i];
+			for (; i < inCount; ++i)
+			{
+				a = ioRow[i - inBytesPerPixel];
+				b = inPrevious[i];
+				c = inPrevious[i - inBytesPerPixel];
+				p = a + b - c;
+				pa = abs(p - a);
+				pb = abs(p - b);
+				pc = abs(p - c);
+				ioRow[i] += (pa <= pb && pa <= pc) ? a : ((pb <= pc) ? b : c);
+			}
+			break;
+		
+		default:
+			return false;
+	}
+	return true;
+}
+
+
+static inline void StorePixel(uint8_t *outPixel, unsigned r, unsigned g, unsigned b, unsigned a)
+{
+	if (255 != a)
+	{
+		r = (r * a + 127) / 255;
+		g = (g * a + 127) / 255;
+		b = (b * a + 127) / 255;
+	}
+	outPixel[0] = (uint8_t)a;
+	outPixel[1] = (uint8_t)r;
+	outPixel[2] = (uint8_t)g;
+	outPixel[3] = (uint8_t)b;
+}
+
+
+// Samples of less than eight bits are packed high bit first.
+static inline unsigned PackedSample(const uint8_t *inSamples, uint32_t inIndex, unsigned inDepth)
+{
+	uint32_t				bit = inIndex * inDepth;
+	
+	return (inSamples[bit >> 3] >> (8 - inDepth - (bit & 7))) & ((1U << inDepth) - 1);
+}
+
+
+static void ConvertRow(const DDPNGDecoder *decoder, const uint8_t *inSamples, uint32_t inCount, uint8_t *outPixels, size_t inStep)
+{
+	uint32_t				i;
+	unsigned				depth = decoder->bitDepth, v, max, a, r, g, b;
+	const uint8_t			*s = inSamples, *entry;
+	bool					key = decoder->hasTransparentKey;
+	
+	switch (decoder->colorType)
+	{
+		case kColorGrey:
+			max = (1U << depth) - 1;
+			for (i = 0; i != inCount; ++i, outPixels += inStep)
+			{
+				if (16 == depth)
+				{
+					v = s[i * 2];
+					a = (key && ((s[i * 2] << 8) | s[i * 2 + 1]) == decoder->transparentKey[0]) ? 0 : 255;
+				}
+				else
+				{
+					v = (8 == depth) ? s[i] : PackedSample(s, i, depth);
+					a = (key && v == decoder->transparentKey[0]) ? 0 : 255;
+					if (8 != depth)  v = v * 255 / max;
+				}
+				StorePixel(outPixels, v, v, v, a);
+			}
+			break;
+		
+		case kColorPalette:
+			for (i = 0; i != inCount; ++i, outPixels += inStep)
+			{
+				v = (8 == depth) ? s[i] : PackedSample(s, i, depth);
+				if (v < decoder->paletteCount)
+				{
+					entry = decoder->palette[v];
+					StorePixel(outPixels, entry[0], entry[1], entry[2], entry[3]);
+				}
+				else  StorePixel(outPixels, 0, 0, 0, 255);
+			}
+			break;
+		
+		case kColorGreyAlpha:
+			for (i = 0; i != inCount; ++i, outPixels += inStep)
+			{
+				if (16 == depth)  StorePixel(outPixels, s[i * 4], s[i * 4], s[i * 4], s[i * 4 + 2]);
+				else  StorePixel(outPixels, s[i * 2], s[i * 2], s[i * 2], s[i * 2 + 1]);
+			}
+			break;
+		
+		case kColorRGB:
+			for (i = 0; i != inCount; ++i, outPixels += inStep)
+			{
+				if (16 == depth)
+				{
+					s = inSamples + i * 6;
+					r = s[0]; g = s[2]; b = s[4];
+					a = (key && ((s[0] << 8) | s[1]) == decoder->transparentKey[0] && ((s[2] << 8) | s[3]) == decoder->transparentKey[1] && ((s[4] << 8) | s[5]) == decoder->transparentKey[2]) ? 0 : 255;
+				}
+				else
+				{
+					s = inSamples + i * 3;
+					r = s[0]; g = s[1]; b = s[2];
+					a = (key && r == decoder->transparentKey[0] && g == decoder->transparentKey[1] && b == decoder->transparentKey[2]) ? 0 : 255;
+				}
+				StorePixel(outPixels, r, g, b, a);
+			}
+			break;
+		
+		case kColorRGBA:
+			for (i = 0; i != inCount; ++i, outPixels += inStep)
+			{
+				if (16 == depth)
+				{
+					s = inSamples + i * 8;
+					StorePixel(outPixels, s[0], s[2], s[4], s[6]);
+				}
+				else
+				{
+					s = inSamples + i * 4;
+					StorePixel(outPixels, s[0], s[1], s[2], s[3]);
+				}
+			}
+			break;
+	}
+}
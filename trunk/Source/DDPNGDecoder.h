@@ -0,0 +1,78 @@
+/*
+	DDPNGDecoder.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Streaming PNG decoder for textures. Expands every PNG pixel format, including
+	interlaced images, to premultiplied ARGB as it inflates, writing each row
+	straight into the caller's buffer with no full-size intermediate image.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDPNGDECODER_h
+#define INCLUDED_DDPNGDECODER_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef enum
+{
+	kDDPNGOK,
+	kDDPNGNotPNG,				// No PNG signature; try another decoder.
+	kDDPNGUnsupported,			// A PNG this decoder doesn't handle (unknown critical chunk or bad header).
+	kDDPNGDamaged,				// Truncated, failed CRC, or bad compressed data.
+	kDDPNGOutOfMemory,
+	kDDPNGReadError
+} DDPNGResult;
+
+
+typedef struct DDPNGDecoder DDPNGDecoder;
+
+
+/*	Open a PNG file and read its header. On success, *outDecoder must be
+	passed to DDPNGClose(). Each decoder may only be used on one thread at a
+	time, but there is no shared state.
+*/
+DDPNGResult DDPNGOpen(const char *inPath, DDPNGDecoder **outDecoder);
+
+void DDPNGGetSize(const DDPNGDecoder *inDecoder, unsigned *outWidth, unsigned *outHeight);
+
+/*	Decode the image into outPixels, inRowBytes apart, top row first. Each
+	pixel is four bytes, alpha, red, green, blue, with colour premultiplied by
+	alpha: the layout of a kCGImageAlphaPremultipliedFirst bitmap context.
+	Palette, grey and low bit depth images are expanded, 16-bit samples are
+	reduced to 8, and tRNS transparency is applied. No gamma or colour space
+	conversion is done, as in Oolite. May only be called once per decoder.
+*/
+DDPNGResult DDPNGDecodePremultipliedARGB(DDPNGDecoder *inDecoder, uint8_t *outPixels, size_t inRowBytes);
+
+void DDPNGClose(DDPNGDecoder *inDecoder);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* INCLUDED_DDPNGDECODER_h */
@@ -0,0 +1,148 @@
+/*
+	DDParallel.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDParallel.h"
+#include <pthread.h>
+#include <unistd.h>
+
+
+enum
+{
+	kMaxWorkers				= 32,
+	kChunksPerWorker		= 8
+};
+
+
+typedef struct DDParallelJob
+{
+	DDParallelApplyFunction	function;
+	void					*context;
+	size_t					count;
+	size_t					granularity;
+	volatile size_t			next;
+} DDParallelJob;
+
+
+typedef struct DDParallelWorkerInfo
+{
+	DDParallelJob			*job;
+	unsigned				index;
+} DDParallelWorkerInfo;
+
+
+static void RunWorker(DDParallelJob *job, unsigned index);
+static void *WorkerThreadEntry(void *info);
+
+
+unsigned DDParallelWorkerCount(void)
+{
+	static unsigned			count = 0;
+	long					online;
+	
+	if (0 == count)
+	{
+		online = sysconf(_SC_NPROCESSORS_ONLN);
+		if (online < 1)  online = 1;
+		if (online > kMaxWorkers)  online = kMaxWorkers;
+		count = (unsigned)online;
+	}
+	
+	return count;
+}
+
+
+void DDParallelApply(size_t inCount, size_t inGranularity, DDParallelApplyFunction inFunction, void *inContext)
+{
+	DDParallelJob			job;
+	DDParallelWorkerInfo	info[kMaxWorkers];
+	pthread_t				threads[kMaxWorkers];
+	unsigned				i, workerCount, started = 0;
+	
+	if (0 == inCount || NULL == inFunction)  return;
+	
+	workerCount = DDParallelWorkerCount();
+	if (0 == inGranularity)
+	{
+		inGranularity = inCount / (workerCount * kChunksPerWorker);
+		if (0 == inGranularity)  inGranularity = 1;
+	}
+	
+	if (1 == workerCount || inCount <= inGranularity)
+	{
+		inFunction(inContext, 0, inCount, 0);
+		return;
+	}
+	
+	job.function = inFunction;
+	job.context = inContext;
+	job.count = inCount;
+	job.granularity = inGranularity;
+	job.next = 0;
+	
+	// No point in starting more threads than there are chunks.
+	if ((inCount + inGranularity - 1) / inGranularity < workerCount)
+	{
+		workerCount = (unsigned)((inCount + inGranularity - 1) / inGranularity);
+	}
+	
+	for (i = 1; i < workerCount; i++)
+	{
+		info[i].job = &job;
+		info[i].index = i;
+		if (0 != pthread_create(&threads[i], NULL, WorkerThreadEntry, &info[i]))  break;
+		started = i;
+	}
+	
+	RunWorker(&job, 0);
+	
+	for (i = 1; i <= started; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+}
+
+
+static void RunWorker(DDParallelJob *job, unsigned index)
+{
+	size_t					start, end;
+	
+	for (;;)
+	{
+		start = __sync_fetch_and_add(&job->next, job->granularity);
+		if (job->count <= start)  break;
+		
+		end = start + job->granularity;
+		if (job->count < end)  end = job->count;
+		
+		job->function(job->context, start, end, index);
+	}
+}
+
+
+static void *WorkerThreadEntry(void *info)
+{
+	DDParallelWorkerInfo	*workerInfo = (DDParallelWorkerInfo *)info;
+	
+	RunWorker(workerInfo->job, workerInfo->index);
+	return NULL;
+}
@@ -0,0 +1,60 @@
+/*
+	DDParallel.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Minimal data-parallel loop over a pthread worker pool. Work is handed out in
+	chunks from a shared atomic counter, so uneven per-item costs balance
+	themselves. The calling thread participates as worker 0.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDPARALLEL_h
+#define INCLUDED_DDPARALLEL_h
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/*	Apply function. Called with a half-open range [inStart, inEnd) of item
+	indices. inWorker is in the range [0, DDParallelWorkerCount()) and may be
+	used to index per-worker scratch space; no two concurrent calls share a
+	worker index.
+*/
+typedef void (*DDParallelApplyFunction)(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+
+
+// Number of threads DDParallelApply() may use, including the caller.
+unsigned DDParallelWorkerCount(void);
+
+/*	Call inFunction over [0, inCount) in chunks of inGranularity items (0 for
+	automatic), and wait for completion. Falls back to a single call on the
+	current thread for small jobs or if threads can't be created.
+*/
+void DDParallelApply(size_t inCount, size_t inGranularity, DDParallelApplyFunction inFunction, void *inContext);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* INCLUDED_DDPARALLEL_h */
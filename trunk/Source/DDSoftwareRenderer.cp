@@ -0,0 +1,805 @@
+/*
+	DDSoftwareRenderer.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDSoftwareRenderer.h"
+#include "DDParallel.h"
+#include <string.h>
+#include <strings.h>
+#include <sys/param.h>
+
+#if defined(__SSE__)
+	#include <xmmintrin.h>
+	#define USE_SSE				1
+#else
+	#define USE_SSE				0
+#endif
+
+
+enum
+{
+	kTileSize				= 64,		// Pixels square; a multiple of four, so tile rows are whole quads
+	kVertexGranularity		= 4096,
+	kTriangleGranularity	= 1024
+};
+
+
+#define kNearPlane				0.2f		// As in DDSceneView
+#define kHalfFieldOfView		(22.5f * (float)M_PI / 180.0f)
+#define kMinimumArea			1e-6f		// Twice the screen area in square pixels below which triangles are dropped
+#define kLineDepthBias			0.002f		// Lets lines win against the faces they lie on, like glPolygonOffset() in the GL views
+
+// As in -[DDMesh glRenderWireframe].
+static const uint8_t kLineColour[3] = { 153, 153, 0 };
+
+
+// Value of a quantity varying linearly over the screen, at the centre of pixel (x, y): a * x + b * y + c.
+typedef struct Plane
+{
+	float					a, b, c;
+} Plane;
+
+
+// Inclusive pixel bounds, within the image. Empty if minX > maxX.
+typedef struct PixelBounds
+{
+	int						minX, minY, maxX, maxY;
+} PixelBounds;
+
+
+typedef struct ScreenVertex
+{
+	float					x, y;
+	float					iw;				// 1 / eye depth, or 0 in front of the near plane
+} ScreenVertex;
+
+
+typedef struct TriangleSetup
+{
+	PixelBounds				bounds;			// Must be first; see BinItems()
+	Plane					edges[3];		// Non-negative inside
+	Plane					iw, uw, vw;		// 1 / w and the texture co-ordinates over w, for perspective correction
+	const DDSoftwareTexture	*texture;		// NULL if untextured
+	unsigned				shade;			// Brightness, 0 to 256
+} TriangleSetup;
+
+
+typedef struct LineSetup
+{
+	PixelBounds				bounds;			// Must be first
+	ScreenVertex			ends[2];
+} LineSetup;
+
+
+typedef struct RenderContext
+{
+	const DDSoftwareRenderMesh *mesh;
+	Matrix					rotation;
+	Scalar					distance;
+	Vector					light;
+	unsigned				width, height;
+	unsigned				tilesX, tilesY;
+	float					xScale, yScale;
+	
+	ScreenVertex			*vertices;
+	TriangleSetup			*triangles;
+	LineSetup				*lines;
+	uint32_t				*triangleBinStarts, *triangleBins;
+	uint32_t				*lineBinStarts, *lineBins;
+	float					*depthTiles;	// One tile of 1 / w per worker; 0 is infinitely far
+	uint8_t					*pixels;
+} RenderContext;
+
+
+#if USE_SSE
+
+typedef __m128 Quad;
+
+static inline Quad QuadRamp(float inBase, float inStep)
+{
+	return _mm_add_ps(_mm_set1_ps(inBase), _mm_mul_ps(_mm_set1_ps(inStep), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)));
+}
+
+static inline Quad QuadSplat(float inValue)					{ return _mm_set1_ps(inValue); }
+static inline Quad QuadAdd(Quad inA, Quad inB)				{ return _mm_add_ps(inA, inB); }
+static inline Quad QuadLoad(const float *inValues)			{ return _mm_loadu_ps(inValues); }
+static inline void QuadStore(float *outValues, Quad inQuad)	{ _mm_storeu_ps(outValues, inQuad); }
+
+// Bit n is set if lane n of every edge is non-negative and lane n of inW is nearer than inDepth.
+static inline unsigned QuadCoverage(Quad inE0, Quad inE1, Quad inE2, Quad inW, Quad inDepth)
+{
+	Quad					zero = _mm_setzero_ps();
+	Quad					inside;
+	
+	inside = _mm_and_ps(_mm_cmpge_ps(inE0, zero), _mm_cmpge_ps(inE1, zero));
+	inside = _mm_and_ps(inside, _mm_cmpge_ps(inE2, zero));
+	return _mm_movemask_ps(_mm_and_ps(inside, _mm_cmpgt_ps(inW, inDepth)));
+}
+
+#else
+
+typedef struct Quad
+{
+	float					v[4];
+} Quad;
+
+static inline Quad QuadRamp(float inBase, float inStep)
+{
+	Quad result = {{ inBase, inBase + inStep, inBase + 2.0f * inStep, inBase + 3.0f * inStep }};
+	return result;
+}
+
+static inline Quad QuadSplat(float inValue)
+{
+	Quad result = {{ inValue, inValue, inValue, inValue }};
+	return result;
+}
+
+static inline Quad QuadAdd(Quad inA, Quad inB)
+{
+	Quad result = {{ inA.v[0] + inB.v[0], inA.v[1] + inB.v[1], inA.v[2] + inB.v[2], inA.v[3] + inB.v[3] }};
+	return result;
+}
+
+static inline Quad QuadLoad(const float *inValues)
+{
+	Quad result = {{ inValues[0], inValues[1], inValues[2], inValues[3] }};
+	return result;
+}
+
+static inline void QuadStore(float *outValues, Quad inQuad)
+{
+	memcpy(outValues, inQuad.v, sizeof inQuad.v);
+}
+
+static inline unsigned QuadCoverage(Quad inE0, Quad inE1, Quad inE2, Quad inW, Quad inDepth)
+{
+	unsigned				i, result = 0;
+	
+	for (i = 0; i != 4; ++i)
+	{
+		if (0.0f <= inE0.v[i] && 0.0f <= inE1.v[i] && 0.0f <= inE2.v[i] && inDepth.v[i] < inW.v[i])  result |= 1 << i;
+	}
+	return result;
+}
+
+#endif
+
+
+static void Apply(bool inParallel, size_t inCount, size_t inGranularity, DDParallelApplyFunction inFunction, void *inContext);
+
+static void ProjectVertices(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+static void SetUpTriangles(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+static void SetUpLines(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+static uint32_t *BinItems(const RenderContext *inContext, const void *inItems, size_t inStride, uint32_t inCount, uint32_t *outStarts);
+static void DrawTiles(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+
+static void DrawTriangle(const RenderContext *inContext, const TriangleSetup *inTriangle, const PixelBounds &inTile, float *ioDepth);
+static void DrawLine(const RenderContext *inContext, const LineSetup *inLine, const PixelBounds &inTile, const float *inDepth);
+
+static inline bool IsEmpty(const PixelBounds &inBounds)		{ return inBounds.maxX < inBounds.minX; }
+static PixelBounds ScreenBounds(const RenderContext *inContext, const ScreenVertex *inVertices[], unsigned inCount);
+static Plane EdgePlane(const ScreenVertex &inFrom, const ScreenVertex &inTo);
+static Plane AttributePlane(const ScreenVertex &inA, const ScreenVertex &inB, const ScreenVertex &inC, float inValA, float inValB, float inValC, float inInverseArea);
+static inline float Evaluate(const Plane &inPlane, float inX, float inY)	{ return inPlane.a * inX + inPlane.b * inY + inPlane.c; }
+static inline void SampleTexture(const DDSoftwareTexture *inTexture, float inU, float inV, unsigned outRGB[3]);
+
+
+Vector DDLightDirection(float inElevation, float inAzimuth)
+{
+	float					phi, theta, sphi;
+	
+	phi = inElevation * (float)M_PI / 180.0f;
+	theta = inAzimuth * (float)M_PI / 180.0f;
+	sphi = sinf(phi);
+	
+	return Vector(sphi * cosf(theta), cosf(phi), sphi * sinf(theta));
+}
+
+
+DDSoftwareRenderer::DDSoftwareRenderer(unsigned inWidth, unsigned inHeight)
+	: _pixels(NULL), _width(inWidth), _height(inHeight), _distance(1), _light(DDLightDirection(kDDDefaultLightElevation, kDDDefaultLightAzimuth)), _parallel(true)
+{
+	if (0 != inWidth && 0 != inHeight && inWidth <= 16384 && inHeight <= 16384)
+	{
+		_pixels = (uint8_t *)malloc((size_t)inWidth * inHeight * 4);
+	}
+}
+
+
+DDSoftwareRenderer::~DDSoftwareRenderer()
+{
+	free(_pixels);
+}
+
+
+void DDSoftwareRenderer::SetView(const Matrix &inRotation, Scalar inDistance)
+{
+	_rotation = inRotation;
+	_distance = inDistance;
+}
+
+
+void DDSoftwareRenderer::SetLightDirection(const Vector &inDirection)
+{
+	_light = inDirection;
+	_light.Normalize();
+}
+
+
+bool DDSoftwareRenderer::Render(const DDSoftwareRenderMesh &inMesh, uint32_t *outDrawnCount)
+{
+	RenderContext			context;
+	unsigned				workerCount;
+	uint32_t				i, lineCount, drawn = 0;
+	bool					OK = true;
+	
+	if (NULL != outDrawnCount)  *outDrawnCount = 0;
+	if (NULL == _pixels)  return false;
+	
+	bzero(&context, sizeof context);
+	context.mesh = &inMesh;
+	context.rotation = _rotation;
+	context.distance = _distance;
+	context.light = _light;
+	context.width = _width;
+	context.height = _height;
+	context.tilesX = (_width + kTileSize - 1) / kTileSize;
+	context.tilesY = (_height + kTileSize - 1) / kTileSize;
+	context.yScale = 1.0f / tanf(kHalfFieldOfView);
+	context.xScale = context.yScale * _height / _width;
+	context.pixels = _pixels;
+	
+	workerCount = _parallel ? DDParallelWorkerCount() : 1;
+	lineCount = (NULL != inMesh.lines) ? inMesh.lineCount : 0;
+	
+	// Counts are padded by one so that empty meshes don't look like allocation failures.
+	context.vertices = (ScreenVertex *)malloc(sizeof *context.vertices * (inMesh.vertexCount + 1));
+	context.triangles = (TriangleSetup *)malloc(sizeof *context.triangles * (inMesh.triangleCount + 1));
+	context.lines = (LineSetup *)malloc(sizeof *context.lines * (lineCount + 1));
+	context.triangleBinStarts = (uint32_t *)malloc(sizeof *context.triangleBinStarts * (context.tilesX * context.tilesY + 1));
+	context.lineBinStarts = (uint32_t *)malloc(sizeof *context.lineBinStarts * (context.tilesX * context.tilesY + 1));
+	context.depthTiles = (float *)malloc(sizeof *context.depthTiles * kTileSize * kTileSize * workerCount);
+	
+	OK = NULL != context.vertices && NULL != context.triangles && NULL != context.lines &&
+		 NULL != context.triangleBinStarts && NULL != context.lineBinStarts && NULL != context.depthTiles;
+	
+	if (OK)
+	{
+		Apply(_parallel, inMesh.vertexCount, kVertexGranularity, ProjectVertices, &context);
+		Apply(_parallel, inMesh.triangleCount, kTriangleGranularity, SetUpTriangles, &context);
+		Apply(_parallel, lineCount, kTriangleGranularity, SetUpLines, &context);
+		
+		// Binning preserves submission order within each tile, so the result doesn't depend on the number of threads.
+		context.triangleBins = BinItems(&context, context.triangles, sizeof *context.triangles, inMesh.triangleCount, context.triangleBinStarts);
+		context.lineBins = BinItems(&context, context.lines, sizeof *context.lines, lineCount, context.lineBinStarts);
+		OK = NULL != context.triangleBins && NULL != context.lineBins;
+	}
+	
+	if (OK)
+	{
+		Apply(_parallel, context.tilesX * context.tilesY, 1, DrawTiles, &context);
+		
+		for (i = 0; i != inMesh.triangleCount; ++i)
+		{
+			if (!IsEmpty(context.triangles[i].bounds))  ++drawn;
+		}
+		if (NULL != outDrawnCount)  *outDrawnCount = drawn;
+	}
+	
+	free(context.vertices);
+	free(context.triangles);
+	free(context.lines);
+	free(context.triangleBinStarts);
+	free(context.triangleBins);
+	free(context.lineBinStarts);
+	free(context.lineBins);
+	free(context.depthTiles);
+	
+	return OK;
+}
+
+
+static void Apply(bool inParallel, size_t inCount, size_t inGranularity, DDParallelApplyFunction inFunction, void *inContext)
+{
+	if (inParallel)  DDParallelApply(inCount, inGranularity, inFunction, inContext);
+	else if (0 != inCount)  inFunction(inContext, 0, inCount, 0);
+}
+
+
+static void ProjectVertices(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	RenderContext			*context = (RenderContext *)inContext;
+	const Matrix			&m = context->rotation;
+	const Vector			*v;
+	ScreenVertex			*out;
+	float					x, y, depth, iw;
+	size_t					i;
+	
+	for (i = inStart; i != inEnd; ++i)
+	{
+		v = &context->mesh->vertices[i];
+		out = &context->vertices[i];
+		
+		// Row vector times matrix, as OpenGL applies a Matrix loaded with glMult().
+		x = v->x * m.m[0][0] + v->y * m.m[1][0] + v->z * m.m[2][0];
+		y = v->x * m.m[0][1] + v->y * m.m[1][1] + v->z * m.m[2][1];
+		depth = context->distance - (v->x * m.m[0][2] + v->y * m.m[1][2] + v->z * m.m[2][2]);
+		
+		if (depth < kNearPlane)
+		{
+			out->x = out->y = out->iw = 0.0f;
+			continue;
+		}
+		
+		iw = 1.0f / depth;
+		out->x = (1.0f + context->xScale * x * iw) * 0.5f * context->width;
+		out->y = (1.0f - context->yScale * y * iw) * 0.5f * context->height;
+		out->iw = iw;
+	}
+}
+
+
+static void SetUpTriangles(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	RenderContext			*context = (RenderContext *)inContext;
+	const DDSoftwareRenderMesh *mesh = context->mesh;
+	TriangleSetup			*t;
+	const uint32_t			*indices;
+	const ScreenVertex		*corners[3], *swapVertex;
+	const Vector2			*uv[3], *swapUV;
+	const DDSoftwareTexture	*texture;
+	uint32_t				textureIndex;
+	float					area, inverseArea, brightness;
+	Vector					normal;
+	Scalar					lambert;
+	size_t					i;
+	unsigned				j;
+	
+	for (i = inStart; i != inEnd; ++i)
+	{
+		t = &context->triangles[i];
+		t->bounds.minX = 1;
+		t->bounds.maxX = 0;
+		
+		indices = &mesh->indices[i * 3];
+		if (mesh->vertexCount <= indices[0] || mesh->vertexCount <= indices[1] || mesh->vertexCount <= indices[2])  continue;
+		
+		for (j = 0; j != 3; ++j)
+		{
+			corners[j] = &context->vertices[indices[j]];
+			uv[j] = (NULL != mesh->texCoords) ? &mesh->texCoords[i * 3 + j] : NULL;
+		}
+		if (0.0f == corners[0]->iw || 0.0f == corners[1]->iw || 0.0f == corners[2]->iw)  continue;
+		
+		area = (corners[1]->x - corners[0]->x) * (corners[2]->y - corners[0]->y) - (corners[2]->x - corners[0]->x) * (corners[1]->y - corners[0]->y);
+		if (fabsf(area) < kMinimumArea)  continue;
+		if (area < 0.0f)
+		{
+			// Faces are drawn whichever way they face; make the edge functions positive inside.
+			swapVertex = corners[1]; corners[1] = corners[2]; corners[2] = swapVertex;
+			swapUV = uv[1]; uv[1] = uv[2]; uv[2] = swapUV;
+			area = -area;
+		}
+		inverseArea = 1.0f / area;
+		
+		t->bounds = ScreenBounds(context, corners, 3);
+		if (IsEmpty(t->bounds))  continue;
+		
+		t->edges[0] = EdgePlane(*corners[0], *corners[1]);
+		t->edges[1] = EdgePlane(*corners[1], *corners[2]);
+		t->edges[2] = EdgePlane(*corners[2], *corners[0]);
+		t->iw = AttributePlane(*corners[0], *corners[1], *corners[2], corners[0]->iw, corners[1]->iw, corners[2]->iw, inverseArea);
+		
+		texture = NULL;
+		textureIndex = (NULL != mesh->textureIndices) ? mesh->textureIndices[i] : 0;
+		if (NULL != uv[0] && textureIndex < mesh->textureCount && NULL != mesh->textures[textureIndex].texels)
+		{
+			texture = &mesh->textures[textureIndex];
+			t->uw = AttributePlane(*corners[0], *corners[1], *corners[2], uv[0]->x * corners[0]->iw, uv[1]->x * corners[1]->iw, uv[2]->x * corners[2]->iw, inverseArea);
+			t->vw = AttributePlane(*corners[0], *corners[1], *corners[2], uv[0]->y * corners[0]->iw, uv[1]->y * corners[1]->iw, uv[2]->y * corners[2]->iw, inverseArea);
+		}
+		t->texture = texture;
+		
+		// Normals are rotated into eye space, where the lights are.
+		normal = mesh->normals[i];
+		normal = Vector(normal.x * context->rotation.m[0][0] + normal.y * context->rotation.m[1][0] + normal.z * context->rotation.m[2][0],
+						normal.x * context->rotation.m[0][1] + normal.y * context->rotation.m[1][1] + normal.z * context->rotation.m[2][1],
+						normal.x * context->rotation.m[0][2] + normal.y * context->rotation.m[1][2] + normal.z * context->rotation.m[2][2]);
+		if (0 != normal.SquareMagnitude())  normal.Normalize();
+		lambert = normal * context->light;
+		
+		brightness = kDDAmbientLightIntensity + kDDKeyLightIntensity * fmaxf(lambert, 0.0f) + kDDFillLightIntensity * fmaxf(-lambert, 0.0f);
+		if (1.0f < brightness)  brightness = 1.0f;
+		t->shade = (unsigned)(brightness * 256.0f + 0.5f);
+	}
+}
+
+
+static void SetUpLines(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	RenderContext			*context = (RenderContext *)inContext;
+	const DDSoftwareRenderMesh *mesh = context->mesh;
+	LineSetup				*line;
+	const ScreenVertex		*ends[2];
+	uint32_t				a, b;
+	size_t					i;
+	
+	for (i = inStart; i != inEnd; ++i)
+	{
+		line = &context->lines[i];
+		line->bounds.minX = 1;
+		line->bounds.maxX = 0;
+		
+		a = mesh->lines[i * 2];
+		b = mesh->lines[i * 2 + 1];
+		if (mesh->vertexCount <= a || mesh->vertexCount <= b)  continue;
+		
+		ends[0] = &context->vertices[a];
+		ends[1] = &context->vertices[b];
+		if (0.0f == ends[0]->iw || 0.0f == ends[1]->iw)  continue;
+		
+		line->ends[0] = *ends[0];
+		line->ends[1] = *ends[1];
+		line->bounds = ScreenBounds(context, ends, 2);
+	}
+}
+
+
+/*	Sort items into the tiles their bounds touch. Tile n's items are
+	result[outStarts[n]] to result[outStarts[n + 1] - 1], in submission order.
+	Items start with their PixelBounds.
+*/
+static uint32_t *BinItems(const RenderContext *inContext, const void *inItems, size_t inStride, uint32_t inCount, uint32_t *outStarts)
+{
+	const PixelBounds		*bounds;
+	uint32_t				*result, *cursors;
+	uint32_t				i, total = 0, count;
+	unsigned				tileCount, tx, ty;
+	
+	tileCount = inContext->tilesX * inContext->tilesY;
+	bzero(outStarts, sizeof *outStarts * (tileCount + 1));
+	
+	// Count into outStarts[tile + 1], then accumulate.
+	for (i = 0; i != inCount; ++i)
+	{
+		bounds = (const PixelBounds *)((const char *)inItems + i * inStride);
+		if (IsEmpty(*bounds))  continue;
+		
+		for (ty = bounds->minY / kTileSize; ty <= (unsigned)bounds->maxY / kTileSize; ++ty)
+		{
+			for (tx = bounds->minX / kTileSize; tx <= (unsigned)bounds->maxX / kTileSize; ++tx)
+			{
+				outStarts[ty * inContext->tilesX + tx + 1]++;
+			}
+		}
+	}
+	for (i = 0; i != tileCount; ++i)
+	{
+		count = outStarts[i + 1];
+		outStarts[i + 1] = outStarts[i] + count;
+	}
+	total = outStarts[tileCount];
+	
+	result = (uint32_t *)malloc(sizeof *result * (total + 1));
+	cursors = (uint32_t *)malloc(sizeof *cursors * tileCount);
+	if (NULL == result || NULL == cursors)
+	{
+		free(result);
+		free(cursors);
+		return NULL;
+	}
+	memcpy(cursors, outStarts, sizeof *cursors * tileCount);
+	
+	for (i = 0; i != inCount; ++i)
+	{
+		bounds = (const PixelBounds *)((const char *)inItems + i * inStride);
+		if (IsEmpty(*bounds))  continue;
+		
+		for (ty = bounds->minY / kTileSize; ty <= (unsigned)bounds->maxY / kTileSize; ++ty)
+		{
+			for (tx = bounds->minX / kTileSize; tx <= (unsigned)bounds->maxX / kTileSize; ++tx)
+			{
+				result[cursors[ty * inContext->tilesX + tx]++] = i;
+			}
+		}
+	}
+	
+	free(cursors);
+	return result;
+}
+
+
+static void DrawTiles(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	RenderContext			*context = (RenderContext *)inContext;
+	float					*depth;
+	PixelBounds				tile;
+	size_t					i;
+	uint32_t				j;
+	int						y;
+	
+	depth = context->depthTiles + inWorker * kTileSize * kTileSize;
+	
+	for (i = inStart; i != inEnd; ++i)
+	{
+		tile.minX = (i % context->tilesX) * kTileSize;
+		tile.minY = (i / context->tilesX) * kTileSize;
+		tile.maxX = MIN(tile.minX + kTileSize, (int)context->width) - 1;
+		tile.maxY = MIN(tile.minY + kTileSize, (int)context->height) - 1;
+		
+		for (y = tile.minY; y <= tile.maxY; ++y)
+		{
+			bzero(context->pixels + ((size_t)y * context->width + tile.minX) * 4, (tile.maxX - tile.minX + 1) * 4);
+		}
+		bzero(depth, sizeof *depth * kTileSize * kTileSize);
+		
+		for (j = context->triangleBinStarts[i]; j != context->triangleBinStarts[i + 1]; ++j)
+		{
+			DrawTriangle(context, &context->triangles[context->triangleBins[j]], tile, depth);
+		}
+		for (j = context->lineBinStarts[i]; j != context->lineBinStarts[i + 1]; ++j)
+		{
+			DrawLine(context, &context->lines[context->lineBins[j]], tile, depth);
+		}
+	}
+}
+
+
+/*	ioDepth is the tile's depth buffer, kTileSize floats per row. Pixels are
+	tested four at a time; the first quad of each row is aligned to the
+	tile, so quads never straddle tiles.
+*/
+static void DrawTriangle(const RenderContext *inContext, const TriangleSetup *inTriangle, const PixelBounds &inTile, float *ioDepth)
+{
+	int						x, y, minX, maxX, minY, maxY;
+	unsigned				mask, lane, shade, rgb[3];
+	Quad					e0, e1, e2, iw, e0Step, e1Step, e2Step, iwStep;
+	float					*depthRow, w[4], px;
+	uint8_t					*pixel;
+	const Plane				*edges = inTriangle->edges;
+	
+	minX = MAX(inTriangle->bounds.minX, inTile.minX);
+	maxX = MIN(inTriangle->bounds.maxX, inTile.maxX);
+	minY = MAX(inTriangle->bounds.minY, inTile.minY);
+	maxY = MIN(inTriangle->bounds.maxY, inTile.maxY);
+	if (maxX < minX || maxY < minY)  return;
+	minX = inTile.minX + ((minX - inTile.minX) & ~3);
+	
+	e0Step = QuadSplat(edges[0].a * 4.0f);
+	e1Step = QuadSplat(edges[1].a * 4.0f);
+	e2Step = QuadSplat(edges[2].a * 4.0f);
+	iwStep = QuadSplat(inTriangle->iw.a * 4.0f);
+	shade = inTriangle->shade;
+	rgb[0] = rgb[1] = rgb[2] = 255;
+	
+	for (y = minY; y <= maxY; ++y)
+	{
+		e0 = QuadRamp(Evaluate(edges[0], minX, y), edges[0].a);
+		e1 = QuadRamp(Evaluate(edges[1], minX, y), edges[1].a);
+		e2 = QuadRamp(Evaluate(edges[2], minX, y), edges[2].a);
+		iw = QuadRamp(Evaluate(inTriangle->iw, minX, y), inTriangle->iw.a);
+		depthRow = ioDepth + (y - inTile.minY) * kTileSize - inTile.minX;
+		
+		for (x = minX; x <= maxX; x += 4)
+		{
+			mask = QuadCoverage(e0, e1, e2, iw, QuadLoad(depthRow + x));
+			if (inTile.maxX < x + 3)  mask &= (1 << (inTile.maxX - x + 1)) - 1;
+			
+			if (0 != mask)
+			{
+				QuadStore(w, iw);
+				for (lane = 0; lane != 4; ++lane)
+				{
+					if (!(mask & (1 << lane)))  continue;
+					
+					depthRow[x + lane] = w[lane];
+					if (NULL != inTriangle->texture)
+					{
+						px = x + lane;
+						SampleTexture(inTriangle->texture, Evaluate(inTriangle->uw, px, y) / w[lane], Evaluate(inTriangle->vw, px, y) / w[lane], rgb);
+					}
+					
+					pixel = inContext->pixels + ((size_t)y * inContext->width + x + lane) * 4;
+					pixel[0] = (rgb[0] * shade) >> 8;
+					pixel[1] = (rgb[1] * shade) >> 8;
+					pixel[2] = (rgb[2] * shade) >> 8;
+					pixel[3] = 255;
+				}
+			}
+			
+			e0 = QuadAdd(e0, e0Step);
+			e1 = QuadAdd(e1, e1Step);
+			e2 = QuadAdd(e2, e2Step);
+			iw = QuadAdd(iw, iwStep);
+		}
+	}
+}
+
+
+// Clip the parameter range [ioStart, ioEnd] of a line to inP * t <= inQ. Returns false if nothing is left.
+static inline bool ClipLineRange(float inP, float inQ, float &ioStart, float &ioEnd)
+{
+	float					t;
+	
+	if (0.0f == inP)  return 0.0f <= inQ;
+	
+	t = inQ / inP;
+	if (inP < 0.0f)
+	{
+		if (ioEnd < t)  return false;
+		if (ioStart < t)  ioStart = t;
+	}
+	else
+	{
+		if (t < ioStart)  return false;
+		if (t < ioEnd)  ioEnd = t;
+	}
+	return true;
+}
+
+
+// One-pixel DDA line, depth tested against the faces but not written to the depth buffer.
+static void DrawLine(const RenderContext *inContext, const LineSetup *inLine, const PixelBounds &inTile, const float *inDepth)
+{
+	const ScreenVertex		&a = inLine->ends[0], &b = inLine->ends[1];
+	float					dx, dy, start = 0.0f, end = 1.0f, t, iw;
+	int						steps, i, last, x, y;
+	uint8_t					*pixel;
+	
+	dx = b.x - a.x;
+	dy = b.y - a.y;
+	steps = (int)ceilf(fmaxf(fabsf(dx), fabsf(dy)));
+	if (steps < 1)  steps = 1;
+	
+	// Only walk the part of the line inside this tile.
+	if (!ClipLineRange(-dx, a.x - inTile.minX, start, end) ||
+		!ClipLineRange(dx, inTile.maxX + 1 - a.x, start, end) ||
+		!ClipLineRange(-dy, a.y - inTile.minY, start, end) ||
+		!ClipLineRange(dy, inTile.maxY + 1 - a.y, start, end))
+	{
+		return;
+	}
+	
+	last = (int)ceilf(end * steps);
+	for (i = (int)floorf(start * steps); i <= last; ++i)
+	{
+		t = (float)i / steps;
+		x = (int)floorf(a.x + t * dx);
+		y = (int)floorf(a.y + t * dy);
+		if (x < inTile.minX || inTile.maxX < x || y < inTile.minY || inTile.maxY < y)  continue;
+		
+		// 1 / w, unlike w, is linear in screen space.
+		iw = a.iw + t * (b.iw - a.iw);
+		if (iw * (1.0f + kLineDepthBias) < inDepth[(y - inTile.minY) * kTileSize + x - inTile.minX])  continue;
+		
+		pixel = inContext->pixels + ((size_t)y * inContext->width + x) * 4;
+		pixel[0] = kLineColour[0];
+		pixel[1] = kLineColour[1];
+		pixel[2] = kLineColour[2];
+		pixel[3] = 255;
+	}
+}
+
+
+static PixelBounds ScreenBounds(const RenderContext *inContext, const ScreenVertex *inVertices[], unsigned inCount)
+{
+	PixelBounds				result;
+	float					minX, minY, maxX, maxY;
+	unsigned				i;
+	
+	minX = maxX = inVertices[0]->x;
+	minY = maxY = inVertices[0]->y;
+	for (i = 1; i != inCount; ++i)
+	{
+		minX = fminf(minX, inVertices[i]->x);
+		maxX = fmaxf(maxX, inVertices[i]->x);
+		minY = fminf(minY, inVertices[i]->y);
+		maxY = fmaxf(maxY, inVertices[i]->y);
+	}
+	
+	// Clamp before converting to int, since off-screen vertices may be arbitrarily far away.
+	result.minX = (int)floorf(fmaxf(minX, 0.0f));
+	result.minY = (int)floorf(fmaxf(minY, 0.0f));
+	result.maxX = (int)fminf(ceilf(maxX), inContext->width - 1.0f);
+	result.maxY = (int)fminf(ceilf(maxY), inContext->height - 1.0f);
+	
+	if ((float)inContext->width <= minX || maxX < 0.0f || (float)inContext->height <= minY || maxY < 0.0f || result.maxY < result.minY)
+	{
+		result.minX = 1;
+		result.maxX = 0;
+	}
+	
+	return result;
+}
+
+
+// Edge function which is positive on the left of inFrom -> inTo (in screen space, with y down).
+static Plane EdgePlane(const ScreenVertex &inFrom, const ScreenVertex &inTo)
+{
+	Plane					result;
+	
+	result.a = inFrom.y - inTo.y;
+	result.b = inTo.x - inFrom.x;
+	result.c = -(result.a * inFrom.x + result.b * inFrom.y);
+	
+	// Sample at pixel centres.
+	result.c += 0.5f * (result.a + result.b);
+	return result;
+}
+
+
+static Plane AttributePlane(const ScreenVertex &inA, const ScreenVertex &inB, const ScreenVertex &inC, float inValA, float inValB, float inValC, float inInverseArea)
+{
+	Plane					result;
+	float					dx1, dy1, dx2, dy2, dv1, dv2;
+	
+	dx1 = inB.x - inA.x;
+	dy1 = inB.y - inA.y;
+	dx2 = inC.x - inA.x;
+	dy2 = inC.y - inA.y;
+	dv1 = inValB - inValA;
+	dv2 = inValC - inValA;
+	
+	result.a = (dv1 * dy2 - dv2 * dy1) * inInverseArea;
+	result.b = (dv2 * dx1 - dv1 * dx2) * inInverseArea;
+	result.c = inValA - result.a * inA.x - result.b * inA.y;
+	
+	result.c += 0.5f * (result.a + result.b);
+	return result;
+}
+
+
+// Bilinear, clamped to the edges, as the GL views draw textures.
+static inline void SampleTexture(const DDSoftwareTexture *inTexture, float inU, float inV, unsigned outRGB[3])
+{
+	float					fx, fy;
+	int						x0, y0, x1, y1;
+	unsigned				wx, wy, top, bottom, c;
+	const uint8_t			*row0, *row1;
+	
+	fx = inU * inTexture->width - 0.5f;
+	fy = inV * inTexture->height - 0.5f;
+	
+	// Written so that NaNs clamp too.
+	if (!(0.0f < fx))  fx = 0.0f;
+	if (!(0.0f < fy))  fy = 0.0f;
+	if (inTexture->width - 1.0f < fx)  fx = inTexture->width - 1.0f;
+	if (inTexture->height - 1.0f < fy)  fy = inTexture->height - 1.0f;
+	
+	x0 = (int)fx;
+	y0 = (int)fy;
+	x1 = MIN(x0 + 1, (int)inTexture->width - 1);
+	y1 = MIN(y0 + 1, (int)inTexture->height - 1);
+	wx = (unsigned)((fx - x0) * 256.0f);
+	wy = (unsigned)((fy - y0) * 256.0f);
+	
+	row0 = inTexture->texels + (size_t)y0 * inTexture->width * 4;
+	row1 = inTexture->texels + (size_t)y1 * inTexture->width * 4;
+	
+	for (c = 0; c != 3; ++c)
+	{
+		top = row0[x0 * 4 + c] * (256 - wx) + row0[x1 * 4 + c] * wx;
+		bottom = row1[x0 * 4 + c] * (256 - wx) + row1[x1 * 4 + c] * wx;
+		outRGB[c] = (top * (256 - wy) + bottom * wy) >> 16;
+	}
+}
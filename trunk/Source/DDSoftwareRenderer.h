@@ -0,0 +1,120 @@
+/*
+	DDSoftwareRenderer.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Rasteriser for drawing meshes into memory without OpenGL, for previews
+	where there is no window server. The image is divided into tiles; triangles
+	are sorted into the tiles they touch, then the tiles are drawn in parallel.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDSOFTWARERENDERER_h
+#define INCLUDED_DDSOFTWARERENDERER_h
+
+#include "phystypes.h"
+
+
+/*	Lighting, shared with DDLightController: a key light and a dim fill light
+	opposite it, both directional and fixed relative to the camera, plus
+	ambient light. Materials are white, so a face's brightness is
+	ambient + key * max(0, n·l) + fill * max(0, -n·l), clamped to 1.
+*/
+#define kDDKeyLightIntensity			0.8f
+#define kDDFillLightIntensity			0.1f
+#define kDDAmbientLightIntensity		0.1f
+
+#define kDDDefaultLightElevation		-60.0f
+#define kDDDefaultLightAzimuth			-80.0f
+
+// Unit vector towards the key light in eye space, for angles in degrees.
+Vector DDLightDirection(float inElevation, float inAzimuth);
+
+
+// 8-bit RGBX texels, top row first, as from DDReadImageFromURL().
+typedef struct DDSoftwareTexture
+{
+	const uint8_t			*texels;		// NULL for an untextured (white) material
+	unsigned				width, height;
+} DDSoftwareTexture;
+
+
+typedef struct DDSoftwareRenderMesh
+{
+	const Vector			*vertices;
+	uint32_t				vertexCount;
+	
+	const uint32_t			*indices;		// Three vertex indices per triangle
+	const Vector			*normals;		// One per triangle
+	const Vector2			*texCoords;		// Three per triangle
+	const uint32_t			*textureIndices;	// One per triangle, into textures
+	uint32_t				triangleCount;
+	
+	const DDSoftwareTexture	*textures;
+	uint32_t				textureCount;
+	
+	const uint32_t			*lines;			// Two vertex indices per wireframe line; may be NULL
+	uint32_t				lineCount;
+} DDSoftwareRenderMesh;
+
+
+class DDSoftwareRenderer
+{
+public:
+							DDSoftwareRenderer(unsigned inWidth, unsigned inHeight);
+							~DDSoftwareRenderer();
+	
+	bool					IsValid(void) const			{ return _pixels != NULL; }
+	unsigned				Width(void) const			{ return _width; }
+	unsigned				Height(void) const			{ return _height; }
+	
+	/*	inRotation takes the mesh to eye space as with Matrix::glMult() (only
+		its rotation is used), and the eye is inDistance from the origin,
+		looking down -z with a 45° vertical field of view as in DDSceneView.
+	*/
+	void					SetView(const Matrix &inRotation, Scalar inDistance);
+	void					SetLightDirection(const Vector &inDirection);
+	
+	// Use DDParallelApply() for each stage (the default), or only the calling thread.
+	void					SetParallel(bool inParallel)	{ _parallel = inParallel; }
+	
+	/*	Clear to black and draw inMesh, with its lines over the faces. Faces are
+		flat shaded, drawn whichever way they face, and textured with bilinear filtering. Triangles
+		crossing the near plane are dropped rather than clipped. Returns false
+		if memory runs out; outDrawnCount, if not NULL, receives the number of
+		triangles which survived culling.
+	*/
+	bool					Render(const DDSoftwareRenderMesh &inMesh, uint32_t *outDrawnCount);
+	
+	const uint8_t			*Pixels(void) const			{ return _pixels; }	// RGBX, top row first
+	
+private:
+	uint8_t					*_pixels;
+	unsigned				_width, _height;
+	Matrix					_rotation;
+	Scalar					_distance;
+	Vector					_light;
+	bool					_parallel;
+	
+	// Not copyable.
+							DDSoftwareRenderer(const DDSoftwareRenderer &);
+	DDSoftwareRenderer		&operator=(const DDSoftwareRenderer &);
+};
+
+#endif	/* INCLUDED_DDSOFTWARERENDERER_h */
@@ -0,0 +1,51 @@
+/*
+	DDStreamingTranscoder.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Convert between Oolite DAT and WaveFront OBJ without building a mesh, using memory
+	bounded by buffer sizes rather than model size.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import <Foundation/Foundation.h>
+
+@class DDProblemReportManager;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*	Each section of the output is written while the corresponding section of
+	the input is read. Where the target format orders data differently (DAT
+	faces come before texture co-ordinates; OBJ groups faces by material) the
+	pending part is spilled to temporary files and appended at the end. The
+	DAT and OBJ writers' problem checks are applied as the data goes past;
+	stop issues abort the conversion and remove anything written.
+	
+	OBJ to DAT reads the source twice: once to count, so the header and the
+	checks that depend on totals come first, and once to convert.
+*/
+BOOL DDStreamTranscodeOoliteDATToWaveFrontOBJ(NSURL *inSource, NSURL *inDestination, DDProblemReportManager *ioIssues);
+BOOL DDStreamTranscodeWaveFrontOBJToOoliteDAT(NSURL *inSource, NSURL *inDestination, DDProblemReportManager *ioIssues);
+
+#ifdef __cplusplus
+}
+#endif
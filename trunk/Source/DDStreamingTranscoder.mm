@@ -0,0 +1,1313 @@
+/*
+	DDStreamingTranscoder.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ENABLE_TRACE 0
+
+#import "DDStreamingTranscoder.h"
+#import "DDMesh.h"
+#import "DDDATLexer.h"
+#import "DDProblemReportManager.h"
+#import "CocoaExtensions.h"
+#import "DDUtilities.h"
+#import "Logging.h"
+#include <unistd.h>
+#include <limits.h>
+
+
+enum
+{
+	kStreamBufferSize			= 64 * 1024,	// stdio buffer for the output and for each spill file
+	kCopyBufferSize				= 16 * 1024,
+	kSpillBlockRecords			= 1024,
+	kSpillCacheBlocks			= 16,
+	kMaxLineLength				= 4096,
+	kMaxKeywordLength			= 32,
+	kDimensionsFieldWidth		= 64,			// Room left in the OBJ header for dimensions known only at the end
+	kPoolDrainInterval			= 256,
+	kWarningSupressThreshold	= 5,
+	kMaxSmoothingGroups			= 255
+};
+
+
+/*	Append-only array of fixed-size records kept in a temporary file, with a
+	small direct-mapped cache of blocks for random access. Faces mostly refer
+	to recently defined co-ordinates, so most lookups hit the cache.
+*/
+template <typename T>
+class SpillArray
+{
+public:
+	SpillArray() : _file(NULL), _cache(NULL), _count(0)
+	{
+		for (unsigned i = 0; i != kSpillCacheBlocks; ++i)
+		{
+			_tags[i] = UINT_MAX;
+			_filled[i] = 0;
+		}
+	}
+	
+	~SpillArray()
+	{
+		if (NULL != _file) fclose(_file);
+		free(_cache);
+	}
+	
+	BOOL Open(void)
+	{
+		_file = tmpfile();
+		_cache = (T *)malloc(sizeof (T) * kSpillBlockRecords * kSpillCacheBlocks);
+		if (NULL != _file) setvbuf(_file, NULL, _IOFBF, kStreamBufferSize);
+		return NULL != _file && NULL != _cache;
+	}
+	
+	unsigned Count(void) const
+	{
+		return _count;
+	}
+	
+	BOOL Append(const T &inRecord)
+	{
+		if (1 != fwrite(&inRecord, sizeof inRecord, 1, _file)) return NO;
+		++_count;
+		return YES;
+	}
+	
+	BOOL Get(unsigned inIndex, T &outRecord)
+	{
+		unsigned			block, slot, offset;
+		
+		if (_count <= inIndex) return NO;
+		
+		block = inIndex / kSpillBlockRecords;
+		slot = block % kSpillCacheBlocks;
+		offset = inIndex % kSpillBlockRecords;
+		
+		// A block read while it was still being appended to may be short.
+		if (_tags[slot] != block || _filled[slot] <= offset)
+		{
+			if (!Load(block, slot) || _filled[slot] <= offset) return NO;
+		}
+		
+		outRecord = _cache[slot * kSpillBlockRecords + offset];
+		return YES;
+	}
+	
+private:
+	FILE				*_file;
+	T					*_cache;
+	unsigned			_count;
+	unsigned			_tags[kSpillCacheBlocks];
+	unsigned			_filled[kSpillCacheBlocks];
+	
+	BOOL Load(unsigned inBlock, unsigned inSlot)
+	{
+		ssize_t				length;
+		
+		if (0 != fflush(_file)) return NO;
+		length = pread(fileno(_file), _cache + inSlot * kSpillBlockRecords, sizeof (T) * kSpillBlockRecords, (off_t)inBlock * kSpillBlockRecords * sizeof (T));
+		if (length < 0) return NO;
+		
+		_tags[inSlot] = inBlock;
+		_filled[inSlot] = length / sizeof (T);
+		return YES;
+	}
+	
+	SpillArray(const SpillArray &);
+	SpillArray &operator=(const SpillArray &);
+};
+
+
+// Header of a DAT face spilled while waiting for its TEXTURES line; followed by vertexCount uint32_t indices.
+typedef struct
+{
+	uint8_t					smoothingGroup;
+	uint8_t					vertexCount;
+} SpilledFace;
+
+
+// A material of the OBJ being written, and its faces so far.
+typedef struct
+{
+	FILE					*spill;
+	unsigned				faceCount;
+	uint8_t					activeSmoothingGroup;
+} OBJMaterialSpill;
+
+
+typedef struct
+{
+	const char				*cursor, *end;
+	unsigned				lineNumber;
+} OBJReader;
+
+
+typedef struct
+{
+	long					v, vt, vn;
+	BOOL					hasVT, hasVN;
+} OBJFaceVertex;
+
+
+// Totals and problems found by the first pass over an OBJ.
+typedef struct
+{
+	unsigned				vertexCount, faceCount, triangleCount;
+	BOOL					hasNonTriangles;
+	Vector					minimum, maximum;
+	NSMutableArray			*materials;			// Material names used by faces, in order of first use
+	NSMutableDictionary		*textureNames;		// Material name -> name written to TEXTURES
+} OBJSummary;
+
+
+static FILE *OpenSpill(DDProblemReportManager *ioIssues);
+static BOOL AppendSpill(FILE *ioFile, FILE *inSpill);
+static NSString *DateString(void);
+static void ReportWriteFailure(DDProblemReportManager *ioIssues);
+static void RemoveFile(NSURL *inURL);
+static NSString *StringFromCString(const char *inString);
+
+static BOOL OBJNextLine(OBJReader *ioReader, char outKeyword[kMaxKeywordLength], char outParams[kMaxLineLength], BOOL *outTruncated);
+static unsigned OBJParseFace(const char *inParams, OBJFaceVertex outVertices[kMaxVertsPerFace]);
+static void OBJParseNumbers(const char *inParams, float *outValues, unsigned inCount);
+static BOOL OBJSmoothingGroup(const char *inParams, NSMutableDictionary *ioGroups, uint8_t *outGroup);
+static BOOL OBJResolveIndex(long inIndex, unsigned inCount, unsigned *outIndex);
+static BOOL OBJScan(NSData *inData, NSURL *inSource, OBJSummary *outSummary, DDProblemReportManager *ioIssues);
+static void OBJReportBadIndex(DDProblemReportManager *ioIssues, unsigned *ioWarningCount, BOOL inNormal, unsigned inFace, long inIndex, unsigned inCount);
+
+
+BOOL DDStreamTranscodeOoliteDATToWaveFrontOBJ(NSURL *inSource, NSURL *inDestination, DDProblemReportManager *ioIssues)
+{
+	TraceEnterMsg(@"Called for %@", inSource);
+	
+	BOOL					OK = YES;
+	NSData					*data;
+	NSError					*error = nil;
+	DDDATLexer				*lexer = nil;
+	NSAutoreleasePool		*pool = nil;
+	FILE					*out = NULL, *faceSpill = NULL;
+	off_t					dimensionsOffset = 0;
+	unsigned				i, j, vertexCount = 0, faceCount = 0, faceVertexTotal = 0, texCoordIdx = 0;
+	unsigned				smoothingGroupID, smoothingGroupIDs[kMaxSmoothingGroups], smoothingGroupsUsed = 0, g, b, faceVertexCount;
+	uint8_t					activeSmoothingGroup = 0;
+	BOOL					flattenSmoothingGroups, readTextures = NO;
+	float					x, y, z, s, t, max_s, max_t;
+	Vector					minimum(INFINITY, INFINITY, INFINITY), maximum(-INFINITY, -INFINITY, -INFINITY);
+	uint32_t				indices[kMaxVertsPerFace];
+	SpilledFace				face;
+	NSString				*name, *mtlName, *tokString, *texFileName;
+	NSMutableArray			*materialNames = nil;
+	NSMutableDictionary		*materialIndices = nil;
+	NSNumber				*materialIndex;
+	OBJMaterialSpill		*materials = NULL, *material;
+	unsigned				materialCount = 0, nameCount, nameIndex;
+	NSMutableArray			*names;
+	char					dimensions[kDimensionsFieldWidth + 1];
+	NSMutableString			*mtlString;
+	
+	name = [inSource displayString];
+	if (NSOrderedSame == [[name substringFromIndex:[name length] - 4] caseInsensitiveCompare:@".dat"]) name = [name substringToIndex:[name length] - 4];
+	mtlName = [DDMesh objMaterialLibraryNameForURL:inDestination];
+	
+	// Mapped, so the source is paged in and out by the system rather than held in memory.
+	data = [NSData dataWithContentsOfURL:inSource options:NSMappedRead error:&error];
+	if (nil == data)
+	{
+		OK = NO;
+		[ioIssues addStopIssueWithKey:@"noReadFile" localizedFormat:@"The document could not be loaded, because an error occurred: %@", [error localizedDescription]];
+	}
+	if (OK)
+	{
+		lexer = [[[DDDATLexer alloc] initWithData:data issues:ioIssues] autorelease];
+		OK = (nil != lexer);
+	}
+	
+	if (OK)
+	{
+		OK = [lexer expectLiteral:"NVERTS"] && [lexer readInteger:&vertexCount] && [lexer expectLiteral:"NFACES"] && [lexer readInteger:&faceCount];
+		if (!OK) [ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], @"NVERTS and NFACES", [lexer currentTokenString]];
+	}
+	if (OK && (vertexCount < 3 || faceCount < 1))
+	{
+		OK = NO;
+		[ioIssues addStopIssueWithKey:@"insufficientParts" localizedFormat:@"The document is invalid; Oolite DAT documents must contain at least three vertices and one face."];
+	}
+	if (OK)
+	{
+		OK = [lexer expectLiteral:"VERTEX"];
+		if (!OK) [ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], @"VERTEX", [lexer currentTokenString]];
+	}
+	
+	if (OK)
+	{
+		out = fopen([[inDestination path] fileSystemRepresentation], "w");
+		if (NULL == out)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %s", strerror(errno)];
+		}
+		else
+		{
+			setvbuf(out, NULL, _IOFBF, kStreamBufferSize);
+		}
+	}
+	if (OK)
+	{
+		faceSpill = OpenSpill(ioIssues);
+		OK = (NULL != faceSpill);
+	}
+	
+	// Header. The dimensions aren't known until the vertices have been read, so space is left for them.
+	if (OK)
+	{
+		fprintf(out, "# Written by %s on %s\n# \n# Model dimensions: ", [ApplicationNameAndVersionString() UTF8String], [DateString() UTF8String]);
+		dimensionsOffset = ftello(out);
+		fprintf(out, "%*s\n# %u vertices, %u faces\n\n", kDimensionsFieldWidth, "", vertexCount, faceCount);
+		fprintf(out, "mtllib %s\no %s\n", [mtlName UTF8String], [name UTF8String]);
+		fprintf(out, "\n# Vertices (%u):\n", vertexCount);
+	}
+	
+	// Vertices go straight through.
+	if (OK)
+	{
+		for (i = 0; i != vertexCount; ++i)
+		{
+			if (![lexer readReal:&x] ||
+				![lexer readReal:&y] ||
+				![lexer readReal:&z])
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"noVertexDataLoaded" localizedFormat:@"Vertex data could not be read for vertex %u (line %u).", i + 1, [lexer lineNumber]];
+				break;
+			}
+			
+			x = -x;		// Oolite uses a flipped co-ordinate system.
+			fprintf(out, "v %f %f %f\n", x, y, z);
+			
+			if (x < minimum.x) minimum.x = x;
+			if (maximum.x < x) maximum.x = x;
+			if (y < minimum.y) minimum.y = y;
+			if (maximum.y < y) maximum.y = y;
+			if (z < minimum.z) minimum.z = z;
+			if (maximum.z < z) maximum.z = z;
+		}
+	}
+	
+	/*	Faces: each normal is written as it is read, and the rest of the face is
+		spilled until its texture co-ordinates turn up.
+	*/
+	if (OK)
+	{
+		OK = [lexer expectLiteral:"FACES"];
+		if (!OK) [ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], @"FACES", [lexer currentTokenString]];
+	}
+	if (OK)
+	{
+		fprintf(out, "\n# Normals (%u):\n", faceCount);
+		for (i = 0; i != faceCount; ++i)
+		{
+			if (![lexer readInteger:&smoothingGroupID])
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"noSmoothingGroupLoaded" localizedFormat:@"Smoothing group ID could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+				break;
+			}
+			
+			// Map file IDs to 1..255 in order of appearance, as the DAT loader does.
+			if (0 == smoothingGroupsUsed || smoothingGroupIDs[activeSmoothingGroup - 1] != smoothingGroupID)
+			{
+				for (j = 0; j != smoothingGroupsUsed; ++j)
+				{
+					if (smoothingGroupIDs[j] == smoothingGroupID) break;
+				}
+				if (j == smoothingGroupsUsed)
+				{
+					if (kMaxSmoothingGroups <= smoothingGroupsUsed)
+					{
+						OK = NO;
+						[ioIssues addStopIssueWithKey:@"documentTooComplex" localizedFormat:@"This document is too complex to be loaded by Dry Dock. Dry Dock cannot handle models with more than %u smoothing groups.", kMaxSmoothingGroups];
+						break;
+					}
+					smoothingGroupIDs[smoothingGroupsUsed++] = smoothingGroupID;
+				}
+				activeSmoothingGroup = j + 1;
+			}
+			
+			if (![lexer readInteger:&g] ||
+				![lexer readInteger:&b])
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"noReservedFieldsLoaded" localizedFormat:@"Reserved fields could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+				break;
+			}
+			
+			if (![lexer readReal:&x] ||
+				![lexer readReal:&y] ||
+				![lexer readReal:&z])
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"noNormalLoaded" localizedFormat:@"Normal data could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+				break;
+			}
+			fprintf(out, "vn %f %f %f\n", -x, y, z);
+			
+			if (![lexer readInteger:&faceVertexCount])
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"noVertexCountLoaded" localizedFormat:@"Vertex count could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+				break;
+			}
+			if (faceVertexCount < 3 || kMaxVertsPerFace < faceVertexCount)
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"vertexCountRange" localizedFormat:@"Invalid vertex count (%u) for face %u (line %u). Each face must have at least 3 and no more than %u vertices.", faceVertexCount, i + 1, [lexer lineNumber], kMaxVertsPerFace];
+				break;
+			}
+			
+			for (j = 0; j != faceVertexCount; ++j)
+			{
+				if (![lexer readInteger:&indices[j]])
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"noVertexDataLoaded" localizedFormat:@"Vertex data could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+					break;
+				}
+				if (vertexCount <= indices[j])
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"vertexRange" localizedFormat:@"Face %u (line %u) specifies a vertex index of %u, but there are only %u vertices in the document.", i + 1, [lexer lineNumber], indices[j] + 1, vertexCount];
+					break;
+				}
+			}
+			if (!OK) break;
+			
+			face.smoothingGroup = activeSmoothingGroup;
+			face.vertexCount = faceVertexCount;
+			fwrite(&face, sizeof face, 1, faceSpill);
+			fwrite(indices, sizeof *indices, faceVertexCount, faceSpill);
+			faceVertexTotal += faceVertexCount;
+		}
+		
+		if (OK && ferror(faceSpill))
+		{
+			OK = NO;
+			ReportWriteFailure(ioIssues);
+		}
+	}
+	
+	// All faces in the same smoothing group is equivalent to no smoothing group.
+	flattenSmoothingGroups = smoothingGroupsUsed < 2;
+	
+	if (OK)
+	{
+		tokString = [lexer nextToken];
+		if (nil == tokString)
+		{
+			[ioIssues addWarningIssueWithKey:@"missingEnd" localizedFormat:@"The document is missing an END line. This is not serious, but should be fixed by resaving the document."];
+		}
+		else if ([tokString isEqualToString:@"TEXTURES"])
+		{
+			readTextures = YES;
+		}
+		else if (![tokString isEqualToString:@"END"])
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], NSLocalizedString(@"TEXTURES or END", NULL), tokString];
+		}
+		
+		if (OK && !readTextures)
+		{
+			[ioIssues addNoteIssueWithKey:@"noTextures" localizedFormat:@"The document does not specify any textures or u/v co-ordinates."];
+		}
+	}
+	
+	/*	Texture lines: co-ordinates are written as they are read, and each face
+		is appended to its material's spill now that all its indices are known.
+	*/
+	if (OK)
+	{
+		materialNames = [NSMutableArray array];
+		materialIndices = [NSMutableDictionary dictionary];
+		
+		if (readTextures)
+		{
+			fprintf(out, "\n# Texture co-ordinates (%u):\n", faceVertexTotal);
+		}
+		else
+		{
+			fprintf(out, "\n# Texture co-ordinates (%u):\nvt %f %f\n", 1, 0.0, 1.0);
+		}
+		
+		fflush(faceSpill);
+		rewind(faceSpill);
+		
+		pool = [[NSAutoreleasePool alloc] init];
+		for (i = 0; i != faceCount; ++i)
+		{
+			if (1 != fread(&face, sizeof face, 1, faceSpill) ||
+				face.vertexCount != fread(indices, sizeof *indices, face.vertexCount, faceSpill))
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"tempFileFailed" localizedFormat:@"A temporary file could not be read back. %s", strerror(errno)];
+				break;
+			}
+			
+			if (readTextures)
+			{
+				if (![lexer readString:&texFileName])
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"noTextureNameLoaded" localizedFormat:@"Texture name could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+					break;
+				}
+			}
+			else
+			{
+				texFileName = @"$untextured";
+			}
+			
+			materialIndex = [materialIndices objectForKey:texFileName];
+			if (nil == materialIndex)
+			{
+				material = (OBJMaterialSpill *)realloc(materials, sizeof *materials * (materialCount + 1));
+				if (NULL == material)
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"allocFailed" localizedFormat:@"A memory allocation failed. This is probably due to a memory shortage"];
+					break;
+				}
+				materials = material;
+				material = &materials[materialCount];
+				bzero(material, sizeof *material);
+				material->spill = OpenSpill(ioIssues);
+				if (NULL == material->spill)
+				{
+					OK = NO;
+					break;
+				}
+				
+				materialIndex = [NSNumber numberWithUnsignedInt:materialCount++];
+				[materialIndices setObject:materialIndex forKey:texFileName];
+				[materialNames addObject:texFileName];
+			}
+			material = &materials[[materialIndex unsignedIntValue]];
+			
+			if (readTextures)
+			{
+				if (![lexer readReal:&max_s] ||
+					![lexer readReal:&max_t])
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"noTextureScaleLoaded" localizedFormat:@"Texture scale could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+					break;
+				}
+				
+				for (j = 0; j != face.vertexCount; ++j)
+				{
+					if (![lexer readReal:&s] ||
+						![lexer readReal:&t])
+					{
+						OK = NO;
+						[ioIssues addStopIssueWithKey:@"noUVLoaded" localizedFormat:@"U/V pair could not be read for face %u (line %u).", i + 1, [lexer lineNumber]];
+						break;
+					}
+					fprintf(out, "vt %f %f\n", s / max_s, 1.0 - t / max_t);
+				}
+				if (!OK) break;
+			}
+			
+			if (flattenSmoothingGroups) face.smoothingGroup = 0;
+			if (material->activeSmoothingGroup != face.smoothingGroup)
+			{
+				material->activeSmoothingGroup = face.smoothingGroup;
+				if (0 == face.smoothingGroup)  fprintf(material->spill, "\ns off");
+				else  fprintf(material->spill, "\ns %u", face.smoothingGroup);
+			}
+			
+			fprintf(material->spill, "\nf");
+			for (j = 0; j != face.vertexCount; ++j)
+			{
+				fprintf(material->spill, " %u/%u/%u", indices[j] + 1, readTextures ? texCoordIdx + j + 1 : 1, i + 1);
+			}
+			if (readTextures)  texCoordIdx += face.vertexCount;
+			++material->faceCount;
+			
+			if (0 == (i + 1) % kPoolDrainInterval)
+			{
+				[pool release];
+				pool = [[NSAutoreleasePool alloc] init];
+			}
+		}
+		[pool release];
+	}
+	
+	if (OK && readTextures)
+	{
+		tokString = [lexer nextToken];
+		
+		// With a NAMES table, the texture names read above are indices into it.
+		if ([tokString isEqualToString:@"NAMES"])
+		{
+			OK = [lexer readInteger:&nameCount];
+			names = [NSMutableArray arrayWithCapacity:nameCount];
+			for (i = 0; OK && i != nameCount; ++i)
+			{
+				OK = [lexer readString:&texFileName];
+				if (OK)  [names addObject:texFileName];
+			}
+			if (!OK)  [ioIssues addStopIssueWithKey:@"parseError" localizedFormat:@"Parse error on line %u: expected %@, got %@.", [lexer lineNumber], NSLocalizedString(@"material names", NULL), [lexer currentTokenString]];
+			
+			for (i = 0; OK && i != materialCount; ++i)
+			{
+				nameIndex = [[materialNames objectAtIndex:i] intValue];
+				if (nameCount <= nameIndex)
+				{
+					[ioIssues addStopIssueWithKey:@"materialRange" localizedFormat:@"The document specifies a material index of %u, but there are only %u materials in the document.", nameIndex, nameCount];
+					OK = NO;
+					break;
+				}
+				[materialNames replaceObjectAtIndex:i withObject:[names objectAtIndex:nameIndex]];
+			}
+			
+			if (OK)  tokString = [lexer nextToken];
+		}
+		
+		// Per-vertex normals and tangents have no equivalent here, since OBJ normals are written per face.
+		if (OK && [tokString isEqualToString:@"NORMALS"])
+		{
+			tokString = [lexer skipTokens:vertexCount * 3] ? [lexer nextToken] : nil;
+		}
+		if (OK && [tokString isEqualToString:@"TANGENTS"])
+		{
+			tokString = [lexer skipTokens:vertexCount * 3] ? [lexer nextToken] : nil;
+		}
+		
+		if (!OK)
+		{
+			// Error already reported.
+		}
+		else if (nil == tokString)
+		{
+			[ioIssues addWarningIssueWithKey:@"missingEnd" localizedFormat:@"The document is missing an END line. This is not serious, but should be fixed by resaving the document."];
+		}
+		else if (![tokString isEqualToString:@"END"])
+		{
+			[ioIssues addWarningIssueWithKey:@"missedData" localizedFormat:@"The document continues beyond where it was expected to end. It may be of a newer format."];
+		}
+	}
+	
+	// Faces, grouped by material.
+	if (OK)
+	{
+		for (i = 0; i != materialCount; ++i)
+		{
+			const char *materialName = [[materialNames objectAtIndex:i] UTF8String];
+			fprintf(out, "\n# Faces with texture %s (%u):\ng %s\nusemtl %s", materialName, materials[i].faceCount, materialName, materialName);
+			if (!AppendSpill(out, materials[i].spill))
+			{
+				OK = NO;
+				break;
+			}
+			fprintf(out, "\n");
+		}
+		
+		if (OK)
+		{
+			snprintf(dimensions, sizeof dimensions, "%g x %g x %g (w x h x l)", maximum.x - minimum.x, maximum.y - minimum.y, maximum.z - minimum.z);
+			OK = (0 == fseeko(out, dimensionsOffset, SEEK_SET)) && (strlen(dimensions) == fwrite(dimensions, 1, strlen(dimensions), out));
+		}
+		if (!OK || ferror(out))
+		{
+			OK = NO;
+			ReportWriteFailure(ioIssues);
+		}
+	}
+	
+	if (NULL != out && 0 != fclose(out) && OK)
+	{
+		OK = NO;
+		ReportWriteFailure(ioIssues);
+	}
+	if (NULL != faceSpill) fclose(faceSpill);
+	for (i = 0; i != materialCount; ++i)
+	{
+		if (NULL != materials[i].spill) fclose(materials[i].spill);
+	}
+	free(materials);
+	
+	// The material library is small enough to build in memory.
+	if (OK)
+	{
+		mtlString = [NSMutableString stringWithFormat:@"# Written by %@ on %@\n# \n# %u materials\n\n", ApplicationNameAndVersionString(), DateString(), materialCount];
+		for (i = 0; i != materialCount; ++i)
+		{
+			texFileName = [materialNames objectAtIndex:i];
+			if ([texFileName isEqualToString:@"$untextured"])  [mtlString appendFormat:@"newmtl %@\n\n", texFileName];
+			else  [mtlString appendFormat:@"newmtl %@\nmap_Kd %@\n\n", texFileName, texFileName];
+		}
+		
+		if (![mtlString writeToURL:[NSURL URLWithString:mtlName relativeToURL:inDestination] atomically:YES encoding:NSUTF8StringEncoding error:&error])
+		{
+			[ioIssues addWarningIssueWithKey:@"mtllibWriteFailed" localizedFormat:@"The material library for the document could not be saved. %@", error ? [error localizedFailureReason] : @""];
+		}
+	}
+	else if (NULL != out)
+	{
+		RemoveFile(inDestination);
+	}
+	
+	return OK;
+	TraceExit();
+}
+
+
+BOOL DDStreamTranscodeWaveFrontOBJToOoliteDAT(NSURL *inSource, NSURL *inDestination, DDProblemReportManager *ioIssues)
+{
+	TraceEnterMsg(@"Called for %@", inSource);
+	
+	BOOL					OK = YES, truncated, warnedAboutNoNormals = NO;
+	NSData					*data;
+	NSError					*error = nil;
+	OBJSummary				summary;
+	OBJReader				reader;
+	char					keyword[kMaxKeywordLength], params[kMaxLineLength], textureName[kMaxLineLength];
+	FILE					*out = NULL, *faceSpill = NULL, *textureSpill = NULL;
+	SpillArray<Vector2>		*texCoords = NULL;
+	SpillArray<Vector>		*normals = NULL;
+	NSMutableDictionary		*smoothingGroups = nil;
+	NSString				*texNameString, *minVersion, *materialName;
+	NSEnumerator			*materialEnum;
+	OBJFaceVertex			faceVertices[kMaxVertsPerFace];
+	unsigned				vertexIdx = 0, faceIdx = 0, fvIdx, faceVertexCount, i, index;
+	unsigned				vertices[kMaxVertsPerFace];
+	Vector2					uv[kMaxVertsPerFace];
+	Vector					normal, vertexNormal;
+	uint8_t					activeSmoothingGroup = 0;
+	float					values[3];
+	NSAutoreleasePool		*pool;
+	
+	bzero(&summary, sizeof summary);
+	strlcpy(textureName, "$untextured", sizeof textureName);
+	
+	data = [NSData dataWithContentsOfURL:inSource options:NSMappedRead error:&error];
+	if (nil == data)
+	{
+		OK = NO;
+		[ioIssues addStopIssueWithKey:@"noDataLoaded" localizedFormat:@"No data could be loaded from %@. %@", [inSource displayString], error ? [error localizedFailureReason] : @""];
+	}
+	
+	/*	First pass: totals for the header, and everything that can stop the
+		conversion, so that nothing is written for a file that can't be.
+	*/
+	if (OK)  OK = OBJScan(data, inSource, &summary, ioIssues);
+	
+	if (OK && summary.hasNonTriangles)
+	{
+		[ioIssues addWarningIssueWithKey:@"nonTriangularFaces" localizedFormat:@"This model contains non-triangular faces. In order to save it in the selected format, Dry Dock will triangulate it."];
+	}
+	if (OK && [DDMesh maximumOoliteDATMaterialCount] < [summary.materials count])
+	{
+		OK = NO;
+		[ioIssues addStopIssueWithKey:@"tooManyMaterials" localizedFormat:@"This model contains %u materials; the selected format allows no more than %u.", (unsigned)[summary.materials count], [DDMesh maximumOoliteDATMaterialCount]];
+	}
+	minVersion = [DDMesh minimumOoliteVersionStringForVertexCount:summary.vertexCount faceCount:summary.triangleCount materialCount:[summary.materials count]];
+	if (OK && nil != minVersion)
+	{
+		[ioIssues addNoteIssueWithKey:@"complexDATOutput" localizedFormat:@"Due to its complexity, this model cannot be used with versions of Oolite earlier than %@.", minVersion];
+	}
+	texNameString = nil;
+	for (materialEnum = [summary.materials objectEnumerator]; (materialName = [materialEnum nextObject]); )
+	{
+		materialName = [summary.textureNames objectForKey:materialName];
+		if (![DDMesh isValidOoliteDATTextureName:materialName])
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"invalidTextureName" localizedFormat:@"This document contains a texture named \"%@\". The specified format does not support texture names containing spaces, commas, line breaks, \"#\" or \"//\".", materialName];
+		}
+		if (nil == texNameString)  texNameString = materialName;
+		else  texNameString = [texNameString stringByAppendingFormat:@", %@", materialName];
+	}
+	if (nil == texNameString)  texNameString = @"none";
+	
+	// Second pass: vertices go straight out, faces and texture lines to spills.
+	if (OK)
+	{
+		out = fopen([[inDestination path] fileSystemRepresentation], "w");
+		if (NULL == out)
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %s", strerror(errno)];
+		}
+		else
+		{
+			setvbuf(out, NULL, _IOFBF, kStreamBufferSize);
+		}
+	}
+	if (OK)
+	{
+		faceSpill = OpenSpill(ioIssues);
+		textureSpill = OpenSpill(ioIssues);
+		texCoords = new SpillArray<Vector2>;
+		normals = new SpillArray<Vector>;
+		OK = NULL != faceSpill && NULL != textureSpill;
+		if (OK && (!texCoords->Open() || !normals->Open()))
+		{
+			OK = NO;
+			[ioIssues addStopIssueWithKey:@"tempFileFailed" localizedFormat:@"A temporary file could not be created. %s", strerror(errno)];
+		}
+	}
+	
+	if (OK)
+	{
+		fprintf(out, "//	Written by %s on %s\n"
+					 "//	\n"
+					 "//	Model dimensions: %g x %g x %g (w x h x l)\n"
+					 "//	Textures used: %s\n",
+					 [ApplicationNameAndVersionString() UTF8String], [DateString() UTF8String],
+					 summary.maximum.x - summary.minimum.x, summary.maximum.y - summary.minimum.y, summary.maximum.z - summary.minimum.z,
+					 [texNameString UTF8String]);
+		if (nil != minVersion)  fprintf(out, "//	Minimum Oolite version: %s\n", [minVersion UTF8String]);
+		fprintf(out, "\nNVERTS %u\nNFACES %u\n\nVERTEX\n", summary.vertexCount, summary.triangleCount);
+		
+		smoothingGroups = [NSMutableDictionary dictionary];
+		reader.cursor = (const char *)[data bytes];
+		reader.end = reader.cursor + [data length];
+		reader.lineNumber = 0;
+		
+		pool = [[NSAutoreleasePool alloc] init];
+		while (OK && OBJNextLine(&reader, keyword, params, &truncated))
+		{
+			if (!strcmp(keyword, "v"))
+			{
+				OBJParseNumbers(params, values, 3);
+				fprintf(out, "%10f,%10f,%10f\n", -values[0], values[1], values[2]);
+				++vertexIdx;
+			}
+			else if (!strcmp(keyword, "vt"))
+			{
+				OBJParseNumbers(params, values, 2);
+				OK = texCoords->Append(Vector2(values[0], 1.0 - values[1]));
+			}
+			else if (!strcmp(keyword, "vn"))
+			{
+				OBJParseNumbers(params, values, 3);
+				normal.Set(values[0], values[1], values[2]);
+				if (0 != normal.SquareMagnitude())  normal.Normalize();
+				OK = normals->Append(normal);
+			}
+			else if (!strcmp(keyword, "usemtl"))
+			{
+				// Materials without faces weren't recorded, and won't be needed.
+				materialName = [summary.textureNames objectForKey:StringFromCString(params)];
+				if (nil != materialName)  strlcpy(textureName, [materialName UTF8String], sizeof textureName);
+			}
+			else if (!strcmp(keyword, "s"))
+			{
+				OBJSmoothingGroup(params, smoothingGroups, &activeSmoothingGroup);
+			}
+			else if (!strcmp(keyword, "f"))
+			{
+				// Indices were checked by the first pass; anything unusable here is a missing U/V or normal.
+				faceVertexCount = OBJParseFace(params, faceVertices);
+				if (faceVertexCount < 3 || kMaxVertsPerFace < faceVertexCount)  continue;
+				
+				normal.Set(0);
+				for (fvIdx = 0; fvIdx != faceVertexCount; ++fvIdx)
+				{
+					OBJResolveIndex(faceVertices[fvIdx].v, vertexIdx, &vertices[fvIdx]);
+					
+					uv[fvIdx] = Vector2(0, 0);
+					if (faceVertices[fvIdx].hasVT && OBJResolveIndex(faceVertices[fvIdx].vt, texCoords->Count(), &index))
+					{
+						texCoords->Get(index, uv[fvIdx]);
+					}
+					if (faceVertices[fvIdx].hasVN && OBJResolveIndex(faceVertices[fvIdx].vn, normals->Count(), &index) && normals->Get(index, vertexNormal))
+					{
+						normal += vertexNormal;
+					}
+				}
+				
+				if (0 != normal.SquareMagnitude())
+				{
+					normal.Normalize();
+				}
+				else if (!warnedAboutNoNormals)
+				{
+					warnedAboutNoNormals = YES;
+					[ioIssues addWarningIssueWithKey:@"invalidNormal" localizedFormat:@"Some or all faces in the document lack a valid normal specified. This is likely to lead to lighting problems. This issue can be rectified by selecting Recalculate Normals from the Tools menu."];
+				}
+				
+				// Triangulate as a fan, as -[DDMesh triangulate] does.
+				for (fvIdx = 1; fvIdx + 1 < faceVertexCount; ++fvIdx)
+				{
+					fprintf(faceSpill, "\n%u,%u,%u,\t%10f,%10f,%10f,\t%u,\t%u,%u,%u",
+						activeSmoothingGroup, 0, 0, -normal.x, normal.y, normal.z, 3,
+						vertices[0], vertices[fvIdx], vertices[fvIdx + 1]);
+					fprintf(textureSpill, "\n%-16s\t1.0 1.0    %f %f %f %f %f %f", textureName,
+						uv[0].x, uv[0].y, uv[fvIdx].x, uv[fvIdx].y, uv[fvIdx + 1].x, uv[fvIdx + 1].y);
+				}
+				
+				if (0 == ++faceIdx % kPoolDrainInterval)
+				{
+					[pool release];
+					pool = [[NSAutoreleasePool alloc] init];
+				}
+			}
+		}
+		[pool release];
+		
+		if (!OK)  [ioIssues addStopIssueWithKey:@"tempFileFailed" localizedFormat:@"A temporary file could not be written. %s", strerror(errno)];
+	}
+	
+	if (OK)
+	{
+		fprintf(out, "\nFACES");
+		OK = AppendSpill(out, faceSpill);
+		fprintf(out, "\n\nTEXTURES");
+		OK = OK && AppendSpill(out, textureSpill);
+		fprintf(out, "\n\nEND\n");
+		
+		if (!OK || ferror(out))
+		{
+			OK = NO;
+			ReportWriteFailure(ioIssues);
+		}
+	}
+	
+	if (NULL != out && 0 != fclose(out) && OK)
+	{
+		OK = NO;
+		ReportWriteFailure(ioIssues);
+	}
+	if (NULL != faceSpill)  fclose(faceSpill);
+	if (NULL != textureSpill)  fclose(textureSpill);
+	delete texCoords;
+	delete normals;
+	[summary.materials release];
+	[summary.textureNames release];
+	
+	if (!OK && NULL != out)  RemoveFile(inDestination);
+	
+	return OK;
+	TraceExit();
+}
+
+
+static BOOL OBJScan(NSData *inData, NSURL *inSource, OBJSummary *outSummary, DDProblemReportManager *ioIssues)
+{
+	BOOL					OK = YES, truncated, warnedUVThisLine, warnedNormalThisLine;
+	BOOL					warnedAboutCall = NO, warnedAboutShellScript = NO;
+	OBJReader				reader;
+	char					keyword[kMaxKeywordLength], params[kMaxLineLength];
+	unsigned				texCoordCount = 0, normalCount = 0, faceVertexCount, fvIdx, index;
+	unsigned				badUVWarnings = 0, badNormalWarnings = 0;
+	OBJFaceVertex			faceVertices[kMaxVertsPerFace];
+	NSDictionary			*materialLibrary = nil, *attributes;
+	NSString				*currentMaterial, *string, *textureName;
+	NSMutableSet			*ignoredTypes;
+	NSMutableDictionary		*smoothingGroups;
+	uint8_t					smoothingGroup;
+	float					values[3];
+	NSAutoreleasePool		*pool;
+	
+	outSummary->minimum.Set(INFINITY, INFINITY, INFINITY);
+	outSummary->maximum.Set(-INFINITY, -INFINITY, -INFINITY);
+	outSummary->materials = [[NSMutableArray alloc] init];
+	outSummary->textureNames = [[NSMutableDictionary alloc] init];
+	currentMaterial = [@"$untextured" retain];
+	ignoredTypes = [NSMutableSet set];
+	smoothingGroups = [NSMutableDictionary dictionary];
+	
+	reader.cursor = (const char *)[inData bytes];
+	reader.end = reader.cursor + [inData length];
+	reader.lineNumber = 0;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	while (OK && OBJNextLine(&reader, keyword, params, &truncated))
+	{
+		if (!strcmp(keyword, "v"))
+		{
+			OBJParseNumbers(params, values, 3);
+			if (values[0] < outSummary->minimum.x) outSummary->minimum.x = values[0];
+			if (outSummary->maximum.x < values[0]) outSummary->maximum.x = values[0];
+			if (values[1] < outSummary->minimum.y) outSummary->minimum.y = values[1];
+			if (outSummary->maximum.y < values[1]) outSummary->maximum.y = values[1];
+			if (values[2] < outSummary->minimum.z) outSummary->minimum.z = values[2];
+			if (outSummary->maximum.z < values[2]) outSummary->maximum.z = values[2];
+			++outSummary->vertexCount;
+		}
+		else if (!strcmp(keyword, "vt"))
+		{
+			++texCoordCount;
+		}
+		else if (!strcmp(keyword, "vn"))
+		{
+			++normalCount;
+		}
+		else if (!strcmp(keyword, "f"))
+		{
+			faceVertexCount = OBJParseFace(params, faceVertices);
+			if (faceVertexCount < 3)  continue;
+			
+			if (kMaxVertsPerFace < faceVertexCount || truncated)
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"vertexCountRange" localizedFormat:@"Invalid vertex count (%u) for face line %u. Each face must have at least 3 and no more than %u vertices.", faceVertexCount, outSummary->faceCount + 1, kMaxVertsPerFace];
+				break;
+			}
+			
+			++outSummary->faceCount;
+			outSummary->triangleCount += faceVertexCount - 2;
+			if (3 < faceVertexCount)  outSummary->hasNonTriangles = YES;
+			
+			if (nil == [outSummary->textureNames objectForKey:currentMaterial])
+			{
+				attributes = [materialLibrary objectForKey:currentMaterial];
+				textureName = [attributes objectForKey:@"diffuse map name"];
+				if (nil == textureName)  textureName = currentMaterial;
+				[outSummary->textureNames setObject:textureName forKey:currentMaterial];
+				[outSummary->materials addObject:currentMaterial];
+			}
+			
+			warnedUVThisLine = NO;
+			warnedNormalThisLine = NO;
+			for (fvIdx = 0; fvIdx != faceVertexCount; ++fvIdx)
+			{
+				if (0 == faceVertices[fvIdx].v)
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"invalidVertexIndex" localizedFormat:@"Face line %u specifies an invalid vertex index %li.", outSummary->faceCount, faceVertices[fvIdx].v];
+					break;
+				}
+				if (!OBJResolveIndex(faceVertices[fvIdx].v, outSummary->vertexCount, &index))
+				{
+					OK = NO;
+					[ioIssues addStopIssueWithKey:@"vertexRange" localizedFormat:@"Face line %u specifies a vertex index of %li, but there are only %u vertices in the document.", outSummary->faceCount, faceVertices[fvIdx].v, outSummary->vertexCount];
+					break;
+				}
+				
+				if (faceVertices[fvIdx].hasVT && !warnedUVThisLine && !OBJResolveIndex(faceVertices[fvIdx].vt, texCoordCount, &index))
+				{
+					warnedUVThisLine = YES;
+					OBJReportBadIndex(ioIssues, &badUVWarnings, NO, outSummary->faceCount, faceVertices[fvIdx].vt, texCoordCount);
+				}
+				if (faceVertices[fvIdx].hasVN && !warnedNormalThisLine && !OBJResolveIndex(faceVertices[fvIdx].vn, normalCount, &index))
+				{
+					warnedNormalThisLine = YES;
+					OBJReportBadIndex(ioIssues, &badNormalWarnings, YES, outSummary->faceCount, faceVertices[fvIdx].vn, normalCount);
+				}
+			}
+			
+			if (0 == outSummary->faceCount % kPoolDrainInterval)
+			{
+				[pool release];
+				pool = [[NSAutoreleasePool alloc] init];
+			}
+		}
+		else if (!strcmp(keyword, "usemtl"))
+		{
+			[currentMaterial release];
+			currentMaterial = [StringFromCString(params) retain];
+		}
+		else if (!strcmp(keyword, "mtllib"))
+		{
+			string = StringFromCString(params);
+			if (nil == materialLibrary)
+			{
+				materialLibrary = [[DDMesh loadObjMaterialLibraryNamed:string relativeTo:inSource issues:ioIssues] retain];
+				if (nil == materialLibrary)  materialLibrary = [[NSDictionary alloc] init];
+			}
+			else
+			{
+				[ioIssues addNoteIssueWithKey:@"multipleMaterialLibraries" localizedFormat:@"The document contains multiple material library references. Currently, only one material library is supported. Ignoring reference to material library \"%@\".", string];
+			}
+		}
+		else if (!strcmp(keyword, "s"))
+		{
+			if (!OBJSmoothingGroup(params, smoothingGroups, &smoothingGroup))
+			{
+				OK = NO;
+				[ioIssues addStopIssueWithKey:@"documentTooComplex" localizedFormat:@"This document is too complex to be loaded by Dry Dock. Dry Dock cannot handle models with more than %u smoothing groups.", kMaxSmoothingGroups];
+			}
+		}
+		else if (!strcmp(keyword, "call"))
+		{
+			if (!warnedAboutCall)
+			{
+				warnedAboutCall = YES;
+				[ioIssues addNoteIssueWithKey:@"OBJCall" localizedFormat:@"The document contains one or more \"calls\" of external files. This feature is not supported by Dry Dock at present."];
+			}
+		}
+		else if (!strcmp(keyword, "csh"))
+		{
+			if (!warnedAboutShellScript)
+			{
+				warnedAboutShellScript = YES;
+				[ioIssues addNoteIssueWithKey:@"OBJShellScript" localizedFormat:@"The document contains one or more shell script commands. For security reasons, this feature is not supported by Dry Dock."];
+			}
+		}
+		else if (strcmp(keyword, "o") && strcmp(keyword, "g"))
+		{
+			// Object and group names are dropped; DAT has neither.
+			string = StringFromCString(keyword);
+			if (![ignoredTypes containsObject:string])
+			{
+				[ignoredTypes addObject:string];
+				[ioIssues addNoteIssueWithKey:@"unknownOBJLineType" localizedFormat:@"The document contains lines of unknown type \"%@\", which will be ignored.", string];
+			}
+		}
+	}
+	
+	[pool release];
+	[currentMaterial release];
+	[materialLibrary release];
+	
+	return OK;
+}
+
+
+// Reads the next line that isn't blank or a comment, split into a keyword and its parameters.
+static BOOL OBJNextLine(OBJReader *ioReader, char outKeyword[kMaxKeywordLength], char outParams[kMaxLineLength], BOOL *outTruncated)
+{
+	const char				*lineEnd, *cursor;
+	size_t					length;
+	
+	while (ioReader->cursor < ioReader->end)
+	{
+		++ioReader->lineNumber;
+		cursor = ioReader->cursor;
+		for (lineEnd = cursor; lineEnd < ioReader->end && '\n' != *lineEnd && '\r' != *lineEnd; ++lineEnd)  {}
+		ioReader->cursor = lineEnd + 1;
+		
+		while (cursor < lineEnd && (' ' == *cursor || '\t' == *cursor))  ++cursor;
+		if (cursor == lineEnd || '#' == *cursor)  continue;
+		
+		for (length = 0; cursor + length < lineEnd && ' ' != cursor[length] && '\t' != cursor[length]; ++length)  {}
+		if (kMaxKeywordLength <= length)  length = kMaxKeywordLength - 1;
+		memcpy(outKeyword, cursor, length);
+		outKeyword[length] = '\0';
+		
+		cursor += length;
+		while (cursor < lineEnd && (' ' == *cursor || '\t' == *cursor))  ++cursor;
+		while (cursor < lineEnd && (' ' == lineEnd[-1] || '\t' == lineEnd[-1]))  --lineEnd;
+		
+		length = lineEnd - cursor;
+		*outTruncated = (kMaxLineLength <= length);
+		if (*outTruncated)  length = kMaxLineLength - 1;
+		memcpy(outParams, cursor, length);
+		outParams[length] = '\0';
+		
+		return YES;
+	}
+	
+	return NO;
+}
+
+
+/*	Parse "v", "v/vt", "v//vn" or "v/vt/vn" elements. Returns the number of
+	elements, which may be more than kMaxVertsPerFace; only that many are
+	stored.
+*/
+static unsigned OBJParseFace(const char *inParams, OBJFaceVertex outVertices[kMaxVertsPerFace])
+{
+	unsigned				count = 0;
+	OBJFaceVertex			vertex;
+	char					*end;
+	
+	while ('\0' != *inParams)
+	{
+		bzero(&vertex, sizeof vertex);
+		vertex.v = strtol(inParams, &end, 10);
+		inParams = end;
+		if ('/' == *inParams)
+		{
+			++inParams;
+			if ('/' != *inParams && ' ' != *inParams && '\t' != *inParams && '\0' != *inParams)
+			{
+				vertex.hasVT = YES;
+				vertex.vt = strtol(inParams, &end, 10);
+				inParams = end;
+			}
+			if ('/' == *inParams)
+			{
+				++inParams;
+				if (' ' != *inParams && '\t' != *inParams && '\0' != *inParams)
+				{
+					vertex.hasVN = YES;
+					vertex.vn = strtol(inParams, &end, 10);
+					inParams = end;
+				}
+			}
+		}
+		
+		// Skip anything unparseable up to the next element.
+		while ('\0' != *inParams && ' ' != *inParams && '\t' != *inParams)  ++inParams;
+		while (' ' == *inParams || '\t' == *inParams)  ++inParams;
+		
+		if (count < kMaxVertsPerFace)  outVertices[count] = vertex;
+		++count;
+	}
+	
+	return count;
+}
+
+
+static void OBJParseNumbers(const char *inParams, float *outValues, unsigned inCount)
+{
+	char					*end;
+	
+	while (inCount--)
+	{
+		*outValues++ = strtof(inParams, &end);
+		inParams = end;
+	}
+}
+
+
+// "off" and "0" are no smoothing; other names are numbered in order of appearance.
+static BOOL OBJSmoothingGroup(const char *inParams, NSMutableDictionary *ioGroups, uint8_t *outGroup)
+{
+	NSString				*key;
+	NSNumber				*group;
+	
+	if (!strcmp(inParams, "off") || !strcmp(inParams, "0"))
+	{
+		*outGroup = 0;
+		return YES;
+	}
+	
+	key = [NSString stringWithUTF8String:inParams];
+	group = [ioGroups objectForKey:key];
+	if (nil == group)
+	{
+		if (kMaxSmoothingGroups <= [ioGroups count])  return NO;
+		group = [NSNumber numberWithUnsignedChar:[ioGroups count] + 1];
+		[ioGroups setObject:group forKey:key];
+	}
+	*outGroup = [group unsignedCharValue];
+	return YES;
+}
+
+
+// OBJ indices are one-based, or negative to count back from the latest.
+static BOOL OBJResolveIndex(long inIndex, unsigned inCount, unsigned *outIndex)
+{
+	long					index;
+	
+	if (inIndex < 0)  index = (long)inCount + inIndex;
+	else  index = inIndex - 1;
+	
+	if (index < 0 || (long)inCount <= index)  return NO;
+	*outIndex = index;
+	return YES;
+}
+
+
+static void OBJReportBadIndex(DDProblemReportManager *ioIssues, unsigned *ioWarningCount, BOOL inNormal, unsigned inFace, long inIndex, unsigned inCount)
+{
+	if (kWarningSupressThreshold < *ioWarningCount)  return;
+	
+	if (kWarningSupressThreshold == (*ioWarningCount)++)
+	{
+		if (inNormal)  [ioIssues addNoteIssueWithKey:@"normalSuppress" localizedFormat:@"Supressing further warnings about normal indices."];
+		else  [ioIssues addNoteIssueWithKey:@"UVSuppress" localizedFormat:@"Supressing further warnings about U/V indices."];
+	}
+	else if (inNormal)
+	{
+		if (0 == inIndex)  [ioIssues addWarningIssueWithKey:@"invalidNormalIndex" localizedFormat:@"Face line %u specifies an invalid normal index %li.", inFace, inIndex];
+		else  [ioIssues addWarningIssueWithKey:@"normalIndexRange" localizedFormat:@"Face line %u specifies a normal index of %li, but there are only %u normals in the document.", inFace, inIndex, inCount];
+	}
+	else
+	{
+		if (0 == inIndex)  [ioIssues addWarningIssueWithKey:@"invalidUVIndex" localizedFormat:@"Face line %u specifies an invalid U/V index %li.", inFace, inIndex];
+		else  [ioIssues addWarningIssueWithKey:@"UVIndexRange" localizedFormat:@"Face line %u specifies a U/V index of %li, but there are only %u U/V pairs in the document.", inFace, inIndex, inCount];
+	}
+}
+
+
+static FILE *OpenSpill(DDProblemReportManager *ioIssues)
+{
+	FILE					*result;
+	
+	result = tmpfile();
+	if (NULL == result)
+	{
+		[ioIssues addStopIssueWithKey:@"tempFileFailed" localizedFormat:@"A temporary file could not be created. %s", strerror(errno)];
+	}
+	else
+	{
+		setvbuf(result, NULL, _IOFBF, kStreamBufferSize);
+	}
+	return result;
+}
+
+
+static BOOL AppendSpill(FILE *ioFile, FILE *inSpill)
+{
+	char					buffer[kCopyBufferSize];
+	size_t					length;
+	
+	if (0 != fflush(inSpill))  return NO;
+	rewind(inSpill);
+	
+	while (0 != (length = fread(buffer, 1, sizeof buffer, inSpill)))
+	{
+		if (length != fwrite(buffer, 1, length, ioFile))  return NO;
+	}
+	return !ferror(inSpill);
+}
+
+
+static NSString *DateString(void)
+{
+	NSDateFormatter			*formatter;
+	NSString				*result;
+	
+	formatter = [[NSDateFormatter alloc] initWithDateFormat:@"%Y-%m-%d" allowNaturalLanguage:NO];	// ISO date format
+	result = [formatter stringForObjectValue:[NSDate date]];
+	[formatter release];
+	
+	return result;
+}
+
+
+static void ReportWriteFailure(DDProblemReportManager *ioIssues)
+{
+	[ioIssues addStopIssueWithKey:@"writeFailed" localizedFormat:@"The document could not be saved. %s", strerror(errno)];
+}
+
+
+static void RemoveFile(NSURL *inURL)
+{
+	unlink([[inURL path] fileSystemRepresentation]);
+}
+
+
+static NSString *StringFromCString(const char *inString)
+{
+	NSString				*result;
+	
+	result = [NSString stringWithUTF8String:inString];
+	if (nil == result)  result = [NSString stringWithCString:inString encoding:NSISOLatin1StringEncoding];
+	
+	return result;
+}
@@ -0,0 +1,252 @@
+/*
+	DDTangentGenerator.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Per-corner tangent generation following MikkTSpace conventions: corner
+	tangents from the u/v gradient of the triangle at each corner, weighted by
+	corner angle and averaged over corners sharing position, normal, u/v and
+	handedness.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDTangentGenerator.h"
+#include "DDParallel.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+
+typedef struct TangentCornerContext
+{
+	const DDMeshFaceData	*faces;
+	const Vector			*vertices;
+	const Vector			*normals;
+	const Vector2			*texCoords;
+	const DDMeshIndex		*vertexIndices;
+	const DDMeshIndex		*normalIndices;
+	const DDMeshIndex		*texCoordIndices;
+	Vector					*contributions;		// Per corner: angle-weighted tangent direction
+	int8_t					*signs;				// Per corner: handedness of the u/v mapping
+} TangentCornerContext;
+
+
+typedef struct TangentGroupContext
+{
+	const Vector			*normals;
+	const DDMeshIndex		*normalIndices;
+	const unsigned			*groupCorners;		// A representative corner for each group
+	Vector					*groupSums;
+	const int8_t			*signs;
+	DDMeshTangent			*groupTangents;
+} TangentGroupContext;
+
+
+static void ComputeCornerContributions(void *context, size_t start, size_t end, unsigned worker);
+static void FinishGroupTangents(void *context, size_t start, size_t end, unsigned worker);
+static inline unsigned CornerKeyHash(DDMeshIndex inVertex, DDMeshIndex inNormal, DDMeshIndex inTexCoord, int8_t inSign);
+
+
+/*	Corners are welded into groups that share vertex, normal and texture
+	co-ordinate indices and handedness, using an open-addressed hash table, so
+	tangents split exactly where normals or u/vs do (seams) and where the
+	mapping is mirrored. Per-corner work and the final orthogonalization run in
+	parallel; grouping is a single serial pass.
+*/
+bool DDGenerateCornerTangents(const DDTangentMeshData *inMesh, DDMeshTangent *outTangents)
+{
+	bool					OK = true;
+	unsigned				cornerCount = inMesh->cornerCount;
+	unsigned				i, slot, hash, mask, tableSize, groupCount = 0;
+	unsigned				*table = NULL, *cornerGroups = NULL, *groupCorners = NULL;
+	Vector					*contributions = NULL, *groupSums = NULL;
+	int8_t					*signs = NULL;
+	DDMeshTangent			*groupTangents = NULL;
+	TangentCornerContext	cornerContext;
+	TangentGroupContext		groupContext;
+	
+	if (NULL == outTangents)  return false;
+	if (0 == cornerCount)  return true;
+	
+	for (tableSize = 16; tableSize < cornerCount * 2; tableSize *= 2)  {}
+	mask = tableSize - 1;
+	
+	table = (unsigned *)malloc(sizeof *table * tableSize);
+	cornerGroups = (unsigned *)malloc(sizeof *cornerGroups * cornerCount);
+	groupCorners = (unsigned *)malloc(sizeof *groupCorners * cornerCount);
+	contributions = (Vector *)malloc(sizeof *contributions * cornerCount);
+	groupSums = (Vector *)malloc(sizeof *groupSums * cornerCount);
+	signs = (int8_t *)malloc(sizeof *signs * cornerCount);
+	groupTangents = (DDMeshTangent *)malloc(sizeof *groupTangents * cornerCount);
+	OK = (NULL != table && NULL != cornerGroups && NULL != groupCorners && NULL != contributions && NULL != groupSums && NULL != signs && NULL != groupTangents);
+	
+	if (OK)
+	{
+		cornerContext.faces = inMesh->faces;
+		cornerContext.vertices = inMesh->vertices;
+		cornerContext.normals = inMesh->normals;
+		cornerContext.texCoords = inMesh->texCoords;
+		cornerContext.vertexIndices = inMesh->vertexIndices;
+		cornerContext.normalIndices = inMesh->normalIndices;
+		cornerContext.texCoordIndices = inMesh->texCoordIndices;
+		cornerContext.contributions = contributions;
+		cornerContext.signs = signs;
+		DDParallelApply(inMesh->faceCount, 0, ComputeCornerContributions, &cornerContext);
+		
+		memset(table, 0xFF, sizeof *table * tableSize);
+		for (slot = 0; slot != cornerCount; ++slot)
+		{
+			DDMeshIndex vertex = inMesh->vertexIndices[slot];
+			DDMeshIndex normal = inMesh->normalIndices[slot];
+			DDMeshIndex texCoord = inMesh->texCoordIndices[slot];
+			int8_t sign = signs[slot];
+			
+			for (hash = CornerKeyHash(vertex, normal, texCoord, sign) & mask; ; hash = (hash + 1) & mask)
+			{
+				i = table[hash];
+				if (UINT_MAX == i)
+				{
+					i = groupCount++;
+					table[hash] = i;
+					groupCorners[i] = slot;
+					groupSums[i].Set(0);
+					break;
+				}
+				
+				unsigned other = groupCorners[i];
+				if (inMesh->vertexIndices[other] == vertex && inMesh->normalIndices[other] == normal && inMesh->texCoordIndices[other] == texCoord && signs[other] == sign)  break;
+			}
+			
+			cornerGroups[slot] = i;
+			groupSums[i] += contributions[slot];
+		}
+		
+		groupContext.normals = inMesh->normals;
+		groupContext.normalIndices = inMesh->normalIndices;
+		groupContext.groupCorners = groupCorners;
+		groupContext.groupSums = groupSums;
+		groupContext.signs = signs;
+		groupContext.groupTangents = groupTangents;
+		DDParallelApply(groupCount, 0, FinishGroupTangents, &groupContext);
+		
+		for (slot = 0; slot != cornerCount; ++slot)
+		{
+			outTangents[slot] = groupTangents[cornerGroups[slot]];
+		}
+	}
+	
+	free(table);
+	free(cornerGroups);
+	free(groupCorners);
+	free(contributions);
+	free(groupSums);
+	free(signs);
+	free(groupTangents);
+	
+	return OK;
+}
+
+
+/*	For each corner, the triangle formed with its two neighbours gives the
+	direction of increasing u (as in MikkTSpace, from the u/v gradient). It is
+	projected into the corner normal's plane and weighted by the corner's
+	angle, also measured in that plane. Corners whose triangle has no u/v area
+	contribute nothing and are taken to be right-handed.
+*/
+static void ComputeCornerContributions(void *context, size_t start, size_t end, unsigned worker)
+{
+	const TangentCornerContext *ctx = (const TangentCornerContext *)context;
+	size_t					i;
+	unsigned				j, count, slot, prev, next;
+	Vector					normal, d1, d2, direction;
+	Vector2					t0, t1, t2;
+	Scalar					area, length, cosine;
+	
+	for (i = start; i != end; ++i)
+	{
+		const DDMeshFaceData *face = &ctx->faces[i];
+		count = face->vertexCount;
+		
+		for (j = 0; j != count; ++j)
+		{
+			slot = face->firstVertex + j;
+			prev = face->firstVertex + (j + count - 1) % count;
+			next = face->firstVertex + (j + 1) % count;
+			
+			normal = ctx->normals[ctx->normalIndices[slot]];
+			d1 = ctx->vertices[ctx->vertexIndices[next]] - ctx->vertices[ctx->vertexIndices[slot]];
+			d2 = ctx->vertices[ctx->vertexIndices[prev]] - ctx->vertices[ctx->vertexIndices[slot]];
+			t0 = ctx->texCoords[ctx->texCoordIndices[slot]];
+			t1 = ctx->texCoords[ctx->texCoordIndices[next]] - t0;
+			t2 = ctx->texCoords[ctx->texCoordIndices[prev]] - t0;
+			
+			area = t1.x * t2.y - t1.y * t2.x;
+			ctx->signs[slot] = (area < 0) ? -1 : 1;
+			ctx->contributions[slot].Set(0);
+			
+			direction = d1 * t2.y - d2 * t1.y;
+			direction -= normal * (normal * direction);
+			length = direction.Magnitude();
+			if (0 == area || length < 1e-20f)  continue;
+			
+			// Corner angle, with both edges projected into the normal's plane.
+			d1 -= normal * (normal * d1);
+			d2 -= normal * (normal * d2);
+			if (0 == d1.SquareMagnitude() || 0 == d2.SquareMagnitude())  continue;
+			cosine = d1.Direction() * d2.Direction();
+			cosine = (cosine < -1) ? -1 : ((1 < cosine) ? 1 : cosine);
+			
+			ctx->contributions[slot] = direction * (ctx->signs[slot] * acos(cosine) / length);
+		}
+	}
+}
+
+
+static void FinishGroupTangents(void *context, size_t start, size_t end, unsigned worker)
+{
+	const TangentGroupContext *ctx = (const TangentGroupContext *)context;
+	size_t					i;
+	unsigned				corner;
+	Vector					normal, tangent;
+	
+	for (i = start; i != end; ++i)
+	{
+		corner = ctx->groupCorners[i];
+		normal = ctx->normals[ctx->normalIndices[corner]];
+		
+		// Contributions are already in the normal's plane; this removes rounding drift.
+		tangent = ctx->groupSums[i];
+		tangent -= normal * (normal * tangent);
+		if (tangent.SquareMagnitude() < 1e-20f)
+		{
+			// No usable u/v mapping: any perpendicular will do, as long as it's stable.
+			tangent = normal % ((fabs(normal.x) < 0.9f) ? Vector(1, 0, 0) : Vector(0, 1, 0));
+			if (0 == tangent.SquareMagnitude())  tangent.Set(1, 0, 0);
+		}
+		
+		ctx->groupTangents[i].tangent = tangent.Direction();
+		ctx->groupTangents[i].sign = ctx->signs[corner];
+	}
+}
+
+
+static inline unsigned CornerKeyHash(DDMeshIndex inVertex, DDMeshIndex inNormal, DDMeshIndex inTexCoord, int8_t inSign)
+{
+	return ((unsigned)inVertex * 73856093U) ^ ((unsigned)inNormal * 19349663U) ^ ((unsigned)inTexCoord * 83492791U) ^ (inSign < 0 ? 0x9E3779B9U : 0);
+}
@@ -0,0 +1,57 @@
+/*
+	DDTangentGenerator.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Per-corner tangent generation following MikkTSpace conventions: corner
+	tangents from the u/v gradient of the triangle at each corner, weighted by
+	corner angle and averaged over corners sharing position, normal, u/v and
+	handedness.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDTANGENTGENERATOR_h
+#define INCLUDED_DDTANGENTGENERATOR_h
+
+#include "DDMeshTypes.h"
+
+
+/*	The parts of a mesh tangent generation looks at. The index arrays have
+	cornerCount entries, laid out as described by faces.
+*/
+typedef struct DDTangentMeshData
+{
+	const DDMeshFaceData	*faces;
+	unsigned				faceCount;
+	unsigned				cornerCount;
+	const Vector			*vertices;
+	const Vector			*normals;
+	const Vector2			*texCoords;
+	const DDMeshIndex		*vertexIndices;
+	const DDMeshIndex		*normalIndices;
+	const DDMeshIndex		*texCoordIndices;
+} DDTangentMeshData;
+
+
+/*	Write a tangent for each corner of inMesh to outTangents. Returns false if
+	working memory can't be allocated.
+*/
+bool DDGenerateCornerTangents(const DDTangentMeshData *inMesh, DDMeshTangent *outTangents);
+
+#endif	/* INCLUDED_DDTANGENTGENERATOR_h */
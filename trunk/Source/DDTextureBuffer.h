@@ -32,6 +32,7 @@
 	void					*_data;
 	id						_key;
 	NSURL					*_file;
+	BOOL					_uncaching;		// Set while the cache drops its reference; guarded by the class
 }
 
 + (id)textureWithFile:(NSURL *)inFile issues:(DDProblemReportManager *)ioIssues;
@@ -31,6 +31,7 @@
 #import <QuickTime/QuickTime.h>
 #import "DDErrorDescription.h"
 #import "DDProblemReportManager.h"
+#import "DDPNGDecoder.h"
 
 
 #if __BIG_ENDIAN__
@@ -48,7 +49,19 @@ static NSMutableDictionary		*sCache = nil;
 static BOOL						sShadowCacheInvalidate = YES;
 static NSMutableDictionary		*sImageCache = nil;
 
+/*	Textures are decoded before there is necessarily a GL context to ask for
+	GL_MAX_TEXTURE_SIZE, so image dimensions are checked against a fixed cap
+	instead; larger mip levels are skipped at upload anyway.
+*/
+enum
+{
+	kMaxTextureDimension		= 8192
+};
+
+
 static unsigned GetMaxTextureSize(void);
+static size_t TextureDataSize(unsigned inWidth, unsigned inHeight);
+static void BuildMipMaps(uint8_t *ioData, unsigned inWidth, unsigned inHeight);
 
 
 @interface DDTextureBuffer(Private)
@@ -56,6 +69,7 @@ static unsigned GetMaxTextureSize(void);
 - (id)initWithURL:(NSURL *)inURL key:(id)inKey issues:(DDProblemReportManager *)ioIssues;
 - (BOOL)loadNSImage:(NSImage *)inImage issues:(DDProblemReportManager *)ioIssues;
 - (BOOL)loadFSRef:(FSRef *)inFile issues:(DDProblemReportManager *)ioIssues;
+- (BOOL)loadPNGAtPath:(NSString *)inPath;
 
 #if USE_TEXTURE_VERIFICATION_WINDOW
 - (void)makeTextureVerificationWindowWithImage:(NSImage *)inImage;
@@ -63,6 +77,7 @@ static unsigned GetMaxTextureSize(void);
 
 + (void)sendDeferredRefCountChangedNotification;
 + (void)doSendRefCountChangedNotification;
++ (void)sendActiveSetChangedNotification;
 
 @end
 
@@ -76,14 +91,16 @@ static unsigned GetMaxTextureSize(void);
 	
 	TraceEnterMsg(@"Called for %@. {", [inFile absoluteURL]);
 	
-	result = [sCache objectForKey:inFile];
+	@synchronized ([DDTextureBuffer class])
+	{
+		result = [[sCache objectForKey:inFile] retain];
+	}
 	if (nil == result)
 	{
 		result = [[self alloc] initWithURL:inFile key:[inFile absoluteURL] issues:ioIssues];
 	}
 	else
 	{
-		[result retain];
 		TraceMessage(@"Using cached texture %@.", result);
 	}
 	
@@ -99,7 +116,10 @@ static unsigned GetMaxTextureSize(void);
 	DDTextureBuffer				*result;
 	NSURL						*url;
 	
-	result = [sCache objectForKey:@"placeholder"];
+	@synchronized ([DDTextureBuffer class])
+	{
+		result = [[sCache objectForKey:@"placeholder"] retain];
+	}
 	if (nil == result)
 	{
 		url = [NSURL fileURLWithPath:[[NSBundle mainBundle] pathForResource:@"Placeholder Texture" ofType:@"png"]];
@@ -107,7 +127,6 @@ static unsigned GetMaxTextureSize(void);
 	}
 	else
 	{
-		[result retain];
 		TraceMessage(@"Using cached texture %@.", result);
 	}
 	
@@ -122,9 +141,10 @@ static unsigned GetMaxTextureSize(void);
 	
 	BOOL					OK = YES;
 	FSRef					fsRef;
+	BOOL					onMainThread;
+	DDTextureBuffer			*existing = nil;
 	
 	assert(nil != inURL);
-	assert(nil == [sCache objectForKey:inURL]);
 	
 	self = [super init];
 	if (nil == self) OK = NO;
@@ -134,8 +154,20 @@ static unsigned GetMaxTextureSize(void);
 		_key = [inKey retain];
 		_file = [inURL retain];
 		
-		OK = CFURLGetFSRef((CFURLRef)inURL, &fsRef);
-		if (OK) OK = [self loadFSRef:&fsRef issues:ioIssues];
+		// PNGs are decoded directly; QuickTime handles other formats, and any PNG that needs rescaling.
+		OK = [inURL isFileURL] && [self loadPNGAtPath:[inURL path]];
+		if (!OK)
+		{
+			OK = CFURLGetFSRef((CFURLRef)inURL, &fsRef);
+			if (OK)
+			{
+				// Textures may be loaded by document loaders on background threads.
+				onMainThread = [NSThread isMainThread];
+				if (!onMainThread)  EnterMoviesOnThread(0);
+				OK = [self loadFSRef:&fsRef issues:ioIssues];
+				if (!onMainThread)  ExitMoviesOnThread();
+			}
+		}
 	}
 	
 	if (!OK)
@@ -146,10 +178,25 @@ static unsigned GetMaxTextureSize(void);
 	}
 	else
 	{
-		sShadowCacheInvalidate = YES;
-		if (nil == sCache) sCache = [[NSMutableDictionary alloc] init];
-		[sCache setObject:self forKey:inKey];
-		[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDTextureBufferActiveSetChanged object:[DDTextureBuffer class]];
+		@synchronized ([DDTextureBuffer class])
+		{
+			// Another thread may have loaded the same file in the meantime.
+			existing = [[sCache objectForKey:inKey] retain];
+			if (nil == existing)
+			{
+				sShadowCacheInvalidate = YES;
+				if (nil == sCache) sCache = [[NSMutableDictionary alloc] init];
+				[sCache setObject:self forKey:inKey];
+			}
+		}
+		
+		if (nil == existing)  [DDTextureBuffer sendActiveSetChangedNotification];
+		else
+		{
+			TraceMessage(@"Texture %@ was loaded concurrently, using cached texture.", inKey);
+			[self release];
+			self = existing;
+		}
 	}
 	
 	return self;
@@ -205,8 +252,8 @@ static unsigned GetMaxTextureSize(void);
 	// Set up buffer
 	if (!err)
 	{
-		dataSize = w * h * 4 * 4 / 3;
-		data = malloc(dataSize); // 4 / 3 ratio provides space for mipmaps
+		dataSize = TextureDataSize(w, h);
+		data = (0 != dataSize) ? malloc(dataSize) : NULL;
 		if (NULL == data)
 		{
 			err = memFullErr;
@@ -255,6 +302,66 @@ static unsigned GetMaxTextureSize(void);
 }
 
 
+/*	Decode straight into mip level 0, in the premultiplied ARGB layout the
+	importer path draws and -setUpCurrentTexture uploads, then box-filter the
+	smaller levels from it. Unlike the importer path there is no full-size
+	intermediate image and no colour matching, so the texels are as stored in
+	the file, as Oolite loads them. Returns NO, with nothing reported, if the
+	importer path should be used instead.
+*/
+- (BOOL)loadPNGAtPath:(NSString *)inPath
+{
+	TraceEnter();
+	
+	DDPNGDecoder			*decoder = NULL;
+	DDPNGResult				result;
+	unsigned				w = 0, h = 0;
+	uint8_t					*data = NULL;
+	size_t					dataSize;
+	BOOL					OK;
+	
+	result = DDPNGOpen([inPath fileSystemRepresentation], &decoder);
+	OK = (kDDPNGOK == result);
+	if (OK)
+	{
+		DDPNGGetSize(decoder, &w, &h);
+		OK = (w == RoundUpToPowerOf2(w) && h == RoundUpToPowerOf2(h));
+	}
+	if (OK)
+	{
+		dataSize = TextureDataSize(w, h);
+		OK = (0 != dataSize);
+	}
+	if (OK)
+	{
+		data = malloc(dataSize);
+		OK = (NULL != data);
+	}
+	if (OK)
+	{
+		result = DDPNGDecodePremultipliedARGB(decoder, data, w * 4);
+		OK = (kDDPNGOK == result);
+	}
+	DDPNGClose(decoder);
+	
+	if (OK)
+	{
+		BuildMipMaps(data, w, h);
+		_data = data;
+		_width = w;
+		_height = h;
+	}
+	else
+	{
+		TraceMessage(@"Not decoding %@ directly (result %i).", inPath, result);
+		free(data);
+	}
+	
+	return OK;
+	TraceExit();
+}
+
+
 - (void)dealloc
 {
 	free(_data);
@@ -262,9 +369,8 @@ static unsigned GetMaxTextureSize(void);
 	[_file autorelease];
 	
 	sShadowCacheInvalidate = YES;
-	NSNotificationCenter *nctr = [NSNotificationCenter defaultCenter];
-	[nctr postNotificationName:kNotificationDDTextureBufferActiveSetChanged object:[DDTextureBuffer class]];
-	[nctr removeObserver:nil name:nil object:self];
+	[DDTextureBuffer sendActiveSetChangedNotification];
+	[[NSNotificationCenter defaultCenter] removeObserver:nil name:nil object:self];
 	@synchronized (sImageCache)
 	{
 		[sImageCache removeObjectForKey:[NSValue valueWithPointer:self]];
@@ -285,12 +391,8 @@ static unsigned GetMaxTextureSize(void);
 }
 
 
-static BOOL sRemovingFromCache = NO;
-
 - (id)retain
 {
-	if (sRemovingFromCache) return self;
-	
 	[super retain];
 	[DDTextureBuffer sendDeferredRefCountChangedNotification];
 	
@@ -298,26 +400,34 @@ static BOOL sRemovingFromCache = NO;
 }
 
 
+/*	The cache holds a reference to each buffer; when only the cache's is
+	left, the buffer is removed from it. The count test and the removal are
+	made under the same lock as cache lookups, so that no other thread can
+	find the buffer, or release it concurrently, in between. Once it is out
+	of the cache, the last reference can only be the cache's, dropped here.
+*/
 - (void)release
 {
-	if (sRemovingFromCache) return;
-	
-	int retainCount = [self retainCount];
-	BOOL uncache = (retainCount == 2);
-	[super release];
+	BOOL					uncache;
 	
-	[DDTextureBuffer sendDeferredRefCountChangedNotification];
-	
-	if (uncache)
+	@synchronized ([DDTextureBuffer class])
 	{
-		if ([sCache objectForKey:_key] == self)
+		// The cache's own release of a buffer being uncached is accounted for below.
+		if (_uncaching)  return;
+		
+		uncache = (2 == [self retainCount] && [sCache objectForKey:_key] == self);
+		if (uncache)
 		{
-			sRemovingFromCache = YES;
+			_uncaching = YES;
 			[sCache removeObjectForKey:_key];
-			sRemovingFromCache = NO;
-			[self release];
+			_uncaching = NO;
+			sShadowCacheInvalidate = YES;
 		}
+		[super release];
 	}
+	
+	[DDTextureBuffer sendDeferredRefCountChangedNotification];
+	if (uncache)  [super release];
 }
 
 
@@ -340,7 +450,7 @@ static BOOL sRemovingFromCache = NO;
 	
 	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_STORAGE_HINT_APPLE, GL_STORAGE_SHARED_APPLE);
 	glPixelStorei(GL_UNPACK_CLIENT_STORAGE_APPLE, GL_TRUE);
-	dataSize = w * h * 4 * 4 / 3;
+	dataSize = TextureDataSize(w, h);
 	glTextureRangeAPPLE(GL_TEXTURE_2D, dataSize, data);
 	
 	if ([@"placeholder" isEqual:_key])
@@ -493,24 +603,91 @@ static BOOL sPendingDeferredRefCountChanged = NO;
 
 + (void)sendDeferredRefCountChangedNotification
 {
-	sPendingDeferredRefCountChanged = YES;
+	BOOL					schedule;
+	
+	// Buffers are retained and released by loader threads too.
+	@synchronized (self)
+	{
+		schedule = !sPendingDeferredRefCountChanged;
+		sPendingDeferredRefCountChanged = YES;
+	}
+	
 	// Call +doSendRefCountChangedNotification after current event is processed
-	[self performSelectorOnMainThread:@selector(doSendRefCountChangedNotification) withObject:nil waitUntilDone:NO];
+	if (schedule)  [self performSelectorOnMainThread:@selector(doSendRefCountChangedNotification) withObject:nil waitUntilDone:NO];
 }
 
 
 + (void)doSendRefCountChangedNotification
 {
-	if (sPendingDeferredRefCountChanged)
+	BOOL					send;
+	
+	@synchronized (self)
 	{
+		send = sPendingDeferredRefCountChanged;
 		sPendingDeferredRefCountChanged = NO;	// Ensure we only send the notification once per event cycle
-		[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDTextureBufferRefCountChanged object:self];
 	}
+	
+	if (send)  [[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDTextureBufferRefCountChanged object:self];
+}
+
+
++ (void)sendActiveSetChangedNotification
+{
+	if (![NSThread isMainThread])
+	{
+		[self performSelectorOnMainThread:_cmd withObject:nil waitUntilDone:NO];
+		return;
+	}
+	
+	[[NSNotificationCenter defaultCenter] postNotificationName:kNotificationDDTextureBufferActiveSetChanged object:[DDTextureBuffer class]];
 }
 
 @end
 
 
+// Each level after the first is a 2x2 box filter of the one before, down to the last level -setUpCurrentTexture uploads.
+static void BuildMipMaps(uint8_t *ioData, unsigned inWidth, unsigned inHeight)
+{
+	const uint8_t			*src, *row0, *row1;
+	uint8_t					*dst;
+	unsigned				w, h, x, y, c;
+	
+	src = ioData;
+	w = inWidth;
+	h = inHeight;
+	while (1 < w && 1 < h)
+	{
+		dst = (uint8_t *)src + w * h * 4;
+		for (y = 0; y != h / 2; ++y)
+		{
+			row0 = src + y * 2 * w * 4;
+			row1 = row0 + w * 4;
+			for (x = 0; x != w / 2; ++x)
+			{
+				for (c = 0; c != 4; ++c)
+				{
+					*dst++ = (row0[x * 8 + c] + row0[x * 8 + 4 + c] + row1[x * 8 + c] + row1[x * 8 + 4 + c] + 2) >> 2;
+				}
+			}
+		}
+		
+		src += w * h * 4;
+		w /= 2;
+		h /= 2;
+	}
+}
+
+
+// Size of an ARGB buffer with room for mipmaps (4 / 3 of the base level), or 0 if too big.
+static size_t TextureDataSize(unsigned inWidth, unsigned inHeight)
+{
+	if (0 == inWidth || 0 == inHeight || kMaxTextureDimension < inWidth || kMaxTextureDimension < inHeight)  return 0;
+	if (SIZE_MAX / 16 / inWidth < inHeight)  return 0;
+	
+	return (size_t)inWidth * inHeight * 4 * 4 / 3;
+}
+
+
 static unsigned GetMaxTextureSize(void)
 {
 	GLint				result;
@@ -0,0 +1,457 @@
+/*
+	DDTriangleBVH.cp
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "DDTriangleBVH.h"
+#include "GLUtilities.h"
+#include <float.h>
+
+
+enum
+{
+	kMaxLeafTriangles		= 4,
+	kMaxSpatialSplitDepth	= 48,	// Below this depth, split by count so tree depth is bounded
+	kMaxTraversalDepth		= kMaxSpatialSplitDepth + 34
+};
+
+
+static inline Scalar BoxDistanceSquared(const Vector &inPoint, const Vector &inMin, const Vector &inMax);
+static inline bool RayHitsBox(const Vector &inOrigin, const Vector &inInvDirection, const Vector &inMin, const Vector &inMax, Scalar inTMin, Scalar inTMax);
+static inline bool RayHitsTriangle(const Vector &inOrigin, const Vector &inDirection, const Vector &inA, const Vector &inB, const Vector &inC, Scalar &outT, Scalar &outU, Scalar &outV);
+static inline Vector SafeReciprocal(const Vector &inVector);
+
+
+DDTriangleBVH::DDTriangleBVH(const Vector *inVertices, uint32_t inTriangleCount, const uint32_t *inTags)
+	: _nodes(NULL), _nodeCount(0), _triangles(NULL), _triangleCount(inTriangleCount)
+{
+	Vector					*centroids = NULL;
+	uint32_t				i;
+	
+	if (0 == inTriangleCount || NULL == inVertices)
+	{
+		_triangleCount = 0;
+		return;
+	}
+	
+	_triangles = (Triangle *)malloc(sizeof *_triangles * inTriangleCount);
+	// A binary tree with at least one triangle per leaf has fewer than 2n nodes.
+	_nodes = (Node *)malloc(sizeof *_nodes * inTriangleCount * 2);
+	centroids = (Vector *)malloc(sizeof *centroids * inTriangleCount);
+	
+	if (NULL == _triangles || NULL == _nodes || NULL == centroids)
+	{
+		free(_triangles);
+		free(_nodes);
+		free(centroids);
+		_triangles = NULL;
+		_nodes = NULL;
+		return;
+	}
+	
+	for (i = 0; i != inTriangleCount; ++i)
+	{
+		_triangles[i].a = inVertices[i * 3];
+		_triangles[i].b = inVertices[i * 3 + 1];
+		_triangles[i].c = inVertices[i * 3 + 2];
+		_triangles[i].index = i;
+		_triangles[i].tag = (NULL != inTags) ? inTags[i] : i;
+		centroids[i] = avg(_triangles[i].a, _triangles[i].b, _triangles[i].c);
+	}
+	
+	Build(0, inTriangleCount, centroids, 0);
+	free(centroids);
+	
+	// Give back unused node space.
+	Node *trimmed = (Node *)realloc(_nodes, sizeof *_nodes * _nodeCount);
+	if (NULL != trimmed)  _nodes = trimmed;
+}
+
+
+DDTriangleBVH::~DDTriangleBVH()
+{
+	free(_nodes);
+	free(_triangles);
+}
+
+
+size_t DDTriangleBVH::MemoryUsage(void) const
+{
+	return sizeof *this + sizeof *_nodes * _nodeCount + sizeof *_triangles * _triangleCount;
+}
+
+
+void DDTriangleBVH::GetBounds(Vector &outMin, Vector &outMax) const
+{
+	if (0 != _nodeCount)
+	{
+		outMin = _nodes[0].min;
+		outMax = _nodes[0].max;
+	}
+	else
+	{
+		outMin.Set(0, 0, 0);
+		outMax.Set(0, 0, 0);
+	}
+}
+
+
+/*	Top-down build, splitting at the midpoint of the longest axis of the
+	centroid bounds. If that fails to separate anything (all centroids on one
+	side), or if the tree is getting too deep, split the range in half instead.
+	This keeps the depth within what the fixed-size traversal stacks can hold.
+*/
+uint32_t DDTriangleBVH::Build(uint32_t inFirst, uint32_t inCount, Vector *inCentroids, unsigned inDepth)
+{
+	uint32_t				nodeIndex = _nodeCount++;
+	Node					&node = _nodes[nodeIndex];
+	Vector					cMin, cMax, extent;
+	uint32_t				i, axis, mid;
+	Scalar					split;
+	
+	node.min = node.max = _triangles[inFirst].a;
+	cMin = cMax = inCentroids[inFirst];
+	for (i = inFirst; i != inFirst + inCount; ++i)
+	{
+		node.min = cmin(node.min, cmin(_triangles[i].a, cmin(_triangles[i].b, _triangles[i].c)));
+		node.max = cmax(node.max, cmax(_triangles[i].a, cmax(_triangles[i].b, _triangles[i].c)));
+		cMin = cmin(cMin, inCentroids[i]);
+		cMax = cmax(cMax, inCentroids[i]);
+	}
+	
+	if (inCount <= kMaxLeafTriangles)
+	{
+		node.first = inFirst;
+		node.count = inCount;
+		return nodeIndex;
+	}
+	
+	extent = cMax - cMin;
+	axis = 0;
+	if (extent[axis] < extent[1])  axis = 1;
+	if (extent[axis] < extent[2])  axis = 2;
+	split = (cMin[axis] + cMax[axis]) * 0.5f;
+	
+	// Partition in place.
+	mid = inFirst;
+	if (kMaxSpatialSplitDepth < inDepth)  split = -INFINITY;
+	for (i = inFirst; i != inFirst + inCount; ++i)
+	{
+		if (inCentroids[i][axis] < split)
+		{
+			if (i != mid)
+			{
+				Triangle tri = _triangles[i]; _triangles[i] = _triangles[mid]; _triangles[mid] = tri;
+				Vector c = inCentroids[i]; inCentroids[i] = inCentroids[mid]; inCentroids[mid] = c;
+			}
+			++mid;
+		}
+	}
+	
+	if (mid == inFirst || mid == inFirst + inCount)  mid = inFirst + inCount / 2;
+	
+	node.count = 0;
+	Build(inFirst, mid - inFirst, inCentroids, inDepth + 1);
+	_nodes[nodeIndex].first = Build(mid, inFirst + inCount - mid, inCentroids, inDepth + 1);
+	
+	return nodeIndex;
+}
+
+
+bool DDTriangleBVH::ClosestPoint(const Vector &inPoint, Scalar inMaxDistance, DDTriangleBVHHit &outHit) const
+{
+	uint32_t				stack[kMaxTraversalDepth];
+	unsigned				sp = 0;
+	Scalar					bestSq = inMaxDistance * inMaxDistance;
+	bool					found = false;
+	
+	if (0 == _nodeCount)  return false;
+	
+	stack[sp++] = 0;
+	while (0 != sp)
+	{
+		const Node &node = _nodes[stack[--sp]];
+		if (bestSq < BoxDistanceSquared(inPoint, node.min, node.max))  continue;
+		
+		if (0 != node.count)
+		{
+			for (uint32_t i = node.first; i != node.first + node.count; ++i)
+			{
+				const Triangle &tri = _triangles[i];
+				Scalar u, v;
+				Vector closest = ClosestPointOnTriangle(inPoint, tri.a, tri.b, tri.c, u, v);
+				Scalar distSq = (closest - inPoint).SquareMagnitude();
+				if (distSq <= bestSq)
+				{
+					bestSq = distSq;
+					found = true;
+					outHit.point = closest;
+					outHit.u = u;
+					outHit.v = v;
+					outHit.triangle = tri.index;
+					outHit.tag = tri.tag;
+				}
+			}
+		}
+		else
+		{
+			// Visit nearer child first, so that the far one is more likely to be culled.
+			uint32_t left = (uint32_t)(&node - _nodes) + 1, right = node.first;
+			Scalar dl = BoxDistanceSquared(inPoint, _nodes[left].min, _nodes[left].max);
+			Scalar dr = BoxDistanceSquared(inPoint, _nodes[right].min, _nodes[right].max);
+			if (dl < dr)  { stack[sp++] = right; stack[sp++] = left; }
+			else  { stack[sp++] = left; stack[sp++] = right; }
+		}
+	}
+	
+	if (found)  outHit.distance = sqrtf(bestSq);
+	return found;
+}
+
+
+bool DDTriangleBVH::IntersectRay(const Vector &inOrigin, const Vector &inDirection, Scalar inTMin, Scalar inTMax, DDTriangleBVHHit &outHit) const
+{
+	uint32_t				stack[kMaxTraversalDepth];
+	unsigned				sp = 0;
+	Vector					invDir = SafeReciprocal(inDirection);
+	bool					found = false;
+	Scalar					t, u, v;
+	
+	if (0 == _nodeCount)  return false;
+	
+	stack[sp++] = 0;
+	while (0 != sp)
+	{
+		const Node &node = _nodes[stack[--sp]];
+		if (!RayHitsBox(inOrigin, invDir, node.min, node.max, inTMin, inTMax))  continue;
+		
+		if (0 != node.count)
+		{
+			for (uint32_t i = node.first; i != node.first + node.count; ++i)
+			{
+				const Triangle &tri = _triangles[i];
+				if (RayHitsTriangle(inOrigin, inDirection, tri.a, tri.b, tri.c, t, u, v) && inTMin < t && t < inTMax)
+				{
+					inTMax = t;
+					found = true;
+					outHit.distance = t;
+					outHit.u = u;
+					outHit.v = v;
+					outHit.triangle = tri.index;
+					outHit.tag = tri.tag;
+				}
+			}
+		}
+		else
+		{
+			uint32_t left = (uint32_t)(&node - _nodes) + 1, right = node.first;
+			// Push far child first, judged by direction sign on the node's widest axis.
+			Vector extent = node.max - node.min;
+			unsigned axis = 0;
+			if (extent[axis] < extent[1])  axis = 1;
+			if (extent[axis] < extent[2])  axis = 2;
+			if (inDirection[axis] < 0)  { stack[sp++] = left; stack[sp++] = right; }
+			else  { stack[sp++] = right; stack[sp++] = left; }
+		}
+	}
+	
+	if (found)  outHit.point = inOrigin + inDirection * outHit.distance;
+	return found;
+}
+
+
+bool DDTriangleBVH::Occluded(const Vector &inOrigin, const Vector &inDirection, Scalar inTMin, Scalar inTMax) const
+{
+	uint32_t				stack[kMaxTraversalDepth];
+	unsigned				sp = 0;
+	Vector					invDir = SafeReciprocal(inDirection);
+	Scalar					t, u, v;
+	
+	if (0 == _nodeCount)  return false;
+	
+	stack[sp++] = 0;
+	while (0 != sp)
+	{
+		const Node &node = _nodes[stack[--sp]];
+		if (!RayHitsBox(inOrigin, invDir, node.min, node.max, inTMin, inTMax))  continue;
+		
+		if (0 != node.count)
+		{
+			for (uint32_t i = node.first; i != node.first + node.count; ++i)
+			{
+				const Triangle &tri = _triangles[i];
+				if (RayHitsTriangle(inOrigin, inDirection, tri.a, tri.b, tri.c, t, u, v) && inTMin < t && t < inTMax)  return true;
+			}
+		}
+		else
+		{
+			stack[sp++] = node.first;
+			stack[sp++] = (uint32_t)(&node - _nodes) + 1;
+		}
+	}
+	
+	return false;
+}
+
+
+uint32_t DDTriangleBVH::CountIntersections(const Vector &inOrigin, const Vector &inDirection, Scalar inTMin, Scalar inTMax) const
+{
+	uint32_t				stack[kMaxTraversalDepth];
+	unsigned				sp = 0;
+	Vector					invDir = SafeReciprocal(inDirection);
+	Scalar					t, u, v;
+	uint32_t				count = 0;
+	
+	if (0 == _nodeCount)  return 0;
+	
+	stack[sp++] = 0;
+	while (0 != sp)
+	{
+		const Node &node = _nodes[stack[--sp]];
+		if (!RayHitsBox(inOrigin, invDir, node.min, node.max, inTMin, inTMax))  continue;
+		
+		if (0 != node.count)
+		{
+			for (uint32_t i = node.first; i != node.first + node.count; ++i)
+			{
+				const Triangle &tri = _triangles[i];
+				if (RayHitsTriangle(inOrigin, inDirection, tri.a, tri.b, tri.c, t, u, v) && inTMin < t && t < inTMax)  ++count;
+			}
+		}
+		else
+		{
+			stack[sp++] = node.first;
+			stack[sp++] = (uint32_t)(&node - _nodes) + 1;
+		}
+	}
+	
+	return count;
+}
+
+
+// After Ericson, Real-Time Collision Detection, 5.1.5.
+Vector DDTriangleBVH::ClosestPointOnTriangle(const Vector &p, const Vector &a, const Vector &b, const Vector &c, Scalar &outU, Scalar &outV)
+{
+	Vector					ab = b - a, ac = c - a, ap = p - a;
+	Scalar					d1 = ab * ap, d2 = ac * ap;
+	
+	if (d1 <= 0 && d2 <= 0)  { outU = 0; outV = 0; return a; }
+	
+	Vector					bp = p - b;
+	Scalar					d3 = ab * bp, d4 = ac * bp;
+	if (d3 >= 0 && d4 <= d3)  { outU = 1; outV = 0; return b; }
+	
+	Scalar					vc = d1 * d4 - d3 * d2;
+	if (vc <= 0 && d1 >= 0 && d3 <= 0)
+	{
+		Scalar v = d1 / (d1 - d3);
+		outU = v; outV = 0;
+		return a + ab * v;
+	}
+	
+	Vector					cp = p - c;
+	Scalar					d5 = ab * cp, d6 = ac * cp;
+	if (d6 >= 0 && d5 <= d6)  { outU = 0; outV = 1; return c; }
+	
+	Scalar					vb = d5 * d2 - d1 * d6;
+	if (vb <= 0 && d2 >= 0 && d6 <= 0)
+	{
+		Scalar w = d2 / (d2 - d6);
+		outU = 0; outV = w;
+		return a + ac * w;
+	}
+	
+	Scalar					va = d3 * d6 - d5 * d4;
+	if (va <= 0 && (d4 - d3) >= 0 && (d5 - d6) >= 0)
+	{
+		Scalar w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		outU = 1 - w; outV = w;
+		return b + (c - b) * w;
+	}
+	
+	Scalar					denom = 1 / (va + vb + vc);
+	Scalar					v = vb * denom, w = vc * denom;
+	outU = v; outV = w;
+	return a + ab * v + ac * w;
+}
+
+
+static inline Scalar BoxDistanceSquared(const Vector &inPoint, const Vector &inMin, const Vector &inMax)
+{
+	Scalar					result = 0, d;
+	
+	for (unsigned i = 0; i != 3; ++i)
+	{
+		if (inPoint[i] < inMin[i])  { d = inMin[i] - inPoint[i]; result += d * d; }
+		else if (inMax[i] < inPoint[i])  { d = inPoint[i] - inMax[i]; result += d * d; }
+	}
+	return result;
+}
+
+
+static inline bool RayHitsBox(const Vector &inOrigin, const Vector &inInvDirection, const Vector &inMin, const Vector &inMax, Scalar inTMin, Scalar inTMax)
+{
+	for (unsigned i = 0; i != 3; ++i)
+	{
+		Scalar t0 = (inMin[i] - inOrigin[i]) * inInvDirection[i];
+		Scalar t1 = (inMax[i] - inOrigin[i]) * inInvDirection[i];
+		if (t1 < t0)  { Scalar tmp = t0; t0 = t1; t1 = tmp; }
+		if (inTMin < t0)  inTMin = t0;
+		if (t1 < inTMax)  inTMax = t1;
+		if (inTMax < inTMin)  return false;
+	}
+	return true;
+}
+
+
+// Möller-Trumbore, double-sided.
+static inline bool RayHitsTriangle(const Vector &inOrigin, const Vector &inDirection, const Vector &inA, const Vector &inB, const Vector &inC, Scalar &outT, Scalar &outU, Scalar &outV)
+{
+	Vector					e1 = inB - inA, e2 = inC - inA;
+	Vector					p = inDirection % e2;
+	Scalar					det = e1 * p, invDet;
+	
+	if (fabsf(det) < 1e-12f)  return false;
+	invDet = 1 / det;
+	
+	Vector					s = inOrigin - inA;
+	outU = (s * p) * invDet;
+	if (outU < 0 || 1 < outU)  return false;
+	
+	Vector					q = s % e1;
+	outV = (inDirection * q) * invDet;
+	if (outV < 0 || 1 < outU + outV)  return false;
+	
+	outT = (e2 * q) * invDet;
+	return true;
+}
+
+
+static inline Vector SafeReciprocal(const Vector &inVector)
+{
+	Vector					result;
+	
+	for (unsigned i = 0; i != 3; ++i)
+	{
+		result[i] = (0 != inVector[i]) ? 1 / inVector[i] : FLT_MAX;
+	}
+	return result;
+}
@@ -0,0 +1,103 @@
+/*
+	DDTriangleBVH.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Bounding volume hierarchy over a triangle soup, for closest-point and ray
+	queries. Built once, then read-only, so queries may be made from several
+	threads concurrently.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef INCLUDED_DDTRIANGLEBVH_h
+#define INCLUDED_DDTRIANGLEBVH_h
+
+#include "phystypes.h"
+
+
+typedef struct DDTriangleBVHHit
+{
+	Vector					point;			// Hit or closest point
+	Scalar					distance;		// Distance to point (closest-point) or ray parameter (ray)
+	Scalar					u, v;			// Barycentric co-ordinates relative to second and third vertex
+	uint32_t				triangle;		// Index of triangle as passed to constructor
+	uint32_t				tag;			// Caller-supplied tag, or triangle index if none
+} DDTriangleBVHHit;
+
+
+class DDTriangleBVH
+{
+public:
+	/*	inVertices is an array of 3 * inTriangleCount vertices. inTags, if not
+		NULL, is an array of inTriangleCount values reported back in hits;
+		typically the index of the polygon each triangle was cut from.
+	*/
+							DDTriangleBVH(const Vector *inVertices, uint32_t inTriangleCount, const uint32_t *inTags = NULL);
+							~DDTriangleBVH();
+	
+	bool					IsValid(void) const			{ return _nodes != NULL || _triangleCount == 0; }
+	uint32_t				TriangleCount(void) const	{ return _triangleCount; }
+	uint32_t				NodeCount(void) const		{ return _nodeCount; }
+	size_t					MemoryUsage(void) const;
+	
+	void					GetBounds(Vector &outMin, Vector &outMax) const;
+	
+	// Closest point on any triangle within inMaxDistance of inPoint.
+	bool					ClosestPoint(const Vector &inPoint, Scalar inMaxDistance, DDTriangleBVHHit &outHit) const;
+	
+	// Nearest ray hit with parameter in (inTMin, inTMax). inDirection need not be normalized.
+	bool					IntersectRay(const Vector &inOrigin, const Vector &inDirection, Scalar inTMin, Scalar inTMax, DDTriangleBVHHit &outHit) const;
+	
+	// Any ray hit with parameter in (inTMin, inTMax); cheaper than IntersectRay().
+	bool					Occluded(const Vector &inOrigin, const Vector &inDirection, Scalar inTMin, Scalar inTMax) const;
+	
+	// Number of triangles crossed by a ray, for inside/outside parity tests.
+	uint32_t				CountIntersections(const Vector &inOrigin, const Vector &inDirection, Scalar inTMin, Scalar inTMax) const;
+	
+	// Closest point on a single triangle, and its barycentric co-ordinates.
+	static Vector			ClosestPointOnTriangle(const Vector &inPoint, const Vector &inA, const Vector &inB, const Vector &inC, Scalar &outU, Scalar &outV);
+	
+private:
+	struct Node
+	{
+		Vector				min, max;
+		uint32_t			first;			// First triangle for leaves, second child for interior nodes
+		uint32_t			count;			// Triangle count for leaves, 0 for interior nodes
+	};
+	
+	struct Triangle
+	{
+		Vector				a, b, c;
+		uint32_t			index;
+		uint32_t			tag;
+	};
+	
+	Node					*_nodes;
+	uint32_t				_nodeCount;
+	Triangle				*_triangles;
+	uint32_t				_triangleCount;
+	
+	uint32_t				Build(uint32_t inFirst, uint32_t inCount, Vector *inCentroids, unsigned inDepth);
+	
+	// Not copyable.
+							DDTriangleBVH(const DDTriangleBVH &);
+	DDTriangleBVH			&operator=(const DDTriangleBVH &);
+};
+
+#endif	/* INCLUDED_DDTRIANGLEBVH_h */
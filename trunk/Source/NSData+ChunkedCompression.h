@@ -0,0 +1,52 @@
+/*
+	NSData+ChunkedCompression.h
+	Dry Dock for Oolite
+	$Id$
+	
+	Category adding chunked, multithreaded compression to NSData. The data is
+	split into fixed-size chunks which are compressed independently, so both
+	compression and decompression can use every core.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "NSData+Deflate.h"
+
+
+typedef enum
+{
+	kDDCompressionDeflate		= 0,	// zlib, levels 0-9.
+	kDDCompressionFastLZ		= 1,	// DDLZCompression, levels 1-9.
+	
+	kDDCompressionCodecCount
+} DDCompressionCodec;
+
+
+@interface NSData (ChunkedCompression)
+
+/*	Returns inPrefix, followed by a chunk index of one little-endian uint32
+	per chunk giving its compressed size, followed by the chunks. A chunk
+	which doesn't get smaller is stored as is, which is indicated by its
+	compressed size being equal to its uncompressed size.
+*/
+- (NSData *)chunkCompressedDataPrefixedWith:(NSData *)inPrefix codec:(DDCompressionCodec)inCodec level:(int)inLevel chunkSize:(size_t)inChunkSize;
+
+// Decompress data written by the above, starting inOffset bytes into the receiver (i.e., after the prefix).
+- (NSData_InflateResult)chunkDecompressedData:(NSData **)outData fromOffset:(size_t)inOffset outputSize:(size_t)inSize codec:(DDCompressionCodec)inCodec chunkSize:(size_t)inChunkSize;
+
+@end
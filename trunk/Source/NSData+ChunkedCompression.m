@@ -0,0 +1,315 @@
+/*
+	NSData+ChunkedCompression.m
+	Dry Dock for Oolite
+	$Id$
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#import "NSData+ChunkedCompression.h"
+#import <zlib.h>
+#import "DDLZCompression.h"
+#import "DDParallel.h"
+#import "DDErrorDescription.h"
+#import "Logging.h"
+
+
+typedef struct
+{
+	const uint8_t			*source;
+	size_t					sourceLength;
+	size_t					chunkSize;
+	DDCompressionCodec		codec;
+	int						level;
+	uint8_t					**chunks;
+	uint32_t				*chunkLengths;
+	volatile BOOL			failed;
+} CompressContext;
+
+
+typedef struct
+{
+	const uint8_t			*source;
+	const size_t			*chunkOffsets;
+	const uint32_t			*chunkLengths;
+	uint8_t					*dest;
+	size_t					destLength;
+	size_t					chunkSize;
+	DDCompressionCodec		codec;
+	volatile BOOL			failed;
+} DecompressContext;
+
+
+static void CompressChunks(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+static void DecompressChunks(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+
+
+static inline size_t ChunkCount(size_t inLength, size_t inChunkSize)
+{
+	return (inLength + inChunkSize - 1) / inChunkSize;
+}
+
+
+static inline size_t ChunkLength(size_t inIndex, size_t inLength, size_t inChunkSize)
+{
+	size_t start = inIndex * inChunkSize;
+	return (inLength - start < inChunkSize) ? inLength - start : inChunkSize;
+}
+
+
+@implementation NSData (ChunkedCompression)
+
+- (NSData *)chunkCompressedDataPrefixedWith:(NSData *)inPrefix codec:(DDCompressionCodec)inCodec level:(int)inLevel chunkSize:(size_t)inChunkSize
+{
+	TraceEnter();
+	
+	BOOL					OK = YES;
+	CompressContext			context = { 0 };
+	size_t					i, chunkCount, prefixLength = 0, indexLength, totalLength = 0;
+	uint8_t					*bytes = NULL, *next;
+	uint32_t				*index;
+	
+	if (kDDCompressionCodecCount <= inCodec || 0 == inChunkSize || UINT32_MAX < inChunkSize) return nil;
+	if (kDDCompressionDeflate == inCodec && (inLevel < Z_DEFAULT_COMPRESSION || Z_BEST_COMPRESSION < inLevel))  inLevel = Z_DEFAULT_COMPRESSION;
+	
+	context.source = [self bytes];
+	context.sourceLength = [self length];
+	context.chunkSize = inChunkSize;
+	context.codec = inCodec;
+	context.level = inLevel;
+	
+	chunkCount = ChunkCount(context.sourceLength, inChunkSize);
+	context.chunks = calloc(chunkCount + 1, sizeof *context.chunks);
+	context.chunkLengths = calloc(chunkCount + 1, sizeof *context.chunkLengths);
+	if (NULL == context.chunks || NULL == context.chunkLengths)
+	{
+		LogMessage(@"Failed to allocate compression chunk table (%lu chunks).", (unsigned long)chunkCount);
+		OK = NO;
+	}
+	
+	if (OK)
+	{
+		DDParallelApply(chunkCount, 1, CompressChunks, &context);
+		OK = !context.failed;
+	}
+	
+	if (OK)
+	{
+		prefixLength = [inPrefix length];
+		indexLength = chunkCount * sizeof (uint32_t);
+		totalLength = prefixLength + indexLength;
+		for (i = 0; i != chunkCount; i++)  totalLength += context.chunkLengths[i];
+		
+		bytes = malloc(totalLength ? totalLength : 1);
+		if (NULL == bytes)
+		{
+			LogMessage(@"Failed to allocate compression buffer (%lu bytes).", (unsigned long)totalLength);
+			OK = NO;
+		}
+	}
+	
+	if (OK)
+	{
+		if (0 != prefixLength)  bcopy([inPrefix bytes], bytes, prefixLength);
+		index = (uint32_t *)(bytes + prefixLength);
+		next = bytes + prefixLength + indexLength;
+		
+		for (i = 0; i != chunkCount; i++)
+		{
+			index[i] = CFSwapInt32HostToLittle(context.chunkLengths[i]);
+			// A NULL chunk is stored uncompressed.
+			bcopy(context.chunks[i] ? context.chunks[i] : context.source + i * inChunkSize, next, context.chunkLengths[i]);
+			next += context.chunkLengths[i];
+		}
+	}
+	
+	if (NULL != context.chunks)
+	{
+		for (i = 0; i != chunkCount; i++)  free(context.chunks[i]);
+		free(context.chunks);
+	}
+	free(context.chunkLengths);
+	
+	return OK ? [NSData dataWithBytesNoCopy:bytes length:totalLength freeWhenDone:YES] : nil;
+	TraceExit();
+}
+
+
+- (NSData_InflateResult)chunkDecompressedData:(NSData **)outData fromOffset:(size_t)inOffset outputSize:(size_t)inSize codec:(DDCompressionCodec)inCodec chunkSize:(size_t)inChunkSize
+{
+	TraceEnter();
+	
+	NSData_InflateResult	result = kInflateSuccess;
+	DecompressContext		context = { 0 };
+	size_t					i, chunkCount = 0, selfLength, offset;
+	const uint32_t			*index;
+	uint32_t				*chunkLengths = NULL;
+	size_t					*chunkOffsets = NULL;
+	uint8_t					*bytes = NULL;
+	
+	if (NULL == outData || kDDCompressionCodecCount <= inCodec || 0 == inChunkSize)  result = kInflateParamError;
+	
+	selfLength = [self length];
+	if (kInflateSuccess == result)
+	{
+		chunkCount = ChunkCount(inSize, inChunkSize);
+		if (selfLength < inOffset || (selfLength - inOffset) / sizeof (uint32_t) < chunkCount)  result = kInflateDecompressionFailure;
+	}
+	
+	if (kInflateSuccess == result)
+	{
+		bytes = malloc(inSize ? inSize : 1);
+		chunkLengths = malloc((chunkCount + 1) * sizeof *chunkLengths);
+		chunkOffsets = malloc((chunkCount + 1) * sizeof *chunkOffsets);
+		if (NULL == bytes || NULL == chunkLengths || NULL == chunkOffsets)  result = kInflateAllocationFailure;
+	}
+	
+	if (kInflateSuccess == result)
+	{
+		// Validate the index up front, so the workers can trust it.
+		index = (const uint32_t *)((const uint8_t *)[self bytes] + inOffset);
+		offset = inOffset + chunkCount * sizeof (uint32_t);
+		for (i = 0; i != chunkCount; i++)
+		{
+			chunkLengths[i] = CFSwapInt32LittleToHost(index[i]);
+			chunkOffsets[i] = offset;
+			if (selfLength - offset < chunkLengths[i] || ChunkLength(i, inSize, inChunkSize) < chunkLengths[i])
+			{
+				result = kInflateDecompressionFailure;
+				break;
+			}
+			offset += chunkLengths[i];
+		}
+	}
+	
+	if (kInflateSuccess == result)
+	{
+		context.source = [self bytes];
+		context.chunkOffsets = chunkOffsets;
+		context.chunkLengths = chunkLengths;
+		context.dest = bytes;
+		context.destLength = inSize;
+		context.chunkSize = inChunkSize;
+		context.codec = inCodec;
+		
+		DDParallelApply(chunkCount, 1, DecompressChunks, &context);
+		if (context.failed)  result = kInflateDecompressionFailure;
+	}
+	
+	if (kInflateSuccess == result)
+	{
+		*outData = [NSData dataWithBytesNoCopy:bytes length:inSize freeWhenDone:YES];
+		if (nil == *outData)  result = kInflateAllocationFailure;
+		else  bytes = NULL;
+	}
+	
+	free(bytes);
+	free(chunkLengths);
+	free(chunkOffsets);
+	
+	return result;
+	TraceExit();
+}
+
+@end
+
+
+static void CompressChunks(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	CompressContext			*context = inContext;
+	size_t					i, length, capacity;
+	uLongf					zLength;
+	int						zResult;
+	uint8_t					*buffer;
+	
+	for (i = inStart; i != inEnd && !context->failed; i++)
+	{
+		const uint8_t *source = context->source + i * context->chunkSize;
+		length = ChunkLength(i, context->sourceLength, context->chunkSize);
+		
+		capacity = (kDDCompressionDeflate == context->codec) ? compressBound(length) : DDLZCompressBound(length);
+		buffer = malloc(capacity);
+		if (NULL == buffer)
+		{
+			context->failed = YES;
+			return;
+		}
+		
+		if (kDDCompressionDeflate == context->codec)
+		{
+			zLength = capacity;
+			zResult = compress2(buffer, &zLength, source, length, context->level);
+			if (Z_OK != zResult)
+			{
+				LogMessage(@"Compression failed (%@).", ZLibErrorToNSString(zResult));
+				context->failed = YES;
+			}
+			capacity = zLength;
+		}
+		else
+		{
+			capacity = DDLZCompress(source, length, buffer, capacity, context->level);
+			if (0 == capacity)  context->failed = YES;
+		}
+		
+		if (length <= capacity)
+		{
+			// Incompressible; store instead.
+			free(buffer);
+			buffer = NULL;
+			capacity = length;
+		}
+		
+		context->chunks[i] = buffer;
+		context->chunkLengths[i] = capacity;
+	}
+}
+
+
+static void DecompressChunks(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	DecompressContext		*context = inContext;
+	size_t					i, length;
+	uLongf					zLength;
+	BOOL					OK;
+	
+	for (i = inStart; i != inEnd && !context->failed; i++)
+	{
+		const uint8_t *source = context->source + context->chunkOffsets[i];
+		uint8_t *dest = context->dest + i * context->chunkSize;
+		length = ChunkLength(i, context->destLength, context->chunkSize);
+		
+		if (context->chunkLengths[i] == length)
+		{
+			bcopy(source, dest, length);
+			continue;
+		}
+		
+		if (kDDCompressionDeflate == context->codec)
+		{
+			zLength = length;
+			OK = Z_OK == uncompress(dest, &zLength, source, context->chunkLengths[i]) && zLength == length;
+		}
+		else
+		{
+			OK = DDLZDecompress(source, context->chunkLengths[i], dest, length);
+		}
+		
+		if (!OK)  context->failed = YES;
+	}
+}
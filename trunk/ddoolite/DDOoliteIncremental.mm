@@ -0,0 +1,547 @@
+/*
+	DDOoliteIncremental.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	Incremental batch conversion for ddoolite: content hashes of inputs and
+	their textures are kept in a manifest, so unchanged models are skipped
+	without being parsed.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ENABLE_TRACE 0
+
+#import "ddoolite.h"
+#import "DDCollisionOctree.h"
+#import "DDParallel.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import <CommonCrypto/CommonDigest.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+
+/*	Manifest layout:
+	{
+		version = "<ddoolite version>";
+		options = "<description of conversion options>";
+		files =		// One per input converted successfully
+		{
+			"<input path>" = { hash; size; modified; output = "<path>"; textures = { "<path>" = "<hash>"; }; };
+		};
+		textures =
+		{
+			"<texture path>" = { hash; size; modified; };
+		};
+	}
+	size and modified let a file whose size and modification date are
+	unchanged keep its recorded hash without being read. A texture hash of ""
+	records a place that was searched before the texture actually used and
+	held nothing; a texture appearing there later invalidates the entry.
+*/
+static NSString * const kManifestVersionKey		= @"version";
+static NSString * const kManifestOptionsKey		= @"options";
+static NSString * const kManifestFilesKey		= @"files";
+static NSString * const kManifestTexturesKey	= @"textures";
+static NSString * const kFileHashKey			= @"hash";
+static NSString * const kFileSizeKey			= @"size";
+static NSString * const kFileModifiedKey		= @"modified";
+static NSString * const kFileOutputKey			= @"output";
+static NSString * const kFileTexturesKey		= @"textures";
+
+
+enum
+{
+	kHashStringLength		= CC_SHA1_DIGEST_LENGTH * 2
+};
+
+
+typedef struct FileState
+{
+	const char				*path;
+	const char				*knownHash;		// From the manifest, or NULL
+	long long				knownSize;
+	double					knownModified;
+	long long				size;
+	double					modified;
+	BOOL					exists;
+	char					hash[kHashStringLength + 1];
+} FileState;
+
+
+static NSString *ManifestPath(const DDOoliteJob *inJob);
+static NSString *OutputPath(const DDOoliteJob *inJob, NSString *inFile, NSString *inCommonDirectory);
+static NSString *AbsolutePath(NSString *inPath);
+static NSString *OptionsDescription(const DDOoliteJob *inJob);
+static BOOL IsUpToDate(const DDOoliteJob *inJob, NSDictionary *inEntry, NSDictionary *inState, NSString *inOutFile, NSDictionary *inTextureStates);
+static void HashFiles(NSArray *inPaths, NSDictionary *inKnownStates, NSMutableDictionary *ioStates);
+static void HashFileRange(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker);
+static BOOL HashFile(const char *inPath, char outHash[kHashStringLength + 1]);
+
+
+BOOL DDOoliteRunIncrementalJob(const DDOoliteJob *inJob)
+{
+	NSString				*manifestPath, *options, *path, *outFile, *commonDirectory, *other;
+	NSDictionary			*manifest, *oldFiles, *oldTextures, *entry, *state;
+	NSMutableDictionary		*files, *textures, *states, *known, *textureHashes, *outFiles, *outFileOwners;
+	NSMutableArray			*paths, *converted, *newTextures;
+	NSArray					*usedTextures, *record;
+	NSEnumerator			*pathEnum, *textureEnum;
+	NSString				*texture;
+	NSTimeInterval			start;
+	unsigned				upToDate = 0, failed = 0;
+	BOOL					OK;
+	
+	start = [NSDate timeIntervalSinceReferenceDate];
+	manifestPath = ManifestPath(inJob);
+	options = OptionsDescription(inJob);
+	
+	manifest = [NSDictionary dictionaryWithContentsOfFile:manifestPath];
+	if ([[manifest objectForKey:kManifestVersionKey] isEqual:@DDOOLITE_VERSION_STRING] && [[manifest objectForKey:kManifestOptionsKey] isEqual:options])
+	{
+		oldFiles = [manifest objectForKey:kManifestFilesKey];
+		oldTextures = [manifest objectForKey:kManifestTexturesKey];
+	}
+	else
+	{
+		if (nil != manifest && !inJob->quiet) Print(@"Options or ddoolite version have changed since the last run; converting everything.\n");
+		oldFiles = nil;
+		oldTextures = nil;
+	}
+	
+	/*	Hash the inputs and the textures they used last time in one parallel
+		pass. Nothing is parsed yet.
+	*/
+	known = [NSMutableDictionary dictionaryWithDictionary:oldTextures];
+	[known addEntriesFromDictionary:oldFiles];
+	paths = [NSMutableArray arrayWithArray:inJob->inFiles];
+	for (pathEnum = [inJob->inFiles objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		[paths addObjectsFromArray:[[[oldFiles objectForKey:path] objectForKey:kFileTexturesKey] allKeys]];
+	}
+	states = [NSMutableDictionary dictionaryWithCapacity:[paths count]];
+	HashFiles(paths, known, states);
+	if (inJob->timings) Print(@"hash: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	if (nil != inJob->outFile && ![[NSFileManager defaultManager] createDirectoryAtPath:inJob->outFile withIntermediateDirectories:YES attributes:nil error:NULL])
+	{
+		EPrint(@"Could not create output directory %@.\n", inJob->outFile);
+		return NO;
+	}
+	
+	/*	Inputs keep their paths relative to the directory they all share, so
+		that a/ship.dat and b/ship.dat don't overwrite each other. Anything
+		that would still be written twice (ship.dat and ship.obj, say) stops
+		the run before anything is converted. Names are compared ignoring
+		case, as the file system usually does.
+	*/
+	commonDirectory = DDOoliteCommonDirectory(inJob->inFiles);
+	outFiles = [NSMutableDictionary dictionaryWithCapacity:[inJob->inFiles count]];
+	outFileOwners = [NSMutableDictionary dictionaryWithCapacity:[inJob->inFiles count]];
+	for (pathEnum = [inJob->inFiles objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		outFile = OutputPath(inJob, path, commonDirectory);
+		other = [outFileOwners objectForKey:[outFile lowercaseString]];
+		if (nil != other)
+		{
+			EPrint(@"%@ and %@ would both be written to %@.\n", other, path, outFile);
+			return NO;
+		}
+		[outFileOwners setObject:path forKey:[outFile lowercaseString]];
+		[outFiles setObject:outFile forKey:path];
+	}
+	
+	files = [NSMutableDictionary dictionaryWithDictionary:oldFiles];
+	converted = [NSMutableArray array];
+	newTextures = [NSMutableArray array];
+	
+	for (pathEnum = [inJob->inFiles objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		state = [states objectForKey:path];
+		outFile = [outFiles objectForKey:path];
+		
+		if (nil == state)
+		{
+			EPrint(@"%@ could not be read.\n", path);
+			[files removeObjectForKey:path];
+			++failed;
+			continue;
+		}
+		if ([outFile isEqual:path])
+		{
+			EPrint(@"Input and output file paths are identical for %@, skipping.\n", path);
+			++failed;
+			continue;
+		}
+		
+		entry = [oldFiles objectForKey:path];
+		if (IsUpToDate(inJob, entry, state, outFile, states))
+		{
+			++upToDate;
+			continue;
+		}
+		
+		// Forget the old entry first, so a failed conversion is retried next time.
+		[files removeObjectForKey:path];
+		if (!inJob->quiet) Print(@"Converting %@\n", path);
+		
+		if (![[NSFileManager defaultManager] createDirectoryAtPath:[outFile stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL])
+		{
+			EPrint(@"Could not create output directory %@.\n", [outFile stringByDeletingLastPathComponent]);
+			++failed;
+			continue;
+		}
+		
+		usedTextures = [NSArray array];
+		if (!DDOoliteConvertFile(inJob, path, outFile, &usedTextures))
+		{
+			++failed;
+			continue;
+		}
+		
+		[converted addObject:[NSArray arrayWithObjects:path, outFile, usedTextures, nil]];
+		for (textureEnum = [usedTextures objectEnumerator]; (texture = [textureEnum nextObject]); )
+		{
+			if (nil == [states objectForKey:texture]) [newTextures addObject:texture];
+		}
+	}
+	
+	// Hash textures that weren't known before, then record the converted files.
+	HashFiles(newTextures, oldTextures, states);
+	for (pathEnum = [converted objectEnumerator]; (record = [pathEnum nextObject]); )
+	{
+		path = [record objectAtIndex:0];
+		
+		textureHashes = [NSMutableDictionary dictionary];
+		for (textureEnum = [[record objectAtIndex:2] objectEnumerator]; (texture = [textureEnum nextObject]); )
+		{
+			state = [states objectForKey:texture];
+			[textureHashes setObject:(nil != state) ? [state objectForKey:kFileHashKey] : @"" forKey:texture];
+		}
+		
+		state = [NSMutableDictionary dictionaryWithDictionary:[states objectForKey:path]];
+		[(NSMutableDictionary *)state setObject:[record objectAtIndex:1] forKey:kFileOutputKey];
+		[(NSMutableDictionary *)state setObject:textureHashes forKey:kFileTexturesKey];
+		[files setObject:state forKey:path];
+	}
+	
+	// Keep the size and date of every texture still in use, so it needn't be read next time.
+	textures = [NSMutableDictionary dictionary];
+	for (pathEnum = [files objectEnumerator]; (entry = [pathEnum nextObject]); )
+	{
+		for (textureEnum = [[entry objectForKey:kFileTexturesKey] keyEnumerator]; (texture = [textureEnum nextObject]); )
+		{
+			state = [states objectForKey:texture];
+			if (nil == state) state = [oldTextures objectForKey:texture];
+			if (nil != state) [textures setObject:state forKey:texture];
+		}
+	}
+	
+	manifest = [NSDictionary dictionaryWithObjectsAndKeys:
+					@DDOOLITE_VERSION_STRING, kManifestVersionKey,
+					options, kManifestOptionsKey,
+					files, kManifestFilesKey,
+					textures, kManifestTexturesKey,
+					nil];
+	OK = [manifest writeToFile:manifestPath atomically:YES];
+	if (!OK) EPrint(@"Could not write manifest %@.\n", manifestPath);
+	
+	if (!inJob->quiet) Print(@"%u converted, %u up to date, %u failed.\n", (unsigned)[converted count], upToDate, failed);
+	if (inJob->timings) Print(@"total: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	return OK && 0 == failed;
+}
+
+
+static NSString *ManifestPath(const DDOoliteJob *inJob)
+{
+	if (nil != inJob->manifestPath) return inJob->manifestPath;
+	if (nil != inJob->outFile) return [inJob->outFile stringByAppendingPathComponent:@kDDOoliteManifestName];
+	return [[[inJob->inFiles objectAtIndex:0] stringByDeletingLastPathComponent] stringByAppendingPathComponent:@kDDOoliteManifestName];
+}
+
+
+static NSString *OutputPath(const DDOoliteJob *inJob, NSString *inFile, NSString *inCommonDirectory)
+{
+	NSString				*name, *directory;
+	
+	name = [[[inFile lastPathComponent] stringByDeletingPathExtension] stringByAppendingPathExtension:ExtensionForDDFormat(inJob->format)];
+	directory = inJob->outFile;
+	if (nil == directory) directory = [inFile stringByDeletingLastPathComponent];
+	else directory = [directory stringByAppendingPathComponent:DDOoliteRelativeDirectory(inFile, inCommonDirectory)];
+	
+	return [directory stringByAppendingPathComponent:name];
+}
+
+
+NSString *DDOoliteCommonDirectory(NSArray *inFiles)
+{
+	NSEnumerator			*pathEnum;
+	NSString				*path;
+	NSArray					*components, *common = nil;
+	NSUInteger				i, count;
+	
+	if ([inFiles count] < 2) return nil;
+	
+	for (pathEnum = [inFiles objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		components = [[AbsolutePath(path) stringByDeletingLastPathComponent] pathComponents];
+		if (nil == common)
+		{
+			common = components;
+			continue;
+		}
+		
+		count = MIN([common count], [components count]);
+		for (i = 0; i != count; ++i)
+		{
+			if (![[common objectAtIndex:i] isEqual:[components objectAtIndex:i]]) break;
+		}
+		common = [common subarrayWithRange:NSMakeRange(0, i)];
+	}
+	
+	return [NSString pathWithComponents:common];
+}
+
+
+NSString *DDOoliteRelativeDirectory(NSString *inFile, NSString *inCommonDirectory)
+{
+	NSArray					*components;
+	NSUInteger				commonCount;
+	
+	if (nil == inCommonDirectory) return @"";
+	
+	// inCommonDirectory is made of whole leading components of the file's directory.
+	components = [[AbsolutePath(inFile) stringByDeletingLastPathComponent] pathComponents];
+	commonCount = [[inCommonDirectory pathComponents] count];
+	if ([components count] <= commonCount) return @"";
+	return [NSString pathWithComponents:[components subarrayWithRange:NSMakeRange(commonCount, [components count] - commonCount)]];
+}
+
+
+static NSString *AbsolutePath(NSString *inPath)
+{
+	if (![inPath isAbsolutePath]) inPath = [[[NSFileManager defaultManager] currentDirectoryPath] stringByAppendingPathComponent:inPath];
+	return [inPath stringByStandardizingPath];
+}
+
+
+// Everything that affects the output, in a form that can be compared with the last run's.
+static NSString *OptionsDescription(const DDOoliteJob *inJob)
+{
+	NSMutableString			*result;
+	const MeshOperation		*operation;
+	unsigned				i;
+	
+	result = [NSMutableString stringWithFormat:@"format=%@ srcFormat=%@ octree=%u", ExtensionForDDFormat(inJob->format), ExtensionForDDFormat(inJob->srcFormat), inJob->octreeDepth];
+	if (inJob->stream) [result appendString:@" stream"];
+	if (inJob->datOptions & kDDOoliteDATVertexNormals) [result appendString:@" vertex-normals"];
+	
+	for (i = 0; i != inJob->operationCount; ++i)
+	{
+		operation = &inJob->operations[i];
+		switch (operation->op)
+		{
+			case kOpScale:
+				[result appendFormat:@" --%s=%g,%g,%g", operation->name, operation->x, operation->y, operation->z];
+				break;
+			
+			case kOpRecenter:
+				[result appendFormat:@" --%s=%i", operation->name, operation->recenterMethod];
+				break;
+			
+			case kOpWeld:
+				[result appendFormat:@" --%s=%g", operation->name, operation->x];
+				break;
+			
+			default:
+				[result appendFormat:@" --%s", operation->name];
+		}
+	}
+	
+	return result;
+}
+
+
+static BOOL IsUpToDate(const DDOoliteJob *inJob, NSDictionary *inEntry, NSDictionary *inState, NSString *inOutFile, NSDictionary *inTextureStates)
+{
+	NSFileManager			*fmgr;
+	NSEnumerator			*textureEnum;
+	NSString				*texture;
+	NSDictionary			*textureHashes;
+	NSString				*hash;
+	
+	if (nil == inEntry) return NO;
+	if (![[inEntry objectForKey:kFileHashKey] isEqual:[inState objectForKey:kFileHashKey]]) return NO;
+	if (![[inEntry objectForKey:kFileOutputKey] isEqual:inOutFile]) return NO;
+	
+	fmgr = [NSFileManager defaultManager];
+	if (![fmgr fileExistsAtPath:inOutFile]) return NO;
+	if (0 != inJob->octreeDepth && ![fmgr fileExistsAtPath:[[DDCollisionOctree octreeURLForDATURL:[NSURL fileURLWithPath:inOutFile]] path]]) return NO;
+	
+	// A changed, missing or newly shadowing texture invalidates only the models that use it.
+	textureHashes = [inEntry objectForKey:kFileTexturesKey];
+	for (textureEnum = [textureHashes keyEnumerator]; (texture = [textureEnum nextObject]); )
+	{
+		hash = [[inTextureStates objectForKey:texture] objectForKey:kFileHashKey];
+		if (![[textureHashes objectForKey:texture] isEqual:(nil != hash) ? hash : @""]) return NO;
+	}
+	
+	return YES;
+}
+
+
+/*	Stat and, if necessary, hash each file in inPaths in parallel, adding
+	{ hash, size, modified } to ioStates for each file that exists. Paths
+	already in ioStates are skipped. The workers use only the C library, so
+	the Objective-C objects are unpacked beforehand.
+*/
+static void HashFiles(NSArray *inPaths, NSDictionary *inKnownStates, NSMutableDictionary *ioStates)
+{
+	NSMutableArray			*paths;
+	NSMutableSet			*seen;
+	NSEnumerator			*pathEnum;
+	NSString				*path, *knownHash;
+	NSDictionary			*known;
+	FileState				*states;
+	size_t					i, count;
+	
+	paths = [NSMutableArray arrayWithCapacity:[inPaths count]];
+	seen = [NSMutableSet setWithCapacity:[inPaths count]];
+	for (pathEnum = [inPaths objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		if (nil == [ioStates objectForKey:path] && ![seen containsObject:path])
+		{
+			[paths addObject:path];
+			[seen addObject:path];
+		}
+	}
+	
+	count = [paths count];
+	if (0 == count) return;
+	states = (FileState *)calloc(count, sizeof *states);
+	if (NULL == states)
+	{
+		EPrint(@"Out of memory.\n");
+		return;
+	}
+	
+	for (i = 0; i != count; ++i)
+	{
+		path = [paths objectAtIndex:i];
+		states[i].path = [path fileSystemRepresentation];
+		
+		known = [inKnownStates objectForKey:path];
+		knownHash = [known objectForKey:kFileHashKey];
+		if ([knownHash isKindOfClass:[NSString class]] && kHashStringLength == [knownHash length])
+		{
+			states[i].knownHash = [knownHash UTF8String];
+			states[i].knownSize = [[known objectForKey:kFileSizeKey] longLongValue];
+			states[i].knownModified = [[known objectForKey:kFileModifiedKey] doubleValue];
+		}
+	}
+	
+	DDParallelApply(count, 1, HashFileRange, states);
+	
+	for (i = 0; i != count; ++i)
+	{
+		if (!states[i].exists) continue;
+		[ioStates setObject:[NSDictionary dictionaryWithObjectsAndKeys:
+								[NSString stringWithUTF8String:states[i].hash], kFileHashKey,
+								[NSNumber numberWithLongLong:states[i].size], kFileSizeKey,
+								[NSNumber numberWithDouble:states[i].modified], kFileModifiedKey,
+								nil]
+					 forKey:[paths objectAtIndex:i]];
+	}
+	
+	free(states);
+}
+
+
+static void HashFileRange(void *inContext, size_t inStart, size_t inEnd, unsigned inWorker)
+{
+	FileState				*state;
+	struct stat				info;
+	
+	for (state = (FileState *)inContext + inStart; state != (FileState *)inContext + inEnd; ++state)
+	{
+		if (0 != stat(state->path, &info) || !S_ISREG(info.st_mode)) continue;
+		
+		state->size = info.st_size;
+#if DDOLITE_MACOSX
+		state->modified = info.st_mtimespec.tv_sec + info.st_mtimespec.tv_nsec * 1e-9;
+#else
+		state->modified = info.st_mtim.tv_sec + info.st_mtim.tv_nsec * 1e-9;
+#endif
+		
+		if (NULL != state->knownHash && state->size == state->knownSize && state->modified == state->knownModified)
+		{
+			strlcpy(state->hash, state->knownHash, sizeof state->hash);
+			state->exists = YES;
+		}
+		else
+		{
+			state->exists = HashFile(state->path, state->hash);
+		}
+	}
+}
+
+
+static BOOL HashFile(const char *inPath, char outHash[kHashStringLength + 1])
+{
+	static const char		hexDigits[] = "0123456789abcdef";
+	unsigned char			digest[CC_SHA1_DIGEST_LENGTH];
+	struct stat				info;
+	void					*bytes;
+	int						fd;
+	unsigned				i;
+	
+	fd = open(inPath, O_RDONLY);
+	if (fd < 0) return NO;
+	if (0 != fstat(fd, &info))
+	{
+		close(fd);
+		return NO;
+	}
+	
+	if (0 != info.st_size)
+	{
+		bytes = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == bytes)
+		{
+			close(fd);
+			return NO;
+		}
+		CC_SHA1(bytes, info.st_size, digest);
+		munmap(bytes, info.st_size);
+	}
+	else CC_SHA1("", 0, digest);
+	close(fd);
+	
+	for (i = 0; i != CC_SHA1_DIGEST_LENGTH; ++i)
+	{
+		outHash[i * 2] = hexDigits[digest[i] >> 4];
+		outHash[i * 2 + 1] = hexDigits[digest[i] & 0xF];
+	}
+	outHash[kHashStringLength] = '\0';
+	
+	return YES;
+}
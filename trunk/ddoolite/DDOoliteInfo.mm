@@ -0,0 +1,249 @@
+/*
+	DDOoliteInfo.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	ddoolite --info: metadata for many models, read in parallel.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ENABLE_TRACE 0
+
+#import "ddoolite.h"
+#import "DDModelInfo.h"
+#import "DDProblemReportManager.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+
+
+// Reads one file. Nothing is printed here, so that output stays on the requesting thread (and in server captures).
+@interface DDOoliteInfoOperation: NSOperation
+{
+	NSString				*_path;
+	DDFormat				_format;
+	DDProblemReportManager	*_issues;
+	NSString				*_line;
+}
+
+- (id)initWithPath:(NSString *)inPath format:(DDFormat)inFormat;
+
+- (NSString *)path;
+- (NSString *)line;		// nil on failure
+- (DDProblemReportManager *)issues;
+
+@end
+
+
+static NSString *FormatInfoLine(NSString *inPath, DDFormat inFormat, DDModelInfo *inInfo);
+static NSString *FieldString(NSArray *inNames);
+
+
+BOOL DDOoliteRunInfoJob(const DDOoliteJob *inJob)
+{
+	NSArray					*paths;
+	NSMutableArray			*operations;
+	NSOperationQueue		*queue;
+	DDOoliteInfoOperation	*operation;
+	NSEnumerator			*pathEnum;
+	NSString				*path;
+	DDFormat				format;
+	NSTimeInterval			start;
+	BOOL					OK = YES;
+	
+	start = [NSDate timeIntervalSinceReferenceDate];
+	paths = DDOoliteExpandPaths(inJob->inFiles, inJob->srcFormat);
+	operations = [NSMutableArray arrayWithCapacity:[paths count]];
+	queue = [[NSOperationQueue alloc] init];
+	
+	for (pathEnum = [paths objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		format = inJob->srcFormat;
+		if (kDDFormat_unknown == format) format = DDFormatForFileName(path);
+		
+		operation = [[DDOoliteInfoOperation alloc] initWithPath:path format:format];
+		[operations addObject:operation];
+		[queue addOperation:operation];
+		[operation release];
+	}
+	
+	[queue waitUntilAllOperationsAreFinished];
+	[queue release];
+	
+	for (pathEnum = [operations objectEnumerator]; (operation = [pathEnum nextObject]); )
+	{
+		if (nil != [operation line])
+		{
+			Print(@"%@\n", [operation line]);
+		}
+		else
+		{
+			EPrint(@"%@ could not be read.\n", [operation path]);
+			[[operation issues] showReportCommandLineQuietMode:YES];
+			OK = NO;
+		}
+	}
+	
+	if (inJob->timings) Print(@"info: %lu files in %.1f ms\n", (unsigned long)[operations count], ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	return OK;
+}
+
+
+// Files are taken as given; directories are searched recursively for files with known extensions.
+NSArray *DDOoliteExpandPaths(NSArray *inPaths, DDFormat inSourceFormat)
+{
+	NSMutableArray			*result;
+	NSFileManager			*fmgr;
+	NSEnumerator			*pathEnum;
+	NSDirectoryEnumerator	*dirEnum;
+	NSString				*path, *subPath;
+	DDFormat				format;
+	BOOL					isDirectory;
+	
+	result = [NSMutableArray arrayWithCapacity:[inPaths count]];
+	fmgr = [NSFileManager defaultManager];
+	
+	for (pathEnum = [inPaths objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		if (!([fmgr fileExistsAtPath:path isDirectory:&isDirectory] && isDirectory))
+		{
+			[result addObject:path];
+			continue;
+		}
+		
+		for (dirEnum = [fmgr enumeratorAtPath:path]; (subPath = [dirEnum nextObject]); )
+		{
+			format = DDFormatForFileName(subPath);
+			if (kDDFormat_unknown != inSourceFormat && format != inSourceFormat) continue;
+			if (kDDFormat_DAT == format || kDDFormat_OBJ == format || kDDFormat_DryDock == format)
+			{
+				[result addObject:[path stringByAppendingPathComponent:subPath]];
+			}
+		}
+	}
+	
+	return result;
+}
+
+
+static NSString *FormatInfoLine(NSString *inPath, DDFormat inFormat, DDModelInfo *inInfo)
+{
+	Vector					min, max;
+	NSString				*bounds;
+	
+	min = [inInfo minimum];
+	max = [inInfo maximum];
+	if (0 != [inInfo vertexCount]) bounds = [NSString stringWithFormat:@"%g,%g,%g\t%g,%g,%g", min.x, min.y, min.z, max.x, max.y, max.z];
+	else bounds = @"\t";
+	
+	return [NSString stringWithFormat:@"%@\t%@\t%lu\t%lu\t%@\t%@\t%@\t%@",
+			inPath, ExtensionForDDFormat(inFormat),
+			(unsigned long)[inInfo vertexCount], (unsigned long)[inInfo faceCount],
+			bounds,
+			FieldString([inInfo materialNames]),
+			FieldString([inInfo textureNames]),
+			FieldString([inInfo materialLibraries])];
+}
+
+
+static NSString *FieldString(NSArray *inNames)
+{
+	if (nil == inNames) return @"";
+	return [inNames componentsJoinedByString:@"|"];
+}
+
+
+@implementation DDOoliteInfoOperation
+
+- (id)initWithPath:(NSString *)inPath format:(DDFormat)inFormat
+{
+	self = [super init];
+	if (nil != self)
+	{
+		_path = [inPath copy];
+		_format = inFormat;
+		_issues = [[DDProblemReportManager alloc] init];
+		[_issues setContext:kContextOpen];
+	}
+	return self;
+}
+
+
+- (void)dealloc
+{
+	[_path release];
+	[_issues release];
+	[_line release];
+	
+	[super dealloc];
+}
+
+
+- (void)main
+{
+	NSAutoreleasePool		*pool;
+	DDModelInfo				*info = nil;
+	NSURL					*url;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	url = [NSURL fileURLWithPath:_path];
+	
+	switch (_format)
+	{
+		case kDDFormat_DAT:
+			info = [[DDModelInfo alloc] initWithOoliteDAT:url issues:_issues];
+			break;
+		
+		case kDDFormat_OBJ:
+			info = [[DDModelInfo alloc] initWithWaveFrontOBJ:url issues:_issues];
+			break;
+		
+		case kDDFormat_DryDock:
+			info = [[DDModelInfo alloc] initWithDryDockDocument:url issues:_issues];
+			break;
+		
+		default:
+			[_issues addStopIssueWithKey:@"unknownFormat" localizedFormat:@"%@ is not a DAT, OBJ or Dry Dock file.", [_path lastPathComponent]];
+	}
+	
+	if (nil != info) _line = [FormatInfoLine(_path, _format, info) retain];
+	[info release];
+	
+	[pool release];
+}
+
+
+- (NSString *)path
+{
+	return _path;
+}
+
+
+- (NSString *)line
+{
+	return _line;
+}
+
+
+- (DDProblemReportManager *)issues
+{
+	return _issues;
+}
+
+@end
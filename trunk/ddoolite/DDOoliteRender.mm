@@ -0,0 +1,323 @@
+/*
+	DDOoliteRender.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	ddoolite --render: preview images drawn without OpenGL, several models at once.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#define ENABLE_TRACE 0
+
+#import "ddoolite.h"
+#import "DDModelDocument.h"
+#import "DDMaterial.h"
+#import "DDProblemReportManager.h"
+#import "DDImageFile.h"
+#import "DDSoftwareRenderer.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+
+
+/*	Loads and draws one model. As with --info, nothing is printed here, so that
+	output stays in order on the requesting thread (and in server captures).
+*/
+@interface DDOoliteRenderOperation: NSOperation
+{
+	NSString				*_path;
+	DDFormat				_format;
+	NSString				*_outPath;
+	const DDOoliteJob		*_job;
+	BOOL					_parallel;
+	DDProblemReportManager	*_issues;
+	NSMutableArray			*_writtenPaths;
+	NSUInteger				_triangleCount;
+	NSTimeInterval			_renderTime;
+	BOOL					_OK;
+}
+
+- (id)initWithPath:(NSString *)inPath format:(DDFormat)inFormat outPath:(NSString *)inOutPath job:(const DDOoliteJob *)inJob parallel:(BOOL)inParallel;
+
+- (NSString *)path;
+- (BOOL)succeeded;
+- (NSArray *)writtenPaths;
+- (NSUInteger)triangleCount;		// Per image
+- (NSTimeInterval)renderTime;		// Drawing only, excluding loading and PNG encoding
+- (DDProblemReportManager *)issues;
+
+@end
+
+
+static NSString *OutPathForModel(NSString *inModelPath, const DDOoliteJob *inJob, BOOL inSingleFile, NSString *inCommonDirectory);
+static NSString *OutPathForAngle(NSString *inOutPath, unsigned inAngle);
+
+
+BOOL DDOoliteRunRenderJob(const DDOoliteJob *inJob)
+{
+	NSArray					*paths;
+	NSMutableArray			*operations;
+	NSOperationQueue		*queue;
+	DDOoliteRenderOperation	*operation;
+	NSEnumerator			*pathEnum;
+	NSString				*path, *outPath, *other, *commonDirectory;
+	NSMutableDictionary		*outPaths, *outPathOwners;
+	DDFormat				format;
+	NSTimeInterval			start, time;
+	NSUInteger				imageCount, triangleCount;
+	BOOL					isDirectory, singleFile;
+	BOOL					OK = YES;
+	
+	start = [NSDate timeIntervalSinceReferenceDate];
+	paths = DDOoliteExpandPaths(inJob->inFiles, inJob->srcFormat);
+	
+	// A single model file is drawn to renderPath itself; anything else fills a directory.
+	singleFile = [inJob->inFiles count] == 1 && !([[NSFileManager defaultManager] fileExistsAtPath:[inJob->inFiles objectAtIndex:0] isDirectory:&isDirectory] && isDirectory);
+	if (!singleFile && ![[NSFileManager defaultManager] createDirectoryAtPath:inJob->renderPath withIntermediateDirectories:YES attributes:nil error:NULL])
+	{
+		EPrint(@"Could not create output directory %@.\n", inJob->renderPath);
+		return NO;
+	}
+	
+	/*	As with conversion, models keep their paths relative to the directory
+		they all share, so a/ship.dat and b/ship.dat get separate images, and
+		anything that would still be drawn to the same file stops the run
+		before anything is rendered.
+	*/
+	commonDirectory = DDOoliteCommonDirectory(paths);
+	outPaths = [NSMutableDictionary dictionaryWithCapacity:[paths count]];
+	outPathOwners = [NSMutableDictionary dictionaryWithCapacity:[paths count]];
+	for (pathEnum = [paths objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		outPath = OutPathForModel(path, inJob, singleFile, commonDirectory);
+		other = [outPathOwners objectForKey:[outPath lowercaseString]];
+		if (nil != other)
+		{
+			EPrint(@"%@ and %@ would both be rendered to %@.\n", other, path, outPath);
+			return NO;
+		}
+		if (!singleFile && ![[NSFileManager defaultManager] createDirectoryAtPath:[outPath stringByDeletingLastPathComponent] withIntermediateDirectories:YES attributes:nil error:NULL])
+		{
+			EPrint(@"Could not create output directory %@.\n", [outPath stringByDeletingLastPathComponent]);
+			return NO;
+		}
+		[outPathOwners setObject:path forKey:[outPath lowercaseString]];
+		[outPaths setObject:outPath forKey:path];
+	}
+	
+	operations = [NSMutableArray arrayWithCapacity:[paths count]];
+	queue = [[NSOperationQueue alloc] init];
+	
+	for (pathEnum = [paths objectEnumerator]; (path = [pathEnum nextObject]); )
+	{
+		format = inJob->srcFormat;
+		if (kDDFormat_unknown == format) format = DDFormatForFileName(path);
+		
+		// With several models, each gets a core; a lone model spreads its tiles across all of them instead.
+		operation = [[DDOoliteRenderOperation alloc] initWithPath:path format:format outPath:[outPaths objectForKey:path] job:inJob parallel:[paths count] == 1];
+		[operations addObject:operation];
+		[queue addOperation:operation];
+		[operation release];
+	}
+	
+	[queue waitUntilAllOperationsAreFinished];
+	[queue release];
+	
+	imageCount = 0;
+	for (pathEnum = [operations objectEnumerator]; (operation = [pathEnum nextObject]); )
+	{
+		if ([operation succeeded])
+		{
+			[[operation issues] showReportCommandLineQuietMode:YES];
+			if (!inJob->quiet) Print(@"%@\n", [[operation writtenPaths] componentsJoinedByString:@"\n"]);
+			if (inJob->timings)
+			{
+				time = [operation renderTime];
+				triangleCount = [operation triangleCount] * [[operation writtenPaths] count];
+				Print(@"render %@: %lu triangles, %lu images, %.1f ms (%.2f Mtriangles/s)\n", [operation path], (unsigned long)[operation triangleCount], (unsigned long)[[operation writtenPaths] count], time * 1000.0, (0 < time) ? triangleCount / time / 1e6 : 0.0);
+			}
+			imageCount += [[operation writtenPaths] count];
+		}
+		else
+		{
+			EPrint(@"%@ could not be rendered.\n", [operation path]);
+			[[operation issues] showReportCommandLineQuietMode:YES];
+			OK = NO;
+		}
+	}
+	
+	if (inJob->timings) Print(@"render: %lu files, %lu images in %.1f ms\n", (unsigned long)[operations count], (unsigned long)imageCount, ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	return OK;
+}
+
+
+static NSString *OutPathForModel(NSString *inModelPath, const DDOoliteJob *inJob, BOOL inSingleFile, NSString *inCommonDirectory)
+{
+	NSString				*directory;
+	
+	if (inSingleFile) return inJob->renderPath;
+	directory = [inJob->renderPath stringByAppendingPathComponent:DDOoliteRelativeDirectory(inModelPath, inCommonDirectory)];
+	return [directory stringByAppendingPathComponent:[[[inModelPath lastPathComponent] stringByDeletingPathExtension] stringByAppendingPathExtension:@"png"]];
+}
+
+
+static NSString *OutPathForAngle(NSString *inOutPath, unsigned inAngle)
+{
+	return [[inOutPath stringByDeletingPathExtension] stringByAppendingFormat:@"-%03u.png", inAngle];
+}
+
+
+@implementation DDOoliteRenderOperation
+
+- (id)initWithPath:(NSString *)inPath format:(DDFormat)inFormat outPath:(NSString *)inOutPath job:(const DDOoliteJob *)inJob parallel:(BOOL)inParallel
+{
+	self = [super init];
+	if (nil != self)
+	{
+		_path = [inPath copy];
+		_format = inFormat;
+		_outPath = [inOutPath copy];
+		_job = inJob;
+		_parallel = inParallel;
+		_issues = [[DDProblemReportManager alloc] init];
+		_writtenPaths = [[NSMutableArray alloc] init];
+	}
+	return self;
+}
+
+
+- (void)dealloc
+{
+	[_path release];
+	[_outPath release];
+	[_issues release];
+	[_writtenPaths release];
+	
+	[super dealloc];
+}
+
+
+- (void)main
+{
+	NSAutoreleasePool		*pool;
+	NSURL					*url, *textureURL;
+	DDModelDocument			*document;
+	DDMesh					*mesh = nil;
+	NSMutableArray			*textureData = nil;
+	NSData					*data, *pixels;
+	DDSoftwareTexture		*textures = NULL;
+	NSUInteger				i, materialCount = 0;
+	unsigned				angle, step, size;
+	NSString				*outPath;
+	NSTimeInterval			start;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	url = [NSURL fileURLWithPath:_path];
+	size = _job->renderSize;
+	step = _job->turntableStep;
+	
+	document = DDOoliteReadDocument(url, _format, _issues);
+	_OK = (nil != document);
+	if (_OK)
+	{
+		mesh = [document rootMesh];
+		materialCount = [mesh materialCount];
+		textures = (DDSoftwareTexture *)calloc(materialCount + 1, sizeof *textures);
+		textureData = [NSMutableArray arrayWithCapacity:materialCount];
+		_OK = (NULL != textures);
+	}
+	
+	// A texture that can't be read leaves its material white, as in the GL view.
+	for (i = 0; _OK && i != materialCount; ++i)
+	{
+		textureURL = [[mesh materialAtIndex:i] diffuseMapURLRelativeTo:url];
+		if (nil == textureURL) continue;
+		
+		data = DDReadImageFromURL(textureURL, &textures[i].width, &textures[i].height, nil);
+		if (nil == data)
+		{
+			[_issues addWarningIssueWithKey:@"noTexture" localizedFormat:@"The texture %@ could not be read, and will be drawn white.", [[textureURL path] lastPathComponent]];
+			continue;
+		}
+		
+		[textureData addObject:data];
+		textures[i].texels = (const uint8_t *)[data bytes];
+	}
+	
+	[_issues setContext:kContextSave];
+	for (angle = 0; _OK && angle < 360; angle += step)
+	{
+		start = [NSDate timeIntervalSinceReferenceDate];
+		pixels = [mesh renderImageWithWidth:size height:size yaw:angle textures:textures wireframe:_job->wireframe parallel:_parallel triangleCount:&_triangleCount];
+		_renderTime += [NSDate timeIntervalSinceReferenceDate] - start;
+		if (nil == pixels)
+		{
+			[_issues addStopIssueWithKey:@"renderFailed" localizedFormat:@"Not enough memory to render %@.", [_path lastPathComponent]];
+			_OK = NO;
+			break;
+		}
+		
+		outPath = (0 != step) ? OutPathForAngle(_outPath, angle) : _outPath;
+		_OK = DDWritePNGToURL([NSURL fileURLWithPath:outPath], pixels, size, size, _issues);
+		if (_OK) [_writtenPaths addObject:outPath];
+		
+		if (0 == step) break;
+	}
+	
+	Free(textures);
+	[pool release];
+}
+
+
+- (NSString *)path
+{
+	return _path;
+}
+
+
+- (BOOL)succeeded
+{
+	return _OK;
+}
+
+
+- (NSArray *)writtenPaths
+{
+	return _writtenPaths;
+}
+
+
+- (NSUInteger)triangleCount
+{
+	return _triangleCount;
+}
+
+
+- (NSTimeInterval)renderTime
+{
+	return _renderTime;
+}
+
+
+- (DDProblemReportManager *)issues
+{
+	return _issues;
+}
+
+@end
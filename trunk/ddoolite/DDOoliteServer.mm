@@ -0,0 +1,511 @@
+/*
+	DDOoliteServer.mm
+	Dry Dock for Oolite
+	$Id$
+	
+	ddoolite --serve: runs conversion requests from stdin or a Unix socket on a
+	pool of worker threads, so build systems needn't start a process per file.
+	
+	Copyright © 2010 Jens Ayton
+
+	Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+	and associated documentation files (the “Software”), to deal in the Software without
+	restriction, including without limitation the rights to use, copy, modify, merge, publish,
+	distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the
+	Software is furnished to do so, subject to the following conditions:
+	
+	The above copyright notice and this permission notice shall be included in all copies or
+	substantial portions of the Software.
+
+	THE SOFTWARE IS PROVIDED “AS IS”, WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING
+	BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+	NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+	DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+	OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#define ENABLE_TRACE 0
+
+#import "ddoolite.h"
+#import "Logging.h"
+#import "DDUtilities.h"
+#import "DDParallel.h"
+#import <sys/socket.h>
+#import <sys/un.h>
+#import <unistd.h>
+#import <errno.h>
+#import <signal.h>
+
+
+static BOOL					sServing = NO;
+static NSOperationQueue		*sJobQueue = nil;
+
+
+static NSString *ReadLine(FILE *inFile);
+static int ConnectToServer(NSString *inSocketPath);
+
+
+// One source of requests: stdin and stdout, or a socket connection.
+@interface DDOoliteConnection: NSObject
+{
+	FILE					*_in;
+	FILE					*_out;
+	NSLock					*_writeLock;
+	NSCondition				*_pendingCondition;
+	unsigned				_pendingCount;
+	unsigned				_nextID;
+}
+
+- (id)initWithInput:(int)inReadFD output:(int)inWriteFD;
+
+// Read and queue requests until end of file, then wait for them to finish.
+- (void)run;
+
+- (void)writeLines:(NSArray *)inLines;
+- (void)jobFinished;
+
+@end
+
+
+@interface DDOoliteJobOperation: NSOperation
+{
+	DDOoliteJob				_job;
+	NSString				*_jobID;
+	DDOoliteConnection		*_connection;
+	NSString				*_parseOutput;
+	NSString				*_parseErrors;
+}
+
+// Takes ownership of the contents of *inJob. inOutput and inErrors are anything printed while parsing it.
+- (id)initWithJob:(DDOoliteJob *)inJob jobID:(NSString *)inID connection:(DDOoliteConnection *)inConnection output:(NSString *)inOutput errors:(NSString *)inErrors;
+
+@end
+
+
+static NSArray *ResponseLines(NSString *inJobID, NSString *inKind, NSString *inText);
+static void BeginCapture(void);
+static void EndCapture(NSString **outOutput, NSString **outErrors);
+
+
+BOOL DDOoliteServe(NSString *inSocketPath)
+{
+	DDOoliteConnection		*connection;
+	int						listener, client, protocolFD;
+	struct sockaddr_un		address;
+	
+	sServing = YES;
+	sJobQueue = [[NSOperationQueue alloc] init];
+	// Jobs use DDParallelApply() themselves, so running more of them at once than there are cores only adds threads.
+	[sJobQueue setMaxConcurrentOperationCount:DDParallelWorkerCount()];
+	
+	// A client hanging up mustn't take the server down with it.
+	signal(SIGPIPE, SIG_IGN);
+	
+	if (nil == inSocketPath)
+	{
+		/*	Output is only captured on the thread running a job, so anything
+			printed elsewhere (by DDParallelApply workers, say) would land in
+			the middle of the responses. Give the connection its own copy of
+			stdout and send everything else written there to stderr.
+		*/
+		fflush(stdout);
+		protocolFD = dup(STDOUT_FILENO);
+		dup2(STDERR_FILENO, STDOUT_FILENO);
+		connection = [[DDOoliteConnection alloc] initWithInput:STDIN_FILENO output:protocolFD];
+		[connection run];
+		[connection release];
+		return YES;
+	}
+	
+	bzero(&address, sizeof address);
+	address.sun_family = AF_UNIX;
+	if (strlen([inSocketPath fileSystemRepresentation]) >= sizeof address.sun_path)
+	{
+		EPrint(@"Socket path %@ is too long.\n", inSocketPath);
+		return NO;
+	}
+	strlcpy(address.sun_path, [inSocketPath fileSystemRepresentation], sizeof address.sun_path);
+	
+	listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+	{
+		EPrint(@"Could not create socket (%s).\n", strerror(errno));
+		return NO;
+	}
+	
+	unlink(address.sun_path);
+	if (bind(listener, (struct sockaddr *)&address, sizeof address) < 0 || listen(listener, 64) < 0)
+	{
+		EPrint(@"Could not listen on %@ (%s).\n", inSocketPath, strerror(errno));
+		close(listener);
+		return NO;
+	}
+	
+	EPrint(@"%@ serving on %@.\n", ApplicationNameAndVersionString(), inSocketPath);
+	
+	for (;;)
+	{
+		client = accept(listener, NULL, NULL);
+		if (client < 0)
+		{
+			if (EINTR == errno) continue;
+			EPrint(@"Could not accept connection (%s).\n", strerror(errno));
+			break;
+		}
+		
+		// Each connection is read on its own thread; the jobs themselves share sJobQueue.
+		connection = [[DDOoliteConnection alloc] initWithInput:client output:dup(client)];
+		[NSThread detachNewThreadSelector:@selector(run) toTarget:connection withObject:nil];
+		[connection release];
+	}
+	
+	close(listener);
+	unlink(address.sun_path);
+	return NO;
+}
+
+
+BOOL DDOoliteIsInteractive(void)
+{
+	return !sServing;
+}
+
+
+int DDOoliteRunRemote(int argc, char **argv, NSString *inSocketPath)
+{
+	NSMutableString			*request;
+	NSString				*line, *prefix;
+	NSData					*data;
+	FILE					*in = NULL, *out = NULL;
+	int						fd, i, result = -1;
+	
+	// Arguments containing tabs or line breaks can't be sent; do the work locally instead.
+	for (i = 1; i < argc; ++i)
+	{
+		if (NULL != strpbrk(argv[i], "\t\r\n")) return -1;
+	}
+	
+	fd = ConnectToServer(inSocketPath);
+	if (fd < 0) return -1;
+	
+	request = [NSMutableString stringWithFormat:@"--id=1\t--cwd=%@", WorkingDirectory()];
+	for (i = 1; i < argc; ++i)
+	{
+		// FIXME: assumes UTF-8
+		[request appendFormat:@"\t%s", argv[i]];
+	}
+	[request appendString:@"\n"];
+	
+	in = fdopen(fd, "r");
+	out = fdopen(dup(fd), "w");
+	if (NULL != in && NULL != out)
+	{
+		data = [request dataUsingEncoding:NSUTF8StringEncoding];
+		fwrite([data bytes], 1, [data length], out);
+		fclose(out);
+		out = NULL;
+		
+		// Relay output until the server says it's done. If the connection drops first, report failure.
+		result = EXIT_FAILURE;
+		while ((line = ReadLine(in)))
+		{
+			if ([line hasPrefix:(prefix = @"1 out ")]) Print(@"%@\n", [line substringFromIndex:[prefix length]]);
+			else if ([line hasPrefix:(prefix = @"1 err ")]) EPrint(@"%@\n", [line substringFromIndex:[prefix length]]);
+			else if ([line hasPrefix:@"1 done "])
+			{
+				result = [line hasPrefix:@"1 done ok"] ? EXIT_SUCCESS : EXIT_FAILURE;
+				break;
+			}
+		}
+	}
+	
+	if (NULL != in) fclose(in);
+	else close(fd);
+	if (NULL != out) fclose(out);
+	
+	return result;
+}
+
+
+@implementation DDOoliteConnection
+
+- (id)initWithInput:(int)inReadFD output:(int)inWriteFD
+{
+	self = [super init];
+	if (nil != self)
+	{
+		_in = fdopen(inReadFD, "r");
+		_out = fdopen(inWriteFD, "w");
+		_writeLock = [[NSLock alloc] init];
+		_pendingCondition = [[NSCondition alloc] init];
+		
+		if (NULL == _in || NULL == _out)
+		{
+			[self release];
+			self = nil;
+		}
+	}
+	return self;
+}
+
+
+- (void)dealloc
+{
+	if (NULL != _in) fclose(_in);
+	if (NULL != _out) fclose(_out);
+	[_writeLock release];
+	[_pendingCondition release];
+	
+	[super dealloc];
+}
+
+
+- (void)run
+{
+	NSAutoreleasePool		*pool, *linePool;
+	NSString				*line, *jobID, *output, *errors;
+	NSArray					*arguments;
+	NSMutableArray			*response;
+	DDOoliteJob				job;
+	DDOoliteJobOperation	*operation;
+	char					**argv;
+	unsigned				i, count;
+	BOOL					OK;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	
+	while ((line = ReadLine(_in)))
+	{
+		linePool = [[NSAutoreleasePool alloc] init];
+		
+		if (0 != [line length])
+		{
+			arguments = [line componentsSeparatedByString:@"\t"];
+			count = [arguments count];
+			argv = (char **)calloc(count + 2, sizeof *argv);
+			argv[0] = (char *)"ddoolite";
+			for (i = 0; i != count; ++i)
+			{
+				argv[i + 1] = (char *)[[arguments objectAtIndex:i] UTF8String];
+			}
+			
+			// Parse errors belong to the request, so they are captured too. getopt_long() isn't reentrant.
+			BeginCapture();
+			@synchronized ([DDOoliteConnection class])
+			{
+				OK = DDOoliteParseArguments(count + 1, argv, &job);
+			}
+			EndCapture(&output, &errors);
+			free(argv);
+			
+			jobID = (nil != job.jobID) ? job.jobID : [NSString stringWithFormat:@"%u", ++_nextID];
+			
+			if (OK)
+			{
+				[_pendingCondition lock];
+				++_pendingCount;
+				[_pendingCondition unlock];
+				
+				operation = [[DDOoliteJobOperation alloc] initWithJob:&job jobID:jobID connection:self output:output errors:errors];
+				[sJobQueue addOperation:operation];
+				[operation release];
+			}
+			else
+			{
+				response = [NSMutableArray array];
+				[response addObjectsFromArray:ResponseLines(jobID, @"out", output)];
+				[response addObjectsFromArray:ResponseLines(jobID, @"err", errors)];
+				[response addObject:[NSString stringWithFormat:@"%@ done failed 0", jobID]];
+				[self writeLines:response];
+				DDOoliteDestroyJob(&job);
+			}
+		}
+		
+		[linePool release];
+	}
+	
+	[_pendingCondition lock];
+	while (0 != _pendingCount) [_pendingCondition wait];
+	[_pendingCondition unlock];
+	
+	[pool release];
+}
+
+
+- (void)writeLines:(NSArray *)inLines
+{
+	NSData					*data;
+	
+	data = [[[inLines componentsJoinedByString:@"\n"] stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding];
+	
+	[_writeLock lock];
+	fwrite([data bytes], 1, [data length], _out);
+	fflush(_out);
+	[_writeLock unlock];
+}
+
+
+- (void)jobFinished
+{
+	[_pendingCondition lock];
+	--_pendingCount;
+	[_pendingCondition signal];
+	[_pendingCondition unlock];
+}
+
+@end
+
+
+@implementation DDOoliteJobOperation
+
+- (id)initWithJob:(DDOoliteJob *)inJob jobID:(NSString *)inID connection:(DDOoliteConnection *)inConnection output:(NSString *)inOutput errors:(NSString *)inErrors
+{
+	self = [super init];
+	if (nil != self)
+	{
+		_job = *inJob;
+		bzero(inJob, sizeof *inJob);
+		_jobID = [inID copy];
+		_connection = [inConnection retain];
+		_parseOutput = [inOutput copy];
+		_parseErrors = [inErrors copy];
+	}
+	return self;
+}
+
+
+- (void)dealloc
+{
+	DDOoliteDestroyJob(&_job);
+	[_jobID release];
+	[_connection release];
+	[_parseOutput release];
+	[_parseErrors release];
+	
+	[super dealloc];
+}
+
+
+- (void)main
+{
+	NSAutoreleasePool		*pool;
+	NSTimeInterval			start;
+	NSString				*output, *errors;
+	NSMutableArray			*response;
+	BOOL					OK = NO;
+	
+	pool = [[NSAutoreleasePool alloc] init];
+	start = [NSDate timeIntervalSinceReferenceDate];
+	
+	BeginCapture();
+	@try
+	{
+		OK = DDOoliteRunJob(&_job);
+	}
+	@catch (id exception)
+	{
+		EPrint(@"Uncaught exception: %@\n", exception);
+		OK = NO;
+	}
+	EndCapture(&output, &errors);
+	
+	response = [NSMutableArray array];
+	[response addObjectsFromArray:ResponseLines(_jobID, @"out", [_parseOutput stringByAppendingString:output])];
+	[response addObjectsFromArray:ResponseLines(_jobID, @"err", [_parseErrors stringByAppendingString:errors])];
+	[response addObject:[NSString stringWithFormat:@"%@ done %@ %.1f", _jobID, OK ? @"ok" : @"failed", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0]];
+	
+	[_connection writeLines:response];
+	[_connection jobFinished];
+	
+	[pool release];
+}
+
+@end
+
+
+static NSArray *ResponseLines(NSString *inJobID, NSString *inKind, NSString *inText)
+{
+	NSMutableArray			*result;
+	NSArray					*lines;
+	unsigned				i, count;
+	
+	lines = [inText componentsSeparatedByString:@"\n"];
+	count = [lines count];
+	if (0 != count && 0 == [[lines lastObject] length]) --count;
+	
+	result = [NSMutableArray arrayWithCapacity:count];
+	for (i = 0; i != count; ++i)
+	{
+		[result addObject:[NSString stringWithFormat:@"%@ %@ %@", inJobID, inKind, [lines objectAtIndex:i]]];
+	}
+	return result;
+}
+
+
+static void BeginCapture(void)
+{
+	NSMutableDictionary		*threadDict;
+	
+	threadDict = [[NSThread currentThread] threadDictionary];
+	[threadDict setObject:[NSMutableString string] forKey:kDDOoliteOutputCaptureKey];
+	[threadDict setObject:[NSMutableString string] forKey:kDDOoliteErrorCaptureKey];
+}
+
+
+static void EndCapture(NSString **outOutput, NSString **outErrors)
+{
+	NSMutableDictionary		*threadDict;
+	
+	threadDict = [[NSThread currentThread] threadDictionary];
+	*outOutput = [[[threadDict objectForKey:kDDOoliteOutputCaptureKey] retain] autorelease];
+	*outErrors = [[[threadDict objectForKey:kDDOoliteErrorCaptureKey] retain] autorelease];
+	[threadDict removeObjectForKey:kDDOoliteOutputCaptureKey];
+	[threadDict removeObjectForKey:kDDOoliteErrorCaptureKey];
+}
+
+
+// Returns the next line without its line break, or nil at end of file.
+static NSString *ReadLine(FILE *inFile)
+{
+	NSMutableData			*data = nil;
+	char					buffer[1024];
+	size_t					length;
+	
+	while (NULL != fgets(buffer, sizeof buffer, inFile))
+	{
+		if (nil == data) data = [NSMutableData dataWithCapacity:sizeof buffer];
+		length = strlen(buffer);
+		if (0 != length && '\n' == buffer[length - 1])
+		{
+			--length;
+			if (0 != length && '\r' == buffer[length - 1]) --length;
+			[data appendBytes:buffer length:length];
+			break;
+		}
+		[data appendBytes:buffer length:length];
+	}
+	
+	if (nil == data) return nil;
+	return [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease] ?: @"";
+}
+
+
+static int ConnectToServer(NSString *inSocketPath)
+{
+	struct sockaddr_un		address;
+	int						fd;
+	
+	bzero(&address, sizeof address);
+	address.sun_family = AF_UNIX;
+	if (strlen([inSocketPath fileSystemRepresentation]) >= sizeof address.sun_path) return -1;
+	strlcpy(address.sun_path, [inSocketPath fileSystemRepresentation], sizeof address.sun_path);
+	
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	
+	if (connect(fd, (struct sockaddr *)&address, sizeof address) < 0)
+	{
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
@@ -221,7 +221,7 @@
 	}
 	else
 	{
-		if (isatty(0))
+		if (isatty(0) && DDOoliteIsInteractive())
 		{
 			Print(@"\nDo you wish to continue? [Y/n]\n");
 			
@@ -43,23 +43,27 @@ extern NSString *LocationOfOoliteResources(void)
 	NSBundle				*oolite;
 	OSStatus				err;
 	
-	if (nil == oolitePath)
+	// The result is looked up once and shared by all server jobs, so it must outlive any autorelease pool.
+	@synchronized ([NSBundle class])
 	{
-		TraceMessage(@"Looking for Oolite.");
-		err = LSFindApplicationForInfo('Ool8', (CFStringRef)@"org.aegidian.oolite", NULL, NULL, (CFURLRef *)&ooliteURL);
-		if (noErr == err && [ooliteURL isFileURL])
+		if (nil == oolitePath)
 		{
-			TraceMessage(@"Oolite found at %@", [ooliteURL path]);
-			oolite = [[NSBundle alloc] initWithPath:[ooliteURL path]];
-			[ooliteURL release];
-			
-			oolitePath = [oolite resourcePath];
-			[oolite release];
-		}
-		else
-		{
-			oolitePath = [NSNull null];
-			TraceMessage(@"Oolite not found.");
+			TraceMessage(@"Looking for Oolite.");
+			err = LSFindApplicationForInfo('Ool8', (CFStringRef)@"org.aegidian.oolite", NULL, NULL, (CFURLRef *)&ooliteURL);
+			if (noErr == err && [ooliteURL isFileURL])
+			{
+				TraceMessage(@"Oolite found at %@", [ooliteURL path]);
+				oolite = [[NSBundle alloc] initWithPath:[ooliteURL path]];
+				[ooliteURL release];
+				
+				oolitePath = [[oolite resourcePath] copy];
+				[oolite release];
+			}
+			else
+			{
+				oolitePath = [NSNull null];
+				TraceMessage(@"Oolite not found.");
+			}
 		}
 	}
 	
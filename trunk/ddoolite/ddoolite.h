@@ -23,6 +23,9 @@
 
 
 #include <stdarg.h>
+#import "DDMesh.h"
+
+@class DDModelDocument;
 
 #define DDOOLITE_VERSION_STRING "0.01 (604-1)"
 
@@ -34,10 +37,99 @@ typedef enum
 	kDDFormat_DAT,
 	kDDFormat_OBJ,
 	kDDFormat_Mesh,
-	kDDFormat_DryDock
+	kDDFormat_DryDock,
+	kDDFormat_BinaryMesh
 } DDFormat;
 
 
+// Long-only options. Mesh operations are applied in command line order before writing.
+typedef enum
+{
+	kOpRecalcNormals = 256,		// Values double as getopt_long() option codes.
+	kOpTriangulate,
+	kOpReverseWinding,
+	kOpFlipX,
+	kOpFlipY,
+	kOpFlipZ,
+	kOpScale,
+	kOpRecenter,
+	kOpWeld,
+	
+	kOptTimings,
+	kOptServe,
+	kOptJobID,
+	kOptWorkingDirectory,
+	kOptIncremental,
+	kOptInfo,
+	kOptStream,
+	kOptVertexNormals,
+	kOptBakeNormalMap,
+	kOptBakeSize,
+	kOptBakeOcclusion,
+	kOptMultiplyOcclusion,
+	kOptRender,
+	kOptRenderSize,
+	kOptAngle,
+	kOptWireframe,
+	kOptAtlas
+} DDOoliteOption;
+
+
+typedef struct MeshOperation
+{
+	DDOoliteOption			op;
+	Scalar					x, y, z;		// Scale factors for kOpScale; tolerance in x for kOpWeld
+	DDMeshRecenterMethod	recenterMethod;
+	const char				*name;
+} MeshOperation;
+
+
+// Everything one run of ddoolite, or one server request, was asked to do.
+typedef struct DDOoliteJob
+{
+	NSString				*inFile, *outFile, *compareFile;
+	NSArray					*inFiles;		// --incremental or --info; for --incremental outFile is a directory
+	NSString				*manifestPath;	// --incremental=path
+	NSString				*jobID;			// --id, for server requests
+	NSString				*serveSocket;	// --serve=path; nil for stdin
+	DDFormat				srcFormat, format;
+	unsigned				octreeDepth;
+	DDOoliteDATOptions		datOptions;
+	NSString				*bakeSource;	// --bake-normal-map=path
+	unsigned				bakeSize;
+	unsigned				occlusionSamples;	// --bake-ao or --ao-multiply; 0 for neither
+	BOOL					bakeOcclusionMap, multiplyOcclusion;
+	NSString				*renderPath;	// --render=path
+	unsigned				renderSize;
+	unsigned				turntableStep;	// --angle, in degrees; 0 for a single image
+	BOOL					wireframe;
+	unsigned				atlasSize;		// --atlas, maximum width and height; 0 for no atlas
+	MeshOperation			*operations;
+	unsigned				operationCount;
+	BOOL					quiet, timings, serve, incremental, info, stream;
+} DDOoliteJob;
+
+
+/*	Name of the environment variable giving the socket of a running
+	ddoolite --serve. If it is set, ddoolite passes its job to the server
+	instead of doing the work itself.
+*/
+#define kDDOoliteServerEnvironmentVariable "DDOOLITE_SERVER"
+
+// Default name of the --incremental manifest, in the output directory.
+#define kDDOoliteManifestName ".ddoolite-manifest.plist"
+
+// Width and height of --bake-normal-map and --bake-ao output if --bake-size isn't given.
+#define kDDOoliteDefaultBakeSize 1024
+
+// Width and height of --render images if --render-size isn't given, and the --angle step if it has no value.
+#define kDDOoliteDefaultRenderSize 512
+#define kDDOoliteDefaultTurntableStep 30
+
+// Maximum width and height of the --atlas texture if none is given.
+#define kDDOoliteDefaultAtlasSize 2048
+
+
 #if __cplusplus
 extern "C" {
 #endif
@@ -48,6 +140,83 @@ NSString *NameForDDFormat(DDFormat inFormat);
 DDFormat DDFormatForExtension(NSString *inExtension);
 DDFormat DDFormatForFileName(NSString *inName);
 
+/*	Parse a command line into *outJob, reporting problems (and printing help
+	if asked). Relative paths are resolved against --cwd if given. Returns NO
+	if the job should not be run; *outJob must be destroyed either way.
+*/
+BOOL DDOoliteParseArguments(int argc, char **argv, DDOoliteJob *outJob);
+BOOL DDOoliteRunJob(const DDOoliteJob *inJob);
+void DDOoliteDestroyJob(DDOoliteJob *ioJob);
+
+/*	Convert one file with the options of inJob. If outTextureFiles is not
+	NULL, it is set to the paths of the textures the model's materials
+	resolve to, and of the places searched first that held no texture.
+*/
+BOOL DDOoliteConvertFile(const DDOoliteJob *inJob, NSString *inFile, NSString *inOutFile, NSArray **outTextureFiles);
+
+/*	Incremental batch conversion. A manifest records the content hash of
+	each input and of the textures it uses, along with the options and tool
+	version; inputs whose hashes are unchanged since they were last converted
+	are skipped without being parsed.
+*/
+BOOL DDOoliteRunIncrementalJob(const DDOoliteJob *inJob);
+
+/*	Batch outputs written to one directory keep their inputs' paths relative
+	to the deepest directory containing all of them, so that models of the
+	same name in different folders don't overwrite each other.
+	DDOoliteCommonDirectory() returns nil for fewer than two files, and
+	DDOoliteRelativeDirectory() then returns an empty path.
+*/
+NSString *DDOoliteCommonDirectory(NSArray *inFiles);
+NSString *DDOoliteRelativeDirectory(NSString *inFile, NSString *inCommonDirectory);
+
+/*	Print a line of metadata for each input, searching directories
+	recursively, without fully loading any model. Files are read in
+	parallel; the lines are printed in order once all are done.
+*/
+BOOL DDOoliteRunInfoJob(const DDOoliteJob *inJob);
+
+/*	Preview images drawn without OpenGL. A single model file is drawn to
+	renderPath; otherwise renderPath is a directory, and directories given
+	as inputs are searched recursively as for --info. With --angle, each
+	model is drawn turning through 360°, to name-angle.png. Models are
+	loaded and drawn in parallel.
+*/
+BOOL DDOoliteRunRenderJob(const DDOoliteJob *inJob);
+
+// Expand directories in inPaths to the models in them (recursively), as --info and --render do.
+NSArray *DDOoliteExpandPaths(NSArray *inPaths, DDFormat inSourceFormat);
+
+/*	Load a model without reporting any problems, for callers that report
+	them later. Returns an autoreleased document, or nil on failure.
+*/
+DDModelDocument *DDOoliteReadDocument(NSURL *inSourceFile, DDFormat inSourceFormat, DDProblemReportManager *ioIssues);
+
+/*	Server mode. Requests are lines of tab-separated arguments, as they would
+	be passed on the command line; --id=name and --cwd=directory may be
+	added. Requests are run concurrently, and each is answered with lines of
+	the form "<id> out <text>", "<id> err <text>" and finally
+	"<id> done ok|failed <milliseconds>". The lines for one request are
+	written together. inSocketPath nil means stdin and stdout.
+*/
+BOOL DDOoliteServe(NSString *inSocketPath);
+
+/*	Send a command line to the server listening at inSocketPath and relay its
+	output. Returns an exit status, or -1 if the job couldn't be sent.
+*/
+int DDOoliteRunRemote(int argc, char **argv, NSString *inSocketPath);
+
+// NO while serving, so problem reports never wait for an answer.
+BOOL DDOoliteIsInteractive(void);
+
+NSString *WorkingDirectory(void);
+
+/*	While a thread's dictionary holds an NSMutableString under one of these
+	keys, Print() or EPrint() output on that thread is appended to it.
+*/
+extern NSString * const kDDOoliteOutputCaptureKey;
+extern NSString * const kDDOoliteErrorCaptureKey;
+
 // printf() for NSStrings
 void Print(NSString *inFormat, ...);
 void Printv(NSString *inFormat, va_list inArgs);
@@ -30,17 +30,75 @@
 #import <sys/param.h>
 
 #import "DDModelDocument.h"
+#import "DDMesh.h"
+#import "DDCollisionOctree.h"
+#import "DDOctreeBuilder.h"
+#import "DDStreamingTranscoder.h"
+#import "DDMaterial.h"
 #import "DDProblemReportManager.h"
+#import "DDImageFile.h"
 #import "DDUtilities.h"
 #import "Logging.h"
 
 static void PrintUsage(const char *inCall) __attribute__((noreturn));
 static void PrintHelp(void);
-static BOOL ProcessFile(NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inOutFile, DDFormat inOutFormat, BOOL inQuiet);
-static NSString *WorkingDirectory(void);
+static BOOL ProcessFile(const DDOoliteJob *inJob, NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inOutFile, NSArray **outTextureFiles);
+static BOOL StreamFile(NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inOutFile, DDFormat inOutFormat, BOOL inTimings, BOOL inQuiet);
+static NSArray *TextureFiles(DDModelDocument *inDocument, NSURL *inSourceFile);
+static BOOL ParseMeshOperation(int inOption, const char *inName, const char *inArgument, MeshOperation *outOperation);
+static void ApplyMeshOperations(DDMesh *ioMesh, const MeshOperation *inOperations, unsigned inOperationCount, BOOL inTimings, BOOL inQuiet);
+static BOOL WriteOctree(DDModelDocument *inDocument, NSURL *inDATFile, unsigned inDepth, DDProblemReportManager *ioIssues);
+static BOOL BakeNormalMap(DDModelDocument *inDocument, NSURL *inOutFile, const DDOoliteJob *inJob, DDProblemReportManager *ioIssues);
+static BOOL BakeOcclusion(DDModelDocument *inDocument, NSURL *inSourceFile, NSURL *inOutFile, const DDOoliteJob *inJob, DDProblemReportManager *ioIssues);
+static BOOL BuildAtlas(DDModelDocument *inDocument, NSURL *inSourceFile, NSURL *inOutFile, const DDOoliteJob *inJob, DDProblemReportManager *ioIssues);
+static BOOL CompareFiles(NSString *inFileA, NSString *inFileB, DDFormat inSourceFormat, BOOL inQuiet);
+static DDModelDocument *LoadDocument(NSURL *inSourceFile, DDFormat inSourceFormat, DDProblemReportManager *ioIssues, BOOL inQuiet);
+static BOOL IsServeCommand(int argc, char **argv);
+static NSString *ResolvePath(NSString *inPath, NSString *inWorkingDirectory);
+
+
+NSString * const kDDOoliteOutputCaptureKey	= @"ddoolite output capture";
+NSString * const kDDOoliteErrorCaptureKey	= @"ddoolite error capture";
 
 
 int main(int argc, char **argv)
+{
+	NSAutoreleasePool		*rootPool;
+	DDOoliteJob				job;
+	const char				*server;
+	int						result = -1;
+	BOOL					OK;
+	
+	rootPool = [[NSAutoreleasePool alloc] init];
+	
+	if (argc < 2) PrintUsage(argv[0]);
+	
+	// If a server is running, let it do the work.
+	server = getenv(kDDOoliteServerEnvironmentVariable);
+	if (NULL != server && '\0' != *server && !IsServeCommand(argc, argv))
+	{
+		result = DDOoliteRunRemote(argc, argv, [NSString stringWithUTF8String:server]);
+	}
+	
+	if (result < 0)
+	{
+		OK = DDOoliteParseArguments(argc, argv, &job);
+		if (OK)
+		{
+			if (job.serve) OK = DDOoliteServe(job.serveSocket);
+			else OK = DDOoliteRunJob(&job);
+		}
+		DDOoliteDestroyJob(&job);
+		result = OK ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+	
+	[rootPool release];
+	
+	return result;
+}
+
+
+BOOL DDOoliteParseArguments(int argc, char **argv, DDOoliteJob *outJob)
 {
 	// Command line options definitions for getopt_long()
 	const struct option		longOpts[] =
@@ -49,35 +107,80 @@ int main(int argc, char **argv)
 								{ "format",		required_argument,	NULL, 'f' },
 								{ "srcFormat",	required_argument,	NULL, 'F' },
 								{ "out",		required_argument,	NULL, 'o' },
+								{ "compare",	no_argument,		NULL, 'c' },
+								{ "octree",		optional_argument,	NULL, 'O' },
+								{ "recalc-normals",	no_argument,	NULL, kOpRecalcNormals },
+								{ "triangulate",	no_argument,	NULL, kOpTriangulate },
+								{ "reverse-winding", no_argument,	NULL, kOpReverseWinding },
+								{ "flip-x",		no_argument,		NULL, kOpFlipX },
+								{ "flip-y",		no_argument,		NULL, kOpFlipY },
+								{ "flip-z",		no_argument,		NULL, kOpFlipZ },
+								{ "scale",		required_argument,	NULL, kOpScale },
+								{ "recenter",	required_argument,	NULL, kOpRecenter },
+								{ "weld",		optional_argument,	NULL, kOpWeld },
+								{ "timings",	no_argument,		NULL, kOptTimings },
+								{ "serve",		optional_argument,	NULL, kOptServe },
+								{ "id",			required_argument,	NULL, kOptJobID },
+								{ "cwd",		required_argument,	NULL, kOptWorkingDirectory },
+								{ "incremental", optional_argument,	NULL, kOptIncremental },
+								{ "info",		no_argument,		NULL, kOptInfo },
+								{ "stream",		no_argument,		NULL, kOptStream },
+								{ "vertex-normals", no_argument,	NULL, kOptVertexNormals },
+								{ "bake-normal-map", required_argument, NULL, kOptBakeNormalMap },
+								{ "bake-size",	required_argument,	NULL, kOptBakeSize },
+								{ "bake-ao",	optional_argument,	NULL, kOptBakeOcclusion },
+								{ "ao-multiply", optional_argument,	NULL, kOptMultiplyOcclusion },
+								{ "render",		required_argument,	NULL, kOptRender },
+								{ "render-size", required_argument,	NULL, kOptRenderSize },
+								{ "angle",		optional_argument,	NULL, kOptAngle },
+								{ "wireframe",	no_argument,		NULL, kOptWireframe },
+								{ "atlas",		optional_argument,	NULL, kOptAtlas },
 								{ "help",		no_argument,		NULL, '?' },
 								{0}
 							};
-	int						option;
-	NSAutoreleasePool		*rootPool;
-	BOOL					quiet = NO, help = NO, stop = NO;
-	NSString				*outFile = nil, *inFile = nil;
-	DDFormat				srcFormat = kDDFormat_unknown, format = kDDFormat_DAT;
+	int						option, optionIndex, i;
+	BOOL					help = NO, stop = NO, compare = NO;
+	NSString				*workingDirectory = nil;
+	NSString				*path;
+	NSMutableArray			*inFiles;
 	
-	rootPool = [[NSAutoreleasePool alloc] init];
+	bzero(outJob, sizeof *outJob);
+	outJob->format = kDDFormat_DAT;
 	
-	if (argc < 2) PrintUsage(argv[0]);
+	// There can't be more operations than arguments.
+	outJob->operations = (MeshOperation *)calloc(argc, sizeof *outJob->operations);
+	if (NULL == outJob->operations)
+	{
+		EPrint(@"Out of memory.\n");
+		return NO;
+	}
+	
+	// getopt_long() keeps its state in globals, so it must be reset for each job when serving.
+#if DDOLITE_MACOSX
+	optreset = 1;
+	optind = 1;
+#else
+	optind = 0;
+#endif
 	
 	for (;;)
 	{
-		option = getopt_long(argc, argv, "qf:F:o:?", longOpts, NULL);
+		optionIndex = -1;
+		option = getopt_long(argc, argv, "qf:F:o:cO::?", longOpts, &optionIndex);
 		if (-1 == option) break;
 		
 		switch (option)
 		{
 			case 'q':
-				quiet = YES;
+				outJob->quiet = YES;
 				break;
 			
 			case 'f':
-				if (!strcasecmp("dat", optarg)) format = kDDFormat_DAT;
-				else if (!strcasecmp("obj", optarg)) format = kDDFormat_OBJ;
-				else if (!strcasecmp("mesh", optarg)) format = kDDFormat_Mesh;
-				else if (!strcasecmp("ddock", optarg)) format = kDDFormat_DryDock;
+				if (!strcasecmp("dat", optarg)) outJob->format = kDDFormat_DAT;
+				else if (!strcasecmp("obj", optarg)) outJob->format = kDDFormat_OBJ;
+				else if (!strcasecmp("mesh", optarg)) outJob->format = kDDFormat_Mesh;
+				else if (!strcasecmp("ddock", optarg)) outJob->format = kDDFormat_DryDock;
+				else if (!strcasecmp("ddmesh", optarg)) outJob->format = kDDFormat_BinaryMesh;
 				else
 				{
 					EPrint(@"Invalid format specifier %s.\n", optarg);
@@ -87,10 +190,11 @@ int main(int argc, char **argv)
 				break;
 			
 			case 'F':
-				if (!strcasecmp("dat", optarg)) srcFormat = kDDFormat_DAT;
-				else if (!strcasecmp("obj", optarg)) srcFormat = kDDFormat_OBJ;
-				else if (!strcasecmp("mesh", optarg)) srcFormat = kDDFormat_Mesh;
-				else if (!strcasecmp("ddock", optarg)) srcFormat = kDDFormat_DryDock;
+				if (!strcasecmp("dat", optarg)) outJob->srcFormat = kDDFormat_DAT;
+				else if (!strcasecmp("obj", optarg)) outJob->srcFormat = kDDFormat_OBJ;
+				else if (!strcasecmp("mesh", optarg)) outJob->srcFormat = kDDFormat_Mesh;
+				else if (!strcasecmp("ddock", optarg)) outJob->srcFormat = kDDFormat_DryDock;
+				else if (!strcasecmp("ddmesh", optarg)) outJob->srcFormat = kDDFormat_BinaryMesh;
 				else
 				{
 					EPrint(@"Invalid format specifier %s.\n", optarg);
@@ -101,7 +205,147 @@ int main(int argc, char **argv)
 			
 			case 'o':
 				// FIXME: assumes UTF-8
-				outFile = [NSString stringWithUTF8String:optarg];
+				outJob->outFile = [[NSString alloc] initWithUTF8String:optarg];
+				break;
+			
+			case 'c':
+				compare = YES;
+				break;
+			
+			case 'O':
+				outJob->octreeDepth = (NULL != optarg) ? strtoul(optarg, NULL, 10) : [DDCollisionOctree defaultDepth];
+				if (outJob->octreeDepth < 1 || kDDOctreeMaxDepth < outJob->octreeDepth)
+				{
+					EPrint(@"Octree depth must be between 1 and %u.\n", (unsigned)kDDOctreeMaxDepth);
+					help = YES;
+					stop = YES;
+				}
+				break;
+			
+			case kOpRecalcNormals:
+			case kOpTriangulate:
+			case kOpReverseWinding:
+			case kOpFlipX:
+			case kOpFlipY:
+			case kOpFlipZ:
+			case kOpScale:
+			case kOpRecenter:
+			case kOpWeld:
+				if (ParseMeshOperation(option, longOpts[optionIndex].name, optarg, &outJob->operations[outJob->operationCount]))
+				{
+					++outJob->operationCount;
+				}
+				else
+				{
+					help = YES;
+					stop = YES;
+				}
+				break;
+			
+			case kOptTimings:
+				outJob->timings = YES;
+				break;
+			
+			case kOptServe:
+				outJob->serve = YES;
+				if (NULL != optarg) outJob->serveSocket = [[NSString alloc] initWithUTF8String:optarg];
+				break;
+			
+			case kOptJobID:
+				outJob->jobID = [[NSString alloc] initWithUTF8String:optarg];
+				break;
+			
+			case kOptWorkingDirectory:
+				workingDirectory = [NSString stringWithUTF8String:optarg];
+				break;
+			
+			case kOptIncremental:
+				outJob->incremental = YES;
+				if (NULL != optarg) outJob->manifestPath = [[NSString alloc] initWithUTF8String:optarg];
+				break;
+			
+			case kOptInfo:
+				outJob->info = YES;
+				break;
+			
+			case kOptStream:
+				outJob->stream = YES;
+				break;
+			
+			case kOptVertexNormals:
+				outJob->datOptions |= kDDOoliteDATVertexNormals;
+				break;
+			
+			case kOptBakeNormalMap:
+				// FIXME: assumes UTF-8
+				[outJob->bakeSource release];
+				outJob->bakeSource = [[NSString alloc] initWithUTF8String:optarg];
+				break;
+			
+			case kOptBakeSize:
+				outJob->bakeSize = strtoul(optarg, NULL, 10);
+				if (outJob->bakeSize < 16 || 8192 < outJob->bakeSize)
+				{
+					EPrint(@"Bake size must be between 16 and 8192.\n");
+					help = YES;
+					stop = YES;
+				}
+				break;
+			
+			case kOptBakeOcclusion:
+			case kOptMultiplyOcclusion:
+				if (kOptBakeOcclusion == option)  outJob->bakeOcclusionMap = YES;
+				else  outJob->multiplyOcclusion = YES;
+				if (NULL != optarg || 0 == outJob->occlusionSamples)
+				{
+					outJob->occlusionSamples = (NULL != optarg) ? strtoul(optarg, NULL, 10) : kDDMeshDefaultOcclusionSampleCount;
+				}
+				if (outJob->occlusionSamples < 1 || 4096 < outJob->occlusionSamples)
+				{
+					EPrint(@"Ambient occlusion samples must be between 1 and 4096.\n");
+					help = YES;
+					stop = YES;
+				}
+				break;
+			
+			case kOptRender:
+				// FIXME: assumes UTF-8
+				[outJob->renderPath release];
+				outJob->renderPath = [[NSString alloc] initWithUTF8String:optarg];
+				break;
+			
+			case kOptRenderSize:
+				outJob->renderSize = strtoul(optarg, NULL, 10);
+				if (outJob->renderSize < 16 || 8192 < outJob->renderSize)
+				{
+					EPrint(@"Render size must be between 16 and 8192.\n");
+					help = YES;
+					stop = YES;
+				}
+				break;
+			
+			case kOptAngle:
+				outJob->turntableStep = (NULL != optarg) ? strtoul(optarg, NULL, 10) : kDDOoliteDefaultTurntableStep;
+				if (outJob->turntableStep < 1 || 360 < outJob->turntableStep)
+				{
+					EPrint(@"Turntable angle must be between 1 and 360 degrees.\n");
+					help = YES;
+					stop = YES;
+				}
+				break;
+			
+			case kOptWireframe:
+				outJob->wireframe = YES;
+				break;
+			
+			case kOptAtlas:
+				outJob->atlasSize = (NULL != optarg) ? strtoul(optarg, NULL, 10) : kDDOoliteDefaultAtlasSize;
+				if (outJob->atlasSize < 16 || 8192 < outJob->atlasSize || 0 != (outJob->atlasSize & (outJob->atlasSize - 1)))
+				{
+					EPrint(@"Atlas size must be a power of two between 16 and 8192.\n");
+					help = YES;
+					stop = YES;
+				}
 				break;
 			
 			case '?':	// Either help or unknown.
@@ -114,7 +358,43 @@ int main(int argc, char **argv)
 	argc -= optind;
 	argv += optind;
 	
-	switch (argc)
+	if (outJob->serve)
+	{
+		if (0 != argc || !DDOoliteIsInteractive())
+		{
+			EPrint(@"--serve takes no other arguments, and can't be used in a server request.\n");
+			stop = YES;
+		}
+		if (help) PrintHelp();
+		return !stop;
+	}
+	
+	if (outJob->incremental || outJob->info || nil != outJob->renderPath)
+	{
+		if (compare || 0 == argc || (outJob->incremental + outJob->info + (nil != outJob->renderPath)) > 1)
+		{
+			EPrint(@"--%s requires one or more input files, and can't be combined with --compare, --incremental, --info or --render.\n", outJob->info ? "info" : (outJob->incremental ? "incremental" : "render"));
+			stop = YES;
+			help = YES;
+		}
+		
+		inFiles = [NSMutableArray arrayWithCapacity:argc];
+		for (i = 0; i < argc; ++i)
+		{
+			// FIXME: assumes UTF-8
+			path = [NSString stringWithUTF8String:argv[i]];
+			if (nil != workingDirectory && ![path isAbsolutePath]) path = [workingDirectory stringByAppendingPathComponent:path];
+			// --info and --render also take directories, and skip files they don't recognise in them.
+			if (!outJob->info && nil == outJob->renderPath && kDDFormat_unknown == outJob->srcFormat && kDDFormat_unknown == DDFormatForFileName(path))
+			{
+				EPrint(@"Can't guess format of %@ from file name extension; specify explicitly using -F.\n", path);
+				stop = YES;
+			}
+			[inFiles addObject:path];
+		}
+		outJob->inFiles = [inFiles copy];
+	}
+	else switch (argc)
 	{
 		case 0:
 			if (!help)
@@ -126,113 +406,231 @@ int main(int argc, char **argv)
 			break;
 		
 		case 1:
+			if (compare)
+			{
+				EPrint(@"--compare requires two input files.\n");
+				stop = YES;
+				help = YES;
+				break;
+			}
 			// FIXME: assumes UTF-8
-			inFile = [NSString stringWithUTF8String:argv[0]];
-			if (kDDFormat_unknown == srcFormat)
+			outJob->inFile = [[NSString alloc] initWithUTF8String:argv[0]];
+			if (kDDFormat_unknown == outJob->srcFormat)
 			{
-				srcFormat = DDFormatForFileName(inFile);
-				if (kDDFormat_unknown == srcFormat)
+				outJob->srcFormat = DDFormatForFileName(outJob->inFile);
+				if (kDDFormat_unknown == outJob->srcFormat)
 				{
-					EPrint(@"Can't guess format of %@ from file name extension; specify explicitly using -F.\n");
+					EPrint(@"Can't guess format of %@ from file name extension; specify explicitly using -F.\n", outJob->inFile);
 					stop = YES;
 				}
 			}
 			break;
 		
+		case 2:
+			if (compare)
+			{
+				// FIXME: assumes UTF-8
+				outJob->inFile = [[NSString alloc] initWithUTF8String:argv[0]];
+				outJob->compareFile = [[NSString alloc] initWithUTF8String:argv[1]];
+				break;
+			}
+			// Else fall through
+		
 		default:
-			EPrint(@"Multiple input files specified. Currently only one file at a time is supported.\n");
+			EPrint(@"Multiple input files specified. Use --incremental to convert several files at once.\n");
 			stop = YES;
 			help = YES;
 	}
 	
 	if (help) PrintHelp();
-	if (nil != inFile && !stop)
+	
+	if (nil != workingDirectory)
 	{
-		if (nil == outFile)
-		{
-			outFile = [[inFile stringByDeletingPathExtension] stringByAppendingPathExtension:ExtensionForDDFormat(format)];
-		}
-		
-	/*	if (![inFile isAbsolutePath]) inFile = [WorkingDirectory() stringByAppendingPathComponent:inFile];
-		if (![outFile isAbsolutePath]) outFile = [WorkingDirectory() stringByAppendingPathComponent:outFile];
-	*/	
-		if ([outFile isEqual:inFile])
-		{
-			EPrint(@"Input and output file paths are identical, aborting.\n");
-		}
-		else
-		{
-			stop = !ProcessFile([NSURL fileURLWithPath:inFile], srcFormat, [NSURL fileURLWithPath:outFile], format, quiet);
-		}
+		outJob->inFile = ResolvePath(outJob->inFile, workingDirectory);
+		outJob->outFile = ResolvePath(outJob->outFile, workingDirectory);
+		outJob->compareFile = ResolvePath(outJob->compareFile, workingDirectory);
+		outJob->manifestPath = ResolvePath(outJob->manifestPath, workingDirectory);
+		outJob->bakeSource = ResolvePath(outJob->bakeSource, workingDirectory);
+		outJob->renderPath = ResolvePath(outJob->renderPath, workingDirectory);
 	}
 	
-	[rootPool release];
+	if (outJob->stream && (0 != outJob->operationCount || 0 != outJob->octreeDepth || 0 != outJob->datOptions || nil != outJob->bakeSource || 0 != outJob->occlusionSamples || 0 != outJob->atlasSize || (kDDFormat_DAT != outJob->format && kDDFormat_OBJ != outJob->format)))
+	{
+		EPrint(@"--stream only converts between DAT and OBJ, and can't be combined with mesh operations, --octree, --vertex-normals, --bake-normal-map, --bake-ao, --ao-multiply or --atlas.\n");
+		stop = YES;
+	}
+	
+	if (nil != outJob->bakeSource && outJob->incremental)
+	{
+		// The manifest doesn't track the high-polygon source, so it couldn't tell when a bake is stale.
+		EPrint(@"--bake-normal-map can't be combined with --incremental.\n");
+		stop = YES;
+	}
+	if (0 != outJob->occlusionSamples && outJob->incremental)
+	{
+		// Nor does it record the textures --ao-multiply writes.
+		EPrint(@"--bake-ao and --ao-multiply can't be combined with --incremental.\n");
+		stop = YES;
+	}
+	if (0 != outJob->atlasSize && (outJob->incremental || outJob->multiplyOcclusion))
+	{
+		// --ao-multiply would look for the atlas next to the source file, and the manifest doesn't record it either.
+		EPrint(@"--atlas can't be combined with --incremental or --ao-multiply.\n");
+		stop = YES;
+	}
+	if (0 == outJob->bakeSize) outJob->bakeSize = kDDOoliteDefaultBakeSize;
+	if (0 == outJob->renderSize) outJob->renderSize = kDDOoliteDefaultRenderSize;
+	
+	if (0 != outJob->octreeDepth && kDDFormat_DAT != outJob->format)
+	{
+		EPrint(@"Collision octrees can only be written alongside DAT files; ignoring --octree.\n");
+		outJob->octreeDepth = 0;
+	}
+	
+	if (0 != outJob->datOptions && kDDFormat_DAT != outJob->format)
+	{
+		EPrint(@"Vertex normals can only be written to DAT files; ignoring --vertex-normals.\n");
+		outJob->datOptions = 0;
+	}
+	
+	return !stop;
+}
+
+
+BOOL DDOoliteRunJob(const DDOoliteJob *inJob)
+{
+	NSString				*outFile;
+	
+	if (inJob->incremental) return DDOoliteRunIncrementalJob(inJob);
+	if (inJob->info) return DDOoliteRunInfoJob(inJob);
+	if (nil != inJob->renderPath) return DDOoliteRunRenderJob(inJob);
+	if (nil != inJob->compareFile)
+	{
+		if (0 != inJob->operationCount) EPrint(@"Mesh operations are not applied when comparing; ignoring them.\n");
+		return CompareFiles(inJob->inFile, inJob->compareFile, inJob->srcFormat, inJob->quiet);
+	}
+	if (nil == inJob->inFile) return YES;
+	
+	outFile = inJob->outFile;
+	if (nil == outFile)
+	{
+		outFile = [[inJob->inFile stringByDeletingPathExtension] stringByAppendingPathExtension:ExtensionForDDFormat(inJob->format)];
+	}
+	
+	if ([outFile isEqual:inJob->inFile])
+	{
+		EPrint(@"Input and output file paths are identical, aborting.\n");
+		return YES;
+	}
+	
+	return DDOoliteConvertFile(inJob, inJob->inFile, outFile, NULL);
+}
+
+
+BOOL DDOoliteConvertFile(const DDOoliteJob *inJob, NSString *inFile, NSString *inOutFile, NSArray **outTextureFiles)
+{
+	DDFormat				srcFormat;
+	
+	srcFormat = inJob->srcFormat;
+	if (kDDFormat_unknown == srcFormat) srcFormat = DDFormatForFileName(inFile);
+	
+	if (inJob->stream) return StreamFile([NSURL fileURLWithPath:inFile], srcFormat, [NSURL fileURLWithPath:inOutFile], inJob->format, inJob->timings, inJob->quiet);
+	return ProcessFile(inJob, [NSURL fileURLWithPath:inFile], srcFormat, [NSURL fileURLWithPath:inOutFile], outTextureFiles);
+}
+
+
+void DDOoliteDestroyJob(DDOoliteJob *ioJob)
+{
+	[ioJob->inFile release];
+	[ioJob->outFile release];
+	[ioJob->compareFile release];
+	[ioJob->inFiles release];
+	[ioJob->manifestPath release];
+	[ioJob->jobID release];
+	[ioJob->serveSocket release];
+	[ioJob->bakeSource release];
+	[ioJob->renderPath release];
+	free(ioJob->operations);
+	bzero(ioJob, sizeof *ioJob);
+}
+
+
+static BOOL IsServeCommand(int argc, char **argv)
+{
+	int						i;
+	
+	for (i = 1; i < argc; ++i)
+	{
+		if (!strncmp(argv[i], "--serve", 7)) return YES;
+	}
+	return NO;
+}
+
+
+// Returns a retained path, releasing inPath.
+static NSString *ResolvePath(NSString *inPath, NSString *inWorkingDirectory)
+{
+	NSString				*result;
+	
+	if (nil == inPath || [inPath isAbsolutePath]) return inPath;
 	
-	return stop ? EXIT_FAILURE : EXIT_SUCCESS;
+	result = [[inWorkingDirectory stringByAppendingPathComponent:inPath] retain];
+	[inPath release];
+	return result;
 }
 
 
-static BOOL ProcessFile(NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inOutFile, DDFormat inOutFormat, BOOL inQuiet)
+static BOOL ProcessFile(const DDOoliteJob *inJob, NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inOutFile, NSArray **outTextureFiles)
 {
 	DDModelDocument			*document;
 	DDProblemReportManager	*issues;
 	BOOL					OK = YES;
+	NSTimeInterval			start;
 	
-//	if (!inQuiet) Print(@"Converting %@ from %@ to %@ and writing to %@\n", [inSourceFile absoluteString], NameForDDFormat(inSourceFormat), NameForDDFormat(inOutFormat), [inOutFile absoluteString]);
+//	if (!inJob->quiet) Print(@"Converting %@ from %@ to %@ and writing to %@\n", [inSourceFile absoluteString], NameForDDFormat(inSourceFormat), NameForDDFormat(inJob->format), [inOutFile absoluteString]);
 	
-	document = [DDModelDocument alloc];
 	issues = [[[DDProblemReportManager alloc] init] autorelease];
-	switch (inSourceFormat)
+	start = [NSDate timeIntervalSinceReferenceDate];
+	document = LoadDocument(inSourceFile, inSourceFormat, issues, inJob->quiet);
+	if (nil == document) return NO;
+	if (inJob->timings) Print(@"load: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	if (NULL != outTextureFiles) *outTextureFiles = TextureFiles(document, inSourceFile);
+	
+	ApplyMeshOperations([document rootMesh], inJob->operations, inJob->operationCount, inJob->timings, inJob->quiet);
+	
+	if (0 != inJob->atlasSize)
 	{
-		case kDDFormat_DAT:
-			document = [document initWithOoliteDAT:inSourceFile issues:issues];
-			break;
-		
-		case kDDFormat_OBJ:
-			document = [document initWithWaveFrontOBJ:inSourceFile issues:issues];
-			break;
-		
-		case kDDFormat_Mesh:
-			EPrint(@"Meshwork format is currently unsupported for import.\n");
-			OK = NO;
-			break;
-		
-		case kDDFormat_DryDock:
-			document = [document initWithDryDockDocument:inSourceFile issues:issues];
-			break;
-		
-		default:
-			EPrint(@"Unknown input format %@.\n", NameForDDFormat(inSourceFormat));
-			OK = NO;
+		[issues clear];
+		OK = BuildAtlas(document, inSourceFile, inOutFile, inJob, issues);
+		OK = [issues showReportCommandLineQuietMode:inJob->quiet] && OK;
+		if (!OK) return NO;
 	}
-	[document autorelease];
-	if (!OK) return NO;
 	
-	[issues setContext:kContextOpen];
-	if (![issues showReportCommandLineQuietMode:inQuiet]) return NO;
+	start = [NSDate timeIntervalSinceReferenceDate];
 	[issues clear];
 	[issues setContext:kContextSave];
 	
-	switch (inOutFormat)
+	switch (inJob->format)
 	{
 		case kDDFormat_DAT:
-			[document gatherIssues:issues withWritingOoliteDATToURL:inOutFile];
-			if ([issues showReportCommandLineQuietMode:inQuiet])
+			[document gatherIssues:issues withWritingOoliteDATToURL:inOutFile options:inJob->datOptions];
+			if ([issues showReportCommandLineQuietMode:inJob->quiet])
 			{
 				[issues clear];
-				OK = [document writeOoliteDATToURL:inOutFile issues:issues];
-				OK = OK && [issues showReportCommandLineQuietMode:inQuiet];
+				OK = [document writeOoliteDATToURL:inOutFile options:inJob->datOptions issues:issues];
+				if (OK && 0 != inJob->octreeDepth) OK = WriteOctree(document, inOutFile, inJob->octreeDepth, issues);
+				OK = OK && [issues showReportCommandLineQuietMode:inJob->quiet];
 			}
 			else OK = NO;
 			break;
 		
 		case kDDFormat_OBJ:
 			[document gatherIssues:issues withWritingWaveFrontOBJToURL:inOutFile];
-			if ([issues showReportCommandLineQuietMode:inQuiet])
+			if ([issues showReportCommandLineQuietMode:inJob->quiet])
 			{
 				[issues clear];
 				OK = [document writeWaveFrontOBJToURL:inOutFile finalLocationURL:inOutFile issues:issues];
-				OK = OK && [issues showReportCommandLineQuietMode:inQuiet];
+				OK = OK && [issues showReportCommandLineQuietMode:inJob->quiet];
 			}
 			else OK = NO;
 			break;
@@ -244,28 +642,507 @@ static BOOL ProcessFile(NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inO
 		
 		case kDDFormat_DryDock:
 			[document gatherIssues:issues withWritingDryDockDocumentToURL:inOutFile];
-			if ([issues showReportCommandLineQuietMode:inQuiet])
+			if ([issues showReportCommandLineQuietMode:inJob->quiet])
 			{
 				[issues clear];
 				OK = [document writeDryDockDocumentToURL:inOutFile issues:issues];
-				OK = OK && [issues showReportCommandLineQuietMode:inQuiet];
+				OK = OK && [issues showReportCommandLineQuietMode:inJob->quiet];
 			}
 			else OK = NO;
 			break;
 		
+		case kDDFormat_BinaryMesh:
+			OK = [document writeBinaryMeshToURL:inOutFile issues:issues];
+			OK = OK && [issues showReportCommandLineQuietMode:inJob->quiet];
+			break;
+		
 		default:
 			EPrint(@"Unknown output format %@.\n", NameForDDFormat(inSourceFormat));
 			OK = NO;
 	}
 	
+	if (OK && inJob->timings) Print(@"write: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	if (OK && nil != inJob->bakeSource)
+	{
+		[issues clear];
+		OK = BakeNormalMap(document, inOutFile, inJob, issues);
+		OK = [issues showReportCommandLineQuietMode:inJob->quiet] && OK;
+	}
+	
+	if (OK && 0 != inJob->occlusionSamples)
+	{
+		[issues clear];
+		OK = BakeOcclusion(document, inSourceFile, inOutFile, inJob, issues);
+		OK = [issues showReportCommandLineQuietMode:inJob->quiet] && OK;
+	}
+	
+	return OK;
+}
+
+
+// --stream: convert without loading the model, so memory use doesn't grow with its size.
+static BOOL StreamFile(NSURL *inSourceFile, DDFormat inSourceFormat, NSURL *inOutFile, DDFormat inOutFormat, BOOL inTimings, BOOL inQuiet)
+{
+	DDProblemReportManager	*issues;
+	BOOL					OK;
+	NSTimeInterval			start;
+	NSFileManager			*fmgr;
+	
+	issues = [[[DDProblemReportManager alloc] init] autorelease];
+	[issues setContext:kContextSave];
+	start = [NSDate timeIntervalSinceReferenceDate];
+	
+	if (kDDFormat_DAT == inSourceFormat && kDDFormat_OBJ == inOutFormat)
+	{
+		OK = DDStreamTranscodeOoliteDATToWaveFrontOBJ(inSourceFile, inOutFile, issues);
+	}
+	else if (kDDFormat_OBJ == inSourceFormat && kDDFormat_DAT == inOutFormat)
+	{
+		OK = DDStreamTranscodeWaveFrontOBJToOoliteDAT(inSourceFile, inOutFile, issues);
+	}
+	else
+	{
+		EPrint(@"--stream can't convert from %@ to %@; it only converts between DAT and OBJ.\n", NameForDDFormat(inSourceFormat), NameForDDFormat(inOutFormat));
+		return NO;
+	}
+	
+	if (OK && inTimings) Print(@"stream: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	// Problems only come to light as the file is written, so declining discards the result.
+	if (![issues showReportCommandLineQuietMode:inQuiet] && OK)
+	{
+		OK = NO;
+		fmgr = [NSFileManager defaultManager];
+		[fmgr removeItemAtPath:[inOutFile path] error:NULL];
+		if (kDDFormat_OBJ == inOutFormat) [fmgr removeItemAtPath:[[NSURL URLWithString:[DDMesh objMaterialLibraryNameForURL:inOutFile] relativeToURL:inOutFile] path] error:NULL];
+	}
+	
 	return OK;
 }
 
 
+/*	Paths of the textures the document's materials would load, found the same
+	way DDMaterial looks for them, followed by every place searched before
+	each one without finding it. A texture added in one of those places later
+	would take precedence, so they matter to --incremental too.
+*/
+static NSArray *TextureFiles(DDModelDocument *inDocument, NSURL *inSourceFile)
+{
+	NSMutableSet			*result;
+	DDMesh					*mesh;
+	DDMaterial				*material;
+	NSUInteger				i, count;
+	NSURL					*url, *probe;
+	NSString				*foundDirectory;
+	NSEnumerator			*probeEnum;
+	
+	mesh = [inDocument rootMesh];
+	count = [mesh materialCount];
+	result = [NSMutableSet setWithCapacity:count];
+	
+	for (i = 0; i != count; ++i)
+	{
+		material = [mesh materialAtIndex:i];
+		if (nil == [material diffuseMapName]) continue;
+		
+		url = [material diffuseMapURLRelativeTo:inSourceFile];
+		foundDirectory = nil;
+		if (nil != url)
+		{
+			[result addObject:[[url path] stringByStandardizingPath]];
+			foundDirectory = [[[url path] stringByDeletingLastPathComponent] stringByStandardizingPath];
+		}
+		
+		// The lookup ignores case, so the place it was found is matched by directory.
+		for (probeEnum = [[DDMaterial diffuseMapSearchURLsForName:[material diffuseMapName] relativeTo:inSourceFile] objectEnumerator]; (probe = [probeEnum nextObject]); )
+		{
+			if (![probe isFileURL]) continue;
+			if ([foundDirectory isEqual:[[[probe path] stringByDeletingLastPathComponent] stringByStandardizingPath]]) break;
+			[result addObject:[[probe path] stringByStandardizingPath]];
+		}
+	}
+	
+	return [result allObjects];
+}
+
+
+static BOOL ParseMeshOperation(int inOption, const char *inName, const char *inArgument, MeshOperation *outOperation)
+{
+	char					*end = NULL;
+	
+	outOperation->op = (DDOoliteOption)inOption;
+	outOperation->name = inName;
+	
+	switch (inOption)
+	{
+		case kOpScale:
+			// Either a uniform factor or x,y,z.
+			outOperation->x = strtod(inArgument, &end);
+			if (',' == *end)
+			{
+				outOperation->y = strtod(end + 1, &end);
+				if (',' == *end) outOperation->z = strtod(end + 1, &end);
+				else end = NULL;
+			}
+			else outOperation->y = outOperation->z = outOperation->x;
+			
+			if (NULL == end || '\0' != *end || end == inArgument || 0.0f == outOperation->x || 0.0f == outOperation->y || 0.0f == outOperation->z)
+			{
+				EPrint(@"Invalid scale %s; expected a non-zero factor or x,y,z factors.\n", inArgument);
+				return NO;
+			}
+			break;
+		
+		case kOpRecenter:
+			if (!strcasecmp("bbox", inArgument)) outOperation->recenterMethod = kDDMeshRecenterUsingBoundingBox;
+			else if (!strcasecmp("average", inArgument)) outOperation->recenterMethod = kDDMeshRecenterByAveragingVertices;
+			else
+			{
+				EPrint(@"Invalid recentering method %s; expected bbox or average.\n", inArgument);
+				return NO;
+			}
+			break;
+		
+		case kOpWeld:
+			if (NULL != inArgument)
+			{
+				outOperation->x = strtod(inArgument, &end);
+				if (end == inArgument || '\0' != *end || outOperation->x < 0.0f)
+				{
+					EPrint(@"Invalid weld tolerance %s.\n", inArgument);
+					return NO;
+				}
+			}
+			else outOperation->x = 0.0f;
+			break;
+		
+		default:
+			break;
+	}
+	
+	return YES;
+}
+
+
+static void ApplyMeshOperations(DDMesh *ioMesh, const MeshOperation *inOperations, unsigned inOperationCount, BOOL inTimings, BOOL inQuiet)
+{
+	unsigned				i;
+	NSTimeInterval			start;
+	NSUInteger				welded = 0;
+	const MeshOperation		*operation;
+	
+	for (i = 0; i != inOperationCount; ++i)
+	{
+		operation = &inOperations[i];
+		start = [NSDate timeIntervalSinceReferenceDate];
+		
+		switch (operation->op)
+		{
+			case kOpRecalcNormals:
+				[ioMesh recalculateNormals];
+				break;
+			
+			case kOpTriangulate:
+				[ioMesh triangulate];
+				break;
+			
+			case kOpReverseWinding:
+				[ioMesh reverseWinding];
+				break;
+			
+			case kOpFlipX:
+				[ioMesh flipX];
+				break;
+			
+			case kOpFlipY:
+				[ioMesh flipY];
+				break;
+			
+			case kOpFlipZ:
+				[ioMesh flipZ];
+				break;
+			
+			case kOpScale:
+				[ioMesh scaleX:operation->x y:operation->y z:operation->z];
+				break;
+			
+			case kOpRecenter:
+				[ioMesh recenterWithMethod:operation->recenterMethod];
+				break;
+			
+			case kOpWeld:
+				welded = [ioMesh weldVerticesWithTolerance:operation->x];
+				if (!inQuiet) Print(@"Welded %lu vertices.\n", (unsigned long)welded);
+				break;
+			
+			default:
+				break;
+		}
+		
+		if (inTimings) Print(@"%s: %.1f ms\n", operation->name, ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	}
+}
+
+
+static BOOL WriteOctree(DDModelDocument *inDocument, NSURL *inDATFile, unsigned inDepth, DDProblemReportManager *ioIssues)
+{
+	DDCollisionOctree		*octree;
+	NSUInteger				solid, mixed, empty;
+	
+	octree = [[[DDCollisionOctree alloc] initWithMesh:[inDocument rootMesh] depth:inDepth] autorelease];
+	if (nil == octree)
+	{
+		EPrint(@"Failed to build collision octree.\n");
+		return NO;
+	}
+	
+	[octree getSolidLeafCount:&solid mixedLeafCount:&mixed emptyLeafCount:&empty];
+	Print(@"Collision octree: depth %u, %u nodes (%lu solid, %lu surface, %lu empty leaves), %.1f KiB, built in %.1f ms.\n",
+		  [octree depth], [octree nodeCount], (unsigned long)solid, (unsigned long)mixed, (unsigned long)empty,
+		  [octree memoryUsage] / 1024.0, [octree buildTime] * 1000.0);
+	
+	return [octree writeToURL:[DDCollisionOctree octreeURLForDATURL:inDATFile] issues:ioIssues];
+}
+
+
+// --bake-normal-map: bake the high-polygon model onto the u/v layout of the converted one, as name-normal.png.
+static BOOL BakeNormalMap(DDModelDocument *inDocument, NSURL *inOutFile, const DDOoliteJob *inJob, DDProblemReportManager *ioIssues)
+{
+	DDModelDocument			*source;
+	DDFormat				sourceFormat;
+	NSData					*pixels;
+	NSURL					*pngURL;
+	NSTimeInterval			start;
+	
+	sourceFormat = DDFormatForFileName(inJob->bakeSource);
+	if (kDDFormat_unknown == sourceFormat)
+	{
+		EPrint(@"Can't guess format of %@ from file name extension.\n", inJob->bakeSource);
+		return NO;
+	}
+	
+	start = [NSDate timeIntervalSinceReferenceDate];
+	source = LoadDocument([NSURL fileURLWithPath:inJob->bakeSource], sourceFormat, ioIssues, inJob->quiet);
+	if (nil == source) return NO;
+	if (inJob->timings) Print(@"load bake source: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	start = [NSDate timeIntervalSinceReferenceDate];
+	pixels = [[inDocument rootMesh] bakeNormalMapFromMesh:[source rootMesh] width:inJob->bakeSize height:inJob->bakeSize maxDistance:0];
+	if (nil == pixels)
+	{
+		EPrint(@"Failed to bake normal map; both models must have faces, and %@ must have texture co-ordinates.\n", [inOutFile path]);
+		return NO;
+	}
+	if (inJob->timings) Print(@"bake: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	
+	pngURL = [NSURL fileURLWithPath:[[[inOutFile path] stringByDeletingPathExtension] stringByAppendingString:@"-normal.png"]];
+	[ioIssues setContext:kContextSave];
+	return DDWritePNGToURL(pngURL, pixels, inJob->bakeSize, inJob->bakeSize, ioIssues);
+}
+
+
+static void PrintOcclusionTiming(NSString *inWhat, NSTimeInterval inStart, NSUInteger inRayCount)
+{
+	NSTimeInterval			time;
+	
+	time = [NSDate timeIntervalSinceReferenceDate] - inStart;
+	Print(@"%@: %.1f ms, %lu rays (%.2f Mrays/s)\n", inWhat, time * 1000.0, (unsigned long)inRayCount, (0 < time) ? inRayCount / time / 1e6 : 0.0);
+}
+
+
+/*	--bake-ao: bake ambient occlusion onto the converted model's u/v layout, as name-ao.png.
+	--ao-multiply: darken each material's diffuse map by its occlusion, writing texture-ao.png
+	next to the output file. Texture files aren't renamed in the model itself.
+*/
+static BOOL BakeOcclusion(DDModelDocument *inDocument, NSURL *inSourceFile, NSURL *inOutFile, const DDOoliteJob *inJob, DDProblemReportManager *ioIssues)
+{
+	BOOL					OK = YES;
+	DDMesh					*mesh;
+	NSData					*occlusion;
+	NSMutableData			*pixels;
+	NSURL					*textureURL, *pngURL;
+	NSString				*outDirectory;
+	NSUInteger				i, count, p, rays;
+	unsigned				width, height;
+	uint8_t					*texel;
+	const uint8_t			*ao;
+	NSTimeInterval			start;
+	
+	mesh = [inDocument rootMesh];
+	[ioIssues setContext:kContextSave];
+	
+	if (inJob->bakeOcclusionMap)
+	{
+		start = [NSDate timeIntervalSinceReferenceDate];
+		occlusion = [mesh bakeOcclusionMapWithWidth:inJob->bakeSize height:inJob->bakeSize material:NSNotFound sampleCount:inJob->occlusionSamples maxDistance:0 rayCount:&rays];
+		if (nil == occlusion)
+		{
+			EPrint(@"Failed to bake ambient occlusion; %@ must have faces and texture co-ordinates.\n", [inOutFile path]);
+			return NO;
+		}
+		if (inJob->timings) PrintOcclusionTiming(@"bake ambient occlusion", start, rays);
+		
+		pngURL = [NSURL fileURLWithPath:[[[inOutFile path] stringByDeletingPathExtension] stringByAppendingString:@"-ao.png"]];
+		OK = DDWritePNGToURL(pngURL, occlusion, inJob->bakeSize, inJob->bakeSize, ioIssues);
+	}
+	
+	if (OK && inJob->multiplyOcclusion)
+	{
+		outDirectory = [[inOutFile path] stringByDeletingLastPathComponent];
+		count = [mesh materialCount];
+		for (i = 0; OK && i != count; ++i)
+		{
+			textureURL = [[mesh materialAtIndex:i] diffuseMapURLRelativeTo:inSourceFile];
+			if (nil == textureURL)  continue;
+			
+			pixels = [[DDReadImageFromURL(textureURL, &width, &height, ioIssues) mutableCopy] autorelease];
+			if (nil == pixels)
+			{
+				OK = NO;
+				break;
+			}
+			
+			// Baked at the texture's own size, so the two line up texel for texel.
+			start = [NSDate timeIntervalSinceReferenceDate];
+			occlusion = [mesh bakeOcclusionMapWithWidth:width height:height material:i sampleCount:inJob->occlusionSamples maxDistance:0 rayCount:&rays];
+			if (nil == occlusion)  continue;	// No texture co-ordinates to bake onto.
+			if (inJob->timings) PrintOcclusionTiming([NSString stringWithFormat:@"bake ambient occlusion for %@", [[textureURL path] lastPathComponent]], start, rays);
+			
+			texel = (uint8_t *)[pixels mutableBytes];
+			ao = (const uint8_t *)[occlusion bytes];
+			for (p = 0; p != (NSUInteger)width * height * 4; p += 4)
+			{
+				texel[p + 0] = (texel[p + 0] * ao[p] + 127) / 255;
+				texel[p + 1] = (texel[p + 1] * ao[p] + 127) / 255;
+				texel[p + 2] = (texel[p + 2] * ao[p] + 127) / 255;
+			}
+			
+			pngURL = [NSURL fileURLWithPath:[outDirectory stringByAppendingPathComponent:[[[[textureURL path] lastPathComponent] stringByDeletingPathExtension] stringByAppendingString:@"-ao.png"]]];
+			OK = DDWritePNGToURL(pngURL, pixels, width, height, ioIssues);
+		}
+	}
+	
+	return OK;
+}
+
+
+/*	--atlas: pack the model's textures into name-atlas.png next to the output
+	file, and merge their materials into one using it, before the model is written.
+*/
+static BOOL BuildAtlas(DDModelDocument *inDocument, NSURL *inSourceFile, NSURL *inOutFile, const DDOoliteJob *inJob, DDProblemReportManager *ioIssues)
+{
+	BOOL					OK;
+	NSURL					*atlasURL;
+	NSUInteger				count;
+	NSTimeInterval			start;
+	
+	[ioIssues setContext:kContextSave];
+	atlasURL = [NSURL fileURLWithPath:[[[inOutFile path] stringByDeletingPathExtension] stringByAppendingString:@"-atlas.png"]];
+	
+	start = [NSDate timeIntervalSinceReferenceDate];
+	OK = [[inDocument rootMesh] packTexturesIntoAtlasAtURL:atlasURL relativeTo:inSourceFile maxSize:inJob->atlasSize padding:kDDMeshDefaultAtlasPadding packedCount:&count issues:ioIssues];
+	if (OK && inJob->timings) Print(@"atlas: %.1f ms\n", ([NSDate timeIntervalSinceReferenceDate] - start) * 1000.0);
+	if (OK && 0 != count && !inJob->quiet) Print(@"Packed %lu textures into %@\n", (unsigned long)count, [atlasURL path]);
+	
+	return OK;
+}
+
+
+static DDModelDocument *LoadDocument(NSURL *inSourceFile, DDFormat inSourceFormat, DDProblemReportManager *ioIssues, BOOL inQuiet)
+{
+	DDModelDocument			*document;
+	
+	document = DDOoliteReadDocument(inSourceFile, inSourceFormat, ioIssues);
+	if (![ioIssues showReportCommandLineQuietMode:inQuiet]) return nil;
+	return document;
+}
+
+
+DDModelDocument *DDOoliteReadDocument(NSURL *inSourceFile, DDFormat inSourceFormat, DDProblemReportManager *ioIssues)
+{
+	DDModelDocument			*document;
+	BOOL					OK = YES;
+	
+	document = [DDModelDocument alloc];
+	[ioIssues setContext:kContextOpen];
+	switch (inSourceFormat)
+	{
+		case kDDFormat_DAT:
+			document = [document initWithOoliteDAT:inSourceFile issues:ioIssues];
+			break;
+		
+		case kDDFormat_OBJ:
+			document = [document initWithWaveFrontOBJ:inSourceFile issues:ioIssues];
+			break;
+		
+		case kDDFormat_Mesh:
+			[ioIssues addStopIssueWithKey:@"unsupportedFormat" localizedFormat:@"Meshwork format is currently unsupported for import."];
+			OK = NO;
+			break;
+		
+		case kDDFormat_DryDock:
+			document = [document initWithDryDockDocument:inSourceFile issues:ioIssues];
+			break;
+		
+		case kDDFormat_BinaryMesh:
+			document = [document initWithBinaryMesh:inSourceFile issues:ioIssues];
+			break;
+		
+		default:
+			[ioIssues addStopIssueWithKey:@"unknownFormat" localizedFormat:@"Unknown input format %@.", NameForDDFormat(inSourceFormat)];
+			OK = NO;
+	}
+	if (!OK)
+	{
+		[document release];
+		return nil;
+	}
+	return [document autorelease];
+}
+
+
+static BOOL CompareFiles(NSString *inFileA, NSString *inFileB, DDFormat inSourceFormat, BOOL inQuiet)
+{
+	DDModelDocument			*docA = nil, *docB = nil;
+	DDProblemReportManager	*issues;
+	DDFormat				formatA, formatB;
+	DDMeshDeviation			forward, backward, symmetric;
+	
+	formatA = formatB = inSourceFormat;
+	if (kDDFormat_unknown == formatA) formatA = DDFormatForFileName(inFileA);
+	if (kDDFormat_unknown == formatB) formatB = DDFormatForFileName(inFileB);
+	if (kDDFormat_unknown == formatA || kDDFormat_unknown == formatB)
+	{
+		EPrint(@"Can't guess format of %@ from file name extension; specify explicitly using -F.\n", (kDDFormat_unknown == formatA) ? inFileA : inFileB);
+		return NO;
+	}
+	
+	issues = [[[DDProblemReportManager alloc] init] autorelease];
+	docA = LoadDocument([NSURL fileURLWithPath:inFileA], formatA, issues, inQuiet);
+	[issues clear];
+	if (nil != docA) docB = LoadDocument([NSURL fileURLWithPath:inFileB], formatB, issues, inQuiet);
+	if (nil == docA || nil == docB) return NO;
+	
+	if (![[docA rootMesh] compareWithMesh:[docB rootMesh] sampleCount:0 result:&symmetric forward:&forward backward:&backward])
+	{
+		EPrint(@"Could not compare %@ and %@; both must contain at least one face.\n", inFileA, inFileB);
+		return NO;
+	}
+	
+	Print(@"%@ -> %@: max %g, mean %g, RMS %g (%lu samples)\n", inFileA, inFileB, forward.maximum, forward.mean, forward.rms, (unsigned long)forward.sampleCount);
+	Print(@"%@ -> %@: max %g, mean %g, RMS %g (%lu samples)\n", inFileB, inFileA, backward.maximum, backward.mean, backward.rms, (unsigned long)backward.sampleCount);
+	Print(@"Hausdorff distance: %g, mean %g, RMS %g\n", symmetric.maximum, symmetric.mean, symmetric.rms);
+	
+	return YES;
+}
+
+
 static void PrintUsage(const char *inCall)
 {
 	Print(@"Usage: %s [-q] [-f format] [-o outfile] sourcefile\n"
-			"%s --help", inCall, inCall);
+			"%s --compare file1 file2\n"
+			"%s --help", inCall, inCall, inCall);
 	
 	exit(0);
 }
@@ -276,7 +1153,16 @@ static void PrintHelp(void)
 	Print(@"%@, copyright 2006 Jens Ayton\n"
 			"Format conversion and verification tool for Oolite\n"
 			"\n"
-			"Usage: ddoolite [-q] [-f format] [-F sourceformat] [-o outfile] sourcefile\n"
+			"Usage: ddoolite [-q] [-f format] [-F sourceformat] [-o outfile] [--octree[=depth]]\n"
+			"                [--vertex-normals] [--bake-normal-map=highpoly] [--bake-ao[=samples]]\n"
+			"                [--ao-multiply[=samples]] [--bake-size=n] [--atlas[=maxsize]]\n"
+			"                [operations] [--timings] [--stream] sourcefile\n"
+			"       ddoolite --incremental[=manifest] [options] [-o outdir] sourcefile...\n"
+			"       ddoolite [-F sourceformat] --info file-or-directory...\n"
+			"       ddoolite [-F sourceformat] --render=path [--render-size=n] [--angle[=degrees]]\n"
+			"                [--wireframe] [--timings] file-or-directory...\n"
+			"       ddoolite [-q] [-F sourceformat] --compare file1 file2\n"
+			"       ddoolite --serve[=socket]\n"
 			"       ddoolite --help\n"
 			"\n"
 			"    -q, --quiet  Suppress note and warning messages, and the associated \"do\n"
@@ -287,11 +1173,90 @@ static void PrintHelp(void)
 			"                     obj   WaveFront OBJ format (with accompanying MTL file).\n"
 //			"                     mesh  Meshwork document.\n"
 			"                     ddock Dry Dock for Oolite document.\n"
+			"                     ddmesh Dry Dock binary mesh, which opens without parsing.\n"
 			"-F, --srcFormat  Format to convert from (same values as -f). If not specified,\n"
 			"                 a guess will be made based on the file name extension.\n"
 			"      -o, --out  Name of file to write to. If not specified, the input\n"
 			"                 file name will be modified with the appropriate extension.\n"
-			"     -?, --help  Display this help message.\n",
+			"       --octree  Also write a collision octree next to the DAT file, as\n"
+			"                 name-octree.plist, and report its size and build time.\n"
+			"                 Depth defaults to 6; maximum is 10.\n"
+			"--vertex-normals Write per-vertex normals and tangents and a material name\n"
+			"                 table in the DAT file, for Oolite 1.74 and later.\n"
+			"--bake-normal-map\n"
+			"                 Also bake a tangent-space normal map from the given detailed\n"
+			"                 model onto the converted model's texture co-ordinates, and\n"
+			"                 write it next to the output file as name-normal.png. Can't\n"
+			"                 be combined with --incremental.\n"
+			"      --bake-ao  Also bake ambient occlusion onto the converted model's texture\n"
+			"                 co-ordinates, and write it next to the output file as\n"
+			"                 name-ao.png. Samples (rays per texel) defaults to 64.\n"
+			"  --ao-multiply  Darken each diffuse texture by the ambient occlusion of the\n"
+			"                 faces using it, and write the result next to the output file\n"
+			"                 as texture-ao.png. Samples as for --bake-ao. Neither option\n"
+			"                 can be combined with --incremental.\n"
+			"    --bake-size  Width and height of baked maps. Defaults to 1024.\n"
+			"        --atlas  Pack the textures of the model's materials into a single\n"
+			"                 texture, no more than maxsize (default 2048) pixels square,\n"
+			"                 written next to the output file as name-atlas.png, and merge\n"
+			"                 those materials into one. Textures that repeat are left out.\n"
+			"                 Useful for staying within the DAT format's limit of eight\n"
+			"                 materials. Can't be combined with --incremental or\n"
+			"                 --ao-multiply.\n"
+			"      --timings  Report the time taken to load, apply each operation and write,\n"
+			"                 the rays per second cast when baking ambient occlusion, and\n"
+			"                 the triangles per second drawn by --render.\n"
+			"       --stream  Convert between DAT and OBJ section by section, without\n"
+			"                 loading the model, so that memory use stays constant for\n"
+			"                 models of any size. Can't be combined with operations,\n"
+			"                 --octree, --vertex-normals, any baking or --atlas.\n"
+			"  --incremental  Convert several files, skipping those that haven't changed\n"
+			"                 since the last run with the same options. -o, if given,\n"
+			"                 names the output directory, where inputs keep their paths\n"
+			"                 relative to the directory they share. Content hashes of\n"
+			"                 each input and of the textures it uses are kept in the\n"
+			"                 manifest, by default " kDDOoliteManifestName " in the output\n"
+			"                 directory.\n"
+			"         --info  Print one tab-separated line per model without fully loading\n"
+			"                 it: path, format, vertex count, face count, minimum and\n"
+			"                 maximum corners as x,y,z, then material names, texture\n"
+			"                 names and OBJ material libraries, each separated by |.\n"
+			"                 Directories are searched for models recursively.\n"
+			"       --render  Draw a preview PNG of each model, without OpenGL. For a\n"
+			"                 single file, path is the image to write; otherwise it is a\n"
+			"                 directory, and each model is written there as name.png,\n"
+			"                 keeping its path relative to the folder all models share.\n"
+			"                 Directories are searched as for --info.\n"
+			"  --render-size  Width and height of rendered images. Defaults to 512.\n"
+			"        --angle  Render a turntable: one image every so many degrees (default\n"
+			"                 30) around the vertical axis, as name-angle.png.\n"
+			"    --wireframe  Draw the model's edges over the rendered images.\n"
+			"      --compare  Measure the surface deviation between two files instead of\n"
+			"                 converting. Reports maximum, mean and RMS distance in each\n"
+			"                 direction, and the (symmetric) Hausdorff distance.\n"
+			"        --serve  Keep running, reading requests from standard input or, if a\n"
+			"                 socket path is given, from connections to a Unix socket.\n"
+			"                 Each request is one line of tab-separated arguments, plus\n"
+			"                 optional --id=name and --cwd=directory. Requests run in\n"
+			"                 parallel; each is answered with \"<id> out <text>\" and\n"
+			"                 \"<id> err <text>\" lines and a final\n"
+			"                 \"<id> done ok|failed <milliseconds>\" line.\n"
+			"                 If " kDDOoliteServerEnvironmentVariable " is set to a socket path, other\n"
+			"                 invocations hand their work to that server.\n"
+			"     -?, --help  Display this help message.\n"
+			"\n"
+			"Operations are applied to the model in the order given, before writing:\n"
+			"  --recalc-normals  Recalculate face normals.\n"
+			"     --triangulate  Split polygons into triangles.\n"
+			" --reverse-winding  Reverse the winding of every face.\n"
+			"  --flip-x, --flip-y, --flip-z\n"
+			"                    Mirror the model along an axis.\n"
+			"   --scale=s|x,y,z  Scale uniformly, or by separate factors for each axis.\n"
+			"--recenter=bbox|average\n"
+			"                    Move the centre of the bounding box or the average vertex\n"
+			"                    position to the origin.\n"
+			"       --weld[=eps] Merge vertices no further apart than eps (default 0, for\n"
+			"                    identical positions) and drop faces that collapse.\n",
 		ApplicationNameAndVersionString());
 }
 
@@ -310,8 +1275,17 @@ void Printv(NSString *inFormat, va_list inArgs)
 {
 	NSString			*string;
 	NSData				*data;
+	NSMutableString		*capture;
 	
 	string = [[NSString alloc] initWithFormat:inFormat arguments:inArgs];
+	capture = [[[NSThread currentThread] threadDictionary] objectForKey:kDDOoliteOutputCaptureKey];
+	if (nil != capture)
+	{
+		[capture appendString:string];
+		[string release];
+		return;
+	}
+	
 	// Data will be autoreleased… do we need a pool just for this?
 	data = [string dataUsingEncoding:NSUTF8StringEncoding];
 	fwrite([data bytes], 1, [data length], stdout);
@@ -334,8 +1308,17 @@ void EPrintv(NSString *inFormat, va_list inArgs)
 {
 	NSString			*string;
 	NSData				*data;
+	NSMutableString		*capture;
 	
 	string = [[NSString alloc] initWithFormat:inFormat arguments:inArgs];
+	capture = [[[NSThread currentThread] threadDictionary] objectForKey:kDDOoliteErrorCaptureKey];
+	if (nil != capture)
+	{
+		[capture appendString:string];
+		[string release];
+		return;
+	}
+	
 	// Data will be autoreleased… do we need a pool just for this?
 	data = [string dataUsingEncoding:NSUTF8StringEncoding];
 	fwrite([data bytes], 1, [data length], stderr);
@@ -359,6 +1342,9 @@ NSString *ExtensionForDDFormat(DDFormat inFormat)
 		case kDDFormat_DryDock:
 			return @"drydock";
 		
+		case kDDFormat_BinaryMesh:
+			return @"ddmesh";
+		
 		default:
 			return nil;
 	}
@@ -381,6 +1367,9 @@ NSString *NameForDDFormat(DDFormat inFormat)
 		case kDDFormat_DryDock:
 			return @"Dry Dock document";
 		
+		case kDDFormat_BinaryMesh:
+			return @"Dry Dock binary mesh";
+		
 		default:
 			return [NSString stringWithFormat:@"<invalid enumerant %i>", inFormat];
 	}
@@ -395,6 +1384,7 @@ DDFormat DDFormatForExtension(NSString *inExtension)
 	if (![inExtension caseInsensitiveCompare:@"obj"]) return kDDFormat_OBJ;
 	if (![inExtension caseInsensitiveCompare:@"mesh"]) return kDDFormat_Mesh;
 	if (![inExtension caseInsensitiveCompare:@"drydock"]) return kDDFormat_DryDock;
+	if (![inExtension caseInsensitiveCompare:@"ddmesh"]) return kDDFormat_BinaryMesh;
 	
 	return kDDFormat_unknown;
 }
@@ -406,7 +1396,7 @@ DDFormat DDFormatForFileName(NSString *inName)
 }
 
 
-static NSString *WorkingDirectory(void)
+NSString *WorkingDirectory(void)
 {
 	static NSString			*result = nil;
 	